@@ -74,6 +74,21 @@ $(include_dir) $(lib_include_dir) $(install_dir):
 INCLUDE_CFLAGS = $(addprefix -I, $(lib_hdr_dirs) $(test_hdr_dirs) $(all_deps_hdr_dirs)) 
 
 
+# Optional compression libraries, enabled when their headers are found
+
+has_header = $(shell $(CC) -E -include $(1) -x c /dev/null >/dev/null 2>&1 && echo yes)
+
+ifeq ($(call has_header,zlib.h),yes)
+opt_cflags += -DHAVE_ZLIB
+opt_ldlibs += -lz
+endif
+
+ifeq ($(call has_header,zstd.h),yes)
+opt_cflags += -DHAVE_ZSTD
+opt_ldlibs += -lzstd
+endif
+
+
 
 #
 # Recursively collects library dependencies 
@@ -196,6 +211,7 @@ debug_cflags = -Wall -g3
 debug_cflags += -DDEBUG_LVL=3 
 debug_cflags += -DMEM_DEBUG   
 debug_cflags += -DXCHAR_BYTES=4
+debug_cflags += $(opt_cflags)
 ifdef print_mem
 debug_cflags += -DMEM_DEBUG_PRINT_ALL
 endif
@@ -237,7 +253,7 @@ debug_strict_deps_objs = $(foreach lib, $(strict_deps), \
 .PHONY: debug  
 debug: debug_lib_build debug_test_build 
 	$(CC) $(INCLUDE_CFLAGS) $(debug_cflags) $(CFLAGS) $(debug_strict_deps_objs) \
-	$(debug_build_dir)/*.o -lm -o $(debug_build_dir)/debug
+	$(debug_build_dir)/*.o -lm -lpthread $(opt_ldlibs) -o $(debug_build_dir)/debug
 
 
 
@@ -250,6 +266,7 @@ debug: debug_lib_build debug_test_build
 test_cflags = -O3 
 test_cflags += -DDEBUG_LVL=1
 test_cflags += -DXCHAR_BYTES=4
+test_cflags += $(opt_cflags)
 
 #$(test_build_dir):
 #	mkdir -p $@
@@ -288,7 +305,7 @@ test_strict_deps_objs = $(foreach lib, $(strict_deps), \
 .PHONY: test  
 test: test_lib_build test_test_build 
 	$(CC) $(INCLUDE_CFLAGS) $(test_cflags) $(CFLAGS) $(test_strict_deps_objs) \
-	$(test_build_dir)/*.o -lm -o $(test_build_dir)/test
+	$(test_build_dir)/*.o -lm -lpthread $(opt_ldlibs) -o $(test_build_dir)/test
 
 
 #
@@ -300,6 +317,7 @@ test: test_lib_build test_test_build
 static_cflags =  -O3
 static_cflags += -DDEBUG_LVL=1 
 static_cflags += -DXCHAR_BYTES=4
+static_cflags += $(opt_cflags)
 
 
 $(static_build_dir)/%.o: %.c
@@ -362,6 +380,7 @@ shared_cflags =  -O3
 shared_cflags += -DDEBUG_LVL=1 
 shared_cflags += -DXCHAR_BYTES=4
 shared_cflags += -fpic
+shared_cflags += $(opt_cflags)
 
 #$(shared_build_dir):
 #	mkdir -p $@
@@ -387,7 +406,7 @@ sharedlib_path = $(shared_build_dir)/$(sharedlib_realname)
 sharedlib_build: deps $(sharedlib_build_deps) $(shared_objs) ;
 	$(CC) -shared -Wl,-soname,$(sharedlib_soname) \
 		-o $(sharedlib_path) \
-		$(shared_objs) -lc
+		$(shared_objs) -lpthread $(opt_ldlibs) -lc
 
 
 $(eval $(call deps_tgt_templ,sharedlib_install,lib_deps))
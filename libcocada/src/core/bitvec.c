@@ -384,6 +384,27 @@ void bitvec_push_n(bitvec *bv, size_t nbits, bool bit)
 
 }
 
+void bitvec_push_word(bitvec *bv, uint64_t word, size_t nbits)
+{
+	assert(nbits <= 64);
+	if (bv->len + nbits > bv->cap) {
+		_growto_bits(bv, bv->len + nbits);
+	}
+	byte_t *last_byte = bv->bits + (bv->len / BYTESIZE);
+	size_t nxt_bit = bv->len % BYTESIZE;
+	bv->len += nbits;
+	while (nbits) {
+		size_t m = MIN(nbits, BYTESIZE - nxt_bit);
+		byte_t mask = (BYTE_MAX >> (BYTESIZE - m)) << (BYTESIZE - nxt_bit - m);
+		byte_t chunk = (word >> (nbits - m)) << (BYTESIZE - nxt_bit - m);
+		*last_byte = (*last_byte & ~mask) | (chunk & mask);
+		nbits -= m;
+		nxt_bit = 0;
+		last_byte++;
+	}
+}
+
+
 void bitvec_cat (bitvec *bv, const bitvec *src)
 {
 	if (bv->len + src->len > bv->cap) {
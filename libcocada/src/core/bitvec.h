@@ -24,6 +24,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "bitbyte.h"
@@ -175,6 +176,13 @@ void bitvec_push (bitvec *bv, bool bit);
 void bitvec_push_n (bitvec *bv, size_t n, bool bit);
 
 
+/**
+ * @brief Appends the @p nbits <= 64 least significant bits of @p word,
+ * most significant first.
+ */
+void bitvec_push_word (bitvec *bv, uint64_t word, size_t nbits);
+
+
 /**
  * @brief Concatenates the contents of @p src to @p bv.
  * @param bv (no transfer) The target bitvector
@@ -20,6 +20,7 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <inttypes.h>
@@ -66,6 +67,9 @@ static const double MIN_LOAD = 0.25;
 
 static memtable tally = {.count = 0, .nact = 0, .ndel = 0, .cap = 0, .data = NULL};
 
+// allocations may come from several threads
+static pthread_mutex_t tally_lock = PTHREAD_MUTEX_INITIALIZER;
+
 
 static void memtable_init(memtable *tally)
 {
@@ -283,12 +287,15 @@ static void memtable_print_stats(FILE *stream, memtable *tally,
 
 void memdbg_print_stats(FILE *stream, bool print_chunks)
 {
+	pthread_mutex_lock(&tally_lock);
 	memtable_print_stats(stream, &tally, print_chunks);
+	pthread_mutex_unlock(&tally_lock);
 }
 
 
 void memdbg_reset()
 {
+	pthread_mutex_lock(&tally_lock);
 	tally.count = 0;
 	tally.cap = 0;
 	tally.nact = 0;
@@ -296,35 +303,49 @@ void memdbg_reset()
 	tally.ndel = 0;
 	free(tally.data);
 	tally.data = NULL;
+	pthread_mutex_unlock(&tally_lock);
 }
 
 
 size_t memdbg_total()
 {
-	return tally.total;
+	pthread_mutex_lock(&tally_lock);
+	size_t ret = tally.total;
+	pthread_mutex_unlock(&tally_lock);
+	return ret;
 }
 
 
 size_t memdbg_nchunks()
 {
-	return tally.nact;
+	pthread_mutex_lock(&tally_lock);
+	size_t ret = tally.nact;
+	pthread_mutex_unlock(&tally_lock);
+	return ret;
 }
 
 
 bool memdbg_is_empty()
 {
-	return (tally.total == 0 && tally.nact == 0);
+	pthread_mutex_lock(&tally_lock);
+	bool ret = (tally.total == 0 && tally.nact == 0);
+	pthread_mutex_unlock(&tally_lock);
+	return ret;
 }
 
 
 memdbg_query_t memdbg_query(const void *addr)
 {
-	return memtable_get(&tally, addr);
+	pthread_mutex_lock(&tally_lock);
+	memdbg_query_t ret = memtable_get(&tally, addr);
+	pthread_mutex_unlock(&tally_lock);
+	return ret;
 }
 
 
 void *memdbg_malloc(size_t size, char *file, int line)
 {
+	pthread_mutex_lock(&tally_lock);
 	void *ret = malloc(size);
 #ifdef MEM_DEBUG_PRINT_ALL
 	size_t alloc_no = memtable_set(&tally, ret, size);
@@ -334,12 +355,14 @@ void *memdbg_malloc(size_t size, char *file, int line)
 #else
 	memtable_set(&tally, ret, size);
 #endif
+	pthread_mutex_unlock(&tally_lock);
 	return ret;
 }
 
 
 void *memdbg_calloc(size_t nmemb, size_t size, char *file, int line)
 {
+	pthread_mutex_lock(&tally_lock);
 	void *ret = calloc(nmemb, size);
 #ifdef MEM_DEBUG_PRINT_ALL
 	size_t alloc_no = memtable_set(&tally, ret, nmemb * size);
@@ -349,12 +372,14 @@ void *memdbg_calloc(size_t nmemb, size_t size, char *file, int line)
 #else
 	memtable_set(&tally, ret, nmemb * size);
 #endif
+	pthread_mutex_unlock(&tally_lock);
 	return ret;
 }
 
 
 void *memdbg_realloc(void *ptr, size_t size, char *file, int line)
 {
+	pthread_mutex_lock(&tally_lock);
 	void *ret = realloc(ptr, size);
 	if (ret != ptr) {
 		memtable_unset(&tally, ptr);
@@ -367,12 +392,14 @@ void *memdbg_realloc(void *ptr, size_t size, char *file, int line)
 #else
 	memtable_set(&tally, ret, size);
 #endif
+	pthread_mutex_unlock(&tally_lock);
 	return ret;
 }
 
 
 void memdbg_free(void *ptr, char *file, int line)
 {
+	pthread_mutex_lock(&tally_lock);
 	memdbg_query_t q = memtable_get(&tally, ptr);
 	ERROR_ASSERT(q.active == true,
 	             "ERROR: invalid or double free detected @%p [%s:%d]\n",
@@ -384,6 +411,7 @@ void memdbg_free(void *ptr, char *file, int line)
 	       file, line, ptr, hrsize.size, hrsize.prefix);
 #endif
 	memtable_unset(&tally, ptr);
+	pthread_mutex_unlock(&tally_lock);
 }
 
 #undef MEM_DEBUG_OFF
\ No newline at end of file
@@ -0,0 +1,191 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "arrays.h"
+#include "errlog.h"
+#include "mathutil.h"
+#include "new.h"
+#include "readahead.h"
+
+
+struct _readahead {
+	readahead_fill fill;
+	void *src;
+	size_t nbufs;
+	rablock *blks;
+	pthread_t thread;
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	bool threaded; // whether a thread is used, i.e. nbufs > 0
+	bool running;
+	bool sync;     // whether the consumer fills the blocks itself
+	bool stop;
+	size_t head;   // next block to be consumed
+	size_t nready; // number of filled blocks, starting from head
+	bool held;     // whether the consumer holds the head block
+	bool done;     // whether the last block was returned
+};
+
+
+readahead *readahead_new(readahead_fill fill, void *src, size_t nbufs,
+                         size_t bufsize)
+{
+	readahead *ret = NEW(readahead);
+	ret->fill = fill;
+	ret->src = src;
+	ret->threaded = (nbufs > 0);
+	ret->nbufs = MAX(1, nbufs);
+	ret->blks = ARR_NEW(rablock, ret->nbufs);
+	for (size_t i = 0; i < ret->nbufs; i++) {
+		ret->blks[i].data = ARR_NEW(byte_t, MAX(1, bufsize));
+		ret->blks[i].cap = MAX(1, bufsize);
+	}
+	pthread_mutex_init(&ret->mtx, NULL);
+	pthread_cond_init(&ret->cond, NULL);
+	ret->running = false;
+	ret->sync = false;
+	ret->stop = false;
+	ret->head = 0;
+	ret->nready = 0;
+	ret->held = false;
+	ret->done = true;
+	return ret;
+}
+
+
+void readahead_free(readahead *self)
+{
+	readahead_stop(self);
+	for (size_t i = 0; i < self->nbufs; i++) {
+		FREE(self->blks[i].data);
+	}
+	FREE(self->blks);
+	pthread_mutex_destroy(&self->mtx);
+	pthread_cond_destroy(&self->cond);
+	FREE(self);
+}
+
+
+size_t readahead_nbufs(const readahead *self)
+{
+	return self->nbufs;
+}
+
+
+static void *_run(void *arg)
+{
+	readahead *self = (readahead *)arg;
+	while (true) {
+		pthread_mutex_lock(&self->mtx);
+		while (self->nready == self->nbufs && !self->stop) {
+			pthread_cond_wait(&self->cond, &self->mtx);
+		}
+		if (self->stop) {
+			pthread_mutex_unlock(&self->mtx);
+			break;
+		}
+		rablock *blk = self->blks + ((self->head + self->nready) % self->nbufs);
+		pthread_mutex_unlock(&self->mtx);
+		blk->len = 0;
+		blk->last = false;
+		self->fill(self->src, blk);
+		bool last = blk->last;
+		pthread_mutex_lock(&self->mtx);
+		self->nready++;
+		pthread_cond_broadcast(&self->cond);
+		pthread_mutex_unlock(&self->mtx);
+		if (last) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+
+bool readahead_start(readahead *self)
+{
+	readahead_stop(self);
+	self->head = 0;
+	self->nready = 0;
+	self->held = false;
+	self->done = false;
+	self->running = self->threaded
+	                && pthread_create(&self->thread, NULL, _run, self) == 0;
+	// without a thread, readahead_next() fills the blocks synchronously
+	self->sync = !self->running;
+	WARN_IF(self->threaded && self->sync,
+	        "Unable to start read-ahead thread. Reading synchronously.\n");
+	return self->running;
+}
+
+
+void readahead_stop(readahead *self)
+{
+	if (self->running) {
+		pthread_mutex_lock(&self->mtx);
+		self->stop = true;
+		pthread_cond_broadcast(&self->cond);
+		pthread_mutex_unlock(&self->mtx);
+		pthread_join(self->thread, NULL);
+		self->running = false;
+		self->stop = false;
+	}
+	self->sync = false;
+	self->done = true;
+}
+
+
+const rablock *readahead_next(readahead *self)
+{
+	if (self->held && !self->sync) {
+		pthread_mutex_lock(&self->mtx);
+		self->head = (self->head + 1) % self->nbufs;
+		self->nready--;
+		pthread_cond_broadcast(&self->cond);
+		pthread_mutex_unlock(&self->mtx);
+	}
+	self->held = false;
+	if (self->done) {
+		return NULL;
+	}
+	rablock *blk = self->blks + self->head;
+	if (self->sync) {
+		blk->len = 0;
+		blk->last = false;
+		self->fill(self->src, blk);
+	}
+	else {
+		pthread_mutex_lock(&self->mtx);
+		while (self->nready == 0) {
+			pthread_cond_wait(&self->cond, &self->mtx);
+		}
+		pthread_mutex_unlock(&self->mtx);
+	}
+	self->held = true;
+	self->done = blk->last;
+	return blk;
+}
@@ -0,0 +1,140 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+/**
+ * @file readahead.h
+ * @author Paulo Fonseca
+ * @brief Asynchronous read-ahead of data blocks.
+ *
+ * A read-ahead engine keeps a ring of buffers which a dedicated thread
+ * fills with the upcoming blocks of a source, through a user-supplied
+ * fill function, while the consumer processes the blocks already
+ * filled. This keeps the storage busy while the consumer computes,
+ * and the consumer busy while the storage is read.
+ *
+ * # Example
+ *
+ * ```C
+ * static void fill(void *src, rablock *blk)
+ * {
+ *     blk->len = fread(blk->data, 1, blk->cap, (FILE *)src);
+ *     blk->last = blk->len < blk->cap;
+ * }
+ *
+ * readahead *ra = readahead_new(fill, file, 4, 1<<20);
+ * readahead_start(ra);
+ * for (const rablock *blk; (blk = readahead_next(ra)); ) {
+ *     // process blk->data[0..blk->len-1]
+ * }
+ * readahead_free(ra);
+ * ```
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "coretype.h"
+
+
+/**
+ * @brief A block of data.
+ */
+typedef struct {
+	byte_t *data;    /**< Buffer */
+	size_t cap;      /**< Buffer capacity */
+	size_t len;      /**< Number of bytes filled */
+	uint64_t tag[2]; /**< Free for use by the fill function */
+	bool last;       /**< Whether this is the last block of the source */
+} rablock;
+
+
+/**
+ * @brief Fills the block @p blk with the next data from the source @p src.
+ * Sets `blk->len` and, if no more data follow, `blk->last`, which is
+ * initially false. Runs on the read-ahead thread, or on the consumer
+ * thread if the engine is synchronous.
+ */
+typedef void (*readahead_fill)(void *src, rablock *blk);
+
+
+/**
+ * @brief Read-ahead engine type.
+ */
+typedef struct _readahead readahead;
+
+
+/**
+ * @brief Creates an engine with @p nbufs buffers of @p bufsize bytes,
+ * which are filled by @p fill from @p src. The engine is initially stopped.
+ * If @p nbufs is 0, no thread is used, and the blocks are filled
+ * synchronously, one at a time, by readahead_next().
+ */
+readahead *readahead_new(readahead_fill fill, void *src, size_t nbufs,
+                         size_t bufsize);
+
+
+/**
+ * @brief Stops the engine and releases the resources.
+ * The source is not affected.
+ */
+void readahead_free(readahead *self);
+
+
+/**
+ * @brief Returns the number of buffers.
+ */
+size_t readahead_nbufs(const readahead *self);
+
+
+/**
+ * @brief Starts filling the buffers with the data from the current
+ * position of the source, discarding any blocks not yet consumed.
+ * If the thread cannot be started, the engine falls back to filling
+ * the blocks synchronously in readahead_next(), with a warning.
+ * @returns Whether the blocks are read ahead by a thread.
+ */
+bool readahead_start(readahead *self);
+
+
+/**
+ * @brief Stops the engine after the block currently being filled.
+ * Between readahead_stop() and readahead_start() the source can be
+ * safely accessed, e.g. repositioned, by the caller.
+ */
+void readahead_stop(readahead *self);
+
+
+/**
+ * @brief Releases the block previously returned, and returns the next
+ * block, waiting for it to be filled if necessary.
+ * @returns The next block, or NULL after the last block, or if the engine
+ * is stopped.
+ * @warning The returned block is only valid until the next call.
+ */
+const rablock *readahead_next(readahead *self);
+
+
+#endif
@@ -19,58 +19,165 @@
  *
  */
 
+#include <assert.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#include "errlog.h"
+#include "mathutil.h"
 #include "strread.h"
 #include "strfilereader.h"
 #include "new.h"
+#include "zfile.h"
 
 
+// buffers are aligned to cache lines
+#define BUF_ALIGN 64
+
 
 struct _strfilereader {
 	strread _t_strread;
 	FILE *src;
-	size_t pos;
+	zfile *zsrc; // read-ahead/decompressed source, instead of src
 	bool own_stream;
+	bool mapped;
+	char *raw;   // allocated block (NULL if mapped)
+	char *buf;   // buffer, or the mapped file
+	size_t cap;  // buffer capacity
+	size_t beg;  // next char in the buffer
+	size_t end;  // end of the valid chars in the buffer
+	size_t off;  // stream offset of buf[0]
+	bool eof;    // no more chars can be pulled from the stream
 };
 
 
 IMPL_TRAIT(strfilereader, strread)
 
 
+static void _alloc_buf(strfilereader *self, size_t cap)
+{
+	char *raw = malloc(cap + BUF_ALIGN - 1);
+	char *buf = (char *)(((uintptr_t)raw + BUF_ALIGN - 1) & ~(uintptr_t)(BUF_ALIGN - 1));
+	if (self->end > 0) {
+		memcpy(buf, self->buf, self->end);
+	}
+	FREE(self->raw);
+	self->raw = raw;
+	self->buf = buf;
+	self->cap = cap;
+}
+
+
+/*
+ * Pulls more chars from the stream into the buffer, discarding the
+ * consumed chars except for the last one, which is kept for ungetc.
+ * The buffer grows if it is full of unconsumed chars.
+ * Returns the number of chars pulled.
+ */
+static size_t _refill(strfilereader *self)
+{
+	if (self->eof) {
+		return 0;
+	}
+	size_t keep = (self->beg > 0) ? self->beg - 1 : 0;
+	if (keep > 0) {
+		memmove(self->buf, self->buf + keep, self->end - keep);
+		self->off += keep;
+		self->beg -= keep;
+		self->end -= keep;
+	}
+	if (self->zsrc) {
+		// strfilereader_tell() cannot go back past buf[0]
+		zfile_release(self->zsrc, self->off);
+	}
+	if (self->end == self->cap) {
+		_alloc_buf(self, 2 * self->cap);
+	}
+	size_t want = self->cap - self->end;
+	size_t n = (self->zsrc)
+	           ? zfile_read(self->zsrc, self->buf + self->end, want)
+	           : fread(self->buf + self->end, sizeof(char), want, self->src);
+	self->end += n;
+	// short reads only happen at the end of the stream, or on errors
+	self->eof = (n < want);
+	return n;
+}
+
+
 static void _reset(strread *self)
 {
-	rewind( ((strfilereader *)self->impltor)->src );
+	strfilereader *sfr = (strfilereader *)self->impltor;
+	sfr->beg = 0;
+	if (!sfr->mapped) {
+		if (sfr->zsrc) {
+			zfile_rewind(sfr->zsrc);
+		}
+		else {
+			rewind(sfr->src);
+		}
+		sfr->end = 0;
+		sfr->off = 0;
+		sfr->eof = false;
+	}
 }
 
 
 static int _getc(strread *self)
 {
-	return fgetc( ((strfilereader *)self->impltor)->src );
+	strfilereader *sfr = (strfilereader *)self->impltor;
+	if (sfr->beg == sfr->end && !_refill(sfr)) {
+		return EOF;
+	}
+	return (unsigned char)sfr->buf[sfr->beg++];
+}
+
+
+static int _ungetc(strread *self)
+{
+	strfilereader *sfr = (strfilereader *)self->impltor;
+	if (sfr->beg > 0) {
+		sfr->beg--;
+		return 1;
+	}
+	return 0;
 }
 
 
 static size_t _read_str(strread *self, char *dest, size_t n)
 {
-	return fread(dest, sizeof(char), n, ((strfilereader *)self->impltor)->src);
+	strfilereader *sfr = (strfilereader *)self->impltor;
+	size_t nread = 0;
+	while (nread < n && (sfr->beg < sfr->end || _refill(sfr))) {
+		size_t l = MIN(n - nread, sfr->end - sfr->beg);
+		memcpy(dest + nread, sfr->buf + sfr->beg, l);
+		sfr->beg += l;
+		nread += l;
+	}
+	return nread;
 }
 
 
 static size_t _read_str_until(strread *self, char *dest, char delim)
 {
-	FILE *src = ((strfilereader *)self->impltor)->src;
-	size_t nread;
-	char c;
-	for (nread=0; !feof(src); nread++) {
-		if ( (c=fgetc(src)) == delim ) {
-			fseek(src, -1, SEEK_CUR);
+	strfilereader *sfr = (strfilereader *)self->impltor;
+	size_t nread = 0;
+	while (sfr->beg < sfr->end || _refill(sfr)) {
+		char *from = sfr->buf + sfr->beg;
+		char *p = memchr(from, delim, sfr->end - sfr->beg);
+		size_t l = p ? (size_t)(p - from) : sfr->end - sfr->beg;
+		memcpy(dest + nread, from, l);
+		sfr->beg += l;
+		nread += l;
+		if (p) {
 			break;
 		}
-		dest[nread] = c;
 	}
 	return nread;
 }
@@ -78,45 +185,221 @@ static size_t _read_str_until(strread *self, char *dest, char delim)
 
 static strread_vt _strread_vt  = {
 	.getc = _getc,
+	.ungetc = _ungetc,
 	.read_str = _read_str,
 	.read_str_until = _read_str_until,
 	.reset = _reset
 };
 
 
-strfilereader *strfilereader_new_from_path(const char *path)
+static strfilereader *_new(FILE *src, bool own_stream, size_t bufsize)
 {
-	FILE *src = fopen(path, "r");
-	if (!src) {
-		return NULL;
-	}
 	strfilereader *ret = NEW(strfilereader);
 	ret->_t_strread.impltor = ret;
 	ret->_t_strread.vt = &_strread_vt;
 	ret->src = src;
-	ret->own_stream = true;
-	ret->pos = 0;
+	ret->zsrc = NULL;
+	ret->own_stream = own_stream;
+	ret->mapped = false;
+	ret->raw = NULL;
+	ret->buf = NULL;
+	ret->beg = 0;
+	ret->end = 0;
+	long off = src ? ftell(src) : 0;
+	ret->off = (off > 0) ? (size_t)off : 0;
+	ret->eof = false;
+	_alloc_buf(ret, MAX(1, bufsize));
+	return ret;
+}
+
+
+strfilereader *strfilereader_new_from_path(const char *path)
+{
+	return strfilereader_new_async(path, ZFILE_NBUFS, ZFILE_BUFSIZE);
+}
+
+
+strfilereader *strfilereader_new_async(const char *path, size_t nbufs,
+                                       size_t bufsize)
+{
+	zfile *zsrc = zfile_open_with_bufs(path, nbufs, bufsize);
+	if (!zsrc) {
+		return NULL;
+	}
+	strfilereader *ret = _new(NULL, true, STRFILEREADER_BUFSIZE);
+	ret->zsrc = zsrc;
 	return ret;
 }
 
 
 strfilereader *strfilereader_new(FILE *stream)
 {
+	return _new(stream, false, STRFILEREADER_BUFSIZE);
+}
+
+
+strfilereader *strfilereader_new_with_bufsize(FILE *stream, size_t bufsize)
+{
+	return _new(stream, false, bufsize);
+}
+
+
+strfilereader *strfilereader_new_mmap(const char *path)
+{
+	if (zfile_detect(path) != ZFILE_PLAIN) {
+		return strfilereader_new_from_path(path);
+	}
+	FILE *src = fopen(path, "r");
+	if (!src) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fileno(src), &st) != 0 || !S_ISREG(st.st_mode)) {
+		return _new(src, true, STRFILEREADER_BUFSIZE);
+	}
+	void *map = NULL;
+	if (st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(src), 0);
+		if (map == MAP_FAILED) {
+			WARN("Unable to map file %s. Using buffered reader.\n", path);
+			return _new(src, true, STRFILEREADER_BUFSIZE);
+		}
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+	}
 	strfilereader *ret = NEW(strfilereader);
 	ret->_t_strread.impltor = ret;
 	ret->_t_strread.vt = &_strread_vt;
-	ret->src = stream;
-	ret->own_stream = false;
-	ret->pos = 0;
+	ret->src = src;
+	ret->zsrc = NULL;
+	ret->own_stream = true;
+	ret->mapped = true;
+	ret->raw = NULL;
+	ret->buf = (char *)map;
+	ret->cap = st.st_size;
+	ret->beg = 0;
+	ret->end = st.st_size;
+	ret->off = 0;
+	ret->eof = true;
 	return ret;
 }
 
 
-
 void strfilereader_free(strfilereader *self)
 {
-	if (self->own_stream) {
+	if (self->mapped && self->cap > 0) {
+		munmap(self->buf, self->cap);
+	}
+	if (self->zsrc) {
+		zfile_close(self->zsrc);
+	}
+	else if (self->own_stream) {
 		fclose(self->src);
 	}
+	FREE(self->raw);
 	FREE(self);
-}
\ No newline at end of file
+}
+
+
+bool strfilereader_end(strfilereader *self)
+{
+	return self->beg == self->end && !_refill(self);
+}
+
+
+size_t strfilereader_pos(const strfilereader *self)
+{
+	return self->off + self->beg;
+}
+
+
+bool strfilereader_tell(const strfilereader *self, uint64_t *voff)
+{
+	if (self->zsrc) {
+		return zfile_voffset(self->zsrc, self->off + self->beg, voff);
+	}
+	*voff = self->off + self->beg;
+	return true;
+}
+
+
+bool strfilereader_seek(strfilereader *self, uint64_t voff)
+{
+	if (self->zsrc) {
+		if (!zfile_seek(self->zsrc, voff)) {
+			return false;
+		}
+		self->off = 0;
+	}
+	else if (self->off <= voff && voff <= self->off + self->end) {
+		// already buffered
+		self->beg = voff - self->off;
+		return true;
+	}
+	else if (self->mapped || fseek(self->src, voff, SEEK_SET) != 0) {
+		return false;
+	}
+	else {
+		self->off = voff;
+	}
+	self->beg = 0;
+	self->end = 0;
+	self->eof = false;
+	return true;
+}
+
+
+const char *strfilereader_read_span(strfilereader *self, size_t n,
+                                    size_t *len)
+{
+	while (self->end - self->beg < n && _refill(self));
+	*len = MIN(n, self->end - self->beg);
+	if (*len == 0 && n > 0) {
+		return NULL;
+	}
+	const char *ret = self->buf + self->beg;
+	self->beg += *len;
+	return ret;
+}
+
+
+const char *strfilereader_read_span_until(strfilereader *self, char delim,
+        size_t *len)
+{
+	char *p = NULL;
+	size_t scanned = 0; // relative to beg, which may move on refill
+	while (true) {
+		size_t avail = self->end - self->beg;
+		if (scanned < avail) {
+			p = memchr(self->buf + self->beg + scanned, delim, avail - scanned);
+			if (p) {
+				break;
+			}
+		}
+		scanned = avail;
+		if (!_refill(self)) {
+			break;
+		}
+	}
+	*len = p ? (size_t)(p - (self->buf + self->beg)) : self->end - self->beg;
+	if (!p && *len == 0) {
+		return NULL;
+	}
+	const char *ret = self->buf + self->beg;
+	self->beg += *len;
+	return ret;
+}
+
+
+const char *strfilereader_peek(strfilereader *self, size_t min, size_t *len)
+{
+	while (self->end - self->beg < MAX(1, min) && _refill(self));
+	*len = self->end - self->beg;
+	return (*len > 0) ? self->buf + self->beg : NULL;
+}
+
+
+void strfilereader_skip(strfilereader *self, size_t n)
+{
+	assert(n <= self->end - self->beg);
+	self->beg += n;
+}
@@ -29,6 +29,18 @@
  * strings from a FILE stream.
  * @see strread.h
  *
+ * The reader pulls the stream contents in large blocks into an internal
+ * buffer, and serves chars from there, scanning for delimiters with
+ * `memchr`. Regular files can alternatively be memory mapped, in which
+ * case the whole file acts as the buffer.
+ * Besides the copying strread operations, the reader provides *spans*,
+ * i.e. pointers to chars directly inside the buffer, which avoid copying
+ * altogether.
+ *
+ * Readers created from a path read the file asynchronously, with a
+ * separate thread reading ahead the upcoming blocks, and transparently
+ * decompress gzip, BGZF and zstd files (see zfile.h).
+ *
  * # Example
  *
  * ```C
@@ -40,6 +52,9 @@
  * ```
  */
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "trait.h"
@@ -64,14 +79,51 @@ DECL_TRAIT(strfilereader, strread)
 strfilereader *strfilereader_new(FILE *stream);
 
 
+/**
+ * @brief Default size of the internal buffer, in bytes.
+ */
+#define STRFILEREADER_BUFSIZE (1<<17)
+
+
+/**
+ * @brief Same as strfilereader_new(), with an internal buffer of
+ * @p bufsize bytes.
+ * @warning As the reader reads ahead from the stream, the position of
+ * the stream does not correspond to that of the reader.
+ */
+strfilereader *strfilereader_new_with_bufsize(FILE *stream, size_t bufsize);
+
+
 /**
  * @brief Creates a new reader attached to a character input stream from its @p path.
  * A new input stream is created and opened for reading.
- * @returns NULL if the FILE at specified @p path cannot be open in "r" mode.
+ * The file is read ahead asynchronously with ::ZFILE_NBUFS buffers of
+ * ::ZFILE_BUFSIZE bytes, and compressed files are decompressed on the fly.
+ * @returns NULL if the FILE at specified @p path cannot be open in "r" mode,
+ * or is compressed in an unsupported format.
  */
 strfilereader *strfilereader_new_from_path(const char *path);
 
 
+/**
+ * @brief Same as strfilereader_new_from_path(), with @p nbufs read-ahead
+ * buffers of @p bufsize bytes. If @p nbufs is 0, the file is read
+ * synchronously.
+ */
+strfilereader *strfilereader_new_async(const char *path, size_t nbufs,
+                                       size_t bufsize);
+
+
+/**
+ * @brief Creates a new reader over the memory mapped contents of the
+ * file at @p path. If the file is compressed, is not a regular file or
+ * cannot be mapped, falls back to a buffered reader, as
+ * strfilereader_new_from_path().
+ * @returns NULL if the file cannot be open for reading.
+ */
+strfilereader *strfilereader_new_mmap(const char *path);
+
+
 /**
  * @brief Destructor. If the reader was created with strfilereader_new(),
  * the underlying stream is not closed. If the reader was created with the
@@ -80,5 +132,87 @@ strfilereader *strfilereader_new_from_path(const char *path);
 void strfilereader_free(strfilereader *self);
 
 
+/**
+ * @brief Tests whether the reader has reached the end of the stream.
+ */
+bool strfilereader_end(strfilereader *self);
+
+
+/**
+ * @brief Returns the number of chars consumed from the beginning of
+ * the stream, i.e. the offset of the next char to be read.
+ * For compressed files, the count restarts at each strfilereader_seek().
+ */
+size_t strfilereader_pos(const strfilereader *self);
+
+
+/**
+ * @brief Gets the virtual offset of the next char to be read into
+ * @p voff. This is the file offset for plain files, and the
+ * virtual offset defined in zfile.h for BGZF files.
+ * @returns false if the offset cannot be determined, namely for
+ * non-BGZF compressed files.
+ */
+bool strfilereader_tell(const strfilereader *self, uint64_t *voff);
+
+
+/**
+ * @brief Moves the reader to the char at virtual offset @p voff,
+ * as given by strfilereader_tell().
+ * @returns Whether the operation succeeded.
+ */
+bool strfilereader_seek(strfilereader *self, uint64_t voff);
+
+
+/**
+ * @brief Reads the next @p n chars without copying.
+ * Less than @p n chars can be read if the stream reaches its end.
+ * @param len (out) The number of chars actually read.
+ * @returns A pointer to the chars inside the internal buffer, or NULL
+ * if the stream has reached its end.
+ * @warning The returned span is not null-terminated, and is only valid
+ * until the next operation on the reader.
+ */
+const char *strfilereader_read_span(strfilereader *self, size_t n,
+                                    size_t *len);
+
+
+/**
+ * @brief Reads the next chars until the next occurrence of the
+ * delimiter @p delim, or the end of the stream, without copying.
+ * As in strread_read_str_until(), the delimiter is not consumed.
+ * @param len (out) The number of chars actually read.
+ * @returns A pointer to the chars inside the internal buffer, or NULL
+ * if the stream has reached its end.
+ * @warning The returned span is not null-terminated, and is only valid
+ * until the next operation on the reader.
+ */
+const char *strfilereader_read_span_until(strfilereader *self, char delim,
+        size_t *len);
+
+
+/**
+ * @brief Returns the buffered chars, pulling more chars from the stream
+ * until at least @p min of them are buffered, or the stream reaches its
+ * end. The chars are not consumed.
+ * This allows parsers to scan the buffer in place, consuming the
+ * processed chars with strfilereader_skip().
+ * @param len (out) The number of buffered chars, which may exceed @p min.
+ * @returns A pointer to the next char inside the internal buffer, or NULL
+ * if the stream has reached its end.
+ * @warning The returned span is not null-terminated, and is only valid
+ * until the next operation on the reader other than
+ * strfilereader_skip(), strfilereader_pos() and strfilereader_tell().
+ */
+const char *strfilereader_peek(strfilereader *self, size_t min, size_t *len);
+
+
+/**
+ * @brief Consumes the next @p n chars, which must have been made
+ * available by strfilereader_peek().
+ */
+void strfilereader_skip(strfilereader *self, size_t n);
+
+
 
 #endif
\ No newline at end of file
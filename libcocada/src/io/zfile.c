@@ -0,0 +1,565 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "arrays.h"
+#include "coretype.h"
+#include "cstrutil.h"
+#include "deque.h"
+#include "errlog.h"
+#include "mathutil.h"
+#include "new.h"
+#include "readahead.h"
+#include "zfile.h"
+
+
+#define IN_SIZE (1<<18)
+#define BGZF_MAX_BLOCK (1<<16)
+#define BGZF_HDR_SIZE 12
+#define BGZF_MAX_UOFF 0xFFFF
+
+// block tags
+#define COFF 0 // compressed offset of the BGZF block
+#define CEND 1 // compressed offset of the next BGZF block
+
+
+// a BGZF block read since the last seek
+typedef struct {
+	uint64_t ustart; // decompressed position of its first char
+	uint64_t coff;
+	uint64_t cend;
+} bgzf_blk;
+
+
+struct _zfile {
+	FILE *src;
+	char *path;
+	zfile_format fmt;
+	// decompression thread
+	readahead *ra;
+	bool corrupt;
+	byte_t *in;
+	size_t in_len;
+	size_t in_pos;
+	uint64_t in_off;
+	bool in_frame;
+#ifdef HAVE_ZLIB
+	z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_DStream *zds;
+#endif
+	// consumer
+	const rablock *cur;
+	size_t cpos;
+	bool done;
+	uint64_t upos;
+	uint64_t ubase;
+	uint64_t pbase;
+	// blocks that zfile_voffset() may still be asked about
+	deque *blks;
+};
+
+
+zfile_format zfile_detect(const char *path)
+{
+	byte_t hdr[BGZF_HDR_SIZE + 4];
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		return ZFILE_PLAIN;
+	}
+	// do not consume the contents of pipes and the like
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode)) {
+		fclose(f);
+		return ZFILE_PLAIN;
+	}
+	size_t n = fread(hdr, 1, sizeof(hdr), f);
+	fclose(f);
+	if (n >= 2 && hdr[0] == 0x1f && hdr[1] == 0x8b) {
+		bool bgzf = n >= 14 && (hdr[3] & 4) && hdr[12] == 'B' && hdr[13] == 'C';
+		return bgzf ? ZFILE_BGZF : ZFILE_GZIP;
+	}
+	if (n >= 4 && hdr[0] == 0x28 && hdr[1] == 0xb5 && hdr[2] == 0x2f
+	        && hdr[3] == 0xfd) {
+		return ZFILE_ZSTD;
+	}
+	return ZFILE_PLAIN;
+}
+
+
+static void _produce_plain(zfile *self, rablock *c)
+{
+	c->len = fread(c->data, 1, c->cap, self->src);
+	c->last = c->len < c->cap;
+}
+
+
+#ifdef HAVE_ZLIB
+
+static size_t _fill_in(zfile *self, size_t n)
+{
+	size_t r = fread(self->in, 1, n, self->src);
+	self->in_off += r;
+	return r;
+}
+
+
+static void _produce_gzip(zfile *self, rablock *c)
+{
+	z_stream *zs = &self->zs;
+	zs->next_out = c->data;
+	zs->avail_out = c->cap;
+	while (zs->avail_out > 0) {
+		if (zs->avail_in == 0) {
+			size_t n = _fill_in(self, IN_SIZE);
+			if (n == 0) {
+				// a member was cut short
+				self->corrupt = self->in_frame;
+				c->last = true;
+				break;
+			}
+			zs->next_in = self->in;
+			zs->avail_in = n;
+		}
+		int ret = inflate(zs, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END) {
+			// there may be other members after this one
+			self->in_frame = false;
+			inflateReset(zs);
+		}
+		else if (ret == Z_OK) {
+			self->in_frame = true;
+		}
+		else {
+			self->corrupt = true;
+			c->last = true;
+			break;
+		}
+	}
+	c->len = c->cap - zs->avail_out;
+}
+
+
+static uint16_t _le16(const byte_t *b)
+{
+	return (uint16_t)b[0] | ((uint16_t)b[1] << 8);
+}
+
+
+static uint32_t _le32(const byte_t *b)
+{
+	return (uint32_t)_le16(b) | ((uint32_t)_le16(b + 2) << 16);
+}
+
+
+/*
+ * Each BGZF block goes to a separate chunk, so that the consumer can
+ * tell the virtual offsets of the chars.
+ */
+static void _produce_bgzf(zfile *self, rablock *c)
+{
+	c->len = 0;
+	c->tag[COFF] = self->in_off;
+	byte_t *hdr = self->in;
+	size_t n = _fill_in(self, BGZF_HDR_SIZE);
+	if (n == 0) {
+		c->last = true;
+		return;
+	}
+	if (n < BGZF_HDR_SIZE || hdr[0] != 0x1f || hdr[1] != 0x8b || !(hdr[3] & 4)) {
+		goto corrupt;
+	}
+	size_t xlen = _le16(hdr + 10);
+	if (BGZF_HDR_SIZE + xlen > IN_SIZE
+	        || fread(hdr + BGZF_HDR_SIZE, 1, xlen, self->src) != xlen) {
+		goto corrupt;
+	}
+	self->in_off += xlen;
+	size_t bsize = 0;
+	for (byte_t *x = hdr + BGZF_HDR_SIZE; x + 4 <= hdr + BGZF_HDR_SIZE + xlen;
+	        x += 4 + _le16(x + 2)) {
+		if (x[0] == 'B' && x[1] == 'C' && _le16(x + 2) == 2) {
+			bsize = (size_t)_le16(x + 4) + 1;
+		}
+	}
+	if (bsize < BGZF_HDR_SIZE + xlen + 8) {
+		goto corrupt;
+	}
+	size_t rest = bsize - BGZF_HDR_SIZE - xlen;
+	byte_t *cdata = hdr + BGZF_HDR_SIZE + xlen;
+	if (fread(cdata, 1, rest, self->src) != rest) {
+		goto corrupt;
+	}
+	self->in_off += rest;
+	c->tag[CEND] = self->in_off;
+	z_stream *zs = &self->zs;
+	inflateReset(zs);
+	zs->next_in = cdata;
+	zs->avail_in = rest - 8;
+	zs->next_out = c->data;
+	zs->avail_out = c->cap;
+	if (inflate(zs, Z_FINISH) != Z_STREAM_END) {
+		goto corrupt;
+	}
+	c->len = c->cap - zs->avail_out;
+	if (_le32(cdata + rest - 4) != c->len
+	        || _le32(cdata + rest - 8) != crc32(0, c->data, c->len)) {
+		goto corrupt;
+	}
+	return;
+
+corrupt:
+	c->len = 0;
+	self->corrupt = true;
+	c->last = true;
+}
+
+#endif
+
+
+#ifdef HAVE_ZSTD
+
+static void _produce_zstd(zfile *self, rablock *c)
+{
+	ZSTD_outBuffer out = {.dst = c->data, .size = c->cap, .pos = 0};
+	while (out.pos < out.size) {
+		if (self->in_pos == self->in_len) {
+			self->in_len = fread(self->in, 1, IN_SIZE, self->src);
+			self->in_pos = 0;
+			if (self->in_len == 0) {
+				self->corrupt = self->in_frame;
+				c->last = true;
+				break;
+			}
+		}
+		ZSTD_inBuffer in = {.src = self->in, .size = self->in_len, .pos = self->in_pos};
+		size_t ret = ZSTD_decompressStream(self->zds, &out, &in);
+		self->in_pos = in.pos;
+		if (ZSTD_isError(ret)) {
+			self->corrupt = true;
+			c->last = true;
+			break;
+		}
+		self->in_frame = (ret != 0);
+	}
+	c->len = out.pos;
+}
+
+#endif
+
+
+static void _produce(void *src, rablock *c)
+{
+	zfile *self = (zfile *)src;
+	switch (self->fmt) {
+	case ZFILE_PLAIN:
+		_produce_plain(self, c);
+		break;
+#ifdef HAVE_ZLIB
+	case ZFILE_GZIP:
+		_produce_gzip(self, c);
+		break;
+	case ZFILE_BGZF:
+		_produce_bgzf(self, c);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case ZFILE_ZSTD:
+		_produce_zstd(self, c);
+		break;
+#endif
+	default:
+		c->last = true;
+	}
+}
+
+
+/*
+ * (Re)starts decompressing from the current position of the source
+ * file, which must be at the start of a gzip member, BGZF block or
+ * zstd frame.
+ */
+static void _start(zfile *self)
+{
+	self->corrupt = false;
+	self->in_len = self->in_pos = 0;
+	self->in_frame = false;
+	self->cur = NULL;
+	self->cpos = 0;
+	self->upos = 0;
+	self->ubase = 0;
+	while (!deque_empty(self->blks)) {
+		deque_del_front(self->blks);
+	}
+#ifdef HAVE_ZLIB
+	if (self->fmt == ZFILE_GZIP || self->fmt == ZFILE_BGZF) {
+		inflateReset(&self->zs);
+		self->zs.avail_in = 0;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (self->fmt == ZFILE_ZSTD) {
+		ZSTD_initDStream(self->zds);
+	}
+#endif
+	self->done = false;
+	readahead_start(self->ra);
+}
+
+
+zfile *zfile_open(const char *path)
+{
+	return zfile_open_with_bufs(path, ZFILE_NBUFS, ZFILE_BUFSIZE);
+}
+
+
+zfile *zfile_open_with_bufs(const char *path, size_t nbufs, size_t bufsize)
+{
+	zfile_format fmt = zfile_detect(path);
+#ifndef HAVE_ZLIB
+	if (fmt == ZFILE_GZIP || fmt == ZFILE_BGZF) {
+		WARN("Unable to open %s: built without gzip support.\n", path);
+		return NULL;
+	}
+#endif
+#ifndef HAVE_ZSTD
+	if (fmt == ZFILE_ZSTD) {
+		WARN("Unable to open %s: built without zstd support.\n", path);
+		return NULL;
+	}
+#endif
+	FILE *src = fopen(path, "rb");
+	if (!src) {
+		WARN("Unable to open %s.\n", path);
+		return NULL;
+	}
+	posix_fadvise(fileno(src), 0, 0, POSIX_FADV_SEQUENTIAL);
+	zfile *ret = NEW(zfile);
+	ret->src = src;
+	ret->path = cstr_clone(path);
+	ret->fmt = fmt;
+	// each BGZF block goes to a separate buffer
+	ret->ra = readahead_new(_produce, ret, nbufs,
+	                        (fmt == ZFILE_BGZF) ? BGZF_MAX_BLOCK : bufsize);
+	ret->in = (fmt == ZFILE_PLAIN) ? NULL : ARR_NEW(byte_t, IN_SIZE);
+	ret->in_off = 0;
+	ret->pbase = 0;
+	ret->blks = deque_new(sizeof(bgzf_blk));
+#ifdef HAVE_ZLIB
+	memset(&ret->zs, 0, sizeof(z_stream));
+	if (fmt == ZFILE_GZIP) {
+		inflateInit2(&ret->zs, 15 + 16);
+	}
+	else if (fmt == ZFILE_BGZF) {
+		inflateInit2(&ret->zs, -15);
+	}
+#endif
+#ifdef HAVE_ZSTD
+	ret->zds = (fmt == ZFILE_ZSTD) ? ZSTD_createDStream() : NULL;
+#endif
+	_start(ret);
+	return ret;
+}
+
+
+void zfile_close(zfile *self)
+{
+	readahead_free(self->ra);
+#ifdef HAVE_ZLIB
+	if (self->fmt == ZFILE_GZIP || self->fmt == ZFILE_BGZF) {
+		inflateEnd(&self->zs);
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (self->zds) {
+		ZSTD_freeDStream(self->zds);
+	}
+#endif
+	fclose(self->src);
+	FREE(self->in);
+	FREE(self->path);
+	DESTROY_FLAT(self->blks, deque);
+	FREE(self);
+}
+
+
+zfile_format zfile_fmt(const zfile *self)
+{
+	return self->fmt;
+}
+
+
+size_t zfile_read(zfile *self, void *dest, size_t n)
+{
+	size_t nread = 0;
+	while (nread < n && !self->done) {
+		if (self->cur == NULL || self->cpos == self->cur->len) {
+			self->cur = readahead_next(self->ra);
+			self->cpos = 0;
+			if (self->cur == NULL) {
+				self->done = true;
+				break;
+			}
+			if (self->fmt == ZFILE_BGZF && self->cur->len > 0) {
+				bgzf_blk b = {.ustart = self->upos, .coff = self->cur->tag[COFF],
+				              .cend = self->cur->tag[CEND]
+				             };
+				deque_push_back(self->blks, &b);
+			}
+		}
+		const rablock *c = self->cur;
+		size_t l = MIN(n - nread, c->len - self->cpos);
+		if (dest) {
+			memcpy((byte_t *)dest + nread, c->data + self->cpos, l);
+		}
+		self->cpos += l;
+		self->upos += l;
+		nread += l;
+		if (self->cpos == c->len && c->last) {
+			self->done = true;
+			WARN_IF(self->corrupt, "Corrupted or truncated file %s.\n", self->path);
+		}
+	}
+	return nread;
+}
+
+
+uint64_t zfile_tell(const zfile *self)
+{
+	return self->upos - self->ubase;
+}
+
+
+bool zfile_seekable(const zfile *self)
+{
+	return self->fmt == ZFILE_PLAIN || self->fmt == ZFILE_BGZF;
+}
+
+
+bool zfile_voffset(const zfile *self, uint64_t upos, uint64_t *voff)
+{
+	upos += self->ubase;
+	if (upos > self->upos) {
+		return false;
+	}
+	if (self->fmt == ZFILE_PLAIN) {
+		*voff = self->pbase + upos;
+		return true;
+	}
+	if (self->fmt != ZFILE_BGZF) {
+		return false;
+	}
+	size_t n = deque_len(self->blks);
+	if (n == 0) {
+		// nothing read since the last seek
+		*voff = self->pbase;
+		return true;
+	}
+	if (upos < ((const bgzf_blk *)deque_front(self->blks))->ustart) {
+		// released
+		return false;
+	}
+	// last block starting at or before upos
+	size_t l = 0, r = n;
+	while (r - l > 1) {
+		size_t m = (l + r) / 2;
+		if (((const bgzf_blk *)deque_get(self->blks, m))->ustart <= upos) {
+			l = m;
+		}
+		else {
+			r = m;
+		}
+	}
+	const bgzf_blk *b = deque_get(self->blks, l);
+	uint64_t uoff = upos - b->ustart;
+	if (uoff > BGZF_MAX_UOFF) {
+		// right at the end of a full block
+		*voff = b->cend << 16;
+	}
+	else {
+		*voff = (b->coff << 16) | uoff;
+	}
+	return true;
+}
+
+
+void zfile_release(zfile *self, uint64_t upos)
+{
+	upos += self->ubase;
+	// keep the block holding upos
+	while (deque_len(self->blks) > 1
+	        && ((const bgzf_blk *)deque_get(self->blks, 1))->ustart <= upos) {
+		deque_del_front(self->blks);
+	}
+}
+
+
+bool zfile_seek(zfile *self, uint64_t voff)
+{
+	if (!zfile_seekable(self)) {
+		return false;
+	}
+	uint64_t coff = (self->fmt == ZFILE_BGZF) ? voff >> 16 : voff;
+	uint64_t uoff = (self->fmt == ZFILE_BGZF) ? voff & BGZF_MAX_UOFF : 0;
+	readahead_stop(self->ra);
+	if (fseek(self->src, coff, SEEK_SET) != 0) {
+		WARN("Unable to seek %s.\n", self->path);
+		self->done = true;
+		return false;
+	}
+	self->in_off = coff;
+	self->pbase = voff;
+	_start(self);
+	if (zfile_read(self, NULL, uoff) != uoff) {
+		return false;
+	}
+	self->ubase = uoff;
+	return true;
+}
+
+
+bool zfile_rewind(zfile *self)
+{
+	if (zfile_seekable(self)) {
+		return zfile_seek(self, 0);
+	}
+	readahead_stop(self->ra);
+	rewind(self->src);
+	self->in_off = 0;
+	_start(self);
+	return true;
+}
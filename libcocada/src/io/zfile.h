@@ -0,0 +1,183 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+
+#ifndef ZFILE_H
+#define ZFILE_H
+
+/**
+ * @file zfile.h
+ * @author Paulo Fonseca
+ * @brief Compressed file reader.
+ *
+ * A zfile reads the decompressed contents of a gzip, BGZF or zstd file,
+ * detecting the format by its magic bytes. Plain files are read as they are.
+ *
+ * Reading and decompression run ahead on a separate thread, which
+ * fills a ring of buffers while the consumer reads the ones already
+ * filled (see readahead.h), so that the consumer works in parallel with
+ * the I/O and the decompression. The file is also declared to be read
+ * sequentially, so that the OS reads ahead more aggressively.
+ *
+ * BGZF files, made of independently compressed blocks of at most 64KiB,
+ * support random access through *virtual offsets*, as defined in the
+ * SAM/BAM specification: the offset of a char in the decompressed
+ * contents is `coff<<16 | uoff`, where `coff` is the offset of its block
+ * in the compressed file, and `uoff` is its offset inside the decompressed
+ * block. For plain files the virtual offset is just the file offset.
+ *
+ * gzip and BGZF support requires zlib, and zstd support requires libzstd,
+ * at build time (HAVE_ZLIB and HAVE_ZSTD).
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * @brief File formats.
+ */
+typedef enum {
+	ZFILE_PLAIN = 0, /**< Uncompressed */
+	ZFILE_GZIP  = 1, /**< gzip, possibly with multiple members */
+	ZFILE_BGZF  = 2, /**< Blocked gzip */
+	ZFILE_ZSTD  = 3  /**< Zstandard */
+} zfile_format;
+
+
+/**
+ * @brief Compressed file reader type.
+ */
+typedef struct _zfile zfile;
+
+
+/**
+ * @brief Detects the format of the file at @p path from its first bytes.
+ * Files that cannot be read, are not regular files, or are not recognised
+ * as compressed, are reported as ::ZFILE_PLAIN.
+ */
+zfile_format zfile_detect(const char *path);
+
+
+/**
+ * @brief Default number of read-ahead buffers.
+ */
+#define ZFILE_NBUFS 4
+
+
+/**
+ * @brief Default size of the read-ahead buffers, in bytes.
+ */
+#define ZFILE_BUFSIZE (1<<20)
+
+
+/**
+ * @brief Opens the file at @p path for reading its decompressed contents,
+ * and starts the read-ahead thread, with ::ZFILE_NBUFS buffers of
+ * ::ZFILE_BUFSIZE bytes.
+ * @returns NULL with a warning if the file cannot be open, or if its
+ * format is not supported by the build.
+ */
+zfile *zfile_open(const char *path);
+
+
+/**
+ * @brief Same as zfile_open() with @p nbufs read-ahead buffers of
+ * @p bufsize bytes. BGZF files use 64KiB buffers, one per block.
+ * If @p nbufs is 0, the file is read synchronously, without a thread.
+ */
+zfile *zfile_open_with_bufs(const char *path, size_t nbufs, size_t bufsize);
+
+
+/**
+ * @brief Stops the read-ahead thread, closes the file and releases
+ * the resources.
+ */
+void zfile_close(zfile *self);
+
+
+/**
+ * @brief Returns the format of the file.
+ */
+zfile_format zfile_fmt(const zfile *self);
+
+
+/**
+ * @brief Reads the next @p n decompressed chars into @p dest.
+ * Less than @p n chars are read if the file reaches its end, or if
+ * it turns out to be corrupted, in which case a warning is issued.
+ * @param dest The destination. If NULL, the chars are skipped.
+ * @returns The number of chars actually read.
+ */
+size_t zfile_read(zfile *self, void *dest, size_t n);
+
+
+/**
+ * @brief Moves the cursor back to the beginning of the file.
+ * @returns Whether the operation succeeded.
+ */
+bool zfile_rewind(zfile *self);
+
+
+/**
+ * @brief Returns the number of decompressed chars read since the file
+ * was open, rewound or last sought.
+ */
+uint64_t zfile_tell(const zfile *self);
+
+
+/**
+ * @brief Tests whether the file supports zfile_voffset() and
+ * zfile_seek(), i.e. whether it is a plain or a BGZF file.
+ */
+bool zfile_seekable(const zfile *self);
+
+
+/**
+ * @brief Computes the virtual offset of a char given by its @p upos,
+ * the number of decompressed chars preceding it since the file was open,
+ * rewound or last sought (cf. zfile_tell()).
+ * @p upos can be anywhere between the last seek, or the last position
+ * passed to zfile_release(), and the current position.
+ * @returns Whether the virtual offset could be computed.
+ */
+bool zfile_voffset(const zfile *self, uint64_t upos, uint64_t *voff);
+
+
+/**
+ * @brief Declares that zfile_voffset() will not be asked about the
+ * chars before @p upos (cf. zfile_tell()), so that the offsets of the
+ * BGZF blocks holding them can be dropped. Otherwise one offset is
+ * kept per block read since the last seek.
+ */
+void zfile_release(zfile *self, uint64_t upos);
+
+
+/**
+ * @brief Moves the cursor to the char at virtual offset @p voff.
+ * After that, zfile_tell() counts from that char.
+ * @returns Whether the operation succeeded.
+ */
+bool zfile_seek(zfile *self, uint64_t voff);
+
+
+#endif
@@ -46,6 +46,7 @@ CuSuite *minqueue_get_test_suite();
 CuSuite *quadtree_get_test_suite();
 CuSuite *queue_get_test_suite();
 CuSuite *randutil_get_test_suite();
+CuSuite *readahead_get_test_suite();
 CuSuite *range_get_test_suite();
 CuSuite *segtree_get_test_suite();
 CuSuite *serialise_get_test_suite();
@@ -55,6 +56,7 @@ CuSuite *strfileread_get_test_suite();
 //CuSuite *tvec_get_test_suite();
 //CuSuite *twuhash_get_test_suite();
 CuSuite *vec_get_test_suite();
+CuSuite *zfile_get_test_suite();
 
 
 void run_all_tests(void)
@@ -78,15 +80,17 @@ void run_all_tests(void)
 	//CuSuiteAddSuite(suite, minqueue_get_test_suite());
 	//CuSuiteAddSuite(suite, randutil_get_test_suite());
 	// CuSuiteAddSuite(suite, range_get_test_suite());
+	CuSuiteAddSuite(suite, readahead_get_test_suite());
 	//CuSuiteAddSuite(suite, serialise_get_test_suite());
 	//CuSuiteAddSuite(suite, segtree_get_test_suite());
 	//CuSuiteAddSuite(suite, sort_get_test_suite());
 	//CuSuiteAddSuite(suite, stack_get_test_suite());
 	CuSuiteAddSuite(suite, strbuf_get_test_suite());
-	//CuSuiteAddSuite(suite, strfileread_get_test_suite());
+	CuSuiteAddSuite(suite, strfileread_get_test_suite());
 	//CuSuiteAddSuite(suite, strstream_get_test_suite());
 	//CuSuiteAddSuite(suite, tvec_get_test_suite());
 	//CuSuiteAddSuite(suite, vec_get_test_suite());
+	CuSuiteAddSuite(suite, zfile_get_test_suite());
 
 	CuSuiteRun(suite);
 	CuSuiteSummary(suite, output);
@@ -33,6 +33,7 @@
 #include "new.h"
 #include "mathutil.h"
 #include "memdbg.h"
+#include "randutil.h"
 
 static size_t ba_size = 1043;
 
@@ -118,6 +119,31 @@ void bitvec_test_push_n(CuTest *tc)
 }
 
 
+void bitvec_test_push_word(CuTest *tc)
+{
+	memdbg_reset();
+	bitvec *bv = bitvec_new_with_capacity(0);
+	byte_t *array = ARR_NEW(byte_t, ba_size + 64);
+	size_t s = 0;
+	while (s < ba_size) {
+		size_t n = rand_range_size_t(0, 65);
+		uint64_t word = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+		bitvec_push_word(bv, word, n);
+		for (size_t i = 0; i < n; i++) {
+			array[s + i] = (word >> (n - 1 - i)) & 1;
+		}
+		s += n;
+	}
+	CuAssertSizeTEquals(tc, s, bitvec_len(bv));
+	for (size_t i = 0; i < s; i++) {
+		CuAssertIntEquals(tc, array[i], bitvec_get_bit(bv, i));
+	}
+	bitvec_free(bv);
+	FREE(array);
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
 void bitvec_test_count(CuTest *tc)
 {
 	memdbg_reset();
@@ -211,6 +237,7 @@ CuSuite *bitvec_get_test_suite()
 	SUITE_ADD_TEST(suite, bitvec_test_get_set);
 	SUITE_ADD_TEST(suite, bitvec_test_push);
 	SUITE_ADD_TEST(suite, bitvec_test_push_n);
+	SUITE_ADD_TEST(suite, bitvec_test_push_word);
 	SUITE_ADD_TEST(suite, bitvec_test_count);
 	SUITE_ADD_TEST(suite, bitvec_test_select);
 	SUITE_ADD_TEST(suite, bitvec_test_format);
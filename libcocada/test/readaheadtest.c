@@ -0,0 +1,114 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "CuTest.h"
+
+#include "mathutil.h"
+#include "readahead.h"
+
+
+typedef struct {
+	uint64_t next;
+	uint64_t end;
+	bool slow;
+} counter;
+
+
+// fills the block with the next values of the counter, one byte each
+static void _fill(void *src, rablock *blk)
+{
+	counter *cnt = (counter *)src;
+	if (cnt->slow) {
+		struct timespec ts = {.tv_sec = 0, .tv_nsec = 100000};
+		nanosleep(&ts, NULL);
+	}
+	blk->tag[0] = cnt->next;
+	for (; blk->len < blk->cap && cnt->next < cnt->end; cnt->next++) {
+		blk->data[blk->len++] = (byte_t)cnt->next;
+	}
+	blk->last = (cnt->next == cnt->end);
+}
+
+
+void test_readahead_next(CuTest *tc)
+{
+	// no buffers means synchronous reading
+	for (size_t nbufs = 0; nbufs <= 4; nbufs++) {
+		for (size_t bufsize = 1; bufsize <= 1000; bufsize *= 10) {
+			counter cnt = {.next = 0, .end = 12345, .slow = (bufsize == 1000)};
+			readahead *ra = readahead_new(_fill, &cnt, nbufs, bufsize);
+			CuAssertSizeTEquals(tc, MAX(1, nbufs), readahead_nbufs(ra));
+			CuAssertPtrEquals(tc, NULL, (void *)readahead_next(ra));
+			for (size_t k = 0; k < 2; k++) {
+				cnt.next = 0;
+				CuAssertTrue(tc, readahead_start(ra) == (nbufs > 0));
+				uint64_t n = 0;
+				for (const rablock *blk; (blk = readahead_next(ra)); ) {
+					CuAssertTrue(tc, blk->tag[0] == n);
+					for (size_t i = 0; i < blk->len; i++, n++) {
+						CuAssertIntEquals(tc, (byte_t)n, blk->data[i]);
+					}
+				}
+				CuAssertTrue(tc, n == cnt.end);
+				CuAssertPtrEquals(tc, NULL, (void *)readahead_next(ra));
+			}
+			readahead_free(ra);
+		}
+	}
+}
+
+
+void test_readahead_restart(CuTest *tc)
+{
+	for (size_t nbufs = 0; nbufs <= 3; nbufs += 3) {
+		counter cnt = {.next = 0, .end = UINT64_MAX, .slow = false};
+		readahead *ra = readahead_new(_fill, &cnt, nbufs, 64);
+		readahead_start(ra);
+		for (size_t k = 0; k < 100; k++) {
+			const rablock *blk = readahead_next(ra);
+			CuAssertTrue(tc, blk->len == 64);
+			if (k % 10 == 9) {
+				// reposition the source
+				readahead_stop(ra);
+				CuAssertPtrEquals(tc, NULL, (void *)readahead_next(ra));
+				cnt.next = 1000 * k;
+				readahead_start(ra);
+				blk = readahead_next(ra);
+				CuAssertTrue(tc, blk->tag[0] == 1000 * k);
+			}
+		}
+		readahead_free(ra);
+	}
+}
+
+
+CuSuite *readahead_get_test_suite()
+{
+	CuSuite *suite = CuSuiteNew();
+	SUITE_ADD_TEST(suite, test_readahead_next);
+	SUITE_ADD_TEST(suite, test_readahead_restart);
+	return suite;
+}
@@ -26,6 +26,7 @@
 #include <string.h>
 
 #include "CuTest.h"
+#include "new.h"
 #include "strread.h"
 #include "strfilereader.h"
 
@@ -58,15 +59,152 @@ void test_getc(CuTest *tc)
 	}
 	c = strread_getc(strfilereader_as_strread(sfr));
 	CuAssertIntEquals(tc, EOF, c);
+	strfilereader_free(sfr);
 	test_teardown();
 }
 
 
+#define NREADERS 9
+
+static char *lines_filename = "test_strfileread_lines.txt";
+
+// opens the file with tiny, default, mapped, read-ahead and synchronous buffers
+static strfilereader *_open(size_t i, FILE **file)
+{
+	size_t bufsizes[4] = {1, 3, 7, 64};
+	*file = NULL;
+	if (i < 4) {
+		*file = fopen(lines_filename, "r");
+		return strfilereader_new_with_bufsize(*file, bufsizes[i]);
+	}
+	switch (i) {
+	case 4:
+		return strfilereader_new_from_path(lines_filename);
+	case 5:
+		return strfilereader_new_mmap(lines_filename);
+	case 6:
+		return strfilereader_new_async(lines_filename, 1, 5);
+	case 7:
+		return strfilereader_new_async(lines_filename, 0, 5);
+	default:
+		return strfilereader_new_async(lines_filename, 3, 100);
+	}
+}
+
+
+static void _close(strfilereader *sfr, FILE *file)
+{
+	strfilereader_free(sfr);
+	if (file) {
+		fclose(file);
+	}
+}
+
+
+static char *_write_lines(size_t nlines)
+{
+	size_t len = 0;
+	char *content = malloc(nlines * 100 + 1);
+	for (size_t i = 0; i < nlines; i++) {
+		size_t l = (i * 37) % 90;
+		for (size_t j = 0; j < l; j++) {
+			content[len++] = "acgt"[(i + j) % 4];
+		}
+		content[len++] = '\n';
+	}
+	content[len] = '\0';
+	FILE *file = fopen(lines_filename, "w");
+	fprintf(file, "%s", content);
+	fclose(file);
+	return content;
+}
+
+
+void test_strfilereader_read(CuTest *tc)
+{
+	char *content = _write_lines(200);
+	size_t len = strlen(content);
+	char *dest = malloc(len + 1);
+	for (size_t i = 0; i < NREADERS; i++) {
+		FILE *file;
+		strfilereader *sfr = _open(i, &file);
+		strread *r = strfilereader_as_strread(sfr);
+		// getc and ungetc
+		for (size_t j = 0; j < len; j++) {
+			CuAssertSizeTEquals(tc, j, strfilereader_pos(sfr));
+			CuAssertIntEquals(tc, content[j], strread_getc(r));
+			if (j % 5 == 0) {
+				CuAssertIntEquals(tc, 1, strread_ungetc(r));
+				CuAssertIntEquals(tc, content[j], strread_getc(r));
+			}
+		}
+		CuAssertIntEquals(tc, EOF, strread_getc(r));
+		CuAssertTrue(tc, strfilereader_end(sfr));
+		// read_str in chunks
+		strread_reset(r);
+		CuAssertTrue(tc, !strfilereader_end(sfr));
+		size_t n = 0;
+		for (size_t l; (l = strread_read_str(r, dest + n, 13)) > 0; n += l);
+		CuAssertSizeTEquals(tc, len, n);
+		CuAssertIntEquals(tc, 0, strncmp(content, dest, len));
+		// read_str_until line by line
+		strread_reset(r);
+		n = 0;
+		while (!strfilereader_end(sfr)) {
+			n += strread_read_str_until(r, dest + n, '\n');
+			CuAssertIntEquals(tc, '\n', strread_getc(r));
+			dest[n++] = '\n';
+		}
+		CuAssertSizeTEquals(tc, len, n);
+		CuAssertIntEquals(tc, 0, strncmp(content, dest, len));
+		_close(sfr, file);
+	}
+	FREE(dest);
+	FREE(content);
+	remove(lines_filename);
+}
+
+
+void test_strfilereader_span(CuTest *tc)
+{
+	char *content = _write_lines(300);
+	size_t len = strlen(content);
+	for (size_t i = 0; i < NREADERS; i++) {
+		FILE *file;
+		strfilereader *sfr = _open(i, &file);
+		strread *r = strfilereader_as_strread(sfr);
+		size_t pos = 0, l;
+		for (const char *span; (span = strfilereader_read_span_until(sfr, '\n', &l)); ) {
+			CuAssertIntEquals(tc, 0, strncmp(content + pos, span, l));
+			pos += l;
+			CuAssertTrue(tc, pos == len || content[pos] == '\n');
+			CuAssertIntEquals(tc, '\n', strread_getc(r));
+			pos++;
+			CuAssertSizeTEquals(tc, pos, strfilereader_pos(sfr));
+		}
+		CuAssertSizeTEquals(tc, len, pos);
+		strread_reset(r);
+		pos = 0;
+		for (const char *span; (span = strfilereader_read_span(sfr, 101, &l)); ) {
+			CuAssertTrue(tc, l == 101 || pos + l == len);
+			CuAssertIntEquals(tc, 0, strncmp(content + pos, span, l));
+			pos += l;
+		}
+		CuAssertSizeTEquals(tc, len, pos);
+		_close(sfr, file);
+	}
+	FREE(content);
+	remove(lines_filename);
+}
+
+
 
 CuSuite *strfileread_get_test_suite()
 {
 	CuSuite *suite = CuSuiteNew();
 	SUITE_ADD_TEST(suite, test_getc);
+	SUITE_ADD_TEST(suite, test_strfilereader_read);
+	SUITE_ADD_TEST(suite, test_strfilereader_span);
 	return suite;
 }
 
@@ -0,0 +1,321 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "CuTest.h"
+
+#include "mathutil.h"
+#include "new.h"
+#include "strfilereader.h"
+#include "strread.h"
+#include "zfile.h"
+
+
+static char *plain_path = "test_zfile.txt";
+
+
+static char *_lines(size_t nlines)
+{
+	size_t len = 0;
+	char *content = malloc(nlines * 100 + 1);
+	for (size_t i = 0; i < nlines; i++) {
+		len += sprintf(content + len, "%zu:", i);
+		size_t l = (i * 37) % 90;
+		for (size_t j = 0; j < l; j++) {
+			content[len++] = "acgt"[(i * j + j / 3) % 4];
+		}
+		content[len++] = '\n';
+	}
+	content[len] = '\0';
+	return content;
+}
+
+
+static void _write_plain(const char *path, const char *data, size_t len)
+{
+	FILE *f = fopen(path, "wb");
+	fwrite(data, 1, len, f);
+	fclose(f);
+}
+
+
+static void _check_reads(CuTest *tc, const char *path, const char *content,
+                         size_t len)
+{
+	zfile *zf = zfile_open(path);
+	CuAssertPtrNotNull(tc, zf);
+	char *dest = malloc(len + 1);
+	for (size_t k = 0; k < 2; k++) {
+		size_t n = 0;
+		for (size_t i = 0, l; (l = zfile_read(zf, dest + n, 1 + (i * 7919) % 100000)) > 0;
+		        i++) {
+			n += l;
+		}
+		CuAssertSizeTEquals(tc, len, n);
+		CuAssertSizeTEquals(tc, len, zfile_tell(zf));
+		CuAssertIntEquals(tc, 0, memcmp(content, dest, len));
+		CuAssertTrue(tc, zfile_rewind(zf));
+	}
+	zfile_close(zf);
+	FREE(dest);
+}
+
+
+// reads the file line by line, saves the offsets of the lines, and
+// then checks them by seeking backwards
+static void _check_seeks(CuTest *tc, const char *path, const char *content,
+                         size_t nlines)
+{
+	strfilereader *sfr = strfilereader_new_from_path(path);
+	CuAssertPtrNotNull(tc, sfr);
+	strread *r = strfilereader_as_strread(sfr);
+	uint64_t *voffs = calloc(nlines, sizeof(uint64_t));
+	size_t *starts = calloc(nlines, sizeof(size_t));
+	size_t pos = 0, l;
+	for (size_t i = 0; i < nlines; i++) {
+		CuAssertTrue(tc, strfilereader_tell(sfr, voffs + i));
+		starts[i] = pos;
+		const char *span = strfilereader_read_span_until(sfr, '\n', &l);
+		CuAssertPtrNotNull(tc, span);
+		CuAssertIntEquals(tc, 0, strncmp(content + pos, span, l));
+		CuAssertIntEquals(tc, '\n', strread_getc(r));
+		pos += l + 1;
+	}
+	CuAssertTrue(tc, strfilereader_end(sfr));
+	for (size_t k = 0; k < nlines; k += 7) {
+		size_t i = nlines - 1 - k;
+		CuAssertTrue(tc, strfilereader_seek(sfr, voffs[i]));
+		const char *span = strfilereader_read_span_until(sfr, '\n', &l);
+		CuAssertPtrNotNull(tc, span);
+		CuAssertIntEquals(tc, 0, strncmp(content + starts[i], span, l));
+		CuAssertTrue(tc, content[starts[i] + l] == '\n');
+	}
+	FREE(voffs);
+	FREE(starts);
+	strfilereader_free(sfr);
+}
+
+
+void test_zfile_plain(CuTest *tc)
+{
+	size_t nlines = 5000;
+	char *content = _lines(nlines);
+	size_t len = strlen(content);
+	_write_plain(plain_path, content, len);
+	CuAssertIntEquals(tc, ZFILE_PLAIN, zfile_detect(plain_path));
+	_check_reads(tc, plain_path, content, len);
+	_check_seeks(tc, plain_path, content, nlines);
+	remove(plain_path);
+	FREE(content);
+}
+
+
+#ifdef HAVE_ZLIB
+
+static char *gz_path = "test_zfile.txt.gz";
+static char *bgzf_path = "test_zfile.txt.bgz";
+
+
+static void _write_gzip(const char *path, const char *data, size_t len,
+                        size_t nmembers)
+{
+	size_t step = len / nmembers + 1;
+	for (size_t i = 0; i < len; i += step) {
+		gzFile gz = gzopen(path, i ? "ab" : "wb");
+		gzwrite(gz, data + i, MIN(step, len - i));
+		gzclose(gz);
+	}
+}
+
+
+static void _write_le(unsigned char *dest, uint64_t val, size_t nbytes)
+{
+	for (size_t i = 0; i < nbytes; i++, val >>= 8) {
+		dest[i] = val & 0xFF;
+	}
+}
+
+
+static void _write_bgzf_block(FILE *f, const char *data, size_t len)
+{
+	size_t cap = compressBound(len) + 64;
+	unsigned char *blk = malloc(cap + 26);
+	unsigned char hdr[18] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0,
+	                         'B', 'C', 2, 0, 0, 0
+	                        };
+	z_stream zs;
+	memset(&zs, 0, sizeof(z_stream));
+	deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+	             Z_DEFAULT_STRATEGY);
+	zs.next_in = (unsigned char *)data;
+	zs.avail_in = len;
+	zs.next_out = blk + 18;
+	zs.avail_out = cap;
+	deflate(&zs, Z_FINISH);
+	size_t clen = zs.total_out;
+	deflateEnd(&zs);
+	memcpy(blk, hdr, 18);
+	_write_le(blk + 16, 18 + clen + 8 - 1, 2);
+	_write_le(blk + 18 + clen, crc32(0, (unsigned char *)data, len), 4);
+	_write_le(blk + 18 + clen + 4, len, 4);
+	fwrite(blk, 1, 18 + clen + 8, f);
+	free(blk);
+}
+
+
+static void _write_bgzf(const char *path, const char *data, size_t len,
+                        size_t bsize)
+{
+	FILE *f = fopen(path, "wb");
+	for (size_t i = 0; i < len; i += bsize) {
+		_write_bgzf_block(f, data + i, MIN(bsize, len - i));
+	}
+	_write_bgzf_block(f, NULL, 0);
+	fclose(f);
+}
+
+
+// reads the file in chunks, releasing the chars before the last one,
+// and checks the offsets of the kept chars by seeking back to them
+static void _check_release(CuTest *tc, const char *path, const char *content,
+                           size_t len, size_t bsize)
+{
+	zfile *zf = zfile_open(path);
+	CuAssertPtrNotNull(tc, zf);
+	size_t chunk = 3000, nchunks = len / chunk + 1;
+	char *dest = malloc(chunk);
+	uint64_t *voffs = calloc(nchunks, sizeof(uint64_t));
+	uint64_t voff, prev = 0;
+	for (size_t k = 0; zfile_read(zf, dest, chunk) > 0; k++) {
+		zfile_release(zf, prev);
+		CuAssertTrue(tc, zfile_voffset(zf, prev, voffs + k));
+		CuAssertTrue(tc, prev < bsize || !zfile_voffset(zf, 0, &voff));
+		prev = zfile_tell(zf);
+	}
+	for (size_t k = 0; k < nchunks; k += 5) {
+		size_t upos = k * chunk;
+		CuAssertTrue(tc, zfile_seek(zf, voffs[k]));
+		size_t n = zfile_read(zf, dest, chunk);
+		CuAssertSizeTEquals(tc, MIN(chunk, len - upos), n);
+		CuAssertIntEquals(tc, 0, memcmp(content + upos, dest, n));
+	}
+	zfile_close(zf);
+	free(voffs);
+	free(dest);
+}
+
+
+void test_zfile_gzip(CuTest *tc)
+{
+	size_t nlines = 40000;
+	char *content = _lines(nlines);
+	size_t len = strlen(content);
+	for (size_t nmembers = 1; nmembers <= 3; nmembers += 2) {
+		_write_gzip(gz_path, content, len, nmembers);
+		CuAssertIntEquals(tc, ZFILE_GZIP, zfile_detect(gz_path));
+		_check_reads(tc, gz_path, content, len);
+		strfilereader *sfr = strfilereader_new_from_path(gz_path);
+		uint64_t voff;
+		CuAssertTrue(tc, !strfilereader_tell(sfr, &voff));
+		size_t l, n = 0;
+		for (const char *span; (span = strfilereader_read_span(sfr, 4096, &l)); n += l) {
+			CuAssertIntEquals(tc, 0, memcmp(content + n, span, l));
+		}
+		CuAssertSizeTEquals(tc, len, n);
+		strfilereader_free(sfr);
+	}
+	remove(gz_path);
+	FREE(content);
+}
+
+
+void test_zfile_bgzf(CuTest *tc)
+{
+	size_t nlines = 20000;
+	char *content = _lines(nlines);
+	size_t len = strlen(content);
+	size_t bsizes[3] = {1000, 50000, 1 << 16};
+	for (size_t i = 0; i < 3; i++) {
+		_write_bgzf(bgzf_path, content, len, bsizes[i]);
+		CuAssertIntEquals(tc, ZFILE_BGZF, zfile_detect(bgzf_path));
+		_check_reads(tc, bgzf_path, content, len);
+		_check_seeks(tc, bgzf_path, content, nlines);
+		_check_release(tc, bgzf_path, content, len, bsizes[i]);
+	}
+	remove(bgzf_path);
+	FREE(content);
+}
+
+
+void test_zfile_truncated(CuTest *tc)
+{
+	size_t nlines = 2000;
+	char *content = _lines(nlines);
+	size_t len = strlen(content);
+	char *paths[2] = {gz_path, bgzf_path};
+	_write_gzip(gz_path, content, len, 1);
+	_write_bgzf(bgzf_path, content, len, 1000);
+	char *dest = malloc(len);
+	for (size_t i = 0; i < 2; i++) {
+		FILE *f = fopen(paths[i], "rb");
+		fseek(f, 0, SEEK_END);
+		long size = ftell(f);
+		rewind(f);
+		char *cdata = malloc(size);
+		CuAssertTrue(tc, fread(cdata, 1, size, f) == (size_t)size);
+		fclose(f);
+		_write_plain(paths[i], cdata, size / 2);
+		zfile *zf = zfile_open(paths[i]);
+		size_t n = zfile_read(zf, dest, len);
+		CuAssertTrue(tc, n < len);
+		CuAssertIntEquals(tc, 0, memcmp(content, dest, n));
+		CuAssertSizeTEquals(tc, 0, zfile_read(zf, dest, len));
+		zfile_close(zf);
+		remove(paths[i]);
+		free(cdata);
+	}
+	free(dest);
+	FREE(content);
+}
+
+#endif
+
+
+CuSuite *zfile_get_test_suite()
+{
+	CuSuite *suite = CuSuiteNew();
+	SUITE_ADD_TEST(suite, test_zfile_plain);
+#ifdef HAVE_ZLIB
+	SUITE_ADD_TEST(suite, test_zfile_gzip);
+	SUITE_ADD_TEST(suite, test_zfile_bgzf);
+	SUITE_ADD_TEST(suite, test_zfile_truncated);
+#endif
+	return suite;
+}
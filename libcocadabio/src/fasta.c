@@ -19,97 +19,174 @@
  *
  */
 
-#include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "arrays.h"
 #include "cstrutil.h"
 #include "fasta.h"
+#include "fastaidx.h"
+#include "mathutil.h"
 #include "new.h"
+#include "strfilereader.h"
 #include "strread.h"
 #include "trait.h"
 #include "errlog.h"
+#include "zfile.h"
+
 
 typedef struct _fastaread {
 	strread _t_strread;
-	FILE *src;
-	size_t file_pos;
+	fasta *owner;
+	size_t seq_offset;
 } fastaread;
 
 
 IMPL_TRAIT(fastaread, strread)
 
 
+struct _fasta {
+	strfilereader *src;
+	char *src_path;
+	bool bol; // whether the cursor is at the beginning of a line
+	fasta_rec cur_rec;
+	size_t cur_rec_len[2];
+	fastaread rd;
+	fasta_rec_rdr cur_rec_rd;
+	size_t cur_rec_rd_len;
+	fasta_span *batch;
+	size_t batch_len;
+	char *arena; // compacted multi-line sequences of the batch
+	size_t arena_len;
+	fastaidx *idx;
+	int fd; // for random access
+};
+
+
+static void _reserve(char **str, size_t *cap, size_t len)
+{
+	if (len > *cap) {
+		*cap = MAX(len, 2 * (*cap));
+		*str = realloc(*str, *cap + 1);
+	}
+}
+
+
+/*
+ * Compacts the sequence chars in src[0..n) into dest, skipping line
+ * breaks, up to dmax chars. Stops before a '>' at the beginning of a
+ * line, setting *stop. *bol tells whether src starts a line, and is
+ * updated accordingly.
+ * Returns the number of chars of src consumed, with the number of chars
+ * written to dest in *dlen.
+ */
+static size_t _compact(const char *src, size_t n, char *dest, size_t dmax,
+                       size_t *dlen, bool *bol, bool *stop)
+{
+	size_t i = 0, d = 0;
+	*stop = false;
+	while (i < n && d < dmax) {
+		if (*bol && src[i] == '>') {
+			*stop = true;
+			break;
+		}
+		const char *nl = memchr(src + i, '\n', n - i);
+		size_t e = nl ? (size_t)(nl - src) : n;
+		const char *cr = memchr(src + i, '\r', e - i);
+		e = cr ? (size_t)(cr - src) : e;
+		size_t l = MIN(e - i, dmax - d);
+		memcpy(dest + d, src + i, l);
+		d += l;
+		i += l;
+		*bol = *bol && l == 0;
+		if (i == e && i < n) {
+			*bol = (src[i] == '\n');
+			i++;
+		}
+	}
+	*dlen = d;
+	return i;
+}
+
+
+static size_t _offset(fasta *self)
+{
+	uint64_t voff;
+	return strfilereader_tell(self->src, &voff)
+	       ? (size_t)voff
+	       : strfilereader_pos(self->src);
+}
+
+
 static void _reset(strread *self)
 {
 	fastaread *fr = (fastaread *)self->impltor;
-	fseek(fr->src, fr->file_pos, SEEK_SET);
+	if (!strfilereader_seek(fr->owner->src, fr->seq_offset)) {
+		WARN("Unable to reset sequence reader of %s.\n", fr->owner->src_path);
+		return;
+	}
+	fr->owner->bol = true;
 }
 
 
 static int _getc(strread *self)
 {
-	fastaread *fr = (fastaread *)self->impltor;
-	int c;
-	while (true) {
-		c = fgetc(fr->src);
-		if (c=='>') {
-			ungetc(c, fr->src);
-			c = EOF;
+	fasta *f = ((fastaread *)self->impltor)->owner;
+	const char *p;
+	size_t n;
+	while ((p = strfilereader_peek(f->src, 1, &n)) != NULL) {
+		char c = p[0];
+		if (f->bol && c == '>') {
 			break;
 		}
-		else if (c=='\n'|| c=='\r') {
-			continue;
+		strfilereader_skip(f->src, 1);
+		if (c == '\n') {
+			f->bol = true;
 		}
-		else {
-			break;
+		else if (c != '\r') {
+			f->bol = false;
+			return (unsigned char)c;
 		}
 	}
-	return c;
+	return EOF;
 }
 
 
 static size_t _read_str(strread *self, char *dest, size_t n)
 {
-	FILE *src = ((fastaread *)self->impltor)->src;
-	char *origdest = dest;
-	memset(dest, '\0', n+1);
-	while ( !feof(src) && n > 0 ) {
-		fgets(dest, n+1, src);
-		size_t l = strlen(dest);
-		if (dest[0] == '>') {
-			memset(dest, '\0', l );
-			break;
-		}
-		while (l > 0 && ( dest[l-1]=='\n' || dest[l-1]=='\r' )) {
-			dest[l-1] = '\0';
-			l--;
-		}
-		dest += l;
-		n -= l;
+	fasta *f = ((fastaread *)self->impltor)->owner;
+	size_t nread = 0, l, d;
+	bool stop = false;
+	const char *p;
+	while (!stop && nread < n && (p = strfilereader_peek(f->src, 1, &l)) != NULL) {
+		l = _compact(p, l, dest + nread, n - nread, &d, &f->bol, &stop);
+		strfilereader_skip(f->src, l);
+		nread += d;
 	}
-	return dest-origdest;
+	dest[nread] = '\0';
+	return nread;
 }
 
 
 static size_t _read_str_until(strread *self, char *dest, char delim)
 {
-	FILE *src = ((fastaread *)self->impltor)->src;
-	size_t nread = 0;
-	char c;
-	while ( !feof(src) ) {
-		c = fgetc(src);
-		if ( c == delim || c == '>' ) {
-			ungetc(c, src);
-			break;
-		}
-		else if ( c == '\n' || c=='\r' ) {
-			continue;
-		}
-		dest[nread++] = c;
+	fasta *f = ((fastaread *)self->impltor)->owner;
+	size_t nread = 0, l, d;
+	bool stop = false;
+	const char *p;
+	while (!stop && (p = strfilereader_peek(f->src, 1, &l)) != NULL) {
+		const char *lim = memchr(p, delim, l);
+		size_t m = lim ? (size_t)(lim - p) : l;
+		l = _compact(p, m, dest + nread, SIZE_MAX, &d, &f->bol, &stop);
+		strfilereader_skip(f->src, l);
+		nread += d;
+		stop = stop || lim != NULL;
 	}
 	dest[nread] = '\0';
 	return nread;
@@ -124,54 +201,46 @@ static strread_vt _strread_vt  = {
 };
 
 
-static void _fastaread_init(fastaread *fr, FILE *src)
+static void _fastaread_init(fastaread *fr, fasta *owner)
 {
-
-	fr->src = src;
+	fr->owner = owner;
+	fr->seq_offset = 0;
 	fr->_t_strread.impltor = fr;
 	fr->_t_strread.vt = &_strread_vt;
 }
 
 
-
-struct _fasta {
-	FILE *src;
-	char *src_path;
-	fasta_rec cur_rec;
-	size_t cur_rec_len[2];
-	fastaread rd;
-	fasta_rec_rdr cur_rec_rd;
-	size_t cur_rec_rd_len[2];
-};
-
-
 rawptr_ok_err_res fasta_open(const char *filename)
 {
 	rawptr_ok_err_res result = {.ok = true};
-	fasta *f = NEW(fasta);
-	f->src = fopen(filename, "r");
-	if (errno) {
-		fprintf(stderr, "Error opening FASTA '%s'.\n", filename);
+	errno = 0;
+	strfilereader *src = strfilereader_new_from_path(filename);
+	if (!src) {
+		WARN("Error opening FASTA '%s'.\n", filename);
+		int code = errno ? errno : EIO;
 		result.ok = false;
-		result.val.err = (code_msg_err){.code = errno, .msg = strerror(errno)};
-		goto ERROR;
+		result.val.err = (code_msg_err) {.code = code, .msg = strerror(code)};
+		return result;
 	}
+	fasta *f = NEW(fasta);
+	f->src = src;
 	f->src_path = cstr_clone(filename);
-	_fastaread_init(&(f->rd), f->src);
+	f->bol = true;
+	_fastaread_init(&(f->rd), f);
 	f->cur_rec_len[0] = f->cur_rec_len[1] = 100;
-	f->cur_rec_rd_len[0] = f->cur_rec_rd_len[1] = 100;
+	f->cur_rec_rd_len = 100;
 	f->cur_rec.descr = cstr_new(f->cur_rec_len[0]);
 	f->cur_rec.seq = cstr_new(f->cur_rec_len[1]);
-	f->cur_rec_rd.descr = cstr_new(f->cur_rec_rd_len[0]);
+	f->cur_rec_rd.descr = cstr_new(f->cur_rec_rd_len);
 	f->cur_rec_rd.seqrdr = fastaread_as_strread(&(f->rd));
-	goto SUCCESS;
-ERROR:
-	FREE(f);
-	f = NULL;
-SUCCESS:
-	result.ok = true;
+	f->batch = NULL;
+	f->batch_len = 0;
+	f->arena = NULL;
+	f->arena_len = 0;
+	f->idx = NULL;
+	f->fd = -1;
 	result.val.ok = f;
-	return result; 
+	return result;
 }
 
 
@@ -183,12 +252,15 @@ const char *fasta_path(fasta *self)
 
 static bool _goto_next(fasta *self)
 {
-	int c;
-	while (!feof(self->src)) {
-		if ((c=fgetc(self->src)) == '>') {
-			ungetc(c, self->src);
+	const char *p;
+	size_t n;
+	while ((p = strfilereader_peek(self->src, 1, &n)) != NULL) {
+		if (self->bol && p[0] == '>') {
 			return true;
 		}
+		const char *nl = memchr(p, '\n', n);
+		strfilereader_skip(self->src, nl ? (size_t)(nl - p) + 1 : n);
+		self->bol = (nl != NULL);
 	}
 	return false;
 }
@@ -196,23 +268,51 @@ static bool _goto_next(fasta *self)
 
 bool fasta_has_next(fasta *self)
 {
-	long cur = ftell(self->src);
-	bool ret = _goto_next(self);
-	fseek(self->src, cur, SEEK_SET);
-	return ret;
+	return _goto_next(self);
 }
 
 
 bool fasta_goto(fasta *self, size_t descr_offset)
 {
-	return ((fseek(self->src, descr_offset, SEEK_SET)==0) &&
-			 _goto_next(self));
+	if (!strfilereader_seek(self->src, descr_offset)) {
+		return false;
+	}
+	self->bol = true;
+	return _goto_next(self);
 }
 
 
 void fasta_rewind(fasta *self)
 {
-	rewind(self->src);
+	strread_reset(strfilereader_as_strread(self->src));
+	self->bol = true;
+}
+
+
+/*
+ * Loads the remainder of the current line into the growable string
+ * *line, consuming the line break.
+ */
+static void _load_line(fasta *self, char **line, size_t *cap)
+{
+	size_t len = 0, n;
+	const char *p;
+	while ((p = strfilereader_peek(self->src, 1, &n)) != NULL) {
+		const char *nl = memchr(p, '\n', n);
+		size_t l = nl ? (size_t)(nl - p) : n;
+		_reserve(line, cap, len + l);
+		memcpy(*line + len, p, l);
+		len += l;
+		strfilereader_skip(self->src, nl ? l + 1 : l);
+		if (nl) {
+			break;
+		}
+	}
+	if (len > 0 && (*line)[len - 1] == '\r') {
+		len--;
+	}
+	(*line)[len] = '\0';
+	self->bol = true;
 }
 
 
@@ -222,46 +322,21 @@ const fasta_rec *fasta_next(fasta *self)
 		return NULL;
 	}
 	// load description
-	self->cur_rec.descr_offset = ftell(self->src);
-	ERROR_ASSERT(fgetc(self->src) == '>',
-	             "Expected '>' at position %ld of %s.\n", self->cur_rec.descr_offset,
-	             self->src_path );
-	cstr_clear(self->cur_rec.descr, self->cur_rec_len[0]);
-	size_t l = 0;
-	bool eol = false;
-	while (!eol) {
-		if (self->cur_rec_len[0] == l) {
-			self->cur_rec_len[0] *= 1.66f;
-			self->cur_rec.descr = cstr_resize(self->cur_rec.descr, self->cur_rec_len[0]);
-		}
-		fgets(self->cur_rec.descr + l, self->cur_rec_len[0] - l + 1, self->src);
-		l = strlen(self->cur_rec.descr);
-		while (self->cur_rec.descr[l-1]=='\n' || self->cur_rec.descr[l-1]=='\r') {
-			self->cur_rec.descr[--l] = '\0';
-			eol = true;
-		}
-	}
+	self->cur_rec.descr_offset = _offset(self);
+	strfilereader_skip(self->src, 1);
+	_load_line(self, &self->cur_rec.descr, &self->cur_rec_len[0]);
 	// load sequence
-	self->cur_rec.seq_offset = ftell(self->src);
-	cstr_clear(self->cur_rec.seq, self->cur_rec_len[1]);
-	l = 0;
-	while ( !feof(self->src) ) {
-		if (self->cur_rec_len[1] == l) {
-			self->cur_rec_len[1] *= 1.66f;
-			//(size_t)(1.66f * self->cur_rec_len[1]);
-			self->cur_rec.seq = cstr_resize(self->cur_rec.seq, self->cur_rec_len[1]);
-		}
-		fgets(self->cur_rec.seq + l, self->cur_rec_len[1] - l + 1, self->src);
-		if (self->cur_rec.seq[l] == '>') {
-			fseek(self->src, l - strlen(self->cur_rec.seq), SEEK_CUR);
-			self->cur_rec.seq[l] = '\0';
-			break;
-		}
-		l = strlen(self->cur_rec.seq);
-		while (self->cur_rec.seq[l-1]=='\n' || self->cur_rec.seq[l-1]=='\r') {
-			self->cur_rec.seq[--l] = '\0';
-		}
+	self->cur_rec.seq_offset = _offset(self);
+	size_t len = 0, n, d;
+	bool stop = false;
+	const char *p;
+	while (!stop && (p = strfilereader_peek(self->src, 1, &n)) != NULL) {
+		_reserve(&self->cur_rec.seq, &self->cur_rec_len[1], len + n);
+		n = _compact(p, n, self->cur_rec.seq + len, n, &d, &self->bol, &stop);
+		strfilereader_skip(self->src, n);
+		len += d;
 	}
+	self->cur_rec.seq[len] = '\0';
 	return &(self->cur_rec);
 }
 
@@ -272,40 +347,201 @@ const fasta_rec_rdr *fasta_next_reader(fasta *self)
 		return NULL;
 	}
 	// load description
-	self->cur_rec_rd.descr_offset = ftell(self->src);
-	ERROR_ASSERT(fgetc(self->src) == '>',
-	             "Expected '>' at position %ld of %s.\n", self->cur_rec_rd.descr_offset,
-	             self->src_path );
-	cstr_clear(self->cur_rec_rd.descr, self->cur_rec_rd_len[0]);
-	size_t l = 0;
-	bool eol = false;
-	while (!eol) {
-		if (self->cur_rec_rd_len[0] == l) {
-			self->cur_rec_rd_len[0] *= 1.66f;
-			//(size_t)(1.66f * self->cur_rec_rd_len[0]);
-			self->cur_rec_rd.descr = cstr_resize(self->cur_rec_rd.descr,
-			                                     self->cur_rec_rd_len[0]);
+	self->cur_rec_rd.descr_offset = _offset(self);
+	strfilereader_skip(self->src, 1);
+	_load_line(self, &self->cur_rec_rd.descr, &self->cur_rec_rd_len);
+	// load sequence reader
+	self->cur_rec_rd.seq_offset = _offset(self);
+	self->rd.seq_offset = self->cur_rec_rd.seq_offset;
+	return &(self->cur_rec_rd);
+}
+
+
+/*
+ * Parses the record at the start of src[0..n), which begins with '>'.
+ * Multi-line sequences are compacted into arena.
+ * If the record is not complete in src and more chars may follow
+ * (!last), returns 0. Otherwise returns the length of the record,
+ * with the length of the description line, line break included,
+ * in *dlen.
+ */
+static size_t _parse_span(const char *src, size_t n, bool last,
+                          char *arena, fasta_span *rec, size_t *dlen)
+{
+	const char *nl = memchr(src, '\n', n);
+	if (!nl && !last) {
+		return 0;
+	}
+	size_t dend = nl ? (size_t)(nl - src) : n;
+	rec->descr = src + 1;
+	rec->descr_len = dend - 1 - (dend > 1 && src[dend - 1] == '\r');
+	*dlen = MIN(dend + 1, n);
+	const char *s = src + *dlen;
+	size_t sn = n - *dlen;
+	rec->seq = s;
+	rec->seq_len = 0;
+	if (sn == 0) {
+		return last ? n : 0;
+	}
+	if (s[0] == '>') {
+		return *dlen;
+	}
+	// single-line sequence, referred to in place
+	const char *snl = memchr(s, '\n', sn);
+	size_t send = snl ? (size_t)(snl - s) : sn;
+	if (send + 1 >= sn && !last) {
+		return 0;
+	}
+	if (send + 1 >= sn || s[send + 1] == '>') {
+		rec->seq_len = send - (send > 0 && s[send - 1] == '\r');
+		return *dlen + MIN(send + 1, sn);
+	}
+	// multi-line sequence
+	bool bol = true, stop;
+	size_t l = _compact(s, sn, arena, SIZE_MAX, &rec->seq_len, &bol, &stop);
+	if (!stop && !last) {
+		return 0;
+	}
+	rec->seq = arena;
+	return *dlen + l;
+}
+
+
+size_t fasta_next_batch(fasta *self, size_t max, const fasta_span **recs)
+{
+	if (max > self->batch_len) {
+		FREE(self->batch);
+		self->batch = ARR_NEW(fasta_span, max);
+		self->batch_len = max;
+	}
+	*recs = self->batch;
+	if (!_goto_next(self)) {
+		return 0;
+	}
+	size_t avail, nrecs = 0, i = 0, alen = 0;
+	bool last = false;
+	const char *p = strfilereader_peek(self->src, 1, &avail);
+	while (nrecs < max && i < avail) {
+		// the compacted sequences are no longer than the buffered chars
+		_reserve(&self->arena, &self->arena_len, avail);
+		fasta_span *rec = self->batch + nrecs;
+		size_t dlen, l = _parse_span(p + i, avail - i, last, self->arena + alen,
+		                             rec, &dlen);
+		if (l == 0) {
+			if (nrecs > 0) {
+				break;
+			}
+			// record larger than the buffered chars
+			size_t had = avail;
+			p = strfilereader_peek(self->src, avail + 1, &avail);
+			last = (avail == had);
+			continue;
 		}
-		fgets(self->cur_rec_rd.descr + l, self->cur_rec_rd_len[0] - l + 1, self->src);
-		l = strlen(self->cur_rec_rd.descr);
-		while (self->cur_rec_rd.descr[l-1]=='\n' || self->cur_rec_rd.descr[l-1]=='\r') {
-			self->cur_rec_rd.descr[--l] = '\0';
-			eol = true;
+		if (rec->seq == self->arena + alen) {
+			alen += rec->seq_len;
 		}
+		rec->descr_offset = _offset(self);
+		strfilereader_skip(self->src, dlen);
+		rec->seq_offset = _offset(self);
+		strfilereader_skip(self->src, l - dlen);
+		self->bol = (p[i + l - 1] == '\n');
+		i += l;
+		nrecs++;
 	}
-	// load sequence reader
-	self->cur_rec_rd.seq_offset = ftell(self->src);
-	self->rd.file_pos = ftell(self->src);
-	return &(self->cur_rec_rd);
+	return nrecs;
+}
+
+
+fastaidx *fasta_index(fasta *self)
+{
+	if (self->idx) {
+		return self->idx;
+	}
+	char *fai_path = cstr_new(strlen(self->src_path) + 4);
+	sprintf(fai_path, "%s.fai", self->src_path);
+	if (access(fai_path, R_OK) == 0) {
+		self->idx = fastaidx_load(self->src_path, fai_path);
+	}
+	if (!self->idx) {
+		self->idx = fastaidx_build(self->src_path);
+		if (self->idx) {
+			fastaidx_save(self->idx, fai_path);
+		}
+	}
+	FREE(fai_path);
+	return self->idx;
+}
+
+
+char *fasta_fetch(fasta *self, const char *name, size_t start, size_t end)
+{
+	size_t rec_no;
+	fastaidx *idx = fasta_index(self);
+	if (!idx || !fastaidx_find(idx, name, &rec_no)) {
+		WARN("No sequence '%s' in %s.\n", name, self->src_path);
+		return NULL;
+	}
+	if (self->fd < 0) {
+		if (zfile_detect(self->src_path) != ZFILE_PLAIN) {
+			WARN("Cannot fetch from compressed file %s.\n", self->src_path);
+			return NULL;
+		}
+		self->fd = open(self->src_path, O_RDONLY);
+		if (self->fd < 0) {
+			WARN("Unable to open %s.\n", self->src_path);
+			return NULL;
+		}
+	}
+	fasta_rec_offs offs = fastaidx_get(idx, rec_no);
+	end = MIN(end, offs.len);
+	if (start > end) {
+		return NULL;
+	}
+	if (start == end) {
+		return cstr_new(0);
+	}
+	// read the bytes of the region at once, and squeeze the line breaks
+	// out, whose positions are given by the line layout
+	size_t from = fastaidx_offset(idx, rec_no, start);
+	size_t nbytes = fastaidx_offset(idx, rec_no, end - 1) + 1 - from;
+	char *ret = cstr_new(nbytes);
+	for (size_t nread = 0; nread < nbytes; ) {
+		ssize_t r = pread(self->fd, ret + nread, nbytes - nread, from + nread);
+		if (r <= 0) {
+			WARN("Unable to read %s.\n", self->src_path);
+			FREE(ret);
+			return NULL;
+		}
+		nread += r;
+	}
+	size_t eol = offs.line_bytes - offs.line_bases;
+	size_t i = 0, len = 0, l = offs.line_bases - (start % offs.line_bases);
+	while (len < end - start) {
+		l = MIN(l, end - start - len);
+		memmove(ret + len, ret + i, l);
+		len += l;
+		i += l + eol;
+		l = offs.line_bases;
+	}
+	ret[len] = '\0';
+	return ret;
 }
 
 
 void fasta_close(fasta *self)
 {
-	fclose(self->src);
+	strfilereader_free(self->src);
 	FREE(self->src_path);
 	FREE(self->cur_rec.descr);
 	FREE(self->cur_rec.seq);
 	FREE(self->cur_rec_rd.descr);
+	FREE(self->batch);
+	FREE(self->arena);
+	if (self->idx) {
+		fastaidx_free(self->idx);
+	}
+	if (self->fd >= 0) {
+		close(self->fd);
+	}
 	FREE(self);
-}
\ No newline at end of file
+}
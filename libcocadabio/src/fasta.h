@@ -23,6 +23,7 @@
 
 #include <stdbool.h>
 
+#include "fastaidx.h"
 #include "result.h"
 #include "strread.h"
 
@@ -39,6 +40,19 @@
  * memory as a string, or be treated as a char input stream with a
  * buffered string reader (::strread), which avoids having to load
  * potentially large sequences fully into memory.
+ *
+ * The file is parsed in large blocks: records and line breaks are
+ * located with `memchr` directly inside the buffer of the underlying
+ * ::strfilereader, and multi-line sequences are compacted by copying
+ * whole lines at a time. Compressed files (gzip, BGZF and zstd) are
+ * read transparently, in which case the record offsets are virtual
+ * offsets as defined in zfile.h. Offsets in gzip and zstd files are
+ * positions in the decompressed stream and cannot be used with
+ * fasta_goto().
+ *
+ * Sets of small records, as typical of sequencing reads, can be
+ * retrieved in batches with fasta_next_batch(), which refers to the
+ * records in place, without copying them when possible.
  */
 
 
@@ -70,6 +84,20 @@ typedef struct {
 } fasta_rec_rdr;
 
 
+/**
+ * @brief A FASTA record referred to as spans of chars.
+ * The spans are not null-terminated.
+ */
+typedef struct {
+	const char *descr;		/**< Sequence descriptor (does not include the `>`) */
+	size_t descr_len;		/**< Descriptor length */
+	const char *seq;		/**< Sequence content, without line breaks */
+	size_t seq_len;			/**< Sequence length */
+	size_t descr_offset;	/**< Descriptor offset from the start of the file **/
+	size_t seq_offset;		/**< Sequence offset from the start of the file **/
+} fasta_span;
+
+
 
 /**
  * @brief Opens a FASTA file and places the cursor at its beginning.
@@ -85,7 +113,10 @@ const char *fasta_path(fasta *self);
 
 /**
  * @brief Checks whether there is a sequence *after* the current
- * cursor position
+ * cursor position.
+ * The cursor is advanced to the beginning of that sequence, so the
+ * remainder of the sequence of the last record returned by
+ * fasta_next_reader() can no longer be read.
  */
 bool fasta_has_next(fasta *self);
 
@@ -152,6 +183,61 @@ const fasta_rec_rdr *fasta_next_reader(fasta *self);
 const fasta_rec *fasta_next(fasta *self);
 
 
+/**
+ * @brief Advances the cursor over a batch of up to @p max records.
+ * The records are parsed directly from the file buffer: descriptions
+ * and single-line sequences point into the buffer, whereas multi-line
+ * sequences are compacted into an internal buffer.
+ * A batch comprises the records that fit in the current buffer, thus
+ * fewer than @p max records can be returned before the end of the file.
+ *
+ * Example
+ * -------
+ *
+ * ```C
+ * const fasta_span *recs;
+ * for (size_t n; (n = fasta_next_batch(fr, 1024, &recs)) > 0; ) {
+ *     for (size_t i = 0; i < n; i++) {
+ *         // do something with recs[i].seq[0..recs[i].seq_len)
+ *     }
+ * }
+ * ```
+ * @param recs (out) The array of records of the batch.
+ * @returns The number of records in the batch, 0 at the end of the file.
+ * @warning The records are only valid until the next operation on the
+ * reader, and should *not* be modified or destroyed directly.
+ */
+size_t fasta_next_batch(fasta *self, size_t max, const fasta_span **recs);
+
+
+/**
+ * @brief Returns the index of the file, which is loaded on the first
+ * call from the `.fai` file with the same path plus the `.fai` extension,
+ * as samtools does. If there is no such file, the index is built and
+ * saved to it.
+ * @returns NULL if the index cannot be built.
+ * @warning The index belongs to the reader and should *not* be modified
+ * or destroyed directly.
+ * @see fastaidx.h
+ */
+fastaidx *fasta_index(fasta *self);
+
+
+/**
+ * @brief Fetches the chars [@p start, @p end) of the sequence
+ * named @p name, i.e. the first word of its description.
+ * The byte offsets of the region are computed from the index
+ * (see fasta_index()), and the region is read directly from the file,
+ * without scanning the sequence.
+ * Positions past the end of the sequence are ignored.
+ * @returns A newly allocated string with the region (**TRANSFER OF
+ * OWNERSHIP**), or NULL if there is no sequence with that name,
+ * @p start > @p end, or the file is compressed, in which case no
+ * random access is possible.
+ */
+char *fasta_fetch(fasta *self, const char *name, size_t start, size_t end);
+
+
 /**
  * @brief Destructor. Closes the reader and releases used resources
  */
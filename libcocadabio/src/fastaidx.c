@@ -19,25 +19,49 @@
  *
  */
 
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "errlog.h"
 #include "fastaidx.h"
 #include "cstrutil.h"
+#include "hash.h"
+#include "hashmap.h"
 #include "new.h"
+#include "strfilereader.h"
 #include "vec.h"
 
 
 struct _fastaidx {
 	char *path;
-	vec *dscs;
-	vec *seqs;
+	vec *recs;		// fasta_rec_offs
+	vec *names;		// cstr, NULL for unnamed records
+	hashmap *ids;	// name -> record number
 };
 
 
+static uint64_t _hash_str(const void *ptr)
+{
+	char *s = *((char **)ptr);
+	return fnv1a_64bit_hash(s, strlen((char *)s));
+}
+
+
+static bool _str_eq(const void *s1, const void *s2)
+{
+	return strcmp(*((char **)s1), *((char **)s2))==0;
+}
+
+
 fastaidx *fastaidx_new(const char *src_path)
 {
 	fastaidx *ret = NEW(fastaidx);
 	ret->path = cstr_clone(src_path);
-	ret->dscs = vec_new(sizeof(size_t));
-	ret->seqs = vec_new(sizeof(size_t));
+	ret->recs = vec_new(sizeof(fasta_rec_offs));
+	ret->names = vec_new(sizeof(char *));
+	ret->ids = hashmap_new(sizeof(char *), sizeof(size_t), _hash_str, _str_eq);
 	return ret;
 }
 
@@ -46,8 +70,12 @@ void fastaidx_finalise(void *ptr, const finaliser *fnr)
 {
 	fastaidx *self = (fastaidx *)ptr;
 	FREE(self->path);
-	DESTROY_FLAT(self->dscs, vec);
-	DESTROY_FLAT(self->seqs, vec);
+	for (size_t i = 0, l = vec_len(self->names); i < l; i++) {
+		FREE(vec_get_cstr(self->names, i));
+	}
+	DESTROY_FLAT(self->recs, vec);
+	DESTROY_FLAT(self->names, vec);
+	DESTROY_FLAT(self->ids, hashmap);
 }
 
 
@@ -57,23 +85,216 @@ void fastaidx_free(fastaidx *self)
 }
 
 
+const char *fastaidx_path(fastaidx *self)
+{
+	return self->path;
+}
+
+
 size_t fastaidx_size(fastaidx *self)
 {
-	return vec_len(self->dscs);
+	return vec_len(self->recs);
 }
 
 
 void fastaidx_add(fastaidx *self, size_t dsc_offset, size_t seq_offset)
 {
-	vec_push_size_t(self->dscs, dsc_offset);
-	vec_push_size_t(self->seqs, seq_offset);
+	fasta_rec_offs offs = {.descr_off = dsc_offset, .seq_off = seq_offset};
+	vec_push(self->recs, &offs);
+	vec_push_cstr(self->names, NULL);
+}
+
+
+void fastaidx_add_rec(fastaidx *self, const char *name, fasta_rec_offs offs)
+{
+	char *nm = cstr_clone(name);
+	size_t rec_no = vec_len(self->recs);
+	vec_push(self->recs, &offs);
+	vec_push_cstr(self->names, nm);
+	if (hashmap_contains(self->ids, &nm)) {
+		WARN("Duplicate sequence name '%s' in %s.\n", nm, self->path);
+		return;
+	}
+	hashmap_ins(self->ids, &nm, &rec_no);
 }
 
 
 fasta_rec_offs fastaidx_get(fastaidx *self, size_t rec_no)
 {
-	fasta_rec_offs ret;
-	ret.descr_off = vec_get_size_t(self->dscs, rec_no);
-	ret.seq_off = vec_get_size_t(self->seqs, rec_no);
+	return *((fasta_rec_offs *)vec_get(self->recs, rec_no));
+}
+
+
+const char *fastaidx_name(fastaidx *self, size_t rec_no)
+{
+	return vec_get_cstr(self->names, rec_no);
+}
+
+
+bool fastaidx_find(fastaidx *self, const char *name, size_t *rec_no)
+{
+	const size_t *r = (const size_t *)hashmap_get(self->ids, &name);
+	if (r) {
+		*rec_no = *r;
+	}
+	return r != NULL;
+}
+
+
+size_t fastaidx_offset(fastaidx *self, size_t rec_no, size_t pos)
+{
+	const fasta_rec_offs *offs = (const fasta_rec_offs *)vec_get(self->recs,
+	                             rec_no);
+	if (offs->line_bases == 0) {
+		return offs->seq_off;
+	}
+	return offs->seq_off + (pos / offs->line_bases) * offs->line_bytes
+	       + (pos % offs->line_bases);
+}
+
+
+/*
+ * Consumes the next line, returning its number of chars, without the
+ * line break, with its number of bytes in *bytes.
+ */
+static size_t _skip_line(strfilereader *src, size_t *bytes)
+{
+	size_t len = 0, n;
+	bool cr = false;
+	const char *p;
+	*bytes = 0;
+	while ((p = strfilereader_peek(src, 1, &n)) != NULL) {
+		const char *nl = memchr(p, '\n', n);
+		size_t l = nl ? (size_t)(nl - p) : n;
+		cr = (l > 0) ? p[l - 1] == '\r' : cr;
+		len += l;
+		strfilereader_skip(src, nl ? l + 1 : l);
+		if (nl) {
+			*bytes = len + 1;
+			break;
+		}
+	}
+	if (*bytes == 0) {
+		*bytes = len;
+	}
+	return len - cr;
+}
+
+
+fastaidx *fastaidx_build(const char *src_path)
+{
+	strfilereader *src = strfilereader_new_from_path(src_path);
+	if (!src) {
+		return NULL;
+	}
+	fastaidx *ret = fastaidx_new(src_path);
+	char *name = NULL;
+	fasta_rec_offs offs;
+	// whether the previous line of the sequence was shorter, or empty
+	bool shorter = false, empty = false;
+	const char *p;
+	size_t n, bases, bytes;
+	while ((p = strfilereader_peek(src, 1, &n)) != NULL) {
+		if (p[0] == '>') {
+			if (name) {
+				fastaidx_add_rec(ret, name, offs);
+				FREE(name);
+			}
+			offs.descr_off = strfilereader_pos(src);
+			strfilereader_skip(src, 1);
+			p = strfilereader_read_span_until(src, '\n', &n);
+			size_t l = 0;
+			while (p && l < n && !isspace(p[l])) {
+				l++;
+			}
+			name = cstr_clone_len(p ? p : "", l);
+			strfilereader_read_span(src, 1, &n);
+			offs.seq_off = strfilereader_pos(src);
+			offs.len = offs.line_bases = offs.line_bytes = 0;
+			shorter = empty = false;
+			continue;
+		}
+		bases = _skip_line(src, &bytes);
+		if (!name) {
+			continue;
+		}
+		if (bases == 0) {
+			empty = true;
+			continue;
+		}
+		if (shorter || empty || (offs.line_bases > 0 && bases > offs.line_bases)) {
+			WARN("Different line length in sequence '%s' of %s.\n", name, src_path);
+			FREE(name);
+			fastaidx_free(ret);
+			strfilereader_free(src);
+			return NULL;
+		}
+		if (offs.line_bases == 0) {
+			offs.line_bases = bases;
+			offs.line_bytes = bytes;
+		}
+		// only the last line may be shorter
+		shorter = (bases < offs.line_bases || bytes != offs.line_bytes);
+		offs.len += bases;
+	}
+	if (name) {
+		fastaidx_add_rec(ret, name, offs);
+		FREE(name);
+	}
+	strfilereader_free(src);
+	return ret;
+}
+
+
+fastaidx *fastaidx_load(const char *src_path, const char *fai_path)
+{
+	strfilereader *fai = strfilereader_new_from_path(fai_path);
+	if (!fai) {
+		return NULL;
+	}
+	fastaidx *ret = fastaidx_new(src_path);
+	const char *p;
+	size_t n;
+	while ((p = strfilereader_read_span_until(fai, '\n', &n)) != NULL) {
+		char *line = cstr_clone_len(p, n);
+		char *tab = strchr(line, '\t');
+		fasta_rec_offs offs = {.descr_off = FASTAIDX_NO_OFFSET};
+		// as samtools, non-empty sequences need 0 < line_bases <= line_bytes
+		if (!tab || sscanf(tab, "%zu %zu %zu %zu", &offs.len, &offs.seq_off,
+		                   &offs.line_bases, &offs.line_bytes) != 4
+		        || (offs.len > 0 && (offs.line_bases == 0
+		                             || offs.line_bases > offs.line_bytes))) {
+			WARN("Malformed FASTA index %s.\n", fai_path);
+			FREE(line);
+			fastaidx_free(ret);
+			ret = NULL;
+			break;
+		}
+		*tab = '\0';
+		fastaidx_add_rec(ret, line, offs);
+		FREE(line);
+		strfilereader_read_span(fai, 1, &n);
+	}
+	strfilereader_free(fai);
 	return ret;
-}
\ No newline at end of file
+}
+
+
+bool fastaidx_save(fastaidx *self, const char *fai_path)
+{
+	FILE *fai = fopen(fai_path, "w");
+	if (!fai) {
+		WARN("Unable to write FASTA index %s.\n", fai_path);
+		return false;
+	}
+	for (size_t i = 0, l = vec_len(self->recs); i < l; i++) {
+		const char *name = vec_get_cstr(self->names, i);
+		if (!name) {
+			continue;
+		}
+		fasta_rec_offs offs = fastaidx_get(self, i);
+		fprintf(fai, "%s\t%zu\t%zu\t%zu\t%zu\n", name, offs.len, offs.seq_off,
+		        offs.line_bases, offs.line_bytes);
+	}
+	return fclose(fai) == 0;
+}
@@ -22,6 +22,7 @@
 #ifndef FASTAIDX_H
 #define FASTAIDX_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 #include "new.h"
@@ -30,20 +31,68 @@
  * @file fastaidx.h
  * @brief FASTA file index
  * @author Paulo Fonseca
+ *
+ * Besides the offsets of the records, the index keeps, for each
+ * sequence, its name, i.e. the first word of its description, its
+ * length and its line layout, namely the number of chars per line
+ * and the number of bytes per line, line break included.
+ * As all the lines of a sequence but the last have the same length,
+ * this allows computing the exact file offset of any position of the
+ * sequence (see fasta_fetch()).
+ *
+ * The index can be saved to and loaded from a file in the
+ * samtools `.fai` format, i.e. one line per sequence with the
+ * tab-separated fields NAME, LENGTH, OFFSET (of the sequence),
+ * LINEBASES and LINEWIDTH.
  */
 
 /**
- * @brief
+ * @brief FASTA index type.
  */
 typedef struct _fastaidx fastaidx;
 
 
 /**
- * @brief
+ * @brief Offset value for unknown offsets.
+ */
+#define FASTAIDX_NO_OFFSET ((size_t)-1)
+
+
+/**
+ * @brief Creates an empty index of the FASTA file at @p src_path.
  */
 fastaidx *fastaidx_new(const char *src_path);
 
 
+/**
+ * @brief Builds the index of the FASTA file at @p src_path.
+ * For compressed files, the offsets refer to the decompressed contents.
+ * @returns NULL if the file cannot be read, or if the lines of some
+ * sequence do not have the same length, except for the last one.
+ */
+fastaidx *fastaidx_build(const char *src_path);
+
+
+/**
+ * @brief Loads the index of the FASTA file at @p src_path from the
+ * `.fai` file at @p fai_path.
+ * As `.fai` files do not contain description offsets, these are set to
+ * ::FASTAIDX_NO_OFFSET.
+ * @returns NULL if the file cannot be read or is malformed, including
+ * records of non-empty sequences whose line length in bases is zero or
+ * exceeds the line length in bytes.
+ */
+fastaidx *fastaidx_load(const char *src_path, const char *fai_path);
+
+
+/**
+ * @brief Saves the index to the `.fai` file at @p fai_path.
+ * Records added with fastaidx_add() have no name and are not saved.
+ * @returns Whether the file could be written.
+ */
+bool fastaidx_save(fastaidx *self, const char *fai_path);
+
+
 /**
  * @brief Finaliser
  */
@@ -57,13 +106,20 @@ void fastaidx_free(fastaidx *self);
 
 
 /**
- * @brief
+ * @brief Returns the path of the indexed file.
+ */
+const char *fastaidx_path(fastaidx *self);
+
+
+/**
+ * @brief Returns the number of indexed records.
  */
 size_t fastaidx_size(fastaidx *self);
 
 
 /**
- * @brief
+ * @brief Appends the offsets of the next record. The record has no
+ * name, and unknown length and line layout (all zero).
  */
 void fastaidx_add(fastaidx *self, size_t descr_offset, size_t seq_offset);
 
@@ -73,13 +129,48 @@ void fastaidx_add(fastaidx *self, size_t descr_offset, size_t seq_offset);
  */
 typedef struct {
 	size_t descr_off;	/**< Record description offset. */
-	size_t seq_off;	/**< Record sequence offset. */
+	size_t seq_off;		/**< Record sequence offset. */
+	size_t len;			/**< Sequence length. */
+	size_t line_bases;	/**< Sequence chars per line. */
+	size_t line_bytes;	/**< Bytes per line, including the line break. */
 } fasta_rec_offs;
 
 
 /**
- * @brief Returns the offsets (description, sequence) of the record #@p rec_no.
+ * @brief Appends the next record, with sequence @p name, given by
+ * the description up to the first whitespace.
+ * If a previous record has the same name, this one can only be accessed
+ * by its number.
+ */
+void fastaidx_add_rec(fastaidx *self, const char *name, fasta_rec_offs offs);
+
+
+/**
+ * @brief Returns the offsets (description, sequence) and the layout
+ * of the record #@p rec_no.
  */
 fasta_rec_offs fastaidx_get(fastaidx *self, size_t rec_no);
 
-#endif
\ No newline at end of file
+
+/**
+ * @brief Returns the sequence name of the record #@p rec_no, or NULL
+ * if it has no name.
+ */
+const char *fastaidx_name(fastaidx *self, size_t rec_no);
+
+
+/**
+ * @brief Looks up the record with sequence @p name, storing its
+ * number in @p rec_no.
+ * @returns Whether the record was found.
+ */
+bool fastaidx_find(fastaidx *self, const char *name, size_t *rec_no);
+
+
+/**
+ * @brief Returns the file offset of the char at position @p pos of the
+ * sequence of the record #@p rec_no, as computed from its line layout.
+ */
+size_t fastaidx_offset(fastaidx *self, size_t rec_no, size_t pos);
+
+#endif
@@ -0,0 +1,517 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arrays.h"
+#include "cstrutil.h"
+#include "errlog.h"
+#include "fastq.h"
+#include "mathutil.h"
+#include "new.h"
+#include "strfilereader.h"
+
+
+#define NO_STOP -1
+#define MALFORMED SIZE_MAX
+
+
+struct _fastq {
+	strfilereader *src;
+	char *src_path;
+	bool load_qual;
+	bool bol; // whether the cursor is at the beginning of a line
+	fastq_rec cur_rec[2];
+	size_t cur_rec_len[2][3];
+	fastq_span *batch;
+	size_t batch_len;
+	char *arena; // compacted multi-line sequences and qualities of the batch
+	size_t arena_len;
+};
+
+
+static void _reserve(char **str, size_t *cap, size_t len)
+{
+	if (len > *cap) {
+		*cap = MAX(len, 2 * (*cap));
+		*str = realloc(*str, *cap + 1);
+	}
+}
+
+
+/*
+ * Compacts the chars in src[0..n) into dest, if not NULL, skipping line
+ * breaks, up to dmax chars. Stops before a @p stopc char at the beginning
+ * of a line, setting *stop. *bol tells whether src starts a line, and is
+ * updated accordingly.
+ * Returns the number of chars of src consumed, with the number of chars
+ * compacted in *dlen.
+ */
+static size_t _compact(const char *src, size_t n, char *dest, size_t dmax,
+                       size_t *dlen, bool *bol, bool *stop, int stopc)
+{
+	size_t i = 0, d = 0;
+	*stop = false;
+	while (i < n && d < dmax) {
+		if (*bol && src[i] == stopc) {
+			*stop = true;
+			break;
+		}
+		const char *nl = memchr(src + i, '\n', n - i);
+		size_t e = nl ? (size_t)(nl - src) : n;
+		const char *cr = memchr(src + i, '\r', e - i);
+		e = cr ? (size_t)(cr - src) : e;
+		size_t l = MIN(e - i, dmax - d);
+		if (dest) {
+			memcpy(dest + d, src + i, l);
+		}
+		d += l;
+		i += l;
+		*bol = *bol && l == 0;
+		if (i == e && i < n) {
+			*bol = (src[i] == '\n');
+			i++;
+		}
+	}
+	*dlen = d;
+	return i;
+}
+
+
+static size_t _offset(fastq *self)
+{
+	uint64_t voff;
+	return strfilereader_tell(self->src, &voff)
+	       ? (size_t)voff
+	       : strfilereader_pos(self->src);
+}
+
+
+rawptr_ok_err_res fastq_open(const char *filename)
+{
+	return fastq_open_with_qual(filename, true);
+}
+
+
+rawptr_ok_err_res fastq_open_with_qual(const char *filename, bool load_qual)
+{
+	rawptr_ok_err_res result = {.ok = true};
+	errno = 0;
+	strfilereader *src = strfilereader_new_from_path(filename);
+	if (!src) {
+		WARN("Error opening FASTQ '%s'.\n", filename);
+		int code = errno ? errno : EIO;
+		result.ok = false;
+		result.val.err = (code_msg_err) {.code = code, .msg = strerror(code)};
+		return result;
+	}
+	fastq *f = NEW(fastq);
+	f->src = src;
+	f->src_path = cstr_clone(filename);
+	f->load_qual = load_qual;
+	f->bol = true;
+	for (size_t r = 0; r < 2; r++) {
+		f->cur_rec_len[r][0] = f->cur_rec_len[r][1] = f->cur_rec_len[r][2] = 100;
+		f->cur_rec[r].descr = cstr_new(f->cur_rec_len[r][0]);
+		f->cur_rec[r].seq = cstr_new(f->cur_rec_len[r][1]);
+		f->cur_rec[r].qual = cstr_new(f->cur_rec_len[r][2]);
+	}
+	f->batch = NULL;
+	f->batch_len = 0;
+	f->arena = NULL;
+	f->arena_len = 0;
+	result.val.ok = f;
+	return result;
+}
+
+
+const char *fastq_path(fastq *self)
+{
+	return self->src_path;
+}
+
+
+static bool _goto_next(fastq *self)
+{
+	const char *p;
+	size_t n;
+	while ((p = strfilereader_peek(self->src, 1, &n)) != NULL) {
+		if (self->bol && p[0] == '@') {
+			return true;
+		}
+		const char *nl = memchr(p, '\n', n);
+		strfilereader_skip(self->src, nl ? (size_t)(nl - p) + 1 : n);
+		self->bol = (nl != NULL);
+	}
+	return false;
+}
+
+
+bool fastq_has_next(fastq *self)
+{
+	return _goto_next(self);
+}
+
+
+bool fastq_goto(fastq *self, size_t descr_offset)
+{
+	if (!strfilereader_seek(self->src, descr_offset)) {
+		return false;
+	}
+	self->bol = true;
+	return _goto_next(self);
+}
+
+
+void fastq_rewind(fastq *self)
+{
+	strread_reset(strfilereader_as_strread(self->src));
+	self->bol = true;
+}
+
+
+/*
+ * Loads the remainder of the current line into the growable string
+ * *line, or just skips it if line is NULL, consuming the line break.
+ */
+static void _load_line(fastq *self, char **line, size_t *cap)
+{
+	size_t len = 0, n;
+	const char *p;
+	while ((p = strfilereader_peek(self->src, 1, &n)) != NULL) {
+		const char *nl = memchr(p, '\n', n);
+		size_t l = nl ? (size_t)(nl - p) : n;
+		if (line) {
+			_reserve(line, cap, len + l);
+			memcpy(*line + len, p, l);
+		}
+		len += l;
+		strfilereader_skip(self->src, nl ? l + 1 : l);
+		if (nl) {
+			break;
+		}
+	}
+	if (line) {
+		if (len > 0 && (*line)[len - 1] == '\r') {
+			len--;
+		}
+		(*line)[len] = '\0';
+	}
+	self->bol = true;
+}
+
+
+/*
+ * Loads the next record into rec, whose string capacities are in cap.
+ * Malformed records, whose quality strings are longer than their
+ * sequences, are skipped.
+ */
+static bool _next_into(fastq *self, fastq_rec *rec, size_t *cap)
+{
+	while (_goto_next(self)) {
+		// load description
+		rec->descr_offset = _offset(self);
+		strfilereader_skip(self->src, 1);
+		_load_line(self, &rec->descr, &cap[0]);
+		// load sequence up to the separator line
+		rec->seq_offset = _offset(self);
+		size_t len = 0, n, d;
+		bool stop = false;
+		const char *p;
+		while (!stop && (p = strfilereader_peek(self->src, 1, &n)) != NULL) {
+			_reserve(&rec->seq, &cap[1], len + n);
+			n = _compact(p, n, rec->seq + len, n, &d, &self->bol, &stop, '+');
+			strfilereader_skip(self->src, n);
+			len += d;
+		}
+		rec->seq[len] = '\0';
+		if (!stop) {
+			WARN("Truncated FASTQ record at offset %zu of %s.\n",
+			     rec->descr_offset, self->src_path);
+			return false;
+		}
+		_load_line(self, NULL, NULL);
+		// load (or skip) as many quality chars as sequence chars
+		rec->qual_offset = _offset(self);
+		char *qual = NULL;
+		if (self->load_qual) {
+			_reserve(&rec->qual, &cap[2], len);
+			qual = rec->qual;
+		}
+		size_t qlen = 0;
+		while (qlen < len && (p = strfilereader_peek(self->src, 1, &n)) != NULL) {
+			n = _compact(p, n, qual ? qual + qlen : NULL, len - qlen, &d, &self->bol,
+			             &stop, NO_STOP);
+			strfilereader_skip(self->src, n);
+			qlen += d;
+		}
+		rec->qual[self->load_qual ? qlen : 0] = '\0';
+		if (qlen < len) {
+			WARN("Truncated FASTQ record at offset %zu of %s.\n",
+			     rec->descr_offset, self->src_path);
+			return false;
+		}
+		// the quality string must end the line
+		p = self->bol ? NULL : strfilereader_peek(self->src, 1, &n);
+		if (p && p[0] != '\n' && p[0] != '\r') {
+			WARN("Malformed FASTQ record at offset %zu of %s.\n",
+			     rec->descr_offset, self->src_path);
+			self->bol = false;
+			continue;
+		}
+		return true;
+	}
+	return false;
+}
+
+
+const fastq_rec *fastq_next(fastq *self)
+{
+	return _next_into(self, &self->cur_rec[0], self->cur_rec_len[0])
+	       ? &self->cur_rec[0]
+	       : NULL;
+}
+
+
+bool fastq_next_pair(fastq *self, const fastq_rec **fwd, const fastq_rec **rev)
+{
+	if (!_next_into(self, &self->cur_rec[0], self->cur_rec_len[0])) {
+		return false;
+	}
+	if (!_next_into(self, &self->cur_rec[1], self->cur_rec_len[1])) {
+		WARN("Unpaired FASTQ record at offset %zu of %s.\n",
+		     self->cur_rec[0].descr_offset, self->src_path);
+		return false;
+	}
+	*fwd = &self->cur_rec[0];
+	*rev = &self->cur_rec[1];
+	return true;
+}
+
+
+/*
+ * Parses the record at the start of src[0..n) into rec, compacting
+ * multi-line sequences and qualities into arena. The record comprises
+ * the line break after the quality string.
+ * If the record is not complete in src and more chars may follow
+ * (!last), returns 0. If the record is malformed, returns MALFORMED.
+ * Otherwise returns the length of the record, with the relative
+ * offsets of the sequence and quality in lens, and the number of
+ * arena chars used in *alen.
+ */
+static size_t _parse_span(const char *src, size_t n, bool last, bool load_qual,
+                          char *arena, fastq_span *rec, size_t *lens,
+                          size_t *alen)
+{
+	const size_t incomplete = last ? MALFORMED : 0;
+	bool bol, stop;
+	*alen = 0;
+	if (n == 0 || src[0] != '@') {
+		return (n == 0) ? incomplete : MALFORMED;
+	}
+	// description
+	const char *nl = memchr(src, '\n', n);
+	if (!nl) {
+		return incomplete;
+	}
+	size_t dend = nl - src;
+	rec->descr = src + 1;
+	rec->descr_len = dend - 1 - (dend > 1 && src[dend - 1] == '\r');
+	size_t i = lens[0] = dend + 1;
+	// sequence, referred to in place if on a single line
+	if (i == n) {
+		return incomplete;
+	}
+	nl = memchr(src + i, '\n', n - i);
+	size_t send = nl ? (size_t)(nl - src) : n;
+	if (src[i] == '+') {
+		rec->seq = src + i;
+		rec->seq_len = 0;
+	}
+	else if (send + 1 >= n) {
+		return incomplete;
+	}
+	else if (src[send + 1] == '+') {
+		rec->seq = src + i;
+		rec->seq_len = send - i - (send > i && src[send - 1] == '\r');
+		i = send + 1;
+	}
+	else {
+		bol = true;
+		i += _compact(src + i, n - i, arena, SIZE_MAX, &rec->seq_len, &bol, &stop,
+		              '+');
+		if (!stop) {
+			return incomplete;
+		}
+		rec->seq = arena;
+		*alen += rec->seq_len;
+	}
+	// separator line
+	nl = memchr(src + i, '\n', n - i);
+	if (!nl) {
+		return incomplete;
+	}
+	i = lens[1] = (nl - src) + 1;
+	// quality, referred to in place if on a single line
+	nl = memchr(src + i, '\n', n - i);
+	size_t qend = nl ? (size_t)(nl - src) : n;
+	size_t qlen = qend - i - (qend > i && src[qend - 1] == '\r');
+	if (qlen == rec->seq_len) {
+		rec->qual = src + i;
+		i = qend;
+	}
+	else if (qlen > rec->seq_len) {
+		return MALFORMED;
+	}
+	else {
+		bol = true;
+		char *qual = load_qual ? arena + *alen : NULL;
+		i += _compact(src + i, n - i, qual, rec->seq_len, &qlen, &bol, &stop,
+		              NO_STOP);
+		if (qlen < rec->seq_len) {
+			return incomplete;
+		}
+		rec->qual = qual;
+		*alen += load_qual ? qlen : 0;
+	}
+	rec->qual_len = rec->seq_len;
+	if (!load_qual) {
+		rec->qual = NULL;
+		rec->qual_len = 0;
+	}
+	// line break
+	i += (i < n && src[i] == '\r');
+	if (i < n && src[i] == '\n') {
+		i++;
+	}
+	else if (i == n && !last) {
+		return 0;
+	}
+	return i;
+}
+
+
+/*
+ * Parses a batch of up to max units of unit consecutive records each.
+ */
+static size_t _next_batch(fastq *self, size_t max, size_t unit,
+                          const fastq_span **recs)
+{
+	if (max * unit > self->batch_len) {
+		FREE(self->batch);
+		self->batch = ARR_NEW(fastq_span, max * unit);
+		self->batch_len = max * unit;
+	}
+	*recs = self->batch;
+	if (!_goto_next(self)) {
+		return 0;
+	}
+	size_t avail, nrecs = 0, i = 0, alen = 0;
+	bool last = false;
+	const char *p = strfilereader_peek(self->src, 1, &avail);
+	while (nrecs < max * unit && i < avail) {
+		// the compacted strings are no longer than the buffered chars
+		_reserve(&self->arena, &self->arena_len, avail);
+		size_t lens[2][3], j = i, a = alen, u, l = 0, used;
+		for (u = 0; u < unit; u++) {
+			l = _parse_span(p + j, avail - j, last, self->load_qual,
+			                self->arena + a, self->batch + nrecs + u, lens[u], &used);
+			if (l == 0 || l == MALFORMED) {
+				break;
+			}
+			lens[u][2] = l;
+			j += l;
+			a += used;
+		}
+		if (l == MALFORMED) {
+			if (nrecs > 0) {
+				// left to the next batch, as skipping may refill the buffer
+				break;
+			}
+			WARN("Malformed FASTQ record at offset %zu of %s.\n",
+			     _offset(self) + (j - i), self->src_path);
+			strfilereader_skip(self->src, MIN(j - i + 1, avail - i));
+			self->bol = false;
+			if (!_goto_next(self)) {
+				break;
+			}
+			p = strfilereader_peek(self->src, 1, &avail);
+			i = alen = 0;
+			last = false;
+			continue;
+		}
+		if (l == 0) {
+			if (nrecs > 0) {
+				break;
+			}
+			// records larger than the buffered chars
+			size_t had = avail;
+			p = strfilereader_peek(self->src, avail + 1, &avail);
+			last = (avail == had);
+			continue;
+		}
+		for (u = 0; u < unit; u++, nrecs++) {
+			fastq_span *rec = self->batch + nrecs;
+			rec->descr_offset = _offset(self);
+			strfilereader_skip(self->src, lens[u][0]);
+			rec->seq_offset = _offset(self);
+			strfilereader_skip(self->src, lens[u][1] - lens[u][0]);
+			rec->qual_offset = _offset(self);
+			strfilereader_skip(self->src, lens[u][2] - lens[u][1]);
+		}
+		self->bol = true;
+		i = j;
+		alen = a;
+	}
+	return nrecs / unit;
+}
+
+
+size_t fastq_next_batch(fastq *self, size_t max, const fastq_span **recs)
+{
+	return _next_batch(self, max, 1, recs);
+}
+
+
+size_t fastq_next_pair_batch(fastq *self, size_t max, const fastq_span **recs)
+{
+	return _next_batch(self, max, 2, recs);
+}
+
+
+void fastq_close(fastq *self)
+{
+	strfilereader_free(self->src);
+	FREE(self->src_path);
+	for (size_t r = 0; r < 2; r++) {
+		FREE(self->cur_rec[r].descr);
+		FREE(self->cur_rec[r].seq);
+		FREE(self->cur_rec[r].qual);
+	}
+	FREE(self->batch);
+	FREE(self->arena);
+	FREE(self);
+}
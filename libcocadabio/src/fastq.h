@@ -0,0 +1,196 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#ifndef FASTQ_H
+#define FASTQ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "result.h"
+
+/**
+ * @file fastq.h
+ * @brief FASTQ file sequence reader.
+ * @author Paulo Fonseca
+ *
+ * A FASTQ file is a plain text sequence of *records*, each consisting
+ * of a *description* line starting with `@`, the *sequence*, a
+ * separator line starting with `+`, and the *quality* string, with
+ * one char per sequence char. Both the sequence and the quality string
+ * can span multiple lines.
+ *
+ * As the ::fasta reader, the `fastq` reader iterates through the records
+ * of a file, parsing it in large blocks, and reads compressed files
+ * (gzip, BGZF and zstd) transparently. Records can be loaded one at a
+ * time with fastq_next(), or in batches, referred to in place inside
+ * the file buffer, with fastq_next_batch().
+ *
+ * Paired-end reads in *interleaved* files, in which each forward read
+ * is followed by its mate, can be read in pairs with fastq_next_pair()
+ * and fastq_next_pair_batch().
+ *
+ * When the quality strings are not needed, the reader can be open with
+ * fastq_open_with_qual() so as to skip them, saving memory and copying.
+ *
+ * Example
+ * -------
+ *
+ * ```C
+ * fastq *fq = fastq_open("reads.fq.gz").val.ok;
+ * for (const fastq_rec *rec; (rec = fastq_next(fq)) != NULL; ) {
+ *     printf("%s\n%s\n%s\n", rec->descr, rec->seq, rec->qual);
+ * }
+ * fastq_close(fq);
+ * ```
+ */
+
+
+/**
+ * @brief FASTQ file/stream type.
+ */
+typedef struct _fastq fastq;
+
+
+/**
+ * @brief A FASTQ record with in-memory sequence and quality.
+ */
+typedef struct {
+	char *descr;	/**< Sequence descriptor (does not include the `@`) */
+	char *seq;		/**< In-memory sequence content */
+	char *qual;		/**< In-memory quality string (empty if skipped) */
+	size_t descr_offset;	/**< Descriptor offset from the start of the file **/
+	size_t seq_offset;		/**< Sequence offset from the start of the file **/
+	size_t qual_offset;		/**< Quality offset from the start of the file **/
+} fastq_rec;
+
+
+/**
+ * @brief A FASTQ record referred to as spans of chars.
+ * The spans are not null-terminated.
+ */
+typedef struct {
+	const char *descr;		/**< Sequence descriptor (does not include the `@`) */
+	size_t descr_len;		/**< Descriptor length */
+	const char *seq;		/**< Sequence content, without line breaks */
+	size_t seq_len;			/**< Sequence length */
+	const char *qual;		/**< Quality string (NULL if skipped) */
+	size_t qual_len;		/**< Quality string length (0 if skipped) */
+	size_t descr_offset;	/**< Descriptor offset from the start of the file **/
+	size_t seq_offset;		/**< Sequence offset from the start of the file **/
+	size_t qual_offset;		/**< Quality offset from the start of the file **/
+} fastq_span;
+
+
+/**
+ * @brief Opens a FASTQ file and places the cursor at its beginning.
+ * @param filename The path to the file (**NO TRANSFER OF OWNERSHIP**)
+ */
+rawptr_ok_err_res fastq_open(const char *filename);
+
+
+/**
+ * @brief Same as fastq_open(), but the quality strings are only
+ * loaded if @p load_qual is true.
+ */
+rawptr_ok_err_res fastq_open_with_qual(const char *filename, bool load_qual);
+
+
+/**
+ * @brief Returns the FASTQ file path
+ */
+const char *fastq_path(fastq *self);
+
+
+/**
+ * @brief Checks whether there is a record *after* the current cursor
+ * position, advancing the cursor to its beginning.
+ */
+bool fastq_has_next(fastq *self);
+
+
+/**
+ * @brief Moves the stream to the record at the given description offset
+ * @p descr_offset, as given by the records or by a ::fastqidx.
+ * @return true on success, false on fail.
+ */
+bool fastq_goto(fastq *self, size_t descr_offset);
+
+
+/**
+ * @brief Sets the position of the stream to the beginning of the file.
+ */
+void fastq_rewind(fastq *self);
+
+
+/**
+ * @brief Advances the cursor to the next record, loading it to memory.
+ * @returns The record, or NULL at the end of the file or if the record
+ * is truncated.
+ * @warning The returned record object should *not* be modified or
+ * destroyed directly, and is only valid until the next call.
+ */
+const fastq_rec *fastq_next(fastq *self);
+
+
+/**
+ * @brief Advances the cursor over the next two records of an
+ * interleaved paired-end file, loading them to memory.
+ * @param fwd (out) The first record of the pair.
+ * @param rev (out) The second record of the pair.
+ * @returns Whether a whole pair could be read.
+ * @warning The returned records should *not* be modified or destroyed
+ * directly, and are only valid until the next call.
+ */
+bool fastq_next_pair(fastq *self, const fastq_rec **fwd, const fastq_rec **rev);
+
+
+/**
+ * @brief Advances the cursor over a batch of up to @p max records.
+ * The records are parsed directly from the file buffer: descriptions
+ * and single-line sequences and qualities point into the buffer,
+ * whereas multi-line ones are compacted into an internal buffer.
+ * A batch comprises the records that fit in the current buffer, thus
+ * fewer than @p max records can be returned before the end of the file.
+ * @param recs (out) The array of records of the batch.
+ * @returns The number of records in the batch, 0 at the end of the file.
+ * @warning The records are only valid until the next operation on the
+ * reader, and should *not* be modified or destroyed directly.
+ */
+size_t fastq_next_batch(fastq *self, size_t max, const fastq_span **recs);
+
+
+/**
+ * @brief Same as fastq_next_batch() for up to @p max pairs of records
+ * of an interleaved paired-end file. The mates of the i-th pair are
+ * `recs[2*i]` and `recs[2*i+1]`.
+ * @returns The number of pairs in the batch, 0 at the end of the file.
+ */
+size_t fastq_next_pair_batch(fastq *self, size_t max,
+                             const fastq_span **recs);
+
+
+/**
+ * @brief Destructor. Closes the reader and releases used resources
+ */
+void fastq_close(fastq *self);
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include "fastqidx.h"
+#include "cstrutil.h"
+#include "new.h"
+#include "vec.h"
+
+
+struct _fastqidx {
+	char *path;
+	vec *dscs;
+	vec *seqs;
+	vec *quals;
+};
+
+
+fastqidx *fastqidx_new(const char *src_path)
+{
+	fastqidx *ret = NEW(fastqidx);
+	ret->path = cstr_clone(src_path);
+	ret->dscs = vec_new(sizeof(size_t));
+	ret->seqs = vec_new(sizeof(size_t));
+	ret->quals = vec_new(sizeof(size_t));
+	return ret;
+}
+
+
+void fastqidx_finalise(void *ptr, const finaliser *fnr)
+{
+	fastqidx *self = (fastqidx *)ptr;
+	FREE(self->path);
+	DESTROY_FLAT(self->dscs, vec);
+	DESTROY_FLAT(self->seqs, vec);
+	DESTROY_FLAT(self->quals, vec);
+}
+
+
+void fastqidx_free(fastqidx *self)
+{
+	DESTROY_FLAT(self, fastqidx);
+}
+
+
+const char *fastqidx_path(fastqidx *self)
+{
+	return self->path;
+}
+
+
+size_t fastqidx_size(fastqidx *self)
+{
+	return vec_len(self->dscs);
+}
+
+
+void fastqidx_add(fastqidx *self, size_t dsc_offset, size_t seq_offset,
+                  size_t qual_offset)
+{
+	vec_push_size_t(self->dscs, dsc_offset);
+	vec_push_size_t(self->seqs, seq_offset);
+	vec_push_size_t(self->quals, qual_offset);
+}
+
+
+fastq_rec_offs fastqidx_get(fastqidx *self, size_t rec_no)
+{
+	fastq_rec_offs ret;
+	ret.descr_off = vec_get_size_t(self->dscs, rec_no);
+	ret.seq_off = vec_get_size_t(self->seqs, rec_no);
+	ret.qual_off = vec_get_size_t(self->quals, rec_no);
+	return ret;
+}
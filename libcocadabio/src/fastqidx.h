@@ -0,0 +1,109 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#ifndef FASTQIDX_H
+#define FASTQIDX_H
+
+#include <stddef.h>
+
+#include "new.h"
+
+/**
+ * @file fastqidx.h
+ * @brief FASTQ file index
+ * @author Paulo Fonseca
+ *
+ * The index keeps the offsets of the records of a FASTQ file, as given
+ * by the `fastq_rec` and `fastq_span` records, so that the records can be
+ * accessed randomly with fastq_goto().
+ *
+ * Example
+ * -------
+ *
+ * ```C
+ * fastqidx *idx = fastqidx_new(path);
+ * for (const fastq_rec *rec; (rec = fastq_next(fq)) != NULL; )
+ *     fastqidx_add(idx, rec->descr_offset, rec->seq_offset, rec->qual_offset);
+ * fastq_goto(fq, fastqidx_get(idx, 42).descr_off);
+ * const fastq_rec *rec42 = fastq_next(fq);
+ * ```
+ */
+
+/**
+ * @brief FASTQ index type.
+ */
+typedef struct _fastqidx fastqidx;
+
+
+/**
+ * @brief Creates an empty index of the FASTQ file at @p src_path.
+ */
+fastqidx *fastqidx_new(const char *src_path);
+
+
+/**
+ * @brief Finaliser
+ */
+void fastqidx_finalise(void *ptr, const finaliser *fnr);
+
+
+/**
+ * @brief Destructor
+ */
+void fastqidx_free(fastqidx *self);
+
+
+/**
+ * @brief Returns the path of the indexed file.
+ */
+const char *fastqidx_path(fastqidx *self);
+
+
+/**
+ * @brief Returns the number of indexed records.
+ */
+size_t fastqidx_size(fastqidx *self);
+
+
+/**
+ * @brief Appends the offsets of the next record.
+ */
+void fastqidx_add(fastqidx *self, size_t descr_offset, size_t seq_offset,
+                  size_t qual_offset);
+
+
+/**
+ * @brief FASTQ record offsets.
+ */
+typedef struct {
+	size_t descr_off;	/**< Record description offset. */
+	size_t seq_off;		/**< Record sequence offset. */
+	size_t qual_off;	/**< Record quality offset. */
+} fastq_rec_offs;
+
+
+/**
+ * @brief Returns the offsets (description, sequence, quality) of the
+ * record #@p rec_no.
+ */
+fastq_rec_offs fastqidx_get(fastqidx *self, size_t rec_no);
+
+#endif
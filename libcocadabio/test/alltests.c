@@ -27,6 +27,7 @@
 
 CuSuite *align_get_test_suite();
 CuSuite *fasta_get_test_suite();
+CuSuite *fastq_get_test_suite();
 
 
 void run_all_tests(void)
@@ -35,6 +36,7 @@ void run_all_tests(void)
 	CuSuite *suite = CuSuiteNew();
 
 	CuSuiteAddSuite(suite, fasta_get_test_suite());
+	CuSuiteAddSuite(suite, fastq_get_test_suite());
 	CuSuiteAddSuite(suite, align_get_test_suite());
 	
 	CuSuiteRun(suite);
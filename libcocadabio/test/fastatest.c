@@ -23,8 +23,13 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "CuTest.h"
 #include "fasta.h"
+#include "mathutil.h"
 #include "memdbg.h"
 
 static char *filename = "test_fasta.fa";
@@ -188,11 +193,360 @@ void test_fasta_next_read(CuTest *tc)
 
 
 
+void test_fasta_next_batch(CuTest *tc)
+{
+	memdbg_reset();
+	test_setup();
+
+	rawptr_ok_err_res result = fasta_open(filename);
+	CuAssert(tc, "Error opening fasta", result.ok);
+	fasta *f = result.val.ok;
+	size_t i = 0;
+	const fasta_span *recs;
+	for (size_t n; (n = fasta_next_batch(f, 3, &recs)) > 0; ) {
+		CuAssertTrue(tc, n <= 3);
+		for (size_t j = 0; j < n; j++, i++) {
+			CuAssertTrue(tc, i < nseq);
+			CuAssertSizeTEquals(tc, desc_offsets[i], recs[j].descr_offset);
+			CuAssertSizeTEquals(tc, seq_offsets[i], recs[j].seq_offset);
+			CuAssertSizeTEquals(tc, strlen(desc[i]), recs[j].descr_len);
+			CuAssertTrue(tc, strncmp(desc[i], recs[j].descr, recs[j].descr_len) == 0);
+			size_t k = 0, l = strlen(seq[i]);
+			for (size_t m = 0; m < recs[j].seq_len; m++, k++) {
+				while (k < l && seq[i][k] == '\n') k++;
+				CuAssert(tc, "fasta read error: read too many chars", k < l);
+				CuAssert(tc, "fasta read error: char mismatch", seq[i][k] == recs[j].seq[m]);
+			}
+			CuAssert(tc, "fasta read error: premature end of sequence", k == l);
+		}
+	}
+	CuAssertSizeTEquals(tc, nseq, i);
+	fasta_close(f);
+
+	test_teardown();
+	if (!memdbg_is_empty()) {
+		memdbg_print_stats(stdout, true);
+	}
+	CuAssert(tc, "Memory leak!", memdbg_is_empty());
+}
+
+
+/*
+ * Writes a large FASTA file with records of random lengths, some with
+ * CRLF line breaks, and one sequence larger than the reader buffer.
+ */
+static size_t write_large_fasta(const char *path, bool gzip)
+{
+	size_t nrecs = 5000, len = 0;
+	char *data = malloc(1 << 23);
+	srand(17);
+	for (size_t i = 0; i < nrecs; i++) {
+		const char *eol = (i % 7 == 3) ? "\r\n" : "\n";
+		len += sprintf(data + len, ">read_%zu some description%s", i, eol);
+		size_t sl = (i == nrecs / 2) ? 300000 : (size_t)(rand() % 400);
+		size_t width = (i % 3 == 0) ? sl + 1 : 1 + (size_t)(rand() % 80);
+		for (size_t j = 0; j < sl; j++) {
+			data[len++] = "ACGT"[rand() % 4];
+			if ((j + 1) % width == 0 || j + 1 == sl) {
+				len += sprintf(data + len, "%s", eol);
+			}
+		}
+	}
+	FILE *file = fopen(path, "w");
+	fwrite(data, 1, len - 1, file); // no final line break
+	fclose(file);
+#ifdef HAVE_ZLIB
+	if (gzip) {
+		gzFile gz = gzopen(path, "wb");
+		gzwrite(gz, data, len - 1);
+		gzclose(gz);
+	}
+#endif
+	free(data);
+	return nrecs;
+}
+
+
+static void check_batches(CuTest *tc, const char *path, size_t nrecs)
+{
+	fasta *f = fasta_open(path).val.ok;
+	fasta *g = fasta_open(path).val.ok;
+	CuAssertPtrNotNull(tc, f);
+	CuAssertPtrNotNull(tc, g);
+	size_t i = 0, max = 1;
+	const fasta_span *recs;
+	for (size_t n; (n = fasta_next_batch(f, max, &recs)) > 0; max = 1 + (max * 3) % 1000) {
+		for (size_t j = 0; j < n; j++, i++) {
+			const fasta_rec *rec = fasta_next(g);
+			CuAssertPtrNotNull(tc, rec);
+			CuAssertSizeTEquals(tc, rec->descr_offset, recs[j].descr_offset);
+			CuAssertSizeTEquals(tc, rec->seq_offset, recs[j].seq_offset);
+			CuAssertSizeTEquals(tc, strlen(rec->descr), recs[j].descr_len);
+			CuAssertTrue(tc, strncmp(rec->descr, recs[j].descr, recs[j].descr_len) == 0);
+			CuAssertSizeTEquals(tc, strlen(rec->seq), recs[j].seq_len);
+			CuAssertTrue(tc, strncmp(rec->seq, recs[j].seq, recs[j].seq_len) == 0);
+			CuAssertTrue(tc, strspn(rec->seq, "ACGT") == recs[j].seq_len);
+		}
+	}
+	CuAssertSizeTEquals(tc, nrecs, i);
+	CuAssertTrue(tc, fasta_next(g) == NULL);
+	fasta_close(f);
+	fasta_close(g);
+}
+
+
+void test_fasta_large(CuTest *tc)
+{
+	memdbg_reset();
+	char *path = "test_fasta_large.fa";
+	size_t nrecs = write_large_fasta(path, false);
+	check_batches(tc, path, nrecs);
+
+	// sequence readers over the same file
+	fasta *f = fasta_open(path).val.ok;
+	fasta *g = fasta_open(path).val.ok;
+	char *buf = malloc(400001);
+	for (size_t i = 0; i < nrecs; i++) {
+		const fasta_rec *rec = fasta_next(g);
+		const fasta_rec_rdr *rr = fasta_next_reader(f);
+		size_t l = strlen(rec->seq), h = l / 3;
+		CuAssertSizeTEquals(tc, h, strread_read_str(rr->seqrdr, buf, h));
+		CuAssertTrue(tc, strncmp(rec->seq, buf, h) == 0);
+		const char *t = strchr(rec->seq + h, 'T');
+		size_t m = t ? (size_t)(t - rec->seq) - h : l - h;
+		CuAssertSizeTEquals(tc, m, strread_read_str_until(rr->seqrdr, buf, 'T'));
+		CuAssertTrue(tc, strncmp(rec->seq + h, buf, m) == 0);
+		CuAssertSizeTEquals(tc, l - h - m, strread_read_str(rr->seqrdr, buf, 400000));
+		CuAssertStrEquals(tc, rec->seq + h + m, buf);
+	}
+	CuAssertTrue(tc, !fasta_has_next(f));
+	free(buf);
+	fasta_close(f);
+	fasta_close(g);
+	remove(path);
+
+#ifdef HAVE_ZLIB
+	path = "test_fasta_large.fa.gz";
+	nrecs = write_large_fasta(path, true);
+	check_batches(tc, path, nrecs);
+	remove(path);
+#endif
+
+	if (!memdbg_is_empty()) {
+		memdbg_print_stats(stdout, true);
+	}
+	CuAssert(tc, "Memory leak!", memdbg_is_empty());
+}
+
+
+/*
+ * Writes sequences with regular line layouts, varying the line widths
+ * and breaks, and the corresponding expected .fai contents.
+ */
+static size_t write_regular_fasta(const char *path, char **seqs, char *fai)
+{
+	size_t nrecs = 6, offset = 0;
+	const char *names[6] = {"chr1", "chr2", "chrM", "empty", "crlf", "last"};
+	size_t lens[6] = {1000, 60, 16571, 0, 333, 121};
+	size_t widths[6] = {60, 60, 70, 60, 50, 60};
+	FILE *file = fopen(path, "w");
+	fai[0] = '\0';
+	srand(31);
+	for (size_t i = 0; i < nrecs; i++) {
+		const char *eol = (i == 4) ? "\r\n" : "\n";
+		offset += fprintf(file, ">%s%s%s", names[i], (i % 2) ? " some description" : "",
+		                  eol);
+		sprintf(fai + strlen(fai), "%s\t%zu\t%zu\t%zu\t%zu\n", names[i], lens[i],
+		        offset, lens[i] ? MIN(widths[i], lens[i]) : 0,
+		        lens[i] ? MIN(widths[i], lens[i]) + strlen(eol) : 0);
+		seqs[i] = malloc(lens[i] + 1);
+		for (size_t j = 0; j < lens[i]; j++) {
+			seqs[i][j] = "ACGTN"[rand() % 5];
+		}
+		seqs[i][lens[i]] = '\0';
+		for (size_t j = 0; j < lens[i]; j += widths[i]) {
+			offset += fwrite(seqs[i] + j, 1, MIN(widths[i], lens[i] - j), file);
+			if (i + 1 < nrecs || j + widths[i] < lens[i]) {
+				offset += fprintf(file, "%s", eol);
+			}
+		}
+	}
+	fclose(file);
+	return nrecs;
+}
+
+
+static char *read_file(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	char *ret = calloc(1 << 16, 1);
+	size_t n = fread(ret, 1, (1 << 16) - 1, file);
+	ret[n] = '\0';
+	fclose(file);
+	return ret;
+}
+
+
+void test_fastaidx_build(CuTest *tc)
+{
+	memdbg_reset();
+	char *path = "test_fasta_regular.fa";
+	char *fai_path = "test_fasta_regular.fa.fai";
+	char *seqs[6], fai[1024];
+	size_t nrecs = write_regular_fasta(path, seqs, fai);
+
+	fastaidx *idx = fastaidx_build(path);
+	CuAssertPtrNotNull(tc, idx);
+	CuAssertSizeTEquals(tc, nrecs, fastaidx_size(idx));
+	CuAssertTrue(tc, fastaidx_save(idx, fai_path));
+	char *saved = read_file(fai_path);
+	CuAssertStrEquals(tc, fai, saved);
+	free(saved);
+
+	fastaidx *loaded = fastaidx_load(path, fai_path);
+	CuAssertPtrNotNull(tc, loaded);
+	CuAssertSizeTEquals(tc, nrecs, fastaidx_size(loaded));
+	for (size_t i = 0; i < nrecs; i++) {
+		size_t r;
+		CuAssertTrue(tc, fastaidx_find(loaded, fastaidx_name(idx, i), &r));
+		CuAssertSizeTEquals(tc, i, r);
+		fasta_rec_offs o = fastaidx_get(idx, i), lo = fastaidx_get(loaded, i);
+		CuAssertSizeTEquals(tc, strlen(seqs[i]), o.len);
+		CuAssertSizeTEquals(tc, o.seq_off, lo.seq_off);
+		CuAssertSizeTEquals(tc, o.len, lo.len);
+		CuAssertSizeTEquals(tc, o.line_bases, lo.line_bases);
+		CuAssertSizeTEquals(tc, o.line_bytes, lo.line_bytes);
+		CuAssertSizeTEquals(tc, FASTAIDX_NO_OFFSET, lo.descr_off);
+		free(seqs[i]);
+	}
+	size_t r;
+	CuAssertTrue(tc, !fastaidx_find(loaded, "chr3", &r));
+	fastaidx_free(idx);
+	fastaidx_free(loaded);
+	remove(path);
+	remove(fai_path);
+
+	// irregular line lengths
+	test_setup();
+	CuAssertTrue(tc, fastaidx_build(filename) == NULL);
+	test_teardown();
+
+	if (!memdbg_is_empty()) {
+		memdbg_print_stats(stdout, true);
+	}
+	CuAssert(tc, "Memory leak!", memdbg_is_empty());
+}
+
+
+void test_fasta_fetch(CuTest *tc)
+{
+	memdbg_reset();
+	char *path = "test_fasta_regular.fa";
+	char *fai_path = "test_fasta_regular.fa.fai";
+	char *seqs[6], fai[1024];
+	const char *names[6] = {"chr1", "chr2", "chrM", "empty", "crlf", "last"};
+	size_t nrecs = write_regular_fasta(path, seqs, fai);
+
+	// the first reader builds and saves the index, the second loads it
+	for (int k = 0; k < 2; k++) {
+		fasta *f = fasta_open(path).val.ok;
+		CuAssertPtrNotNull(tc, fasta_index(f));
+		for (size_t i = 0; i < nrecs; i++) {
+			size_t l = strlen(seqs[i]);
+			for (size_t t = 0; t < 200; t++) {
+				size_t from = rand() % (l + 1), to = from + rand() % (l + 2 - from);
+				char *sub = fasta_fetch(f, names[i], from, to);
+				CuAssertPtrNotNull(tc, sub);
+				size_t n = MIN(to, l) - from;
+				CuAssertSizeTEquals(tc, n, strlen(sub));
+				CuAssertTrue(tc, strncmp(seqs[i] + from, sub, n) == 0);
+				free(sub);
+			}
+			char *whole = fasta_fetch(f, names[i], 0, SIZE_MAX);
+			CuAssertStrEquals(tc, seqs[i], whole);
+			free(whole);
+		}
+		CuAssertTrue(tc, fasta_fetch(f, "chr3", 0, 10) == NULL);
+		CuAssertTrue(tc, fasta_fetch(f, "chr1", 10, 5) == NULL);
+		// sequential reading is not affected
+		const fasta_rec *rec = fasta_next(f);
+		CuAssertStrEquals(tc, seqs[0], rec->seq);
+		fasta_close(f);
+		FILE *file = fopen(fai_path, "r");
+		CuAssertPtrNotNull(tc, file);
+		fclose(file);
+	}
+	for (size_t i = 0; i < nrecs; i++) {
+		free(seqs[i]);
+	}
+	remove(path);
+	remove(fai_path);
+
+	if (!memdbg_is_empty()) {
+		memdbg_print_stats(stdout, true);
+	}
+	CuAssert(tc, "Memory leak!", memdbg_is_empty());
+}
+
+
+void test_fastaidx_load_invalid(CuTest *tc)
+{
+	memdbg_reset();
+	char *path = "test_fasta_regular.fa";
+	char *fai_path = "test_fasta_regular.fa.fai";
+	char *seqs[6], fai[1024];
+	size_t nrecs = write_regular_fasta(path, seqs, fai);
+	for (size_t i = 0; i < nrecs; i++) {
+		free(seqs[i]);
+	}
+
+	const char *bad[] = {
+		"chr1\t10\t6\t0\t1\n",    // no bases per line
+		"chr1\t10\t6\t5\t4\n",    // more bases than bytes per line
+		"chr1\t10\t6\t5\n",       // missing field
+	};
+	for (size_t k = 0; k < sizeof(bad) / sizeof(bad[0]); k++) {
+		FILE *file = fopen(fai_path, "w");
+		fprintf(file, "%s", bad[k]);
+		fclose(file);
+		CuAssertPtrEquals(tc, NULL, fastaidx_load(path, fai_path));
+		// the reader rebuilds the index instead
+		fasta *f = fasta_open(path).val.ok;
+		char *sub = fasta_fetch(f, "chr1", 0, 3);
+		CuAssertPtrNotNull(tc, sub);
+		CuAssertSizeTEquals(tc, 3, strlen(sub));
+		free(sub);
+		fasta_close(f);
+	}
+
+	// empty sequences may have any line lengths
+	FILE *file = fopen(fai_path, "w");
+	fprintf(file, "empty\t0\t7\t0\t0\n");
+	fclose(file);
+	fastaidx *idx = fastaidx_load(path, fai_path);
+	CuAssertPtrNotNull(tc, idx);
+	CuAssertSizeTEquals(tc, 1, fastaidx_size(idx));
+	fastaidx_free(idx);
+	remove(path);
+	remove(fai_path);
+
+	if (!memdbg_is_empty()) {
+		memdbg_print_stats(stdout, true);
+	}
+	CuAssert(tc, "Memory leak!", memdbg_is_empty());
+}
+
+
 CuSuite *fasta_get_test_suite()
 {
 	CuSuite *suite = CuSuiteNew();
 	SUITE_ADD_TEST(suite, test_fasta_next);
 	SUITE_ADD_TEST(suite, test_fasta_next_read);
 	SUITE_ADD_TEST(suite, test_fasta_goto);
+	SUITE_ADD_TEST(suite, test_fasta_next_batch);
+	SUITE_ADD_TEST(suite, test_fasta_large);
+	SUITE_ADD_TEST(suite, test_fastaidx_build);
+	SUITE_ADD_TEST(suite, test_fastaidx_load_invalid);
+	SUITE_ADD_TEST(suite, test_fasta_fetch);
 	return suite;
 }
@@ -0,0 +1,445 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "CuTest.h"
+#include "fastq.h"
+#include "fastqidx.h"
+#include "memdbg.h"
+
+static char *filename = "test_fastq.fq";
+static size_t nrecs = 5;
+static char *desc[5] = {
+	"r1/1",
+	"r1/2",
+	"",
+	"r3 quality starting with @ and +",
+	"r4 long multi-line record"
+};
+static char *seq[5] = {
+	"ACGTACGTAC",
+	"TTGCA",
+	"",
+	"GGGGCCCCAAAATTTT",
+	"ACGTTGCAACGTTGCAACGTTGCAACGTTGCAACGTTGCAACGTTGCAACGTTGCAACGTTGCAACGTTGCA"
+};
+static char *qual[5] = {
+	"IIIIIIIIII",
+	"#####",
+	"",
+	"@+@+IIIIIIII@@++",
+	"ABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJAB"
+};
+static size_t desc_offsets[5];
+static size_t seq_offsets[5];
+static size_t qual_offsets[5];
+
+
+/*
+ * Writes the test records, breaking the sequence and quality lines of
+ * the last ones at the given width.
+ */
+static void write_lines(FILE *file, const char *str, size_t width,
+                        size_t *offset)
+{
+	size_t l = strlen(str);
+	for (size_t i = 0; i < l || i == 0; i += width) {
+		size_t w = (l - i < width) ? l - i : width;
+		fwrite(str + i, 1, w, file);
+		fputc('\n', file);
+		*offset += w + 1;
+	}
+}
+
+
+static void test_setup()
+{
+	FILE *file = fopen(filename, "w");
+	size_t offset = 0;
+	for (size_t i = 0; i < nrecs; i++) {
+		size_t width = (i < 3) ? 1000 : 7 + i;
+		desc_offsets[i] = offset;
+		offset += fprintf(file, "@%s\n", desc[i]);
+		seq_offsets[i] = offset;
+		write_lines(file, seq[i], width, &offset);
+		offset += fprintf(file, "+%s\n", (i % 2) ? desc[i] : "");
+		qual_offsets[i] = offset;
+		write_lines(file, qual[i], width, &offset);
+	}
+	fclose(file);
+}
+
+
+static void test_teardown()
+{
+	remove(filename);
+}
+
+
+static void check_rec(CuTest *tc, size_t i, const fastq_rec *rec, bool qual_loaded)
+{
+	CuAssertPtrNotNull(tc, rec);
+	CuAssertSizeTEquals(tc, desc_offsets[i], rec->descr_offset);
+	CuAssertSizeTEquals(tc, seq_offsets[i], rec->seq_offset);
+	CuAssertSizeTEquals(tc, qual_offsets[i], rec->qual_offset);
+	CuAssertStrEquals(tc, desc[i], rec->descr);
+	CuAssertStrEquals(tc, seq[i], rec->seq);
+	CuAssertStrEquals(tc, qual_loaded ? qual[i] : "", rec->qual);
+}
+
+
+static void check_span(CuTest *tc, size_t i, const fastq_span *rec, bool qual_loaded)
+{
+	CuAssertSizeTEquals(tc, desc_offsets[i], rec->descr_offset);
+	CuAssertSizeTEquals(tc, seq_offsets[i], rec->seq_offset);
+	CuAssertSizeTEquals(tc, qual_offsets[i], rec->qual_offset);
+	CuAssertSizeTEquals(tc, strlen(desc[i]), rec->descr_len);
+	CuAssertTrue(tc, strncmp(desc[i], rec->descr, rec->descr_len) == 0);
+	CuAssertSizeTEquals(tc, strlen(seq[i]), rec->seq_len);
+	CuAssertTrue(tc, strncmp(seq[i], rec->seq, rec->seq_len) == 0);
+	if (qual_loaded) {
+		CuAssertSizeTEquals(tc, strlen(qual[i]), rec->qual_len);
+		CuAssertTrue(tc, strncmp(qual[i], rec->qual, rec->qual_len) == 0);
+	}
+	else {
+		CuAssertTrue(tc, rec->qual == NULL);
+		CuAssertSizeTEquals(tc, 0, rec->qual_len);
+	}
+}
+
+
+void test_fastq_next(CuTest *tc)
+{
+	memdbg_reset();
+	test_setup();
+
+	for (int load_qual = 1; load_qual >= 0; load_qual--) {
+		rawptr_ok_err_res result = fastq_open_with_qual(filename, load_qual);
+		CuAssert(tc, "Error opening fastq", result.ok);
+		fastq *f = result.val.ok;
+		size_t i;
+		for (i = 0; fastq_has_next(f); i++) {
+			check_rec(tc, i, fastq_next(f), load_qual);
+		}
+		CuAssertSizeTEquals(tc, nrecs, i);
+		CuAssertTrue(tc, fastq_next(f) == NULL);
+		fastq_rewind(f);
+		check_rec(tc, 0, fastq_next(f), load_qual);
+		fastq_close(f);
+	}
+
+	test_teardown();
+	if (!memdbg_is_empty()) {
+		memdbg_print_stats(stdout, true);
+	}
+	CuAssert(tc, "Memory leak!", memdbg_is_empty());
+}
+
+
+void test_fastq_next_batch(CuTest *tc)
+{
+	memdbg_reset();
+	test_setup();
+
+	for (int load_qual = 1; load_qual >= 0; load_qual--) {
+		fastq *f = fastq_open_with_qual(filename, load_qual).val.ok;
+		size_t i = 0;
+		const fastq_span *recs;
+		for (size_t n; (n = fastq_next_batch(f, 2, &recs)) > 0; ) {
+			CuAssertTrue(tc, n <= 2);
+			for (size_t j = 0; j < n; j++, i++) {
+				check_span(tc, i, recs + j, load_qual);
+			}
+		}
+		CuAssertSizeTEquals(tc, nrecs, i);
+		fastq_close(f);
+	}
+
+	test_teardown();
+	if (!memdbg_is_empty()) {
+		memdbg_print_stats(stdout, true);
+	}
+	CuAssert(tc, "Memory leak!", memdbg_is_empty());
+}
+
+
+void test_fastq_pairs(CuTest *tc)
+{
+	memdbg_reset();
+	test_setup();
+
+	fastq *f = fastq_open(filename).val.ok;
+	const fastq_rec *fwd, *rev;
+	CuAssertTrue(tc, fastq_next_pair(f, &fwd, &rev));
+	check_rec(tc, 0, fwd, true);
+	check_rec(tc, 1, rev, true);
+	CuAssertTrue(tc, fastq_next_pair(f, &fwd, &rev));
+	check_rec(tc, 2, fwd, true);
+	check_rec(tc, 3, rev, true);
+	// odd number of records
+	CuAssertTrue(tc, !fastq_next_pair(f, &fwd, &rev));
+
+	fastq_rewind(f);
+	size_t i = 0;
+	const fastq_span *recs;
+	for (size_t n; (n = fastq_next_pair_batch(f, 1, &recs)) > 0; ) {
+		CuAssertSizeTEquals(tc, 1, n);
+		check_span(tc, i++, recs, true);
+		check_span(tc, i++, recs + 1, true);
+	}
+	CuAssertSizeTEquals(tc, 4, i);
+	fastq_close(f);
+
+	test_teardown();
+	if (!memdbg_is_empty()) {
+		memdbg_print_stats(stdout, true);
+	}
+	CuAssert(tc, "Memory leak!", memdbg_is_empty());
+}
+
+
+void test_fastq_truncated(CuTest *tc)
+{
+	memdbg_reset();
+	test_setup();
+
+	FILE *file = fopen(filename, "a");
+	fprintf(file, "@truncated\nACGT\n+\nII");
+	fclose(file);
+	fastq *f = fastq_open(filename).val.ok;
+	for (size_t i = 0; i < nrecs; i++) {
+		check_rec(tc, i, fastq_next(f), true);
+	}
+	CuAssertTrue(tc, fastq_next(f) == NULL);
+	fastq_rewind(f);
+	size_t n = 0;
+	const fastq_span *recs;
+	for (size_t m; (m = fastq_next_batch(f, 100, &recs)) > 0; n += m);
+	CuAssertSizeTEquals(tc, nrecs, n);
+	fastq_close(f);
+
+	test_teardown();
+	if (!memdbg_is_empty()) {
+		memdbg_print_stats(stdout, true);
+	}
+	CuAssert(tc, "Memory leak!", memdbg_is_empty());
+}
+
+
+void test_fastq_malformed(CuTest *tc)
+{
+	memdbg_reset();
+	const char *contents[2] = {
+		"@bad\nACGT\n+\nIIIIII\n@r1\nAC\n+\nII\n@r2\nGGT\n+\n###\n",
+		"@r1\nAC\n+\nII\n@bad\nACGT\n+\nIIIIII\n@r2\nGGT\n+\n###\n"
+	};
+	for (size_t t = 0; t < 2; t++) {
+		FILE *file = fopen(filename, "w");
+		fputs(contents[t], file);
+		fclose(file);
+		fastq *f = fastq_open(filename).val.ok;
+		const fastq_rec *rec;
+		rec = fastq_next(f);
+		CuAssertPtrNotNull(tc, rec);
+		CuAssertStrEquals(tc, "r1", rec->descr);
+		CuAssertStrEquals(tc, "II", rec->qual);
+		rec = fastq_next(f);
+		CuAssertPtrNotNull(tc, rec);
+		CuAssertStrEquals(tc, "r2", rec->descr);
+		CuAssertStrEquals(tc, "###", rec->qual);
+		CuAssertTrue(tc, fastq_next(f) == NULL);
+
+		fastq_rewind(f);
+		const fastq_span *recs;
+		const char *descrs[2] = {"r1", "r2"};
+		size_t i = 0;
+		for (size_t n; (n = fastq_next_batch(f, 100, &recs)) > 0; ) {
+			for (size_t j = 0; j < n; j++, i++) {
+				CuAssertTrue(tc, i < 2);
+				CuAssertSizeTEquals(tc, 2, recs[j].descr_len);
+				CuAssertTrue(tc, strncmp(descrs[i], recs[j].descr, 2) == 0);
+				CuAssertSizeTEquals(tc, 2 + i, recs[j].qual_len);
+			}
+		}
+		CuAssertSizeTEquals(tc, 2, i);
+		fastq_close(f);
+	}
+	test_teardown();
+	if (!memdbg_is_empty()) {
+		memdbg_print_stats(stdout, true);
+	}
+	CuAssert(tc, "Memory leak!", memdbg_is_empty());
+}
+
+
+/*
+ * Writes a large FASTQ file with records of random lengths, some with
+ * CRLF line breaks or multi-line sequences and qualities, and one record
+ * larger than the reader buffer.
+ */
+static size_t write_large_fastq(const char *path, bool gzip)
+{
+	size_t n = 20000, len = 0;
+	char *data = malloc(1 << 24);
+	srand(23);
+	for (size_t i = 0; i < n; i++) {
+		const char *eol = (i % 7 == 3) ? "\r\n" : "\n";
+		len += sprintf(data + len, "@read_%zu/%zu%s", i / 2, 1 + i % 2, eol);
+		size_t sl = (i == n / 2) ? 300000 : (size_t)(rand() % 300);
+		size_t width = (i % 5 == 1) ? 1 + (size_t)(rand() % 80) : sl + 1;
+		for (int q = 0; q < 2; q++) {
+			for (size_t j = 0; j < sl; j++) {
+				data[len++] = q ? "@+!I#"[rand() % 5] : "ACGT"[rand() % 4];
+				if ((j + 1) % width == 0 || j + 1 == sl) {
+					len += sprintf(data + len, "%s", eol);
+				}
+			}
+			if (sl == 0) {
+				len += sprintf(data + len, "%s", eol);
+			}
+			if (!q) {
+				len += sprintf(data + len, "+%s", eol);
+			}
+		}
+	}
+	FILE *file = fopen(path, "w");
+	fwrite(data, 1, len, file);
+	fclose(file);
+#ifdef HAVE_ZLIB
+	if (gzip) {
+		gzFile gz = gzopen(path, "wb");
+		gzwrite(gz, data, len);
+		gzclose(gz);
+	}
+#endif
+	free(data);
+	return n;
+}
+
+
+static void check_batches(CuTest *tc, const char *path, size_t n, size_t unit)
+{
+	fastq *f = fastq_open(path).val.ok;
+	fastq *g = fastq_open(path).val.ok;
+	CuAssertPtrNotNull(tc, f);
+	CuAssertPtrNotNull(tc, g);
+	size_t i = 0, max = 1;
+	const fastq_span *recs;
+	for (size_t m; (m = (unit == 1) ? fastq_next_batch(f, max, &recs)
+	                    : fastq_next_pair_batch(f, max, &recs)) > 0;
+	        max = 1 + (max * 3) % 1000) {
+		for (size_t j = 0; j < m * unit; j++, i++) {
+			const fastq_rec *rec = fastq_next(g);
+			CuAssertPtrNotNull(tc, rec);
+			CuAssertSizeTEquals(tc, rec->descr_offset, recs[j].descr_offset);
+			CuAssertSizeTEquals(tc, rec->seq_offset, recs[j].seq_offset);
+			CuAssertSizeTEquals(tc, rec->qual_offset, recs[j].qual_offset);
+			CuAssertSizeTEquals(tc, strlen(rec->descr), recs[j].descr_len);
+			CuAssertTrue(tc, strncmp(rec->descr, recs[j].descr, recs[j].descr_len) == 0);
+			CuAssertSizeTEquals(tc, strlen(rec->seq), recs[j].seq_len);
+			CuAssertTrue(tc, strncmp(rec->seq, recs[j].seq, recs[j].seq_len) == 0);
+			CuAssertSizeTEquals(tc, strlen(rec->qual), recs[j].qual_len);
+			CuAssertTrue(tc, strncmp(rec->qual, recs[j].qual, recs[j].qual_len) == 0);
+			CuAssertTrue(tc, strspn(rec->seq, "ACGT") == recs[j].seq_len);
+			CuAssertTrue(tc, strspn(rec->qual, "@+!I#") == recs[j].qual_len);
+		}
+	}
+	CuAssertSizeTEquals(tc, n, i);
+	CuAssertTrue(tc, fastq_next(g) == NULL);
+	fastq_close(f);
+	fastq_close(g);
+}
+
+
+void test_fastq_large(CuTest *tc)
+{
+	memdbg_reset();
+	char *path = "test_fastq_large.fq";
+	size_t n = write_large_fastq(path, false);
+	check_batches(tc, path, n, 1);
+	check_batches(tc, path, n, 2);
+	remove(path);
+
+#ifdef HAVE_ZLIB
+	path = "test_fastq_large.fq.gz";
+	n = write_large_fastq(path, true);
+	check_batches(tc, path, n, 2);
+	remove(path);
+#endif
+
+	if (!memdbg_is_empty()) {
+		memdbg_print_stats(stdout, true);
+	}
+	CuAssert(tc, "Memory leak!", memdbg_is_empty());
+}
+
+
+void test_fastqidx(CuTest *tc)
+{
+	memdbg_reset();
+	test_setup();
+
+	fastq *f = fastq_open(filename).val.ok;
+	fastqidx *idx = fastqidx_new(filename);
+	for (const fastq_rec *rec; (rec = fastq_next(f)) != NULL; ) {
+		fastqidx_add(idx, rec->descr_offset, rec->seq_offset, rec->qual_offset);
+	}
+	CuAssertSizeTEquals(tc, nrecs, fastqidx_size(idx));
+	CuAssertStrEquals(tc, filename, fastqidx_path(idx));
+	for (int i = nrecs - 1; i >= 0; i--) {
+		fastq_rec_offs offs = fastqidx_get(idx, i);
+		CuAssertSizeTEquals(tc, desc_offsets[i], offs.descr_off);
+		CuAssertSizeTEquals(tc, seq_offsets[i], offs.seq_off);
+		CuAssertSizeTEquals(tc, qual_offsets[i], offs.qual_off);
+		CuAssertTrue(tc, fastq_goto(f, offs.descr_off));
+		check_rec(tc, i, fastq_next(f), true);
+	}
+	fastqidx_free(idx);
+	fastq_close(f);
+
+	test_teardown();
+	if (!memdbg_is_empty()) {
+		memdbg_print_stats(stdout, true);
+	}
+	CuAssert(tc, "Memory leak!", memdbg_is_empty());
+}
+
+
+CuSuite *fastq_get_test_suite()
+{
+	CuSuite *suite = CuSuiteNew();
+	SUITE_ADD_TEST(suite, test_fastq_next);
+	SUITE_ADD_TEST(suite, test_fastq_next_batch);
+	SUITE_ADD_TEST(suite, test_fastq_pairs);
+	SUITE_ADD_TEST(suite, test_fastq_truncated);
+	SUITE_ADD_TEST(suite, test_fastq_malformed);
+	SUITE_ADD_TEST(suite, test_fastq_large);
+	SUITE_ADD_TEST(suite, test_fastqidx);
+	return suite;
+}
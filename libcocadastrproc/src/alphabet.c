@@ -22,9 +22,13 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
 
 #include "alphabet.h"
 #include "arrays.h"
@@ -36,6 +40,7 @@
 #include "cstrutil.h"
 #include "hashmap.h"
 #include "mathutil.h"
+#include "xstr.h"
 
 
 #define UCHAR_RANGE (UCHAR_MAX+1)
@@ -55,9 +60,53 @@ struct _alphabet {
 		size_t        *arr;
 		char_rank_func func;
 	} ranks;
+	uint8_t *rank8;        // byte ranks of a char alphabet
+	bool     nib;          // whether chars are told apart by their low nibble
+	uint8_t  nib_rank[16]; // rank of the chars of each low nibble
+	uint8_t  nib_chr[2][16]; // (up to two) chars of each low nibble
 };
 
 
+/*
+ * Builds the tables for bulk ranking of a char alphabet. As a char
+ * alphabet has at most 256 letters, ranks of chars (including the
+ * rank ab_size of non-letters) always fit in a byte.
+ * Small alphabets in which all chars sharing their lowest 4 bits have
+ * the same rank (e.g. "ACGTacgt") can be ranked with a 16-entry
+ * table lookup on the low nibble, which is done 16 chars at a time
+ * with a byte shuffle when SSSE3 is available.
+ */
+static void _init_bulk_tables(alphabet *ab)
+{
+	ab->rank8 = ARR_NEW(uint8_t, UCHAR_RANGE);
+	for (size_t c = 0; c < UCHAR_RANGE; c++) {
+		ab->rank8[c] = (uint8_t)ab->ranks.arr[c];
+	}
+	ab->nib = (ab->size <= 16);
+	size_t nchrs[16] = {0};
+	for (size_t n = 0; n < 16; n++) {
+		ab->nib_rank[n] = (uint8_t)ab->size;
+		// a char with a different low nibble never matches
+		ab->nib_chr[0][n] = ab->nib_chr[1][n] = (uint8_t)(n ^ 1);
+	}
+	for (size_t c = 0; c < UCHAR_RANGE && ab->nib; c++) {
+		if (ab->ranks.arr[c] == ab->size) continue;
+		size_t n = c & 0x0F;
+		if ( nchrs[n] == 2
+		        || (nchrs[n] == 1 && ab->nib_rank[n] != ab->ranks.arr[c]) ) {
+			ab->nib = false;
+			break;
+		}
+		ab->nib_rank[n] = (uint8_t)ab->ranks.arr[c];
+		ab->nib_chr[nchrs[n]++][n] = (uint8_t)c;
+	}
+	for (size_t n = 0; n < 16; n++) {
+		if (nchrs[n] == 1)
+			ab->nib_chr[1][n] = ab->nib_chr[0][n];
+	}
+}
+
+
 alphabet *alphabet_new(size_t size, const char *letters)
 {
 	alphabet *ret;
@@ -82,6 +131,7 @@ alphabet *alphabet_new(size_t size, const char *letters)
 		ret->ranks.arr[i] = MIN(ret->ranks.arr[i], ret->size);
 	}
 	ret->letters = cstr_crop_len(ret->letters, ret->size);
+	_init_bulk_tables(ret);
 	return ret;
 }
 
@@ -118,6 +168,7 @@ alphabet *alphabet_new_with_equivs(size_t size, char **letters)
 		ret->ranks.arr[i] = MIN(ret->ranks.arr[i], ret->size);
 	}
 	ret->letters = cstr_crop_len(ret->letters, ret->size);
+	_init_bulk_tables(ret);
 	return ret;
 }
 
@@ -137,6 +188,8 @@ alphabet *int_alphabet_new(size_t size)
 	ret->size = size;
 	ret->letters = NULL;
 	ret->ranks.func = int_ab_rank;
+	ret->rank8 = NULL;
+	ret->nib = false;
 	return ret;
 }
 
@@ -161,6 +214,7 @@ void alphabet_free(alphabet *ab)
 	switch (ab->rank_mode) {
 	case ARRAY:
 		FREE(ab->ranks.arr);
+		FREE(ab->rank8);
 		break;
 	default:
 		break;
@@ -177,6 +231,7 @@ void alphabet_finalise(void *ptr, const finaliser *fnr)
 	switch (ab->rank_mode) {
 	case ARRAY:
 		FREE(ab->ranks.arr);
+		FREE(ab->rank8);
 		break;
 	default:
 		break;
@@ -207,7 +262,7 @@ xchar_t ab_char(const alphabet *ab, size_t index)
 {
 	switch (ab->type) {
 	case CHAR_TYPE:
-		return (char)(ab->letters[index]);
+		return (unsigned char)(ab->letters[index]);
 		break;
 	case INT_TYPE:
 		return (xchar_t)index;
@@ -239,3 +294,132 @@ int ab_cmp(const alphabet *ab, xchar_t a, xchar_t b)
 	else if (ra<rb) return -1;
 	else return +1;
 }
+
+
+#if defined(__SSSE3__)
+
+// Ranks 16 chars at a time by nibble lookup. Returns the number of
+// chars processed (a multiple of 16) and adds the number of
+// unknown chars to *nunk.
+static size_t _rank_bytes_ssse3(const alphabet *ab, const char *src,
+                                size_t len, uint8_t *dest, size_t *nunk)
+{
+	const __m128i lo = _mm_set1_epi8(0x0F);
+	const __m128i unk = _mm_set1_epi8((char)ab->size);
+	const __m128i rk = _mm_loadu_si128((const __m128i *)ab->nib_rank);
+	const __m128i ca = _mm_loadu_si128((const __m128i *)ab->nib_chr[0]);
+	const __m128i cb = _mm_loadu_si128((const __m128i *)ab->nib_chr[1]);
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i idx = _mm_and_si128(v, lo);
+		__m128i ok = _mm_or_si128(
+		                 _mm_cmpeq_epi8(v, _mm_shuffle_epi8(ca, idx)),
+		                 _mm_cmpeq_epi8(v, _mm_shuffle_epi8(cb, idx)) );
+		__m128i r = _mm_or_si128( _mm_and_si128(ok, _mm_shuffle_epi8(rk, idx)),
+		                          _mm_andnot_si128(ok, unk) );
+		_mm_storeu_si128((__m128i *)(dest + i), r);
+		unsigned int bad = (~(unsigned int)_mm_movemask_epi8(ok)) & 0xFFFF;
+		while (bad) {
+			(*nunk)++;
+			bad &= bad - 1;
+		}
+	}
+	return i;
+}
+
+#endif
+
+
+size_t ab_rank_bytes(const alphabet *ab, const char *src, size_t len,
+                     byte_t *dest)
+{
+	size_t nunk = 0, i = 0;
+	switch (ab->type) {
+	case CHAR_TYPE:
+#if defined(__SSSE3__)
+		if (ab->nib)
+			i = _rank_bytes_ssse3(ab, src, len, dest, &nunk);
+#endif
+		for (; i < len; i++) {
+			dest[i] = ab->rank8[(unsigned char)src[i]];
+			nunk += (dest[i] == ab->size);
+		}
+		break;
+	case INT_TYPE:
+		for (; i < len; i++) {
+			size_t r = ab_rank(ab, (unsigned char)src[i]);
+			dest[i] = (byte_t)r;
+			nunk += (r == ab->size);
+		}
+		break;
+	}
+	return nunk;
+}
+
+
+#define RANK_BLOCK 1024
+
+size_t ab_rank_str(const alphabet *ab, const char *src, size_t len,
+                   xstr *dest)
+{
+	xstr_clear(dest);
+	if (xstr_sizeof_char(dest) == 1) {
+		xstr_push_n(dest, 0, len);
+		return ab_rank_bytes(ab, src, len, xstr_as_uint8_t(dest));
+	}
+	size_t nunk = 0;
+	byte_t rks[RANK_BLOCK];
+	xchar_t xrks[RANK_BLOCK];
+	for (size_t i = 0; i < len; i += RANK_BLOCK) {
+		size_t n = MIN(RANK_BLOCK, len - i);
+		nunk += ab_rank_bytes(ab, src + i, n, rks);
+		for (size_t j = 0; j < n; j++) {
+			xrks[j] = rks[j];
+		}
+		xstr_set_range(dest, i, n, xrks);
+	}
+	return nunk;
+}
+
+
+void ab_char_str(const alphabet *ab, const xstr *src, char *dest)
+{
+	size_t len = xstr_len(src);
+	if (ab->type == CHAR_TYPE && xstr_sizeof_char(src) == 1) {
+		const byte_t *rks = xstr_as_bytes(src);
+		for (size_t i = 0; i < len; i++) {
+			dest[i] = ab->letters[rks[i]];
+		}
+	} else {
+		xchar_t rks[RANK_BLOCK];
+		for (size_t i = 0; i < len; i += RANK_BLOCK) {
+			size_t n = MIN(RANK_BLOCK, len - i);
+			xstr_get_range(src, i, n, rks);
+			for (size_t j = 0; j < n; j++) {
+				dest[i + j] = (char)ab_char(ab, rks[j]);
+			}
+		}
+	}
+	dest[len] = '\0';
+}
+
+
+size_t ab_validate_str(const alphabet *ab, const char *src, size_t len,
+                       size_t *first_unknown)
+{
+	size_t nunk = 0;
+	*first_unknown = len;
+	byte_t rks[RANK_BLOCK];
+	for (size_t i = 0; i < len; i += RANK_BLOCK) {
+		size_t n = MIN(RANK_BLOCK, len - i);
+		size_t nu = ab_rank_bytes(ab, src + i, n, rks);
+		if (nu && nunk == 0) {
+			size_t j = 0;
+			while (rks[j] != ab->size) j++;
+			*first_unknown = i + j;
+		}
+		nunk += nu;
+	}
+	return nunk;
+}
@@ -25,8 +25,10 @@
 #include <stddef.h>
 #include <stdlib.h>
 
+#include "coretype.h"
 #include "new.h"
 #include "xchar.h"
+#include "xstr.h"
 
 /**
  * @file alphabet.h
@@ -178,4 +180,53 @@ size_t ab_rank(const alphabet *ab, xchar_t c);
 int ab_cmp(const alphabet *ab, xchar_t a, xchar_t b);
 
 
+/**
+ * @brief Bulk version of ::ab_rank. Writes the ranks of the @p len
+ *        chars of @p src into @p dest.
+ *
+ * Since a char alphabet has at most 256 letters, the ranks of plain
+ * chars (including the rank ab_size(ab) of chars not in the alphabet)
+ * always fit in a byte. For char alphabets of up to 16 letters in
+ * which equivalent letters share their lowest 4 bits (e.g. DNA with
+ * upper and lower case), the ranks are computed 16 chars at a time
+ * with a byte shuffle when compiled with SSSE3 support.
+ *
+ * @param dest (out) The ranks. Must have room for @p len bytes.
+ * @return The number of chars not in the alphabet.
+ */
+size_t ab_rank_bytes(const alphabet *ab, const char *src, size_t len,
+                     byte_t *dest);
+
+
+/**
+ * @brief Same as ::ab_rank_bytes, with the ranks written into the
+ *        xstr @p dest, which is cleared first.
+ * @param dest (out) The ranks. Its char size must be large enough for
+ *        ranks up to ab_size(ab).
+ * @return The number of chars not in the alphabet.
+ */
+size_t ab_rank_str(const alphabet *ab, const char *src, size_t len,
+                   xstr *dest);
+
+
+/**
+ * @brief Bulk version of ::ab_char. Writes the letters with the ranks
+ *        in @p src into @p dest followed by a '\0'. @p dest must have room
+ *        for xstr_len(src)+1 chars. For ranks >= ab_size(ab) the
+ *        behaviour is undefined.
+ */
+void ab_char_str(const alphabet *ab, const xstr *src, char *dest);
+
+
+/**
+ * @brief Checks whether all the @p len chars of @p src belong to the
+ *        alphabet.
+ * @param first_unknown (out) The position of the first char not in
+ *        the alphabet, or @p len if there is none.
+ * @return The number of chars not in the alphabet.
+ */
+size_t ab_validate_str(const alphabet *ab, const char *src, size_t len,
+                       size_t *first_unknown);
+
+
 #endif
\ No newline at end of file
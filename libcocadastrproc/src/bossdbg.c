@@ -21,8 +21,10 @@
 
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "alphabet.h"
 #include "arrays.h"
@@ -32,8 +34,9 @@
 #include "new.h"
 #include "csrsbitarr.h"
 #include "cstrutil.h"
+#include "errlog.h"
 #include "bossdbg.h"
-#include "vec.h"
+#include "iter.h"
 #include "strbuf.h"
 #include "mathutil.h"
 #include "strstream.h"
@@ -51,7 +54,8 @@ struct _dbgraph {
 	wavtree      *edge_lbl_wt;
 	csrsbitarr *true_node;
 	size_t       *char_cumul_count;
-	csrsbitarr *node_lbl_last_char;
+	size_t       *char_node_offset; // # of nodes whose label ends in a smaller char
+	byte_t       *dummy;            // edges of nodes with $-prefixed labels
 };
 
 
@@ -94,30 +98,108 @@ static alphabet *get_ext_ab(alphabet *input_ab)
 }
 
 
-typedef struct {
-	xstr  *txt;
-	size_t    pos;
-	size_t    k;
-} kmer_t;
+/*
+ * Packed (k+1)-mers.
+ * A (k+1)-mer c[0..k] over the extended alphabet is packed into nw 64-bit
+ * words, with b bits per char. The edge char c[k] is stored in digit 0
+ * and c[j] in digit j+1, where digit i occupies bits [ib, (i+1)b) and word
+ * 0 is the least significant. Hence the integer order of the keys is
+ * the order by c[k-1], c[k-2], ..., c[0] and then by the edge label c[k].
+ */
+
+static inline uint64_t _key_digit(const uint64_t *key, size_t i, size_t b)
+{
+	size_t pos = i * b, w = pos / 64, off = pos % 64;
+	uint64_t d = key[w] >> off;
+	if (off + b > 64)
+		d |= key[w+1] << (64 - off);
+	return d & ((UINT64_C(1) << b) - 1);
+}
 
 
-kmer_t *kmer_new(xstr *txt, size_t pos, size_t k)
+// ORs digit i of the key with d, assuming it is zero.
+static inline void _key_or_digit(uint64_t *key, size_t i, size_t b,
+                                 uint64_t d)
 {
-	kmer_t *ret = NEW(kmer_t);
-	ret->txt = txt;
-	ret->k = k;
-	ret->pos = pos;
-	return ret;
+	size_t pos = i * b, w = pos / 64, off = pos % 64;
+	key[w] |= d << off;
+	if (off + b > 64)
+		key[w+1] |= d >> (64 - off);
 }
 
 
-static size_t kmer_key_fn(const void *kp, size_t d)
+// Slides the (k+1)-mer window one position, appending edge char e.
+static inline void _key_roll(uint64_t *key, size_t nw, size_t k, size_t b,
+                             uint64_t e)
 {
-	kmer_t *km = *(kmer_t **)kp;
-	if ( d == 0 )
-		return xstr_get(km->txt, km->pos + km->k - 1);
-	else
-		return xstr_get(km->txt, km->pos + d - 1 );
+	uint64_t cmask = (UINT64_C(1) << b) - 1;
+	uint64_t last = key[0] & cmask;
+	for (size_t w = 0; w + 1 < nw; w++)
+		key[w] = (key[w] >> b) | (key[w+1] << (64 - b));
+	key[nw-1] >>= b;
+	key[0] = (key[0] & ~cmask) | e;
+	_key_or_digit(key, k, b, last);
+}
+
+
+// Compares two keys disregarding their lowest f bits.
+static inline bool _key_eq_from(const uint64_t *x, const uint64_t *y,
+                                size_t nw, size_t f)
+{
+	size_t w = f / 64;
+	if (w >= nw) return true;
+	if ((x[w] ^ y[w]) >> (f % 64)) return false;
+	for (w++; w < nw; w++)
+		if (x[w] != y[w]) return false;
+	return true;
+}
+
+
+// LSD radix sort of n records of nw words each, by their lowest nbits
+// bits. Byte positions where all keys coincide are skipped.
+static void _keys_radixsort(uint64_t *keys, size_t n, size_t nw,
+                            size_t nbits)
+{
+	size_t nbyt = (nbits + 7) / 8;
+	size_t *hist = ARR_NEW(size_t, nbyt * 256);
+	ARR_FILL(hist, 0, nbyt * 256, 0);
+	for (size_t i = 0; i < n; i++) {
+		const uint64_t *key = keys + (i * nw);
+		for (size_t j = 0; j < nbyt; j++)
+			hist[(j * 256) + ((key[j/8] >> ((j%8) * 8)) & 0xFF)]++;
+	}
+
+	uint64_t *src = keys;
+	uint64_t *dst = ARR_NEW(uint64_t, n * nw);
+	uint64_t *tmp = dst;
+	for (size_t j = 0; j < nbyt; j++) {
+		size_t w = j / 8, sh = (j % 8) * 8;
+		size_t *cnt = hist + (j * 256);
+		if (cnt[(src[w] >> sh) & 0xFF] == n)
+			continue;
+		for (size_t d = 0, off = 0, c; d < 256; d++) {
+			c = cnt[d];
+			cnt[d] = off;
+			off += c;
+		}
+		if (nw == 1) {
+			for (size_t i = 0; i < n; i++)
+				dst[cnt[(src[i] >> sh) & 0xFF]++] = src[i];
+		} else {
+			for (size_t i = 0; i < n; i++) {
+				const uint64_t *key = src + (i * nw);
+				size_t p = cnt[(key[w] >> sh) & 0xFF]++;
+				memcpy(dst + (p * nw), key, nw * sizeof(uint64_t));
+			}
+		}
+		uint64_t *swp = src;
+		src = dst;
+		dst = swp;
+	}
+	if (src != keys)
+		memcpy(keys, src, n * nw * sizeof(uint64_t));
+	FREE(tmp);
+	FREE(hist);
 }
 
 
@@ -127,100 +209,75 @@ static void _init_cumul_char_count(dbgraph *graph, size_t *cumul_char_count)
 	size_t eabsize = ab_size(graph->ext_ab);
 	assert(graph->nedges == cumul_char_count[eabsize]);
 	//ARR_PRINT(cumul_char_count, cumul_char_count, %zu, 0, eabsize, eabsize);
-	size_t l = eabsize + graph->nedges;
-	byte_t *bits = bitarr_new(l);
-	for (size_t i=0; i<eabsize; i++)
-		bitarr_set_bit(bits, cumul_char_count[i+1]+i, 1);
-	graph->node_lbl_last_char = csrsbitarr_new(bits, l);
-	//csrsbitarr_fprint(graph->node_lbl_last_char, 4);
+	graph->char_node_offset = ARR_NEW(size_t, eabsize+1);
+	graph->char_node_offset[0] = 0;
+	for (size_t i=1; i<=eabsize; i++)
+		graph->char_node_offset[i] = csrsbitarr_rank1(graph->true_node,
+		                             cumul_char_count[i]);
 }
 
 
 
 
-static dbgraph *_dbg_init( alphabet *ab, strstream *sst, size_t k,
-                           bool multigraph )
+// bits per packed char: the k+1-mers only contain the sentinel and
+// the (positive) input chars, i.e. values 0..|ab|
+static size_t _packed_char_bits(alphabet *ab)
 {
-	alphabet *ext_ab = get_ext_ab(ab);
-	size_t sizeof_ext_char = nbytes(ab_size(ext_ab));
+	size_t b = 1;
+	while ((UINT64_C(1) << b) < ab_size(ab) + 1)
+		b++;
+	assert(b < 64);
+	return b;
+}
 
-	// build padded string with k sentinels at the beginning an one at the end
-	xstr *padstr = xstr_new(sizeof_ext_char);
-	for (size_t i=0; i<k; i++)
-		xstr_push(padstr, SENTINEL);
-	for (xchar_t c; (c=strstream_getc(sst))!=XEOF; )
-		xstr_push(padstr, (xchar_t)(ab_rank(ab, c) + 1));
-	xstr_push(padstr, SENTINEL);
-	xstr_fit(padstr);
-	//xstr_print(padstr);
-
-	// build list of k+1mers
-	vec *kp1mers = vec_new(sizeof(kmer_t *));
-	for (size_t i=0, padslen=xstr_len(padstr), l=padslen-(k+1); i<=l; i++) {
-		kmer_t *kmer = kmer_new(padstr, i, k+1);
-		vec_push(kp1mers, &kmer);
-	}
-
-	//printf("kmers before sort:\n");
-	//xstr *kmstr = xstr_new(sizeof_ext_char);
-	//strbuf *kmdstr = strbuf_new();
-	//for (size_t i=0, l=vec_len(kp1mers); i<l; i++) {
-	//    kmer_t *kp1mer = *(kmer_t **)vec_get(kp1mers, i);
-	//    xstr_ncpy(kmstr, 0, kp1mer->txt, kp1mer->pos, k+1);
-	//    xstr_to_string(kmstr, kmdstr);
-	//    printf("kmer[%*zu]=%s\n",2, i, strbuf_as_str(kmdstr));
-	//    strbuf_clear(kmdstr);
-	//}
-	//xstr_free(kmstr);
-	//strbuf_free(kmdstr);
 
-	// sort the k+1-mers
-	vec_radixsort(kp1mers, &kmer_key_fn, k+1, ab_size(ext_ab));
-
-	//printf("kmers after sort:\n");
-	//kmstr = xstr_new(sizeof_ext_char);
-	//kmdstr = strbuf_new();
-	//for (size_t i=0, l=vec_len(kp1mers); i<l; i++) {
-	//    kmer_t *kp1mer = *(kmer_t **)vec_get(kp1mers, i);
-	//    xstr_ncpy(kmstr, 0, kp1mer->txt, kp1mer->pos, k+1);
-	//    xstr_to_string(kmstr, kmdstr);
-	//    printf("kmer[%*zu]=%s\n",2, i, strbuf_as_str(kmdstr));
-	//    strbuf_clear(kmdstr);
-	//}
-	//xstr_free(kmstr);
-	//strbuf_free(kmdstr);
-
-	xstr *edge_labels  = xstr_new_with_capacity( sizeof_ext_char, xstr_len(padstr));
-	byte_t *last_node   = bitarr_new(vec_len(kp1mers));
-	size_t *char_count = ARR_NEW(size_t, ab_size(ext_ab)+1);
-	ARR_FILL(char_count, 0, ab_size(ext_ab)+1, 0);
+/*
+ * Builds the graph from nrecs sorted packed k+1-mer records of stride
+ * words each. If stride > nw, the word following each key holds its
+ * multiplicity. Otherwise, repeated k+1-mers appear as equal
+ * consecutive keys.
+ */
+static dbgraph *_dbg_from_sorted_keys( alphabet *ab, const uint64_t *keys,
+                                       size_t nrecs, size_t stride,
+                                       size_t nw, size_t b, size_t k,
+                                       bool multigraph )
+{
+	alphabet *ext_ab = get_ext_ab(ab);
+	size_t eabsize = ab_size(ext_ab);
+	size_t sizeof_ext_char = nbytes(eabsize);
+	bool counted = (stride > nw);
+
+	size_t maxedges = nrecs;
+	if (counted && multigraph) {
+		maxedges = 0;
+		for (size_t i=0; i<nrecs; i++)
+			maxedges += keys[(i * stride) + nw];
+	}
+
+	xstr *edge_labels  = xstr_new_with_capacity(sizeof_ext_char, maxedges);
+	byte_t *last_node   = bitarr_new(maxedges);
+	byte_t *dummy       = bitarr_new(maxedges);
+	size_t *char_count = ARR_NEW(size_t, eabsize+1);
+	ARR_FILL(char_count, 0, eabsize+1, 0);
 
 	size_t nnodes = 0; // # of *distinct* nodes (k-mers)
 	size_t nedges = 0; // # of *distinct* edges (k+1-mers)
 
-	byte_t *km1mers_chars = bitarr_new(sizeof_ext_char);
-	xstr *lastkp1mers[2];
-	lastkp1mers[0] = xstr_new_with_capacity(sizeof_ext_char, k+1);
-	lastkp1mers[1] = xstr_new_with_capacity(sizeof_ext_char, k+1);
-	xstr *lastkm1mers[2];
-	lastkm1mers[0] = xstr_new_with_capacity(sizeof_ext_char, k-1);
-	lastkm1mers[1] = xstr_new_with_capacity(sizeof_ext_char, k-1);
-	size_t this_line, last_line;
-	kmer_t *kp1mer;
+	size_t km1mers_chars_nbytes = (eabsize + 7) / 8;
+	byte_t *km1mers_chars = bitarr_new(eabsize);
+	uint64_t cmask = (UINT64_C(1) << b) - 1;
 	bool new_edge = false;
 	xchar_t edge_chr;
 
 	// scan sorted k+1-mers to identify nodes and edges
-	for (size_t i=0, nkp1mers = vec_len(kp1mers); i<nkp1mers; i++) {
-		this_line = i%2;
-		last_line = (i+1)%2;
-		kp1mer = *(kmer_t **)vec_get(kp1mers, i);
-		xstr_ncpy(lastkp1mers[this_line], 0, kp1mer->txt, kp1mer->pos, k+1);
+	for (size_t i=0; i<nrecs; i++) {
+		const uint64_t *cur = keys + (i * stride);
+		const uint64_t *prev = cur - stride;
 
 		// compare this k+1-mer with the previous
 		// if the first k chars are different from previous line,
 		//              then it's a new node (and also necessarily a new edge)
-		if (xstr_ncmp(lastkp1mers[this_line], lastkp1mers[last_line], k)) {
+		if (i == 0 || !_key_eq_from(cur, prev, nw, b)) {
 			if (nedges > 0)
 				bitarr_set_bit(last_node, nedges-1, 1);
 			nnodes++;
@@ -229,8 +286,7 @@ static dbgraph *_dbg_init( alphabet *ab, strstream *sst, size_t k,
 		else {
 			// else if the first k chars (node label) are the same, but the
 			// last one (edge label) is different, then it is new edge
-			if ( xstr_get(lastkp1mers[this_line], k)
-			        != xstr_get(lastkp1mers[last_line], k) )
+			if ( (cur[0] & cmask) != (prev[0] & cmask) )
 				new_edge = true;
 
 			// otherwise, then the entire k+1-mer is the same, and so
@@ -243,15 +299,20 @@ static dbgraph *_dbg_init( alphabet *ab, strstream *sst, size_t k,
 		// now, check the (k-1)-mers (suffix of the node label).
 		// if the last node label suffix is different from previous
 		// we clear edge labels marks and start afresh
-		xstr_ncpy(lastkm1mers[this_line], 0, kp1mer->txt, kp1mer->pos+1, k-1);
-		if (xstr_cmp(lastkm1mers[this_line], lastkm1mers[last_line])) {
-			ARR_FILL(km1mers_chars, 0, sizeof_ext_char, 0x0);
+		if (i == 0 || !_key_eq_from(cur, prev, nw, 2 * b)) {
+			ARR_FILL(km1mers_chars, 0, km1mers_chars_nbytes, 0x0);
 		}
 
-		// then, if we are adding another edge...
-		if ( new_edge ) {
+		// a counted k+1-mer stands for as many equal consecutive ones
+		uint64_t mult = counted ? cur[nw] : 1;
+		for (uint64_t r=0; r<mult; r++) {
+			if (r > 0)
+				new_edge = multigraph;
+			// then, if we are adding another edge...
+			if ( !new_edge )
+				break;
 			nedges++;
-			edge_chr = xstr_get(lastkp1mers[this_line], k);
+			edge_chr = (xchar_t)(cur[0] & cmask);
 			// ... and the edge char has already been marked with the same
 			// node label suffix, the edge label should be its corresponding
 			// extended char
@@ -263,7 +324,10 @@ static dbgraph *_dbg_init( alphabet *ab, strstream *sst, size_t k,
 			// whatever the case, set the new edge label char
 			xstr_push(edge_labels, edge_chr);
 			// and update the count of the last node label char
-			char_count[ab_rank(ext_ab, xstr_get(lastkp1mers[this_line], k-1)) + 1]++;
+			char_count[ab_rank(ext_ab, (xchar_t)_key_digit(cur, k, b)) + 1]++;
+			// the node label starts with $ iff c[0] (digit 1) does
+			if (_key_digit(cur, 1, b) == SENTINEL)
+				bitarr_set_bit(dummy, nedges-1, 1);
 		}
 	}
 	xstr_fit(edge_labels);
@@ -274,7 +338,6 @@ static dbgraph *_dbg_init( alphabet *ab, strstream *sst, size_t k,
 	dbgraph *graph = NEW(dbgraph);
 	graph->input_ab = ab;
 	graph->ext_ab = ext_ab;
-	//graph->txt = padstr;
 	graph->k = k;
 	graph->multi = multigraph;
 	graph->nnodes = nnodes;
@@ -282,7 +345,8 @@ static dbgraph *_dbg_init( alphabet *ab, strstream *sst, size_t k,
 	graph->edge_lbl_wt = wavtree_new_from_xstr( ext_ab, edge_labels,
 	                     WT_HUFFMAN );
 	graph->true_node = csrsbitarr_new(last_node, nedges);
-	for (size_t i=1, l=ab_size(ext_ab)+1; i<l; i++) {
+	graph->dummy = dummy;
+	for (size_t i=1, l=eabsize+1; i<l; i++) {
 		char_count[i] += char_count[i-1];
 	}
 	_init_cumul_char_count(graph, char_count);
@@ -291,19 +355,49 @@ static dbgraph *_dbg_init( alphabet *ab, strstream *sst, size_t k,
 	//wavtree_print(graph->edge_lbl_wt);
 
 	// clean up temporary stuff
-	xstr_free(padstr);
 	xstr_free(edge_labels);
-	DESTROY(kp1mers, finaliser_cons(FNR(vec), finaliser_new_ptr()));
-	FREE(lastkm1mers[0]);
-	FREE(lastkm1mers[1]);
-	FREE(lastkp1mers[0]);
-	FREE(lastkp1mers[1]);
 	FREE(km1mers_chars);
 
 	return graph;
 }
 
 
+static dbgraph *_dbg_init( alphabet *ab, strstream *sst, size_t k,
+                           bool multigraph )
+{
+	size_t b = _packed_char_bits(ab);
+	size_t nw = (((k + 1) * b) + 63) / 64;
+
+	// build the packed k+1-mers of the input padded to the left with
+	// k sentinels and to the right with a single sentinel, by sliding
+	// a window over the stream.
+	size_t nkeys = 0, cap = 1024;
+	uint64_t *keys = ARR_NEW(uint64_t, cap * nw);
+	uint64_t *key = ARR_NEW(uint64_t, nw);
+	ARR_FILL(key, 0, nw, 0);
+	for (bool eof = false; !eof; ) {
+		xchar_t c = strstream_getc(sst);
+		eof = (c == XEOF);
+		_key_roll(key, nw, k, b, eof ? SENTINEL : inp2ext(ab, c));
+		if (nkeys == cap) {
+			cap *= 2;
+			keys = realloc(keys, cap * nw * sizeof(uint64_t));
+		}
+		memcpy(keys + (nkeys * nw), key, nw * sizeof(uint64_t));
+		nkeys++;
+	}
+	FREE(key);
+
+	// sort the k+1-mers
+	_keys_radixsort(keys, nkeys, nw, (k + 1) * b);
+
+	dbgraph *graph = _dbg_from_sorted_keys(ab, keys, nkeys, nw, nw, b, k,
+	                                       multigraph);
+	FREE(keys);
+	return graph;
+}
+
+
 dbgraph *bossbossdbg_new_from_str(alphabet *ab, char *txt, size_t k,
                                   bool multigraph)
 {
@@ -321,6 +415,554 @@ dbgraph *bossbossdbg_new_from_stream( alphabet *ab, strstream *sst, size_t k,
 }
 
 
+/*
+ * Multi-read construction.
+ *
+ * The k+1-mers of every read are packed into a buffer, without any
+ * sentinels. When the buffer is full, it is split into slices which
+ * are sorted and collapsed into (key, count) records by concurrent
+ * threads. The slices are then merged into a sorted run, which is
+ * spilled to a temporary file if a memory budget was given.
+ * Runs are merged MERGE_FANIN at a time as they accumulate, as in a
+ * base-MERGE_FANIN counter, so that the number of open runs grows only
+ * logarithmically with the input. At the end, all runs are merged,
+ * summing the counts of equal k+1-mers and dropping those below the
+ * minimum abundance.
+ * Finally, as in the original BOSS construction, sentinel-padded dummy
+ * edges are added: a chain $^k x[0], $^{k-1} x[0..1], ..., $ x[0..k-1]
+ * for every node x without incoming edges, and an edge y$ for every
+ * node y without outgoing edges.
+ */
+
+#define RUN_BUF_RECS 4096
+#define MERGE_FANIN 16
+#define MIN_SLICE_KEYS 4096
+#define READ_BLOCK 1024
+
+
+/*
+ * A sorted run of (key, count) records of nw+1 words, either in memory
+ * or in a temporary file read through a buffer. The level is the number
+ * of merges the run results from.
+ */
+typedef struct {
+	FILE     *file;
+	uint64_t *recs;
+	size_t    len;
+	size_t    pos;
+	size_t    left;   // records of the file not yet buffered
+	size_t    level;
+	bool      err;
+} dbgrun;
+
+
+struct _dbgbuilder {
+	alphabet *ab;
+	size_t    k;
+	bool      multi;
+	size_t    min_abund;
+	size_t    mem_budget;
+	size_t    nthreads;
+	size_t    b;
+	size_t    nw;
+	uint64_t *key;
+	size_t    filled;
+	uint64_t *buf;
+	size_t    nbuf;
+	size_t    cap;
+	dbgrun   *runs;
+	size_t    nruns;
+	size_t    runs_cap;
+	bool      failed;
+};
+
+
+static inline int _key_cmp(const uint64_t *x, const uint64_t *y, size_t nw)
+{
+	for (size_t w = nw; w-- > 0; ) {
+		if (x[w] != y[w])
+			return (x[w] < y[w]) ? -1 : 1;
+	}
+	return 0;
+}
+
+
+// Shifts a key s bits to the right.
+static void _key_shr(uint64_t *dest, const uint64_t *src, size_t nw,
+                     size_t s)
+{
+	size_t ws = s / 64, bs = s % 64;
+	for (size_t w = 0; w < nw; w++) {
+		uint64_t lo = (w + ws < nw) ? src[w + ws] : 0;
+		uint64_t hi = (w + ws + 1 < nw) ? src[w + ws + 1] : 0;
+		dest[w] = (bs == 0) ? lo : ((lo >> bs) | (hi << (64 - bs)));
+	}
+}
+
+
+static const uint64_t *_run_head(dbgrun *run, size_t rw)
+{
+	if (run->pos == run->len && run->left > 0) {
+		size_t n = MIN(RUN_BUF_RECS, run->left);
+		run->len = fread(run->recs, rw * sizeof(uint64_t), n, run->file);
+		run->pos = 0;
+		run->left = (run->len == n) ? run->left - n : 0;
+		run->err |= (run->len != n);
+	}
+	return (run->pos < run->len) ? run->recs + (run->pos * rw) : NULL;
+}
+
+
+static void _run_close(dbgrun *run)
+{
+	if (run->file != NULL)
+		fclose(run->file);
+	FREE(run->recs);
+}
+
+
+/*
+ * Merges sorted runs, summing the counts of equal keys and keeping
+ * only the records with count >= min_count. The result is written to
+ * the file out if not NULL, or to a new array *dest otherwise, and
+ * its number of records to *ndest. Returns false on I/O errors.
+ */
+static bool _merge_runs( dbgrun *runs, size_t nruns, size_t nw,
+                         uint64_t min_count, FILE *out,
+                         uint64_t **dest, size_t *ndest )
+{
+	bool ok = true;
+	size_t rw = nw + 1;
+	size_t n = 0, cap = 0;
+	uint64_t *res = NULL;
+	if (out == NULL) {
+		cap = 1024;
+		res = ARR_NEW(uint64_t, cap * rw);
+	}
+	uint64_t *rec = ARR_NEW(uint64_t, rw);
+	while (ok) {
+		// the number of runs is at most about MERGE_FANIN per level,
+		// so a linear scan for the smallest head is good enough
+		const uint64_t *min = NULL;
+		for (size_t r = 0; r < nruns; r++) {
+			const uint64_t *head = _run_head(runs + r, rw);
+			if (head != NULL && (min == NULL || _key_cmp(head, min, nw) < 0))
+				min = head;
+		}
+		if (min == NULL)
+			break;
+		memcpy(rec, min, nw * sizeof(uint64_t));
+		rec[nw] = 0;
+		for (size_t r = 0; r < nruns; r++) {
+			const uint64_t *head = _run_head(runs + r, rw);
+			if (head != NULL && _key_cmp(head, rec, nw) == 0) {
+				rec[nw] += head[nw];
+				runs[r].pos++;
+			}
+		}
+		if (rec[nw] < min_count)
+			continue;
+		if (out != NULL) {
+			ok = (fwrite(rec, sizeof(uint64_t), rw, out) == rw);
+			n++;
+			continue;
+		}
+		if (n == cap) {
+			cap *= 2;
+			res = realloc(res, cap * rw * sizeof(uint64_t));
+		}
+		memcpy(res + (n * rw), rec, rw * sizeof(uint64_t));
+		n++;
+	}
+	FREE(rec);
+	for (size_t r = 0; r < nruns; r++)
+		ok &= !runs[r].err;
+	if (out != NULL)
+		ok &= (fflush(out) == 0);
+	if (!ok) {
+		WARN("Error accessing temporary k+1-mer run file.\n");
+		FREE(res);
+		return false;
+	}
+	if (out == NULL)
+		*dest = res;
+	*ndest = n;
+	return true;
+}
+
+
+/*
+ * Merges and closes the given runs into a new run of level @p level,
+ * spilled to a temporary file if @p spill and one can be created.
+ * Returns false on I/O errors.
+ */
+static bool _merge_into_run( dbgrun *runs, size_t nruns, size_t nw,
+                             bool spill, size_t level, dbgrun *dest )
+{
+	FILE *out = spill ? tmpfile() : NULL;
+	if (spill && out == NULL)
+		WARN("Unable to create temporary file. Keeping k+1-mer run in memory.\n");
+	*dest = (dbgrun) {
+		.file = out, .recs = NULL, .len = 0, .pos = 0, .left = 0,
+		.level = level, .err = false
+	};
+	bool ok = _merge_runs(runs, nruns, nw, 1, out, &dest->recs, &dest->len);
+	for (size_t r=0; r<nruns; r++)
+		_run_close(runs + r);
+	if (out != NULL) {
+		rewind(out);
+		dest->left = dest->len;
+		dest->len = 0;
+		dest->recs = ARR_NEW(uint64_t, RUN_BUF_RECS * (nw + 1));
+	}
+	if (!ok) {
+		_run_close(dest);
+		dest->file = NULL;
+		dest->recs = NULL;
+	}
+	return ok;
+}
+
+
+typedef struct {
+	uint64_t *keys;
+	size_t    n;
+	size_t    nw;
+	size_t    nbits;
+	dbgrun    run;
+} dbgslice;
+
+
+// Sorts a slice of keys and collapses equal keys into counted records.
+static void *_slice_sort(void *arg)
+{
+	dbgslice *slice = (dbgslice *)arg;
+	size_t nw = slice->nw, rw = nw + 1;
+	_keys_radixsort(slice->keys, slice->n, nw, slice->nbits);
+	uint64_t *recs = ARR_NEW(uint64_t, MAX(1, slice->n) * rw);
+	size_t nrecs = 0;
+	for (size_t i = 0; i < slice->n; i++) {
+		const uint64_t *key = slice->keys + (i * nw);
+		if (nrecs > 0 && _key_cmp(key, recs + ((nrecs - 1) * rw), nw) == 0) {
+			recs[((nrecs - 1) * rw) + nw]++;
+			continue;
+		}
+		memcpy(recs + (nrecs * rw), key, nw * sizeof(uint64_t));
+		recs[(nrecs * rw) + nw] = 1;
+		nrecs++;
+	}
+	slice->run = (dbgrun) {
+		.file = NULL, .recs = recs, .len = nrecs, .pos = 0, .left = 0,
+		.level = 0, .err = false
+	};
+	return NULL;
+}
+
+
+/*
+ * Runs @p fn over all slices, one thread per slice. Falls back to
+ * running a slice in the calling thread if the thread cannot be created.
+ */
+static void _run_slices( void *(*fn)(void *), dbgslice *slices,
+                         size_t nslices )
+{
+	if (nslices == 1) {
+		fn(slices);
+		return;
+	}
+	pthread_t *threads = ARR_NEW(pthread_t, nslices);
+	bool *started = ARR_OF_0_NEW(bool, nslices);
+	for (size_t t=0; t<nslices; t++) {
+		started[t] = (pthread_create(threads+t, NULL, fn, slices+t) == 0);
+		if (!started[t]) fn(slices+t);
+	}
+	for (size_t t=0; t<nslices; t++) {
+		if (started[t]) pthread_join(threads[t], NULL);
+	}
+	FREE(started);
+	FREE(threads);
+}
+
+
+/*
+ * Appends a run. Whenever the last MERGE_FANIN runs have the same level,
+ * they are merged into a single run of the next level. Levels are
+ * non-increasing along the runs, so it suffices to compare the ends.
+ */
+static bool _builder_add_run(dbgbuilder *bld, dbgrun run)
+{
+	if (bld->nruns == bld->runs_cap) {
+		bld->runs_cap = MAX(4, 2 * bld->runs_cap);
+		bld->runs = realloc(bld->runs, bld->runs_cap * sizeof(dbgrun));
+	}
+	bld->runs[bld->nruns++] = run;
+	while (bld->nruns >= MERGE_FANIN
+	        && bld->runs[bld->nruns - MERGE_FANIN].level
+	        == bld->runs[bld->nruns - 1].level) {
+		dbgrun *group = bld->runs + (bld->nruns - MERGE_FANIN), merged;
+		bool ok = _merge_into_run(group, MERGE_FANIN, bld->nw, true,
+		                          group->level + 1, &merged);
+		bld->nruns -= MERGE_FANIN - 1;
+		*group = merged;
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+
+/*
+ * Sorts and counts the buffered k+1-mers into a new run. The run is
+ * spilled to a temporary file if the builder has a memory budget and
+ * this is not the last run. I/O errors mark the builder as failed.
+ */
+static void _builder_flush(dbgbuilder *bld, bool last)
+{
+	if (bld->nbuf == 0 || bld->failed)
+		return;
+	size_t nw = bld->nw;
+	size_t nslices = MAX(1, MIN(bld->nthreads, bld->nbuf / MIN_SLICE_KEYS));
+	dbgslice *slices = ARR_NEW(dbgslice, nslices);
+	for (size_t t=0; t<nslices; t++) {
+		size_t from = (t * bld->nbuf) / nslices;
+		size_t to = ((t+1) * bld->nbuf) / nslices;
+		slices[t].keys = bld->buf + (from * nw);
+		slices[t].n = to - from;
+		slices[t].nw = nw;
+		slices[t].nbits = (bld->k + 1) * bld->b;
+	}
+	_run_slices(_slice_sort, slices, nslices);
+
+	dbgrun *sruns = ARR_NEW(dbgrun, nslices);
+	for (size_t t=0; t<nslices; t++)
+		sruns[t] = slices[t].run;
+	dbgrun run;
+	bld->failed = !_merge_into_run(sruns, nslices, nw,
+	                               bld->mem_budget > 0 && !last, 0, &run)
+	              || !_builder_add_run(bld, run);
+	FREE(sruns);
+	FREE(slices);
+	bld->nbuf = 0;
+}
+
+
+dbgbuilder *bossdbg_builder_new( alphabet *ab, size_t k, bool multigraph,
+                                 size_t min_abund, size_t mem_budget,
+                                 size_t nthreads )
+{
+	dbgbuilder *bld = NEW(dbgbuilder);
+	bld->ab = ab;
+	bld->k = k;
+	bld->multi = multigraph;
+	bld->min_abund = MAX(1, min_abund);
+	bld->mem_budget = mem_budget;
+	if (nthreads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (ncpus > 0) ? (size_t)ncpus : 1;
+	}
+	bld->nthreads = nthreads;
+	bld->b = _packed_char_bits(ab);
+	bld->nw = (((k + 1) * bld->b) + 63) / 64;
+	bld->key = ARR_OF_0_NEW(uint64_t, bld->nw);
+	bld->filled = 0;
+	// buffered keys, their sorting buffer and their counted records
+	// take about 3nw+1 words per k+1-mer
+	size_t bytes_per_key = ((3 * bld->nw) + 1) * sizeof(uint64_t);
+	bld->cap = (mem_budget > 0) ? MAX(MIN_SLICE_KEYS, mem_budget / bytes_per_key)
+	           : MIN_SLICE_KEYS;
+	bld->buf = ARR_NEW(uint64_t, bld->cap * bld->nw);
+	bld->nbuf = 0;
+	bld->runs = NULL;
+	bld->nruns = 0;
+	bld->runs_cap = 0;
+	bld->failed = false;
+	return bld;
+}
+
+
+void bossdbg_builder_free(dbgbuilder *bld)
+{
+	if (bld == NULL) return;
+	for (size_t r=0; r<bld->nruns; r++)
+		_run_close(bld->runs + r);
+	FREE(bld->runs);
+	FREE(bld->buf);
+	FREE(bld->key);
+	FREE(bld);
+}
+
+
+static inline void _builder_put_rank(dbgbuilder *bld, size_t rk)
+{
+	// chars not in the alphabet (e.g. Ns) break the read
+	if (rk >= ab_size(bld->ab) || bld->failed) {
+		bld->filled = 0;
+		return;
+	}
+	_key_roll(bld->key, bld->nw, bld->k, bld->b, (xchar_t)(rk + 1));
+	if (++bld->filled <= bld->k)
+		return;
+	if (bld->nbuf == bld->cap) {
+		if (bld->mem_budget > 0) {
+			_builder_flush(bld, false);
+		} else {
+			bld->cap *= 2;
+			bld->buf = realloc(bld->buf, bld->cap * bld->nw * sizeof(uint64_t));
+		}
+	}
+	memcpy(bld->buf + (bld->nbuf * bld->nw), bld->key,
+	       bld->nw * sizeof(uint64_t));
+	bld->nbuf++;
+}
+
+
+void bossdbg_builder_add_read(dbgbuilder *bld, const char *read, size_t len)
+{
+	byte_t rks[READ_BLOCK];
+	bld->filled = 0;
+	for (size_t i=0; i<len; i+=READ_BLOCK) {
+		size_t n = MIN(READ_BLOCK, len - i);
+		ab_rank_bytes(bld->ab, read + i, n, rks);
+		for (size_t j=0; j<n; j++)
+			_builder_put_rank(bld, rks[j]);
+	}
+	bld->filled = 0;
+}
+
+
+void bossdbg_builder_add_stream(dbgbuilder *bld, strstream *sst)
+{
+	bld->filled = 0;
+	for (xchar_t c; (c=strstream_getc(sst))!=XEOF; )
+		_builder_put_rank(bld, ab_rank(bld->ab, c));
+	bld->filled = 0;
+}
+
+
+dbgraph *bossdbg_builder_build(dbgbuilder *bld)
+{
+	size_t k = bld->k, b = bld->b, nw = bld->nw, rw = nw + 1;
+	uint64_t cmask = (UINT64_C(1) << b) - 1;
+
+	// distinct k+1-mers above the minimum abundance, with their counts
+	_builder_flush(bld, true);
+	while (!bld->failed && bld->nruns > MERGE_FANIN) {
+		dbgrun *group = bld->runs + (bld->nruns - MERGE_FANIN), merged;
+		bld->failed = !_merge_into_run(group, MERGE_FANIN, nw, true,
+		                               group->level + 1, &merged);
+		bld->nruns -= MERGE_FANIN - 1;
+		*group = merged;
+	}
+	uint64_t *edges = NULL;
+	size_t nedges = 0;
+	bool ok = !bld->failed
+	          && _merge_runs(bld->runs, bld->nruns, nw, bld->min_abund, NULL,
+	                         &edges, &nedges);
+	for (size_t r=0; r<bld->nruns; r++)
+		_run_close(bld->runs + r);
+	bld->nruns = 0;
+	bld->nbuf = 0;
+	bld->failed = false;
+	if (!ok)
+		return NULL;
+
+	// source (prefix) and target (suffix) k-mers of the edges, packed
+	// with x[j] in digit j. The sources are already sorted.
+	uint64_t *srcs = ARR_NEW(uint64_t, MAX(1, nedges) * nw);
+	uint64_t *tgts = ARR_NEW(uint64_t, MAX(1, nedges) * nw);
+	for (size_t i=0; i<nedges; i++) {
+		const uint64_t *e = edges + (i * rw);
+		_key_shr(srcs + (i * nw), e, nw, b);
+		_key_shr(tgts + (i * nw), e, nw, 2 * b);
+		_key_or_digit(tgts + (i * nw), k - 1, b, e[0] & cmask);
+	}
+	_keys_radixsort(tgts, nedges, nw, k * b);
+
+	// dummy edges for sources without incoming edges and for
+	// targets without outgoing edges
+	size_t ndummy = 0, dcap = 1024;
+	uint64_t *dummy = ARR_NEW(uint64_t, dcap * rw);
+	uint64_t *key = ARR_NEW(uint64_t, nw);
+	bool has_root = false;
+	for (size_t i=0, j=0; i<nedges || j<nedges; ) {
+		const uint64_t *s = srcs + (i * nw), *t = tgts + (j * nw);
+		int cmp = (i == nedges) ? 1 : (j == nedges) ? -1 : _key_cmp(s, t, nw);
+		size_t nnew = (cmp < 0) ? k : (cmp > 0) ? 1 : 0;
+		if (ndummy + nnew > dcap) {
+			dcap = MAX(2 * dcap, ndummy + nnew);
+			dummy = realloc(dummy, dcap * rw * sizeof(uint64_t));
+		}
+		if (cmp < 0) {
+			ARR_FILL(key, 0, nw, 0);
+			for (size_t l=0; l<k; l++) {
+				_key_roll(key, nw, k, b, _key_digit(s, l, b));
+				memcpy(dummy + (ndummy * rw), key, nw * sizeof(uint64_t));
+				dummy[(ndummy * rw) + nw] = 1;
+				ndummy++;
+			}
+			has_root = true;
+		} else if (cmp > 0) {
+			// y$ = y shifted one digit up, with a sentinel edge char
+			ARR_FILL(key, 0, nw, 0);
+			for (size_t l=0; l<k; l++)
+				_key_or_digit(key, l + 1, b, _key_digit(t, l, b));
+			memcpy(dummy + (ndummy * rw), key, nw * sizeof(uint64_t));
+			dummy[(ndummy * rw) + nw] = 1;
+			ndummy++;
+		}
+		// skip all copies of the smallest k-mer in both lists
+		const uint64_t *min = (cmp <= 0) ? s : t;
+		memcpy(key, min, nw * sizeof(uint64_t));
+		while (i < nedges && _key_cmp(srcs + (i * nw), key, nw) == 0) i++;
+		while (j < nedges && _key_cmp(tgts + (j * nw), key, nw) == 0) j++;
+	}
+	FREE(srcs);
+	FREE(tgts);
+	FREE(key);
+	if (!has_root) {
+		// keep the all-sentinel node as the root, even when every node
+		// has an incoming edge, by adding the k+1-mer $^{k+1}
+		if (ndummy == dcap)
+			dummy = realloc(dummy, (++dcap) * rw * sizeof(uint64_t));
+		ARR_FILL(dummy + (ndummy * rw), 0, rw, 0);
+		dummy[(ndummy * rw) + nw] = 1;
+		ndummy++;
+	}
+
+	// all edges sorted, with the repeated dummy edges collapsed
+	size_t nall = nedges + ndummy;
+	edges = realloc(edges, MAX(1, nall) * rw * sizeof(uint64_t));
+	memcpy(edges + (nedges * rw), dummy, ndummy * rw * sizeof(uint64_t));
+	FREE(dummy);
+	_keys_radixsort(edges, nall, rw, (k + 1) * b);
+	size_t n = 0;
+	for (size_t i=0; i<nall; i++) {
+		if (n > 0 && _key_cmp(edges + (i * rw), edges + ((n - 1) * rw), nw) == 0)
+			continue;
+		memmove(edges + (n * rw), edges + (i * rw), rw * sizeof(uint64_t));
+		n++;
+	}
+
+	dbgraph *graph = _dbg_from_sorted_keys(bld->ab, edges, n, rw, nw, b, k,
+	                                       bld->multi);
+	FREE(edges);
+	return graph;
+}
+
+
+dbgraph *bossdbg_new_from_reads( alphabet *ab, strstream **reads,
+                                 size_t nreads, size_t k, bool multigraph,
+                                 size_t min_abund )
+{
+	dbgbuilder *bld = bossdbg_builder_new(ab, k, multigraph, min_abund, 0, 0);
+	for (size_t i=0; i<nreads; i++)
+		bossdbg_builder_add_stream(bld, reads[i]);
+	dbgraph *graph = bossdbg_builder_build(bld);
+	bossdbg_builder_free(bld);
+	return graph;
+}
+
+
 void bossdbg_free(dbgraph *g)
 {
 	if (g==NULL) return;
@@ -328,6 +970,8 @@ void bossdbg_free(dbgraph *g)
 	wavtree_free(g->edge_lbl_wt);
 	csrsbitarr_free(g->true_node, true);
 	FREE(g->char_cumul_count);
+	FREE(g->char_node_offset);
+	FREE(g->dummy);
 	FREE(g);
 }
 
@@ -396,22 +1040,51 @@ size_t bossdbg_node_rank(dbgraph *g, size_t nid)
 }
 
 
+// Edges are sorted by the last char of their node labels, and so
+// the edges of nodes ending in the char of rank r are those in the
+// range [cumul[r], cumul[r+1]).
 static size_t _last_node_char_rank(dbgraph *g, size_t nid)
 {
-	size_t p = csrsbitarr_select0(g->node_lbl_last_char, nid);
-	return csrsbitarr_rank1(g->node_lbl_last_char, p);
+	size_t lo = 0, hi = ab_size(g->ext_ab);
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (g->char_cumul_count[mid] <= nid)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+// Returns the id of the child pointed by the positive edge at
+// position p with char of rank crk.
+static inline size_t _edge_child(dbgraph *g, size_t p, size_t crk)
+{
+	size_t elrk = wavtree_rank_pos(g->edge_lbl_wt, p);
+	return csrsbitarr_select1(g->true_node, g->char_node_offset[crk] + elrk);
+}
+
+
+// Returns the position of the positive edge pointing to node nid,
+// whose label ends in the char of rank crk > 0.
+static inline size_t _in_edge(dbgraph *g, size_t nid, size_t crk)
+{
+	size_t r = csrsbitarr_rank1(g->true_node, nid) - g->char_node_offset[crk];
+	return wavtree_select(g->edge_lbl_wt, ab_char(g->ext_ab, crk), r);
 }
 
 
 void bossdbg_node_lbl(dbgraph *g, size_t nid, xstr *dest)
 {
+	xstr_clear(dest);
 	if (nid >= g->nedges) return;
 	size_t l=0;
-	for (size_t i=0; i<g->k; i++) {
-		xstr_set(dest, i, SENTINEL);
-	}
-	for (size_t cur=nid; l<g->k && 0<cur && cur<g->nedges; l++) {
+	xstr_push_n(dest, SENTINEL, g->k);
+	for (size_t cur=nid; l<g->k && cur<g->nedges; l++) {
 		size_t crk = _last_node_char_rank(g, cur);
+		// only the root label ends in $, and it is all $
+		if (crk == 0) break;
 		xchar_t c = ab_char(g->ext_ab, crk);
 		xstr_set(dest, g->k-1-l, c);
 		cur = bossdbg_parent(g, cur);
@@ -428,6 +1101,22 @@ size_t bossdbg_outdeg(dbgraph *g, size_t nid)
 }
 
 
+size_t bossdbg_indeg(dbgraph *g, size_t nid)
+{
+	size_t crk = _last_node_char_rank(g, nid);
+	if (crk == 0) return 0;
+	// the edges pointing to nid are the positive edge with its last char
+	// followed by the negative ones up to the next positive edge
+	xchar_t c = ab_char(g->ext_ab, crk);
+	xchar_t cn = neg_char(g->input_ab, c);
+	size_t r = csrsbitarr_rank1(g->true_node, nid) - g->char_node_offset[crk];
+	size_t p = wavtree_select(g->edge_lbl_wt, c, r);
+	size_t q = wavtree_select(g->edge_lbl_wt, c, r+1);
+	return 1 + wavtree_rank(g->edge_lbl_wt, q, cn)
+	       - wavtree_rank(g->edge_lbl_wt, p, cn);
+}
+
+
 size_t bossdbg_lbl_outdeg(dbgraph *g, size_t nid, xchar_t c)
 {
 	if (!ab_contains(g->input_ab, c)) return 0;
@@ -447,18 +1136,15 @@ size_t bossdbg_lbl_outdeg(dbgraph *g, size_t nid, xchar_t c)
 
 size_t bossdbg_child(dbgraph *g, size_t nid, xchar_t c)
 {
+	if (!ab_contains(g->input_ab, c)) return g->nedges;
+	c = inp2ext(g->input_ab, c);
 	size_t l = (nid==0)?0:csrsbitarr_pred1(g->true_node, nid)+1;
 	size_t r = nid+1;
 	// nodes of the same label are in the range [l,r)
 	// get the position p of edge label == c within this range
 	size_t p = wavtree_pred(g->edge_lbl_wt, r, c);
 	if ( l<=p && p<r ) {
-		size_t crk = ab_rank(g->ext_ab, c);
-		size_t elrk = wavtree_rank_pos(g->edge_lbl_wt, p);
-		size_t past1 = (crk==0)?0:csrsbitarr_rank1(g->true_node,
-		               g->char_cumul_count[crk]);
-		size_t chd = csrsbitarr_select1(g->true_node, past1+elrk);
-		return chd;
+		return _edge_child(g, p, ab_rank(g->ext_ab, c));
 	}
 	// if c not found in [l,r), try the extendedversion
 	p = wavtree_pred(g->edge_lbl_wt, r, neg_char(g->input_ab, c));
@@ -466,28 +1152,414 @@ size_t bossdbg_child(dbgraph *g, size_t nid, xchar_t c)
 		// if found, then by construction there is a preceding node
 		// with same suffix that has an outgoing edge labeled c
 		p = wavtree_pred(g->edge_lbl_wt, p, c);
-		size_t crk = ab_rank(g->ext_ab, c);
-		size_t elrk = wavtree_rank_pos(g->edge_lbl_wt, p);
-		size_t past1 = (crk==0)?0:csrsbitarr_rank1( g->true_node,
-		               g->char_cumul_count[crk]);
-		size_t chd = csrsbitarr_select1(g->true_node, past1+elrk);
-		return chd;
+		return _edge_child(g, p, ab_rank(g->ext_ab, c));
 	}
 	// if the extended version also not found, then return a null id
 	return g->nedges;
 }
 
 
+size_t bossdbg_children_all(dbgraph *g, size_t nid, xchar_t *lbls,
+                            size_t *chds)
+{
+	if (nid >= g->nedges) return 0;
+	size_t l = (nid==0)?0:csrsbitarr_pred1(g->true_node, nid)+1;
+	for (size_t p=l; p<=nid; p++) {
+		size_t rk;
+		xchar_t e = wavtree_char_rank(g->edge_lbl_wt, p, &rk);
+		if (e == SENTINEL) {
+			lbls[p-l] = SENTINEL;
+			chds[p-l] = g->nedges;
+			continue;
+		}
+		xchar_t c = pos_chr(g->input_ab, e);
+		size_t crk = ab_rank(g->ext_ab, c);
+		lbls[p-l] = ext2inp(g->input_ab, c);
+		if (e == c) {
+			chds[p-l] = csrsbitarr_select1( g->true_node,
+			                                g->char_node_offset[crk] + rk );
+		} else {
+			// a negative edge points to the same child as the preceding
+			// positive edge with the same char
+			chds[p-l] = _edge_child(g, wavtree_pred(g->edge_lbl_wt, p, c), crk);
+		}
+	}
+	return nid - l + 1;
+}
+
+
 size_t bossdbg_parent(dbgraph *g, size_t nid)
 {
-	if (nid==0)
+	if (nid>=g->nedges)
 		return g->nedges;
 	size_t  crk = _last_node_char_rank(g, nid);
-	xchar_t c   = ab_char(g->ext_ab, crk);
-	size_t  r   = csrsbitarr_rank1(g->true_node, nid)
-	              - csrsbitarr_rank1(g->true_node, g->char_cumul_count[crk]);
-	size_t par  = wavtree_select(g->edge_lbl_wt, c, r);
-	return _true_node(g, par);
+	if (crk==0)
+		return g->nedges;
+	return _true_node(g, _in_edge(g, nid, crk));
+}
+
+
+bool bossdbg_is_dummy(dbgraph *g, size_t nid)
+{
+	return nid < g->nedges && bitarr_get_bit(g->dummy, nid);
+}
+
+
+/*
+ * Label cache.
+ * A direct-mapped table of node labels. The label of a node is
+ * obtained by walking up its parents until a cached node (or the
+ * root) is found, and then shifting the cached label by the number
+ * of steps taken.
+ */
+struct _dbglblcache {
+	dbgraph *g;
+	size_t   nslots;
+	size_t  *nids;
+	xchar_t *lbls;
+	xchar_t *path;
+};
+
+
+dbglblcache *bossdbg_lblcache_new(dbgraph *g, size_t nslots)
+{
+	dbglblcache *cache = NEW(dbglblcache);
+	cache->g = g;
+	cache->nslots = 1;
+	while (cache->nslots < nslots)
+		cache->nslots *= 2;
+	cache->nids = ARR_NEW(size_t, cache->nslots);
+	ARR_FILL(cache->nids, 0, cache->nslots, g->nedges);
+	cache->lbls = ARR_NEW(xchar_t, cache->nslots * g->k);
+	cache->path = ARR_NEW(xchar_t, g->k);
+	return cache;
+}
+
+
+void bossdbg_lblcache_free(dbglblcache *cache)
+{
+	if (cache == NULL) return;
+	FREE(cache->nids);
+	FREE(cache->lbls);
+	FREE(cache->path);
+	FREE(cache);
+}
+
+
+static inline size_t _lblcache_slot(dbglblcache *cache, size_t nid)
+{
+	return (size_t)((nid * UINT64_C(0x9E3779B97F4A7C15)) >> 17)
+	       & (cache->nslots - 1);
+}
+
+
+void bossdbg_node_lbl_cached(dbglblcache *cache, size_t nid, xstr *dest)
+{
+	dbgraph *g = cache->g;
+	size_t k = g->k;
+	xstr_clear(dest);
+	if (nid >= g->nedges) return;
+
+	// walk up at most k steps until a cached node or the root
+	const xchar_t *hit = NULL;
+	size_t d = 0;
+	for (size_t cur=nid; d<k && cur<g->nedges; d++) {
+		size_t slot = _lblcache_slot(cache, cur);
+		if (cache->nids[slot] == cur) {
+			hit = cache->lbls + (slot * k);
+			break;
+		}
+		size_t crk = _last_node_char_rank(g, cur);
+		if (crk == 0) break;
+		cache->path[d] = ab_char(g->ext_ab, crk);
+		cur = bossdbg_parent(g, cur);
+	}
+
+	size_t slot = _lblcache_slot(cache, nid);
+	xchar_t *lbl = cache->lbls + (slot * k);
+	if (d > 0 || hit == NULL) {
+		// the first k-d chars come from the cached label (or are $).
+		// The hit may share the slot of nid, so shift left in place.
+		for (size_t i=0; i+d<k; i++)
+			lbl[i] = (hit != NULL) ? hit[i+d] : SENTINEL;
+		for (size_t j=0; j<d; j++)
+			lbl[k-1-j] = cache->path[j];
+		cache->nids[slot] = nid;
+	}
+	for (size_t i=0; i<k; i++)
+		xstr_push(dest, lbl[i]);
+}
+
+
+/*
+ * Unitigs.
+ */
+
+// Number of distinct children of a real node through non-$ edges,
+// up to 2, and the first of them.
+static size_t _real_children(dbgraph *g, size_t nid, xchar_t *lbls,
+                             size_t *chds, size_t *chd)
+{
+	size_t n = bossdbg_children_all(g, nid, lbls, chds), ret = 0;
+	for (size_t i=0; i<n && ret<2; i++) {
+		if (chds[i] >= g->nedges || (ret > 0 && chds[i] == *chd))
+			continue;
+		if (ret == 0)
+			*chd = chds[i];
+		ret++;
+	}
+	return ret;
+}
+
+
+// Number of distinct real parents of a node, up to 2, and the first
+// of them.
+static size_t _real_parents(dbgraph *g, size_t nid, size_t *par)
+{
+	size_t crk = _last_node_char_rank(g, nid);
+	if (crk == 0) return 0;
+	xchar_t c = ab_char(g->ext_ab, crk);
+	xchar_t cn = neg_char(g->input_ab, c);
+	size_t r = csrsbitarr_rank1(g->true_node, nid) - g->char_node_offset[crk];
+	size_t q = wavtree_select(g->edge_lbl_wt, c, r+1);
+	size_t ret = 0, last = g->nedges;
+	for (size_t p = wavtree_select(g->edge_lbl_wt, c, r); p < q && ret < 2;
+	        p = wavtree_succ(g->edge_lbl_wt, p, cn)) {
+		size_t src = _true_node(g, p);
+		if (src == last || bitarr_get_bit(g->dummy, src))
+			continue;
+		if (ret == 0)
+			*par = src;
+		last = src;
+		ret++;
+	}
+	return ret;
+}
+
+
+struct _dbgunitig_iter {
+	iter        _t_iter;
+	dbgraph    *g;
+	dbglblcache *cache;
+	byte_t     *visited;
+	size_t      pos;     // next node id to examine
+	bool        cycles;  // whether looking for isolated cycles
+	bool        ready;   // whether nxt holds an unreturned unitig
+	dbgunitig   cur;     // last returned unitig
+	dbgunitig   nxt;     // lookahead unitig
+	xstr       *lbl;
+	xchar_t    *lbls;
+	size_t     *chds;
+	size_t      maxdeg;
+};
+
+
+static bool _unitig_starts(dbgunitig_iter *it, size_t nid)
+{
+	size_t par, chd;
+	if (_real_parents(it->g, nid, &par) != 1)
+		return true;
+	return _real_children(it->g, par, it->lbls, it->chds, &chd) != 1;
+}
+
+
+static void _unitig_extend(dbgunitig_iter *it, size_t start)
+{
+	dbgraph *g = it->g;
+	dbgunitig *u = &it->nxt;
+	xstr_clear(u->seq);
+	bossdbg_node_lbl_cached(it->cache, start, it->lbl);
+	for (size_t i=0; i<g->k; i++)
+		xstr_push(u->seq, ext2inp(g->input_ab, xstr_get(it->lbl, i)));
+	bitarr_set_bit(it->visited, start, 1);
+	u->first = u->last = start;
+	u->nnodes = 1;
+	u->cycle = false;
+	for (size_t cur=start, chd, par; ; cur=chd) {
+		if (_real_children(g, cur, it->lbls, it->chds, &chd) != 1)
+			break;
+		if (chd == start) {
+			u->cycle = true;
+			break;
+		}
+		if (_real_parents(g, chd, &par) != 1)
+			break;
+		size_t crk = _last_node_char_rank(g, chd);
+		xstr_push(u->seq, ext2inp(g->input_ab, ab_char(g->ext_ab, crk)));
+		bitarr_set_bit(it->visited, chd, 1);
+		u->last = chd;
+		u->nnodes++;
+	}
+}
+
+
+static bool _unitig_iter_has_next(iter *i)
+{
+	dbgunitig_iter *it = (dbgunitig_iter *)i->impltor;
+	dbgraph *g = it->g;
+	while (!it->ready) {
+		if (it->pos >= g->nedges) {
+			if (it->cycles)
+				return false;
+			// whatever is left unvisited lies on isolated cycles
+			it->cycles = true;
+			it->pos = 0;
+			continue;
+		}
+		size_t nid = it->pos++;
+		if (!csrsbitarr_get(g->true_node, nid)
+		        || bitarr_get_bit(g->dummy, nid)
+		        || bitarr_get_bit(it->visited, nid))
+			continue;
+		if (it->cycles || _unitig_starts(it, nid)) {
+			_unitig_extend(it, nid);
+			it->ready = true;
+		}
+	}
+	return true;
+}
+
+
+static const void *_unitig_iter_next(iter *i)
+{
+	dbgunitig_iter *it = (dbgunitig_iter *)i->impltor;
+	if (!_unitig_iter_has_next(i))
+		return NULL;
+	// has_next may be called before the returned unitig is consumed,
+	// so the lookahead is kept apart
+	dbgunitig tmp = it->cur;
+	it->cur = it->nxt;
+	it->nxt = tmp;
+	it->ready = false;
+	return &it->cur;
+}
+
+
+static iter_vt _unitig_iter_vt = { .has_next = _unitig_iter_has_next,
+                                   .next = _unitig_iter_next
+                                 };
+
+
+dbgunitig_iter *bossdbg_unitigs(dbgraph *g)
+{
+	dbgunitig_iter *it = NEW(dbgunitig_iter);
+	it->_t_iter.impltor = it;
+	it->_t_iter.vt = &_unitig_iter_vt;
+	it->g = g;
+	it->cache = bossdbg_lblcache_new(g, 1024);
+	it->visited = bitarr_new(g->nedges);
+	it->pos = 0;
+	it->cycles = false;
+	it->ready = false;
+	size_t sizeof_char = (ab_type(g->input_ab) == CHAR_TYPE)
+	                     ? 1 : nbytes(ab_size(g->input_ab));
+	it->cur.seq = xstr_new(sizeof_char);
+	it->nxt.seq = xstr_new(sizeof_char);
+	it->lbl = xstr_new_with_capacity(nbytes(ab_size(g->ext_ab)), g->k);
+	// the out-degree of a node is at most its number of edges
+	it->maxdeg = 0;
+	for (size_t nid=0, prev=0; nid<g->nedges; nid++) {
+		if (csrsbitarr_get(g->true_node, nid)) {
+			it->maxdeg = MAX(it->maxdeg, nid + 1 - prev);
+			prev = nid + 1;
+		}
+	}
+	it->lbls = ARR_NEW(xchar_t, MAX(1, it->maxdeg));
+	it->chds = ARR_NEW(size_t, MAX(1, it->maxdeg));
+	return it;
+}
+
+
+void bossdbg_unitigs_free(dbgunitig_iter *it)
+{
+	if (it == NULL) return;
+	bossdbg_lblcache_free(it->cache);
+	FREE(it->visited);
+	xstr_free(it->cur.seq);
+	xstr_free(it->nxt.seq);
+	xstr_free(it->lbl);
+	FREE(it->lbls);
+	FREE(it->chds);
+	FREE(it);
+}
+
+
+IMPL_TRAIT(dbgunitig_iter, iter);
+
+
+/*
+ * Parallel node iteration.
+ */
+typedef struct {
+	dbgraph   *g;
+	size_t     from;
+	size_t     to;
+	size_t     tid;
+	bool       with_lbl;
+	dbgnode_fn fn;
+	void      *ctx;
+} dbgnode_chunk;
+
+
+static void *_node_chunk_run(void *arg)
+{
+	dbgnode_chunk *chunk = (dbgnode_chunk *)arg;
+	dbgraph *g = chunk->g;
+	dbglblcache *cache = NULL;
+	xstr *lbl = NULL;
+	if (chunk->with_lbl) {
+		cache = bossdbg_lblcache_new(g, 1024);
+		lbl = xstr_new_with_capacity(nbytes(ab_size(g->ext_ab)), g->k);
+	}
+	for (size_t nid=chunk->from; nid<chunk->to; nid++) {
+		if (!csrsbitarr_get(g->true_node, nid))
+			continue;
+		if (chunk->with_lbl)
+			bossdbg_node_lbl_cached(cache, nid, lbl);
+		chunk->fn(g, nid, lbl, chunk->tid, chunk->ctx);
+	}
+	bossdbg_lblcache_free(cache);
+	if (lbl != NULL)
+		xstr_free(lbl);
+	return NULL;
+}
+
+
+void bossdbg_foreach_node_par(dbgraph *g, dbgnode_fn fn, bool with_lbl,
+                              void *ctx, size_t nthreads)
+{
+	if (nthreads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (ncpus > 0) ? (size_t)ncpus : 1;
+	}
+	size_t nchunks = MAX(1, MIN(nthreads, g->nedges));
+	dbgnode_chunk *chunks = ARR_NEW(dbgnode_chunk, nchunks);
+	for (size_t t=0; t<nchunks; t++) {
+		chunks[t].g = g;
+		chunks[t].from = (t * g->nedges) / nchunks;
+		chunks[t].to = ((t+1) * g->nedges) / nchunks;
+		chunks[t].tid = t;
+		chunks[t].with_lbl = with_lbl;
+		chunks[t].fn = fn;
+		chunks[t].ctx = ctx;
+	}
+	if (nchunks == 1) {
+		_node_chunk_run(chunks);
+	} else {
+		pthread_t *threads = ARR_NEW(pthread_t, nchunks);
+		bool *started = ARR_OF_0_NEW(bool, nchunks);
+		for (size_t t=0; t<nchunks; t++) {
+			started[t] = (pthread_create(threads+t, NULL, _node_chunk_run,
+			                             chunks+t) == 0);
+			if (!started[t]) _node_chunk_run(chunks+t);
+		}
+		for (size_t t=0; t<nchunks; t++) {
+			if (started[t]) pthread_join(threads[t], NULL);
+		}
+		FREE(started);
+		FREE(threads);
+	}
+	FREE(chunks);
 }
 
 
@@ -504,7 +1576,6 @@ static void node_cstr(xstr *node, alphabet *ab, char *dest)
 void bossdbg_print(dbgraph *g)
 {
 	printf("dbgraph@%p\n",g);
-	//csrsbitarr_fprint(g->node_lbl_last_char, 10);
 	size_t ncols = 4;
 	char *headers[4] = {"nid", "real", "node", "edge"};
 	int *cols = ARR_NEW(int, ncols);
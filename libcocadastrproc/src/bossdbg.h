@@ -23,8 +23,10 @@
 #define DEBRUIJNGRAPH_H
 
 #include "alphabet.h"
+#include "iter.h"
 #include "strstream.h"
 #include "xchar.h"
+#include "xstr.h"
 
 /**
  * @file bossdbg.h
@@ -67,6 +69,103 @@ dbgraph *bossbossdbg_new_from_stream( alphabet *ab, strstream *sst, size_t k,
                                       bool multigraph );
 
 
+/**
+ * @brief Incremental builder of a dBG from a collection of reads.
+ *
+ * Unlike ::bossbossdbg_new_from_str, the reads are not concatenated,
+ * so no k+1-mers spanning two reads are created. Instead, the graph
+ * contains the k+1-mers occurring in the reads, padded as in the
+ * standard BOSS construction: every node x without incoming edges gets
+ * a chain of edges $^k x[0], $^(k-1) x[0..1], ..., $ x[0..k-1] from the
+ * all-sentinel node, and every node y without outgoing edges gets an
+ * edge labeled $. For a single read whose first and last k-mers occur
+ * only once, the result is the same as ::bossbossdbg_new_from_str.
+ *
+ * The k+1-mers are counted during construction, and those occurring
+ * fewer than a minimum number of times are discarded. In a multigraph,
+ * every remaining k+1-mer gives as many edges as its count.
+ *
+ * Example
+ * -------
+ *
+ * ```C
+ * dbgbuilder *bld = bossdbg_builder_new(ab, k, false, 2, 1<<30, 0);
+ * fasta *fr = fasta_open("reads.fa");
+ * while (fasta_has_next(fr)) {
+ *     const fasta_rec *rec = fasta_next(fr);
+ *     bossdbg_builder_add_read(bld, rec->seq, strlen(rec->seq));
+ * }
+ * fasta_close(fr);
+ * dbgraph *g = bossdbg_builder_build(bld);
+ * bossdbg_builder_free(bld);
+ * ```
+ */
+typedef struct _dbgbuilder dbgbuilder;
+
+
+/**
+ * @brief Creates a builder of a dBG of order @p k.
+ * @param ab Input alphabet.
+ * @param k A strictly positive order.
+ * @param multigraph Whether repeated k+1-mers give multiple edges.
+ * @param min_abund Minimum number of occurrences of a k+1-mer
+ *        for it to be kept. Values 0 and 1 keep all k+1-mers.
+ * @param mem_budget Approximate number of bytes used for buffering
+ *        k+1-mers. When the buffer is full, its k+1-mers are sorted,
+ *        counted and spilled to a temporary file. Runs are merged in
+ *        groups as they accumulate, and the remaining ones at the end.
+ *        If 0, everything is kept in memory.
+ *        The final graph and its distinct k+1-mers are always built in
+ *        memory.
+ * @param nthreads Number of threads used for sorting the buffered
+ *        k+1-mers. If 0, uses the number of online processors.
+ */
+dbgbuilder *bossdbg_builder_new( alphabet *ab, size_t k, bool multigraph,
+                                 size_t min_abund, size_t mem_budget,
+                                 size_t nthreads );
+
+
+/**
+ * @brief Destructor.
+ */
+void bossdbg_builder_free(dbgbuilder *bld);
+
+
+/**
+ * @brief Adds the k+1-mers of a read of length @p len.
+ *        Chars not in the input alphabet (e.g. N) split the read.
+ */
+void bossdbg_builder_add_read(dbgbuilder *bld, const char *read, size_t len);
+
+
+/**
+ * @brief Adds the k+1-mers of the read given by the remaining
+ *        contents of the stream @p sst.
+ * @see bossdbg_builder_add_read
+ */
+void bossdbg_builder_add_stream(dbgbuilder *bld, strstream *sst);
+
+
+/**
+ * @brief Builds the dBG from the reads added so far. The builder is
+ *        emptied, and may be reused for a new graph.
+ * @return The graph, or NULL if a temporary run file could not be
+ *        written or read back, in which case the reads are discarded.
+ */
+dbgraph *bossdbg_builder_build(dbgbuilder *bld);
+
+
+/**
+ * @brief Creates a dBG from a collection of @p nreads streams, each
+ *        containing a single read, in memory and with all available
+ *        threads.
+ * @see dbgbuilder
+ */
+dbgraph *bossdbg_new_from_reads( alphabet *ab, strstream **reads,
+                                 size_t nreads, size_t k, bool multigraph,
+                                 size_t min_abund );
+
+
 /**
  * @brief Destructor.
  */
@@ -178,11 +277,145 @@ size_t bossdbg_child(dbgraph *g, size_t nid, xchar_t c);
  * @brief Returns the smallest node id corresponding to a node w with
  *        an outgoing edge pointing to the node with the given id.
  * @param nid The node id of the child node. If a nonexistant id is given,
- *        the result is undefined.
+ *        or if @p nid is the root, an invalid node id is returned.
  */
 size_t bossdbg_parent(dbgraph *g, size_t nid);
 
 
+/**
+ * @brief Returns the indegree of a node given its id, that is the
+ *        number of edges pointing to it. The root has indegree 0.
+ *        If @p nid is invalid, the result is undefined.
+ */
+size_t bossdbg_indeg(dbgraph *g, size_t nid);
+
+
+/**
+ * @brief Returns all the children of the node with id @p nid in a
+ *        single pass over its edges, which is faster than calling
+ *        ::bossdbg_child once per alphabet symbol.
+ *        The i-th outgoing edge has label `lbls[i]` and points to the
+ *        node `chds[i]`. An edge to the final sentinel has label
+ *        ::bossdbg_sentinel and an invalid child id (::bossdbg_nedges).
+ * @param lbls (out) The edge labels. Must have room for
+ *        ::bossdbg_outdeg(g, nid) chars.
+ * @param chds (out) The child ids. Must have room for
+ *        ::bossdbg_outdeg(g, nid) ids.
+ * @return The outdegree of the node, or 0 if @p nid is invalid.
+ */
+size_t bossdbg_children_all(dbgraph *g, size_t nid, xchar_t *lbls,
+                            size_t *chds);
+
+
+/**
+ * @brief Is the node a dummy node, i.e. one whose label is
+ *        $-prefixed and which does not correspond to a k-mer of the
+ *        input?
+ */
+bool bossdbg_is_dummy(dbgraph *g, size_t nid);
+
+
+/**
+ * @brief Node label cache type.
+ *
+ * Retrieving a node label with ::bossdbg_node_lbl takes k backward
+ * steps. A label cache keeps recently computed labels so that the
+ * label of a node can be obtained by walking up only until a cached
+ * ancestor is found. This pays off when labels of neighbouring nodes
+ * are requested in sequence, as in graph traversals.
+ *
+ * A cache is not thread-safe. Use one cache per thread.
+ */
+typedef struct _dbglblcache dbglblcache;
+
+
+/**
+ * @brief Creates a label cache for the graph @p g with room for
+ *        (at least) @p nslots labels.
+ */
+dbglblcache *bossdbg_lblcache_new(dbgraph *g, size_t nslots);
+
+
+/**
+ * @brief Destructor.
+ */
+void bossdbg_lblcache_free(dbglblcache *cache);
+
+
+/**
+ * @brief Same as ::bossdbg_node_lbl, but using (and updating) the
+ *        label cache @p cache.
+ */
+void bossdbg_node_lbl_cached(dbglblcache *cache, size_t nid, xstr *dest);
+
+
+/**
+ * @brief A unitig, i.e. a maximal non-branching path of the graph.
+ */
+typedef struct {
+	xstr   *seq;    /**< Spelled sequence, over the input alphabet */
+	size_t  first;  /**< Id of the first node */
+	size_t  last;   /**< Id of the last node */
+	size_t  nnodes; /**< Number of nodes */
+	bool    cycle;  /**< Whether the path is an isolated cycle */
+} dbgunitig;
+
+
+/**
+ * Unitig iterator type.
+ */
+typedef struct _dbgunitig_iter dbgunitig_iter;
+
+
+/**
+ * @brief Returns an iterator over the unitigs of the graph @p g.
+ * Implements iter trait.
+ * The ::iter_next method returns a pointer to a ::dbgunitig which is
+ * owned by the iterator and overwritten by the following call.
+ *
+ * Only nodes which correspond to k-mers of the input are considered,
+ * that is, dummy nodes and edges to the final sentinel are ignored.
+ * Every such node belongs to exactly one unitig. The sequence of a
+ * unitig of n nodes has length k+n-1. For an isolated cycle, the
+ * sequence spells the cycle starting and ending at the first node,
+ * without repeating it.
+ */
+dbgunitig_iter *bossdbg_unitigs(dbgraph *g);
+
+
+/**
+ * @brief Destructor.
+ */
+void bossdbg_unitigs_free(dbgunitig_iter *it);
+
+
+DECL_TRAIT(dbgunitig_iter, iter);
+
+
+/**
+ * @brief Per-node callback type for ::bossdbg_foreach_node_par.
+ * @param nid The node id.
+ * @param lbl The node label, or NULL if labels were not requested.
+ * @param tid The index of the calling thread, in [0, nthreads).
+ */
+typedef void (*dbgnode_fn)(dbgraph *g, size_t nid, const xstr *lbl,
+                           size_t tid, void *ctx);
+
+
+/**
+ * @brief Calls @p fn on every node of the graph, splitting the id range
+ *        among @p nthreads threads. Within each thread the nodes are
+ *        visited in increasing id order.
+ * @param with_lbl Whether to compute the node labels, with one label
+ *        cache per thread.
+ * @param ctx Passed through to @p fn.
+ * @param nthreads Number of threads. If 0, uses the number of online
+ *        processors.
+ */
+void bossdbg_foreach_node_par(dbgraph *g, dbgnode_fn fn, bool with_lbl,
+                              void *ctx, size_t nthreads);
+
+
 /**
  * @brief Prints the dBG @p g to std output.
  */
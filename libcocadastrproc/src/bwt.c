@@ -0,0 +1,591 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "alphabet.h"
+#include "arrays.h"
+#include "bitarr.h"
+#include "bitbyte.h"
+#include "bytearr.h"
+#include "bwt.h"
+#include "errlog.h"
+#include "lcp.h"
+#include "mathutil.h"
+#include "new.h"
+#include "sais.h"
+#include "strfilereader.h"
+#include "wavtree.h"
+#include "xstrreader.h"
+
+
+#define IO_CHUNK (1 << 16)
+
+
+static bool read_text(FILE *txt, size_t from, size_t to, char *dest)
+{
+	if (fseeko(txt, (off_t)from, SEEK_SET)
+	        || fread(dest, 1, to - from, txt) != to - from) {
+		WARN("Error reading text from temporary file.\n");
+		return false;
+	}
+	return true;
+}
+
+
+/*
+ * Reads a text file backwards in chunks.
+ */
+typedef struct {
+	FILE   *file;
+	size_t  pos;
+	size_t  buf_from;
+	char   *buf;
+	bool    ok;
+} revreader;
+
+
+static void revreader_init(revreader *rr, FILE *file, size_t to)
+{
+	rr->file = file;
+	rr->pos = to;
+	rr->buf_from = to;
+	rr->buf = ARR_NEW(char, IO_CHUNK);
+	rr->ok = true;
+}
+
+
+// returns the char preceding the last one read
+static char revreader_prev(revreader *rr)
+{
+	if (rr->pos == rr->buf_from) {
+		rr->buf_from = (rr->pos > IO_CHUNK) ? (rr->pos - IO_CHUNK) : 0;
+		rr->ok &= read_text(rr->file, rr->buf_from, rr->pos, rr->buf);
+	}
+	rr->pos--;
+	return rr->buf[rr->pos - rr->buf_from];
+}
+
+
+/*
+ * Sequential bit files, MSB first. I/O errors clear the ok flag.
+ */
+typedef struct {
+	FILE   *file;
+	size_t  nbits;
+	int     byte;
+	bool    ok;
+} bitfile;
+
+
+static void bitfile_init(bitfile *bf, FILE *file)
+{
+	bf->file = file;
+	bf->nbits = 0;
+	bf->byte = 0;
+	bf->ok = true;
+}
+
+
+static void bitfile_put(bitfile *bf, bool bit)
+{
+	if (bit) {
+		bf->byte |= (1 << (7 - (bf->nbits % BYTESIZE)));
+	}
+	if ((++bf->nbits % BYTESIZE) == 0) {
+		bf->ok &= (putc(bf->byte, bf->file) != EOF);
+		bf->byte = 0;
+	}
+}
+
+
+static void bitfile_flush(bitfile *bf)
+{
+	if (bf->nbits % BYTESIZE) {
+		bf->ok &= (putc(bf->byte, bf->file) != EOF);
+	}
+	bf->ok &= (fflush(bf->file) == 0);
+	rewind(bf->file);
+}
+
+
+static bool bitfile_get(bitfile *bf)
+{
+	if ((bf->nbits % BYTESIZE) == 0) {
+		bf->byte = getc(bf->file);
+		bf->ok &= (bf->byte != EOF);
+	}
+	return (bf->byte >> (7 - (bf->nbits++ % BYTESIZE))) & 1;
+}
+
+
+/*
+ * The gt file of the tail T[b:] has one bit per position i = n, n-1, ..., b+1
+ * (in this order) telling whether T[i:] > T[b:].
+ * Loads gt(b+t) for 1 <= t <= m into bit t of the returned array,
+ * or returns NULL if the file cannot be read.
+ */
+static byte_t *load_gt_head(FILE *gt, size_t nentries, size_t m)
+{
+	byte_t *ret = bytearr_new((size_t)DIVCEIL(m + 1, BYTESIZE));
+	if (m == 0) {
+		return ret;
+	}
+	size_t byte_lo = (nentries - m) / BYTESIZE;
+	size_t nbytes = (size_t)DIVCEIL(nentries, BYTESIZE) - byte_lo;
+	byte_t *buf = ARR_NEW(byte_t, nbytes);
+	if (fseeko(gt, (off_t)byte_lo, SEEK_SET)
+	        || fread(buf, 1, nbytes, gt) != nbytes) {
+		WARN("Error reading temporary file.\n");
+		FREE(buf);
+		FREE(ret);
+		return NULL;
+	}
+	for (size_t t = 1; t <= m; t++) {
+		size_t k = nentries - t;
+		bitarr_set_bit(ret, t, bitarr_get_bit(buf, k - (byte_lo * BYTESIZE)));
+	}
+	FREE(buf);
+	rewind(gt);
+	return ret;
+}
+
+
+/*
+ * A block T[a:b] of length m, preceding the tail T[b:] whose BWT is on
+ * disk. X is the set of the block suffixes plus T[b:].
+ */
+typedef struct {
+	alphabet *ab;
+	FILE     *txt;
+	size_t    n;
+	size_t    a;
+	size_t    b;
+	size_t    m;
+	char     *chars;    // T[a:b]
+	byte_t   *gtb;      // gtb[r] = T[a+r:] > T[b:]
+	size_t   *order;    // block suffixes (offsets from a) in lex order
+	size_t   *xrank;    // xrank[j] = rank of T[a+j:] in X, 0 <= j <= m
+} bwtblock;
+
+
+/*
+ * Comparison of block suffixes within a group of the SA of
+ * W = T[a:e] in which some W-suffixes are prefixes of others.
+ */
+typedef struct {
+	bwtblock *blk;
+	size_t    wlen;
+	size_t   *isa;
+	lcparray *lcpa;
+} blkcmp_ctx;
+
+
+// lcp of the W-suffixes of SA ranks i < j
+static inline size_t w_lcp(lcparray *lcpa, size_t i, size_t j)
+{
+	return lcparray_get(lcpa, lcparray_rmq(lcpa, i + 1, j + 1));
+}
+
+
+static int blk_cmp(blkcmp_ctx *ctx, size_t x, size_t y)
+{
+	size_t ix = ctx->isa[x], iy = ctx->isa[y];
+	size_t l = w_lcp(ctx->lcpa, MIN(ix, iy), MAX(ix, iy));
+	if (l < ctx->wlen - MAX(x, y)) {
+		return (ix < iy) ? -1 : +1;
+	}
+	// the shorter W-suffix T[q:] is a prefix of T[p:], p < q, and
+	// T[q:] < T[p:] iff T[b:] < T[p+b-q:]
+	size_t m = ctx->blk->m;
+	if (x < y) {
+		return bitarr_get_bit(ctx->blk->gtb, x + m - y) ? +1 : -1;
+	}
+	return bitarr_get_bit(ctx->blk->gtb, y + m - x) ? -1 : +1;
+}
+
+
+static void blk_msort(blkcmp_ctx *ctx, size_t *arr, size_t n, size_t *tmp)
+{
+	if (n < 2) {
+		return;
+	}
+	size_t h = n / 2;
+	blk_msort(ctx, arr, h, tmp);
+	blk_msort(ctx, arr + h, n - h, tmp);
+	size_t i = 0, j = h, k = 0;
+	while (i < h && j < n) {
+		tmp[k++] = (blk_cmp(ctx, arr[j], arr[i]) < 0) ? arr[j++] : arr[i++];
+	}
+	while (i < h) {
+		tmp[k++] = arr[i++];
+	}
+	while (j < n) {
+		tmp[k++] = arr[j++];
+	}
+	for (k = 0; k < n; k++) {
+		arr[k] = tmp[k];
+	}
+}
+
+
+/*
+ * Sorts the block suffixes using the SA of W = T[a:e], e = min(n, b+m),
+ * and the gt bits gt_head of the tail.
+ * W-suffixes are compared as if the text ended at e, which gives the
+ * right order except when a W-suffix is a prefix of another. Those
+ * are found with the LCP of W, and resolved with gt_head.
+ * Returns false if the text cannot be read.
+ */
+static bool sort_block(bwtblock *blk, const byte_t *gt_head)
+{
+	size_t m = blk->m;
+	size_t e = MIN(blk->n, blk->b + m);
+	size_t wlen = e - blk->a;
+	bool ext = (e < blk->n);
+
+	char *w = ARR_NEW(char, wlen + 1);
+	for (size_t j = 0; j < m; j++) {
+		w[j] = blk->chars[j];
+	}
+	if (!read_text(blk->txt, blk->b, e, w + m)) {
+		FREE(w);
+		return false;
+	}
+	w[wlen] = '\0';
+	size_t *sa = sais(w, wlen, blk->ab);
+	size_t *isa = ARR_NEW(size_t, m + 1);
+	for (size_t k = 0; k <= wlen; k++) {
+		if (sa[k] <= m) {
+			isa[sa[k]] = k;
+		}
+	}
+	lcparray *lcpa = NULL;
+	if (ext) {
+		size_t *lcp = lcp_phi(w, wlen, sa);
+		lcpa = lcparray_new(lcp, wlen + 1);
+		FREE(lcp);
+	}
+
+	// gtb[r] = T[a+r:] > T[b:]
+	blk->gtb = bytearr_new((size_t)DIVCEIL(m, BYTESIZE));
+	for (size_t r = 0; r < m; r++) {
+		bool gt;
+		if (isa[r] < isa[m]) {
+			gt = false;
+		}
+		else if (ext && w_lcp(lcpa, isa[m], isa[r]) >= e - blk->b) {
+			// T[a+r:b] = T[b:2b-a-r], so compare T[b:] with T[2b-a-r:]
+			gt = !bitarr_get_bit(gt_head, m - r);
+		}
+		else {
+			gt = true;
+		}
+		bitarr_set_bit(blk->gtb, r, gt);
+	}
+
+	blk->order = ARR_NEW(size_t, m);
+	for (size_t k = 0, j = 0; k <= wlen; k++) {
+		if (sa[k] < m) {
+			blk->order[j++] = sa[k];
+		}
+	}
+	FREE(sa);
+	FREE(w);
+
+	if (ext) {
+		blkcmp_ctx ctx = {.blk = blk, .wlen = wlen, .isa = isa, .lcpa = lcpa};
+		size_t *tmp = ARR_NEW(size_t, m);
+		size_t *order = blk->order;
+		size_t gstart = 0, gminlen = wlen - order[0];
+		for (size_t k = 1; k <= m; k++) {
+			size_t l = (k < m) ? w_lcp(lcpa, isa[order[k - 1]], isa[order[k]]) : 0;
+			if (k == m || l < gminlen) {
+				if (k - gstart > 1) {
+					blk_msort(&ctx, order + gstart, k - gstart, tmp);
+				}
+				gstart = k;
+				gminlen = (k < m) ? (wlen - order[k]) : 0;
+			}
+			else {
+				gminlen = MIN(gminlen, wlen - order[k]);
+			}
+		}
+		FREE(tmp);
+		lcparray_free(lcpa);
+	}
+
+	// ranks in X, where T[b:] is preceded by the block suffixes smaller than it
+	size_t idx_b = 0;
+	for (size_t r = 0; r < m; r++) {
+		idx_b += !bitarr_get_bit(blk->gtb, r);
+	}
+	blk->xrank = isa;
+	for (size_t k = 0; k < m; k++) {
+		blk->xrank[blk->order[k]] = k + (k >= idx_b);
+	}
+	blk->xrank[m] = idx_b;
+	return true;
+}
+
+
+/*
+ * Scans the tail T[b:] from right to left computing the rank among the
+ * block suffixes of each tail suffix, by backward steps over the
+ * preceding chars of X. Returns the counts of those ranks (the gap array),
+ * and writes the gt bits of the new tail T[a:] to new_gt, if not NULL.
+ * Returns NULL on I/O errors.
+ */
+static size_t *scan_tail(bwtblock *blk, FILE *gt, FILE *new_gt)
+{
+	size_t m = blk->m;
+	size_t sigma = ab_size(blk->ab);
+	size_t pos_a = blk->xrank[0];
+	size_t idx_b = blk->xrank[m];
+
+	// preceding chars of X in lex order. T[a:] gets a placeholder
+	char placeholder = (char)ab_char(blk->ab, 0);
+	char *xbwt = ARR_NEW(char, m + 2);
+	for (size_t j = 0; j <= m; j++) {
+		xbwt[blk->xrank[j]] = (j > 0) ? blk->chars[j - 1] : placeholder;
+	}
+	xbwt[m + 1] = '\0';
+	wavtree *wt = wavtree_new(blk->ab, xbwt, m + 1, WT_BALANCED);
+	FREE(xbwt);
+
+	size_t *C = ARR_OF_0_NEW(size_t, sigma + 1);
+	for (size_t j = 0; j < m; j++) {
+		C[ab_rank(blk->ab, blk->chars[j]) + 1]++;
+	}
+	for (size_t r = 1; r <= sigma; r++) {
+		C[r] += C[r - 1];
+	}
+
+	size_t *gap = ARR_OF_0_NEW(size_t, m + 1);
+	bitfile gtr, gtw;
+	bitfile_init(&gtr, gt);
+	bitfile_init(&gtw, new_gt);
+	revreader rr;
+	revreader_init(&rr, blk->txt, blk->n);
+
+	if (blk->b < blk->n) {
+		// the empty suffix T[n:]
+		gap[0]++;
+		bitfile_get(&gtr);
+		if (new_gt) {
+			bitfile_put(&gtw, false);
+		}
+	}
+	for (size_t i = blk->n - 1, rX = 0; i > blk->b && i < blk->n; i--) {
+		char c = revreader_prev(&rr);
+		size_t rB = C[ab_rank(blk->ab, c)] + wavtree_rank(wt, rX, c)
+		            - (c == placeholder && pos_a < rX);
+		rX = rB + bitfile_get(&gtr);
+		gap[rB]++;
+		if (new_gt) {
+			bitfile_put(&gtw, rX > pos_a);
+		}
+	}
+	gap[idx_b]++;
+	if (new_gt) {
+		bitfile_put(&gtw, idx_b > pos_a);
+		for (size_t j = m - 1; j > 0; j--) {
+			bitfile_put(&gtw, blk->xrank[j] > pos_a);
+		}
+		bitfile_flush(&gtw);
+	}
+
+	FREE(rr.buf);
+	FREE(C);
+	wavtree_free(wt);
+	if (!rr.ok || !gtr.ok || !gtw.ok) {
+		WARN("Error accessing temporary file.\n");
+		FREE(gap);
+		return NULL;
+	}
+	return gap;
+}
+
+
+/*
+ * Merges the BWT of the block into the BWT of the tail.
+ * If final, the sentinel is dropped.
+ * Sets the new primary row, and returns false on I/O errors.
+ */
+static bool merge_bwt(bwtblock *blk, size_t *gap, FILE *bwt,
+                      size_t *primary, FILE *new_bwt, bool final)
+{
+	size_t m = blk->m;
+	size_t row_in = 0, row_out = 0, new_primary = 0;
+	bool ok = true;
+	for (size_t k = 0; ok && k <= m; k++) {
+		for (size_t t = 0; ok && t < gap[k]; t++, row_in++, row_out++) {
+			int c = getc(bwt);
+			ok &= (c != EOF);
+			c = (row_in == *primary) ? blk->chars[m - 1] : c;
+			ok &= (putc(c, new_bwt) != EOF);
+		}
+		if (k < m) {
+			size_t j = blk->order[k];
+			if (j > 0) {
+				ok &= (putc(blk->chars[j - 1], new_bwt) != EOF);
+			}
+			else {
+				new_primary = row_out;
+				if (!final) {
+					ok &= (putc(0, new_bwt) != EOF);
+				}
+			}
+			row_out++;
+		}
+	}
+	ok &= (fflush(new_bwt) == 0);
+	if (!ok) {
+		WARN("Error writing the BWT.\n");
+		return false;
+	}
+	if (!final) {
+		rewind(new_bwt);
+	}
+	*primary = new_primary;
+	return true;
+}
+
+
+size_t bwt_from_stream(strstream *sst, alphabet *ab, size_t mem_budget,
+                       FILE *out, size_t *primary)
+{
+	ERROR_ASSERT(ab_type(ab) == CHAR_TYPE,
+	             "Incompatible alphabet type for BWT construction");
+
+	// copy the text to a temporary file
+	FILE *txt = tmpfile(), *bwt = NULL, *gt = NULL;
+	if (txt == NULL) {
+		WARN("Unable to create temporary file.\n");
+		return SIZE_MAX;
+	}
+	bool ok = true;
+	char *buf = ARR_NEW(char, IO_CHUNK);
+	size_t n = 0, prim = 0;
+	strstream_reset(sst);
+	for (size_t nread; (nread = strstream_reads(sst, buf, IO_CHUNK)) > 0; ) {
+		if (fwrite(buf, 1, nread, txt) != nread) {
+			ok = false;
+			break;
+		}
+		n += nread;
+	}
+	FREE(buf);
+	ok = ok && (fflush(txt) == 0);
+
+	size_t blksize = MAX(1, mem_budget / BWT_BYTES_PER_BLOCK_CHAR);
+	// BWT of the empty suffix T[n:] and its (empty) gt file
+	bwt = ok ? tmpfile() : NULL;
+	gt = bwt ? tmpfile() : NULL;
+	ok = ok && gt && (putc(0, bwt) != EOF);
+	if (!ok) {
+		WARN("Unable to write temporary file.\n");
+		goto cleanup;
+	}
+	rewind(bwt);
+
+	for (size_t b = n, a; ok && b > 0; b = a) {
+		a = (b > blksize) ? (b - blksize) : 0;
+		bool final = (a == 0);
+		bwtblock blk = {.ab = ab, .txt = txt, .n = n, .a = a, .b = b, .m = b - a};
+		blk.chars = ARR_NEW(char, blk.m);
+		byte_t *gt_head = NULL;
+		size_t *gap = NULL;
+		FILE *new_gt = NULL, *new_bwt = NULL;
+		ok = read_text(txt, a, b, blk.chars)
+		     && (gt_head = load_gt_head(gt, n - b, MIN(blk.m, n - b))) != NULL
+		     && sort_block(&blk, gt_head);
+		if (ok && !final && (new_gt = tmpfile()) == NULL) {
+			WARN("Unable to create temporary file.\n");
+			ok = false;
+		}
+		ok = ok && (gap = scan_tail(&blk, gt, new_gt)) != NULL;
+		if (ok) {
+			fclose(gt);
+			gt = new_gt;
+			new_gt = NULL;
+		}
+		if (ok && !final && (new_bwt = tmpfile()) == NULL) {
+			WARN("Unable to create temporary file.\n");
+			ok = false;
+		}
+		ok = ok && merge_bwt(&blk, gap, bwt, &prim, final ? out : new_bwt, final);
+		if (ok) {
+			fclose(bwt);
+			bwt = new_bwt;
+			new_bwt = NULL;
+		}
+
+		if (new_gt) {
+			fclose(new_gt);
+		}
+		if (new_bwt) {
+			fclose(new_bwt);
+		}
+		FREE(gt_head);
+		FREE(gap);
+		FREE(blk.chars);
+		FREE(blk.gtb);
+		FREE(blk.order);
+		FREE(blk.xrank);
+	}
+
+cleanup:
+	if (bwt) {
+		// empty text, or an error
+		fclose(bwt);
+	}
+	if (gt) {
+		fclose(gt);
+	}
+	fclose(txt);
+	if (!ok) {
+		return SIZE_MAX;
+	}
+	*primary = prim;
+	return n;
+}
+
+
+wavtree *bwt_wavtree_from_file(const char *path, alphabet *ab,
+                               wtshape shape)
+{
+	strfilereader *sfr = strfilereader_new_from_path(path);
+	if (sfr == NULL) {
+		WARN("Unable to open BWT file %s.", path);
+		return NULL;
+	}
+	xstrreader *xsr = xstrreader_open_strread(strfilereader_as_strread(sfr));
+	wavtree *wt = wavtree_new_from_reader(ab, xstrreader_as_xstrread(xsr),
+	                                      shape);
+	xstrreader_close(xsr);
+	strfilereader_free(sfr);
+	return wt;
+}
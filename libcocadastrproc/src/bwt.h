@@ -0,0 +1,98 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#ifndef BWT_H
+#define BWT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "alphabet.h"
+#include "strstream.h"
+#include "wavtree.h"
+
+/**
+ * @file bwt.h
+ * @author Paulo Fonseca
+ *
+ * @brief Semi-external construction of the Burrows-Wheeler Transform
+ *        (BWT) of a long text.
+ *
+ * The text is read once from a ::strstream into a temporary file and the
+ * BWT is built by blockwise merging
+ * (P.Ferragina, T.Gagie and G.Manzini, Lightweight data indexing and
+ * compression in external memory, Algorithmica 2012).
+ * The text is split into blocks which are processed from right to
+ * left. The suffixes of each block are sorted in memory and merged into
+ * the BWT of the suffixes to its right, which is kept on disk. Besides
+ * the block, the merge only needs one bit per suffix of the processed
+ * part, telling whether it is larger than the first suffix of that
+ * part, which is also kept on disk.
+ * The block size is derived from a memory budget. All disk accesses are
+ * sequential, but the whole BWT is rewritten once per block, so the
+ * total I/O is O(n^2/budget).
+ *
+ * The BWT of a text T of length n is that of T$, where $ is a virtual
+ * sentinel smaller than any other character. It is stored without the
+ * sentinel, as n chars, together with the index of the row whose BWT
+ * char is the sentinel (the row of T itself), as in ::fmindex.
+ */
+
+
+/**
+ * @brief Approximate number of bytes of memory used per block character.
+ */
+#define BWT_BYTES_PER_BLOCK_CHAR 64
+
+
+/**
+ * @brief Builds the BWT of the text read from @p sst over the char
+ *        alphabet @p ab using about @p mem_budget bytes of memory,
+ *        and writes it to @p out without the sentinel.
+ *
+ * @param sst The source text stream.
+ * @param ab The text alphabet.
+ * @param mem_budget The memory budget in bytes. The block size is
+ *        @p mem_budget / ::BWT_BYTES_PER_BLOCK_CHAR characters (at least 1).
+ * @param out (out) The destination of the BWT.
+ * @param primary (out) The index of the row of the sentinel. Left
+ *        unchanged on failure.
+ * @return The length of the text, which is the number of chars written,
+ *         or SIZE_MAX if a temporary file cannot be created, read or
+ *         written, or if writing to @p out fails.
+ */
+size_t bwt_from_stream(strstream *sst, alphabet *ab, size_t mem_budget,
+                       FILE *out, size_t *primary);
+
+
+/**
+ * @brief Builds a wavelet tree over the BWT (without the sentinel)
+ *        written by bwt_from_stream() to the file @p path.
+ *
+ * The BWT is read with a ::xstrread, so the construction does not
+ * need the BWT in memory.
+ * @see wavtree_new_from_reader
+ */
+wavtree *bwt_wavtree_from_file(const char *path, alphabet *ab,
+                               wtshape shape);
+
+#endif
@@ -19,6 +19,7 @@
  *
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -55,9 +56,14 @@ struct _csarray {
 	csrsbitarr **even_bv;
 	csrsbitarr **char_stop_bv;
 	wavtree **phi_wt;
+	alphabet **phi_ab;
 	size_t *root_sa;
 	size_t *root_sa_inv;
 	//xstr **phi_str;
+	size_t sa_rate;          // 0 for the recursive (levels) representation
+	csrsbitarr *sampled_bv;  // rows whose SA value is sampled
+	size_t *sa_samples;      // SA values of the sampled rows, in row order
+	size_t *isa_samples;     // isa_samples[k] = SA^-1[k*sa_rate]
 };
 
 
@@ -68,26 +74,34 @@ static void sarr_invert(size_t *src, size_t len, size_t *dest)
 }
 
 
-csarray *csarray_new( char *str, size_t len, alphabet *ab )
+static csarray *csa_new(size_t nlevels)
 {
 	csarray *csa = NEW(csarray);
-
-	csa->nlevels = 1;  // # of levels, including root level
-	for ( size_t lvl_len = len+1; lvl_len > MAX_PLAIN_SA_LEN;
-	        lvl_len = (size_t) ceil(lvl_len/2.0f) )
-		csa->nlevels++;
-
+	csa->nlevels = nlevels;
 	csa->lvl_len = ARR_NEW(size_t, csa->nlevels);
 	csa->even_bv = ARR_NEW(csrsbitarr *, csa->nlevels);
 	csa->char_stop_bv = ARR_NEW(csrsbitarr *, csa->nlevels);
 	csa->phi_wt = ARR_NEW(wavtree *, csa->nlevels);
+	csa->phi_ab = ARR_NEW(alphabet *, csa->nlevels);
 	//csa->phi_str = NEW_ARR(xstr*, csa->nlevels);
+	csa->root_sa = NULL;
+	csa->root_sa_inv = NULL;
+	csa->sa_rate = 0;
+	csa->sampled_bv = NULL;
+	csa->sa_samples = NULL;
+	csa->isa_samples = NULL;
+	return csa;
+}
 
-	// build plain sarray and its inverse
-	size_t *sarr = sais(str, len, ab);
-	size_t *sarr_inv = ARR_NEW(size_t, len+1);
-	sarr_invert(sarr, len+1, sarr_inv);
 
+/*
+ * Computes the support alphabet, the root level char stops and
+ * the "normalised" source xstr, in which each char is replaced by
+ * its rank in the support alphabet.
+ */
+static xstr *csa_init_root( csarray *csa, char *str, size_t len, size_t *sarr,
+                            bitvec **char_stops, size_t *nchars )
+{
 	size_t lvl_len = len+1;  // sentinel added by sais
 	csa->lvl_len[0] = lvl_len;
 	bitvec *xchar_stops = bitvec_new_with_capacity(lvl_len);
@@ -105,7 +119,8 @@ csarray *csarray_new( char *str, size_t len, alphabet *ab )
 			ndiff_xchars++;
 		}
 	}
-	csa->xab = alphabet_new(ndiff_xchars, strbuf_detach(supp_ab_str));
+	csa->xab = alphabet_new(ndiff_xchars, strbuf_as_str(supp_ab_str));
+	strbuf_free(supp_ab_str);
 
 	// convert source string to "normalised" xstr
 	assert(ndiff_xchars < XCHAR_MAX);
@@ -117,6 +132,55 @@ csarray *csarray_new( char *str, size_t len, alphabet *ab )
 		if ( bitvec_get_bit(xchar_stops, i) )
 			cur_xchar++;
 	}
+	*char_stops = xchar_stops;
+	*nchars = ndiff_xchars;
+	return cur_xstr;
+}
+
+
+/*
+ * Builds the char stops and the phi function wavelet tree of a level.
+ * Takes ownership of @p xchar_stops.
+ */
+static void csa_init_phi( csarray *csa, size_t lvl, size_t lvl_len,
+                          size_t *sarr, size_t *sarr_inv, bitvec *xchar_stops,
+                          xstr *cur_xstr, size_t ndiff_xchars )
+{
+	csa->lvl_len[lvl] = lvl_len;
+	csa->char_stop_bv[lvl] = csrsbitarr_new( bitvec_detach(xchar_stops),
+	                         lvl_len );
+	xstr *phi_xstr = xstr_new_with_capacity(nbytes(ndiff_xchars), lvl_len);
+	xstr_push_n(phi_xstr, 0, lvl_len);
+	for (size_t i=0; i<lvl_len; i++)
+		xstr_set( phi_xstr, sarr_inv[(sarr[i]+1)%lvl_len],
+		          xstr_get(cur_xstr, sarr[i]) );
+	csa->phi_ab[lvl] = int_alphabet_new(ndiff_xchars);
+	csa->phi_wt[lvl] = wavtree_new_from_xstr( csa->phi_ab[lvl], phi_xstr,
+	                   WT_BALANCED );
+	//csa->phi_str[lvl] = phi_xstr;
+	xstr_free(phi_xstr);
+}
+
+
+csarray *csarray_new( char *str, size_t len, alphabet *ab )
+{
+	size_t nlevels = 1;  // # of levels, including root level
+	for ( size_t lvl_len = len+1; lvl_len > MAX_PLAIN_SA_LEN;
+	        lvl_len = (size_t) ceil(lvl_len/2.0f) )
+		nlevels++;
+	csarray *csa = csa_new(nlevels);
+
+	// build plain sarray and its inverse
+	size_t *sarr = sais(str, len, ab);
+	size_t *sarr_inv = ARR_NEW(size_t, len+1);
+	sarr_invert(sarr, len+1, sarr_inv);
+
+	size_t lvl_len = len+1;
+	bitvec *xchar_stops;
+	size_t ndiff_xchars;
+	xstr *cur_xstr = csa_init_root(csa, str, len, sarr, &xchar_stops,
+	                               &ndiff_xchars);
+	xchar_t cur_xchar;
 
 	//printf("str[0]: %s\n", str);
 	//xstr_print(cur_xstr);
@@ -130,40 +194,24 @@ csarray *csarray_new( char *str, size_t len, alphabet *ab )
 		//printf("building level %zu\n",lvl);
 		//ARR_PRINT(sarr, sarr, %zu, 0, lvl_len, 20);
 
-		csa->lvl_len[lvl] = lvl_len;
-
 		// build phi function wavelet tree representation
-		csa->char_stop_bv[lvl] = csrsbitarr_new( bitvec_detach(xchar_stops),
-		                         lvl_len );
-
-		xstr *phi_xstr = xstr_new_with_capacity(nbytes(ndiff_xchars), lvl_len);
-		xstr_push_n(phi_xstr, 0, lvl_len);
-		for (size_t i=0; i<lvl_len; i++)
-			xstr_set( phi_xstr, sarr_inv[(sarr[i]+1)%lvl_len],
-			          xstr_get(cur_xstr, sarr[i]) );
-		csa->phi_wt[lvl] = wavtree_new_from_xstr( int_alphabet_new(ndiff_xchars),
-		                   phi_xstr,  WT_BALANCED );
-		//csa->phi_str[lvl] = phi_xstr;
-		xstr_free(phi_xstr);
+		csa_init_phi( csa, lvl, lvl_len, sarr, sarr_inv, xchar_stops,
+		              cur_xstr, ndiff_xchars );
 
 		// build even-suffix indicator bitvector
 		// push even entries to first half of sarr rescaling its value
 		// if not last level
-		bitvec *even_suff = bitvec_new_with_capacity(lvl_len);
 		if (lvl == csa->nlevels - 1) {
-			for (size_t i = 0 ; i < lvl_len; i++)
-				bitvec_push(even_suff, IS_EVEN(sarr[i]));
 			break;
 		}
-		else {
-			for (size_t i = 0, last = 0; i < lvl_len; i++) {
-				if (IS_EVEN(sarr[i])) {
-					bitvec_push(even_suff, 1);
-					sarr[last++] = sarr[i]/2;
-				}
-				else
-					bitvec_push(even_suff, 0);
+		bitvec *even_suff = bitvec_new_with_capacity(lvl_len);
+		for (size_t i = 0, last = 0; i < lvl_len; i++) {
+			if (IS_EVEN(sarr[i])) {
+				bitvec_push(even_suff, 1);
+				sarr[last++] = sarr[i]/2;
 			}
+			else
+				bitvec_push(even_suff, 0);
 		}
 		csa->even_bv[lvl] = csrsbitarr_new(bitvec_detach(even_suff), lvl_len);
 
@@ -209,6 +257,46 @@ csarray *csarray_new( char *str, size_t len, alphabet *ab )
 }
 
 
+csarray *csarray_new_sampled( char *str, size_t len, alphabet *ab,
+                              size_t sa_rate )
+{
+	csarray *csa = csa_new(1);
+	csa->sa_rate = MAX(1, sa_rate);
+
+	size_t *sarr = sais(str, len, ab);
+	size_t *sarr_inv = ARR_NEW(size_t, len+1);
+	sarr_invert(sarr, len+1, sarr_inv);
+
+	size_t lvl_len = len+1;
+	bitvec *xchar_stops;
+	size_t ndiff_xchars;
+	xstr *cur_xstr = csa_init_root(csa, str, len, sarr, &xchar_stops,
+	                               &ndiff_xchars);
+	csa_init_phi( csa, 0, lvl_len, sarr, sarr_inv, xchar_stops,
+	              cur_xstr, ndiff_xchars );
+	xstr_free(cur_xstr);
+
+	// sample the text positions multiple of sa_rate
+	size_t nsamples = (size_t)DIVCEIL(lvl_len, csa->sa_rate);
+	byte_t *sampled = bytearr_new( (size_t)DIVCEIL(lvl_len, BYTESIZE)
+	                               + sizeof(uint64_t) );
+	csa->isa_samples = ARR_NEW(size_t, nsamples);
+	for (size_t k=0; k<nsamples; k++) {
+		csa->isa_samples[k] = sarr_inv[k * csa->sa_rate];
+		bitarr_set_bit(sampled, csa->isa_samples[k], 1);
+	}
+	csa->sampled_bv = csrsbitarr_new(sampled, lvl_len);
+	csa->sa_samples = ARR_NEW(size_t, nsamples);
+	for (size_t i=0, k=0; i<lvl_len; i++) {
+		if (sarr[i] % csa->sa_rate == 0)
+			csa->sa_samples[k++] = sarr[i];
+	}
+	FREE(sarr);
+	FREE(sarr_inv);
+	return csa;
+}
+
+
 
 void csarray_print(FILE *stream, csarray *csa)
 {
@@ -234,8 +322,16 @@ void csarray_print(FILE *stream, csarray *csa)
 		//printf("%s\n", strbuf_as_str(phi));
 		//strbuf_free(phi);
 	}
-	ARR_FPRINT(stream, csa->root_sa, 0, csa->lvl_len[csa->nlevels-1], 10, "root_sa", "%zu", " ", "");
-	ARR_FPRINT(stream, csa->root_sa_inv, 0, csa->lvl_len[csa->nlevels-1], 10, "root_sa_inv", "%zu", " ", "");
+	if (csa->sa_rate) {
+		size_t nsamples = (size_t)DIVCEIL(csa->lvl_len[0], csa->sa_rate);
+		fprintf(stream, "\tsa_rate:%zu\n", csa->sa_rate);
+		ARR_FPRINT(stream, csa->sa_samples, 0, nsamples, 10, "sa_samples", "%zu", " ", "");
+		ARR_FPRINT(stream, csa->isa_samples, 0, nsamples, 10, "isa_samples", "%zu", " ", "");
+	}
+	else {
+		ARR_FPRINT(stream, csa->root_sa, 0, csa->lvl_len[csa->nlevels-1], 10, "root_sa", "%zu", " ", "");
+		ARR_FPRINT(stream, csa->root_sa_inv, 0, csa->lvl_len[csa->nlevels-1], 10, "root_sa_inv", "%zu", " ", "");
+	}
 
 	fprintf (stream, "} #end of csarray@%p\n", csa);
 
@@ -245,18 +341,26 @@ void csarray_print(FILE *stream, csarray *csa)
 void csarray_free(csarray *csa)
 {
 	if (csa==NULL) return;
-	for (size_t l=0; l<csa->nlevels-1; l++) {
-		csrsbitarr_free(csa->even_bv[l], true);
+	for (size_t l=0; l<csa->nlevels; l++) {
+		if (l < csa->nlevels-1)
+			csrsbitarr_free(csa->even_bv[l], true);
 		csrsbitarr_free(csa->char_stop_bv[l], true);
 		wavtree_free(csa->phi_wt[l]);
+		alphabet_free(csa->phi_ab[l]);
 	}
 	alphabet_free(csa->xab);
 	FREE(csa->lvl_len);
 	FREE(csa->even_bv);
 	FREE(csa->char_stop_bv);
 	FREE(csa->phi_wt);
+	FREE(csa->phi_ab);
 	FREE(csa->root_sa);
 	FREE(csa->root_sa_inv);
+	if (csa->sampled_bv != NULL)
+		csrsbitarr_free(csa->sampled_bv, true);
+	FREE(csa->sa_samples);
+	FREE(csa->isa_samples);
+	FREE(csa);
 }
 
 
@@ -298,12 +402,72 @@ static size_t csa_get(csarray *csa, size_t lvl, size_t i)
 }
 
 
+/*
+ * Walks phi from row i until a sampled row. Each step moves to the
+ * next text position (wrapping around the sentinel).
+ */
+static size_t csa_get_sampled(csarray *csa, size_t i)
+{
+	size_t len = csa->lvl_len[0];
+	size_t steps = 0;
+	while (!csrsbitarr_get(csa->sampled_bv, i)) {
+		i = csa_phi(csa, 0, i);
+		steps++;
+	}
+	size_t sample = csa->sa_samples[csrsbitarr_rank1(csa->sampled_bv, i)];
+	return (sample + len - steps) % len;
+}
+
+
 size_t csarray_get(csarray *csa, size_t i)
 {
+	if (csa->sa_rate)
+		return csa_get_sampled(csa, i);
 	return csa_get(csa, 0, i);
 }
 
 
+void csarray_get_range(csarray *csa, size_t from, size_t to, size_t *dest)
+{
+	to = MIN(to, csarray_len(csa));
+	if (from >= to) return;
+	if (!csa->sa_rate) {
+		for (size_t i=from; i<to; i++)
+			dest[i-from] = csa_get(csa, 0, i);
+		return;
+	}
+	// Advance all the rows of the range in lockstep, one phi step
+	// per round, compacting the pending ones at the front.
+	// phi is increasing over rows sharing the same first char, so the
+	// rows of a round stay mostly sorted, which favours locality.
+	size_t len = csa->lvl_len[0];
+	size_t n = to - from;
+	size_t *row = ARR_NEW(size_t, n);
+	size_t *idx = ARR_NEW(size_t, n);
+	for (size_t j=0; j<n; j++) {
+		row[j] = from + j;
+		idx[j] = j;
+	}
+	for (size_t steps=0, npending=n; npending>0; steps++) {
+		size_t k = 0;
+		for (size_t j=0; j<npending; j++) {
+			if (csrsbitarr_get(csa->sampled_bv, row[j])) {
+				size_t sample = csa->sa_samples[csrsbitarr_rank1(csa->sampled_bv, row[j])];
+				dest[idx[j]] = (sample + len - steps) % len;
+			}
+			else {
+				row[k] = csa_phi(csa, 0, row[j]);
+				idx[k] = idx[j];
+				k++;
+			}
+		}
+		npending = k;
+	}
+	FREE(row);
+	FREE(idx);
+}
+
+
 static size_t csa_get_inv(csarray *csa, size_t lvl, size_t i)
 {
 	if (lvl == csa->nlevels - 1)
@@ -321,10 +485,22 @@ static size_t csa_get_inv(csarray *csa, size_t lvl, size_t i)
 
 size_t csarray_get_inv(csarray *csa, size_t i)
 {
+	if (csa->sa_rate) {
+		size_t inv = csa->isa_samples[i / csa->sa_rate];
+		for (size_t k=0, l=i % csa->sa_rate; k<l; k++)
+			inv = csa_phi(csa, 0, inv);
+		return inv;
+	}
 	return csa_get_inv(csa, 0, i);
 }
 
 
+size_t csarray_sa_rate(csarray *csa)
+{
+	return csa->sa_rate;
+}
+
+
 xchar_t csarray_get_char(csarray *csa, size_t i)
 {
 	size_t inv = csarray_get_inv(csa, i);
@@ -44,6 +44,22 @@ typedef struct _csarray csarray;
 csarray *csarray_new(char *str, size_t len, alphabet *ab);
 
 
+/**
+ * @brief Creates a sampled CSA for the string @p str of length @p len over
+ *        the alphabet @p ab.
+ *
+ * Instead of the recursive halving levels, keeps only the root level
+ * phi function plus the SA values of the suffixes starting at
+ * the positions multiple of @p sa_rate (and the inverse SA at those
+ * positions). An access then takes at most @p sa_rate phi steps,
+ * while the samples take about 2(n/@p sa_rate) words.
+ * Larger rates give smaller and slower arrays.
+ * A zero @p sa_rate is treated as one.
+ */
+csarray *csarray_new_sampled(char *str, size_t len, alphabet *ab,
+                             size_t sa_rate);
+
+
 /**
  * @brief Creates a CSA from the stream @p sst over the alphabet @p ab
  */
@@ -90,6 +106,25 @@ size_t csarray_phi(csarray *csa, size_t i);
 size_t csarray_get(csarray *csa, size_t i);
 
 
+/**
+ * @brief Writes the suffix array values of the positions
+ *        [@p from, @p to) to @p dest, i.e.
+ *        @p dest[j] = csarray_get(@p csa, @p from + j).
+ *        On sampled CSAs the whole range is advanced together, one
+ *        phi step per round, keeping the accesses to the phi
+ *        wavelet tree localised when locating many occurrences.
+ *        @p to is clipped to the length of the CSA.
+ */
+void csarray_get_range(csarray *csa, size_t from, size_t to, size_t *dest);
+
+
+/**
+ * @brief Returns the SA sampling rate, or 0 if the CSA uses the
+ *        recursive representation.
+ */
+size_t csarray_sa_rate(csarray *csa);
+
+
 /**
  * @brief Returns the inverse of @p i, that is, the array index j s.t.
  *        csarray_get(@p csa, j) == @p i.
@@ -181,49 +181,27 @@ static void init_select_tables(csrsbitarr *ba)
 
 		while (target_rank < ba->total_bit_count[bit]) {
 			// read bytes greedily on a per max word basis
+			// (without reading past the end of the array)
 #if BYTEWORDSIZE==8
-			chunk_rank = uint64_bitcount( *((uint64_t *)(ba->data+byte_pos)),
-			                              bit );
-			while (cumul_rank+chunk_rank < target_rank) {
+			while (byte_pos + 8 <= ba->byte_size
+			        && cumul_rank + (chunk_rank = uint64_bitcount(
+			                *((uint64_t *)(ba->data+byte_pos)), bit)) < target_rank) {
 				cumul_rank += chunk_rank;
 				byte_pos += 8;
-				chunk_rank = uint64_bitcount(*((uint64_t *)(ba->data+byte_pos)),
-				                             bit );
-			}
-			chunk_rank = uint32_bitcount( *((uint32_t *)(ba->data+byte_pos)),
-			                              bit );
-			while (cumul_rank+chunk_rank < target_rank) {
-				cumul_rank += chunk_rank;
-				byte_pos += 4;
-				chunk_rank = uint32_bitcount(*((uint32_t *)(ba->data+byte_pos)),
-				                             bit);
-			}
-			chunk_rank = uint16_bitcount( *((uint16_t *)(ba->data+byte_pos)),
-			                              bit );
-			while (cumul_rank+chunk_rank < target_rank) {
-				cumul_rank += chunk_rank;
-				byte_pos += 2;
-				chunk_rank = uint16_bitcount(*((uint16_t *)(ba->data+byte_pos)),
-				                             bit);
 			}
-#elif BYTEWORDSIZE==4
-			chunk_rank = uint32_bitcount( *((uint32_t *)(ba->data+byte_pos)),
-			                              bit );
-			while (cumul_rank+chunk_rank < target_rank) {
+#endif
+			while (byte_pos + 4 <= ba->byte_size
+			        && cumul_rank + (chunk_rank = uint32_bitcount(
+			                *((uint32_t *)(ba->data+byte_pos)), bit)) < target_rank) {
 				cumul_rank += chunk_rank;
 				byte_pos += 4;
-				chunk_rank = uint32_bitcount(*((uint32_t *)(ba->data+byte_pos)),
-				                             bit);
 			}
-			chunk_rank = uint16_bitcount( *((uint16_t *)(ba->data+byte_pos)),
-			                              bit );
-			while (cumul_rank+chunk_rank < target_rank) {
+			while (byte_pos + 2 <= ba->byte_size
+			        && cumul_rank + (chunk_rank = uint16_bitcount(
+			                *((uint16_t *)(ba->data+byte_pos)), bit)) < target_rank) {
 				cumul_rank += chunk_rank;
 				byte_pos += 2;
-				chunk_rank = uint16_bitcount(*((uint16_t *)(ba->data+byte_pos)),
-				                             bit);
 			}
-#endif
 			chunk_rank = byte_bitcount(*((byte_t *)(ba->data+byte_pos)), bit);
 			while (cumul_rank+chunk_rank < target_rank) {
 				cumul_rank += chunk_rank;
@@ -364,7 +342,8 @@ size_t csrsbitarr_rank1(csrsbitarr *ba, size_t pos)
 	last_byte = pos / BYTESIZE;
 
 	// try to go to the last selection sample stop before pos
-	sel_grp = rank/ba->sel_samples_bit_interval[1];
+	sel_grp = MIN( rank/ba->sel_samples_bit_interval[1],
+	               ba->sel_samples_count[1]-1 );
 	while ( sel_grp < ba->sel_samples_count[1]-1 &&
 	        bytearr_read_size_t( ba->byte_sel_samples[1],
 	                             (sel_grp+1)*ba->bytes_per_byte_pos,
@@ -0,0 +1,398 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alphabet.h"
+#include "bitarr.h"
+#include "bitbyte.h"
+#include "bytearr.h"
+#include "cstrutil.h"
+#include "csrsbitarr.h"
+#include "errlog.h"
+#include "fmindex.h"
+#include "mathutil.h"
+#include "new.h"
+#include "sais.h"
+#include "vec.h"
+#include "wavtree.h"
+#include "xchar.h"
+
+
+static const char FMI_MAGIC[4] = {'F', 'M', 'I', '1'};
+
+
+struct _fmindex {
+	alphabet   *ab;
+	size_t      len;
+	size_t      primary;     // row of the suffix T[0:], whose BWT char is the sentinel
+	size_t     *C;           // C[r] = 1 + # of chars of rank < r in T
+	wavtree    *bwt;         // BWT without the sentinel
+	size_t      sa_rate;
+	csrsbitarr *sampled;     // marks the rows whose SA value is sampled
+	size_t     *sa_samples;  // SA values of the sampled rows, in row order
+	size_t     *isa_samples; // isa_samples[k] = row of the suffix T[k*sa_rate:]
+};
+
+
+static inline size_t fmi_nsamples(fmindex *fmi)
+{
+	return (fmi->len / fmi->sa_rate) + 1;
+}
+
+
+/*
+ * # of occurrences of c in BWT[0:row]
+ */
+static inline size_t fmi_occ(fmindex *fmi, xchar_t c, size_t row)
+{
+	return wavtree_rank(fmi->bwt, row - (row > fmi->primary), c);
+}
+
+
+/*
+ * LF-mapping: row of the suffix T[SA[row]-1:].
+ * Requires row != primary.
+ */
+static inline size_t fmi_lf(fmindex *fmi, size_t row, xchar_t *c)
+{
+	size_t rank;
+	*c = wavtree_char_rank(fmi->bwt, row - (row > fmi->primary), &rank);
+	return fmi->C[ab_rank(fmi->ab, *c)] + rank;
+}
+
+
+/*
+ * Builds C, the wavelet tree, and the SA samples from the
+ * BWT (minus the sentinel) and the ISA samples.
+ */
+static void fmi_init(fmindex *fmi, char *bwt)
+{
+	size_t nchars = ab_size(fmi->ab);
+	fmi->C = ARR_OF_0_NEW(size_t, nchars+1);
+	for (size_t i=0; i<fmi->len; i++) {
+		fmi->C[ab_rank(fmi->ab, (unsigned char)bwt[i]) + 1]++;
+	}
+	fmi->C[0] = 1;
+	for (size_t r=1; r<=nchars; r++) {
+		fmi->C[r] += fmi->C[r-1];
+	}
+	fmi->bwt = wavtree_new(fmi->ab, bwt, fmi->len, WT_HUFFMAN);
+
+	size_t nrows = fmi->len + 1;
+	size_t nsamples = fmi_nsamples(fmi);
+	byte_t *bits = bytearr_new( (size_t)DIVCEIL(nrows, BYTESIZE)
+	                            + sizeof(uint64_t) );
+	for (size_t k=0; k<nsamples; k++) {
+		bitarr_set_bit(bits, fmi->isa_samples[k], 1);
+	}
+	fmi->sampled = csrsbitarr_new(bits, nrows);
+	fmi->sa_samples = ARR_NEW(size_t, nsamples);
+	for (size_t k=0; k<nsamples; k++) {
+		fmi->sa_samples[csrsbitarr_rank1(fmi->sampled, fmi->isa_samples[k])]
+		    = k * fmi->sa_rate;
+	}
+}
+
+
+fmindex *fmindex_new(alphabet *ab, char *txt, size_t len, size_t sa_rate)
+{
+	fmindex *fmi = NEW(fmindex);
+	fmi->ab = alphabet_clone(ab);
+	fmi->len = len;
+	fmi->sa_rate = MAX(1, sa_rate);
+
+	size_t *sa = sais(txt, len, fmi->ab);
+	char *bwt = cstr_new(len);
+	fmi->isa_samples = ARR_NEW(size_t, fmi_nsamples(fmi));
+	fmi->primary = 0;
+	for (size_t i=0, j=0; i<=len; i++) {
+		if (sa[i] % fmi->sa_rate == 0) {
+			fmi->isa_samples[sa[i] / fmi->sa_rate] = i;
+		}
+		if (sa[i] == 0) {
+			fmi->primary = i;
+		}
+		else {
+			bwt[j++] = txt[sa[i]-1];
+		}
+	}
+	FREE(sa);
+	fmi_init(fmi, bwt);
+	FREE(bwt);
+	return fmi;
+}
+
+
+void fmindex_free(fmindex *fmi)
+{
+	if (fmi == NULL) return;
+	wavtree_free(fmi->bwt);
+	alphabet_free(fmi->ab);
+	csrsbitarr_free(fmi->sampled, true);
+	FREE(fmi->C);
+	FREE(fmi->sa_samples);
+	FREE(fmi->isa_samples);
+	FREE(fmi);
+}
+
+
+size_t fmindex_len(fmindex *fmi)
+{
+	return fmi->len;
+}
+
+
+size_t fmindex_sa_rate(fmindex *fmi)
+{
+	return fmi->sa_rate;
+}
+
+
+size_t fmindex_range( fmindex *fmi, const char *pat, size_t patlen,
+                      size_t *sp, size_t *ep )
+{
+	size_t nchars = ab_size(fmi->ab);
+	size_t s = 0, e = fmi->len + 1;
+	for (size_t k=patlen; k>0 && s<e; k--) {
+		xchar_t c = (unsigned char)pat[k-1];
+		size_t r = ab_rank(fmi->ab, c);
+		if (r >= nchars) {
+			s = e = 0;
+			break;
+		}
+		s = fmi->C[r] + fmi_occ(fmi, c, s);
+		e = fmi->C[r] + fmi_occ(fmi, c, e);
+	}
+	*sp = s;
+	*ep = MAX(s, e);
+	return *ep - *sp;
+}
+
+
+size_t fmindex_count(fmindex *fmi, const char *pat, size_t patlen)
+{
+	size_t sp, ep;
+	return fmindex_range(fmi, pat, patlen, &sp, &ep);
+}
+
+
+size_t fmindex_lookup(fmindex *fmi, size_t row)
+{
+	size_t steps = 0;
+	xchar_t c;
+	while (!csrsbitarr_get(fmi->sampled, row)) {
+		row = fmi_lf(fmi, row, &c);
+		steps++;
+	}
+	return fmi->sa_samples[csrsbitarr_rank1(fmi->sampled, row)] + steps;
+}
+
+
+size_t fmindex_locate( fmindex *fmi, const char *pat, size_t patlen,
+                       vec *occs )
+{
+	size_t sp, ep;
+	fmindex_range(fmi, pat, patlen, &sp, &ep);
+	for (size_t row=sp; row<ep; row++) {
+		vec_push_size_t(occs, fmindex_lookup(fmi, row));
+	}
+	return ep - sp;
+}
+
+
+char *fmindex_extract(fmindex *fmi, size_t from, size_t to)
+{
+	to = MIN(to, fmi->len);
+	from = MIN(from, to);
+	char *ret = cstr_new(to - from);
+	// start at the closest sampled suffix at or after to
+	size_t pos = MIN(((to + fmi->sa_rate - 1) / fmi->sa_rate) * fmi->sa_rate,
+	                 fmi->len);
+	size_t row = (pos == fmi->len) ? 0 : fmi->isa_samples[pos / fmi->sa_rate];
+	xchar_t c;
+	while (pos > from) {
+		row = fmi_lf(fmi, row, &c);
+		pos--;
+		if (pos < to) {
+			ret[pos - from] = (char)c;
+		}
+	}
+	return ret;
+}
+
+
+typedef struct {
+	fmindex       *fmi;
+	char         **pats;
+	const size_t  *patlens;
+	size_t        *counts;
+	size_t         from;
+	size_t         to;
+} fmi_batch;
+
+
+static void *fmi_count_batch(void *arg)
+{
+	fmi_batch *batch = (fmi_batch *)arg;
+	for (size_t i=batch->from; i<batch->to; i++) {
+		batch->counts[i] = fmindex_count( batch->fmi, batch->pats[i],
+		                                  batch->patlens[i] );
+	}
+	return NULL;
+}
+
+
+void fmindex_count_batch( fmindex *fmi, char **pats, const size_t *patlens,
+                          size_t npats, size_t *counts, size_t nthreads )
+{
+	if (nthreads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (ncpus > 0) ? (size_t)ncpus : 1;
+	}
+	size_t nbatches = MAX(1, MIN(nthreads, npats));
+	fmi_batch *batches = ARR_NEW(fmi_batch, nbatches);
+	pthread_t *threads = ARR_NEW(pthread_t, nbatches);
+	bool *started = ARR_OF_0_NEW(bool, nbatches);
+	for (size_t t=0; t<nbatches; t++) {
+		batches[t].fmi = fmi;
+		batches[t].pats = pats;
+		batches[t].patlens = patlens;
+		batches[t].counts = counts;
+		batches[t].from = (t * npats) / nbatches;
+		batches[t].to = ((t+1) * npats) / nbatches;
+	}
+	for (size_t t=1; t<nbatches; t++) {
+		started[t] = ( pthread_create(threads+t, NULL, fmi_count_batch,
+		                              batches+t) == 0 );
+		if (!started[t]) fmi_count_batch(batches+t);
+	}
+	fmi_count_batch(batches);
+	for (size_t t=1; t<nbatches; t++) {
+		if (started[t]) pthread_join(threads[t], NULL);
+	}
+	FREE(started);
+	FREE(threads);
+	FREE(batches);
+}
+
+
+void fmindex_write(fmindex *fmi, FILE *stream)
+{
+	size_t nchars = ab_size(fmi->ab);
+	fwrite(FMI_MAGIC, sizeof(char), 4, stream);
+	fwrite(&fmi->len, sizeof(size_t), 1, stream);
+	fwrite(&fmi->sa_rate, sizeof(size_t), 1, stream);
+	fwrite(&fmi->primary, sizeof(size_t), 1, stream);
+	fwrite(&nchars, sizeof(size_t), 1, stream);
+	for (size_t r=0; r<nchars; r++) {
+		char c = (char)ab_char(fmi->ab, r);
+		fwrite(&c, sizeof(char), 1, stream);
+	}
+	for (size_t i=0; i<fmi->len; i++) {
+		char c = (char)wavtree_char(fmi->bwt, i);
+		fwrite(&c, sizeof(char), 1, stream);
+	}
+	fwrite(fmi->isa_samples, sizeof(size_t), fmi_nsamples(fmi), stream);
+}
+
+
+/*
+ * Checks whether the stream has at least n more bytes, if its size
+ * can be determined.
+ */
+static bool fmi_has_bytes(FILE *stream, size_t n)
+{
+	long cur = ftell(stream);
+	if (cur < 0 || fseek(stream, 0, SEEK_END) != 0) {
+		return true;
+	}
+	long end = ftell(stream);
+	fseek(stream, cur, SEEK_SET);
+	return end < 0 || (size_t)(end - cur) >= n;
+}
+
+
+fmindex *fmindex_read(FILE *stream)
+{
+	char magic[4];
+	size_t hdr[4];
+	if ( fread(magic, sizeof(char), 4, stream) != 4
+	        || memcmp(magic, FMI_MAGIC, 4) != 0
+	        || fread(hdr, sizeof(size_t), 4, stream) != 4 ) {
+		WARN("Invalid FM-index stream.\n");
+		return NULL;
+	}
+	size_t len = hdr[0], sa_rate = hdr[1], primary = hdr[2], nchars = hdr[3];
+	size_t nsamples = (sa_rate > 0) ? (len / sa_rate) + 1 : 0;
+	if ( sa_rate == 0 || nchars > UCHAR_MAX || primary > len
+	        || len >= SIZE_MAX / sizeof(size_t)
+	        || !fmi_has_bytes(stream, nchars + len + nsamples * sizeof(size_t)) ) {
+		WARN("Invalid FM-index stream.\n");
+		return NULL;
+	}
+	char *letters = ARR_NEW(char, nchars + 1);
+	char *bwt = ARR_NEW(char, len + 1);
+	size_t *isa_samples = ARR_NEW(size_t, nsamples);
+	bool ok = letters && bwt && isa_samples
+	          && fread(letters, sizeof(char), nchars, stream) == nchars
+	          && fread(bwt, sizeof(char), len, stream) == len
+	          && fread(isa_samples, sizeof(size_t), nsamples, stream) == nsamples;
+	// the letters must be distinct, and the BWT and ISA samples
+	// consistent with them and with the length
+	bool seen[UCHAR_MAX + 1] = {false};
+	for (size_t r = 0; ok && r < nchars; r++) {
+		ok = !seen[(unsigned char)letters[r]];
+		seen[(unsigned char)letters[r]] = true;
+	}
+	for (size_t i = 0; ok && i < len; i++) {
+		ok = seen[(unsigned char)bwt[i]];
+	}
+	for (size_t k = 0; ok && k < nsamples; k++) {
+		ok = isa_samples[k] <= len;
+	}
+	if (!ok) {
+		WARN("Invalid or truncated FM-index stream.\n");
+		FREE(letters);
+		FREE(bwt);
+		FREE(isa_samples);
+		return NULL;
+	}
+	letters[nchars] = '\0';
+	bwt[len] = '\0';
+	fmindex *fmi = NEW(fmindex);
+	fmi->len = len;
+	fmi->sa_rate = sa_rate;
+	fmi->primary = primary;
+	fmi->isa_samples = isa_samples;
+	fmi->ab = alphabet_new(nchars, letters);
+	FREE(letters);
+	fmi_init(fmi, bwt);
+	FREE(bwt);
+	return fmi;
+}
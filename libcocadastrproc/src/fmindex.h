@@ -0,0 +1,160 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#ifndef FMINDEX_H
+#define FMINDEX_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "alphabet.h"
+#include "vec.h"
+
+/**
+ * @file fmindex.h
+ * @author Paulo Fonseca
+ *
+ * @brief FM-index.
+ *
+ * Self-index of a string T of length n over an alphabet of
+ * size σ supporting exact pattern search.
+ * A sentinel, smaller than every char, is virtually appended to T
+ * so that the Burrows-Wheeler Transform (BWT) of T has n+1 rows.
+ * The BWT is computed from the suffix array built with ::sais and
+ * stored, minus the sentinel, in a Huffman-shaped wavelet tree that
+ * provides the occ function, i.e. the number of occurrences of a char
+ * in a BWT prefix.
+ *
+ * Every suffix starting at a position multiple of a given
+ * SA sampling rate s has its SA position sampled. This trades
+ * space, (n/s) words for the samples, for time, at most
+ * s LF-steps to locate an occurrence or to start extracting
+ * a substring.
+ */
+
+typedef struct _fmindex fmindex;
+
+
+/**
+ * @brief Creates an FM-index of the string @p txt of length @p len
+ *        over the (char) alphabet @p ab.
+ *        The index keeps a copy of the alphabet and does not
+ *        require the text afterwards.
+ * @param sa_rate The SA sampling rate. Zero is treated as one,
+ *        i.e. a plain suffix array.
+ */
+fmindex *fmindex_new(alphabet *ab, char *txt, size_t len, size_t sa_rate);
+
+
+/**
+ * @brief Destructor.
+ */
+void fmindex_free(fmindex *fmi);
+
+
+/**
+ * @brief Returns the length of the indexed string (excluding the
+ *        sentinel).
+ */
+size_t fmindex_len(fmindex *fmi);
+
+
+/**
+ * @brief Returns the SA sampling rate.
+ */
+size_t fmindex_sa_rate(fmindex *fmi);
+
+
+/**
+ * @brief Backward search. Computes the interval [@p sp, @p ep) of the
+ *        rows of the BWT, i.e. of the suffix array, whose suffixes
+ *        are prefixed by the pattern @p pat of length @p patlen.
+ * @return The number of occurrences, @p ep - @p sp.
+ */
+size_t fmindex_range( fmindex *fmi, const char *pat, size_t patlen,
+                      size_t *sp, size_t *ep );
+
+
+/**
+ * @brief Returns the number of occurrences of the pattern @p pat of
+ *        length @p patlen in the indexed string.
+ */
+size_t fmindex_count(fmindex *fmi, const char *pat, size_t patlen);
+
+
+/**
+ * @brief Returns the suffix array value at @p row, that is, the
+ *        position of the text where the @p row-th smallest suffix starts.
+ *        Takes at most sa_rate LF-steps.
+ */
+size_t fmindex_lookup(fmindex *fmi, size_t row);
+
+
+/**
+ * @brief Locates the occurrences of the pattern @p pat of length
+ *        @p patlen. The starting positions are appended
+ *        to @p occs, which must be a vec of size_t, in suffix array
+ *        (not text) order.
+ * @return The number of occurrences.
+ */
+size_t fmindex_locate( fmindex *fmi, const char *pat, size_t patlen,
+                       vec *occs );
+
+
+/**
+ * @brief Extracts the substring T[@p from:@p to] of the indexed
+ *        string T without the text itself.
+ *        Takes O(sa_rate + @p to - @p from) LF-steps.
+ *        @p to is clipped to the length of the string.
+ * @return A new null-terminated string. The caller is responsible for
+ *         freeing it.
+ */
+char *fmindex_extract(fmindex *fmi, size_t from, size_t to);
+
+
+/**
+ * @brief Counts a batch of @p npats patterns.
+ *        Sets @p counts[i] = fmindex_count(@p fmi, @p pats[i], @p patlens[i]).
+ *        The patterns are distributed among @p nthreads threads, which
+ *        query the index concurrently. If @p nthreads is 0 uses the
+ *        number of online processors.
+ */
+void fmindex_count_batch( fmindex *fmi, char **pats, const size_t *patlens,
+                          size_t npats, size_t *counts, size_t nthreads );
+
+
+/**
+ * @brief Writes the index to a binary @p stream in native byte order.
+ *        Only the BWT, the alphabet and the ISA samples are stored.
+ *        The wavelet tree and the SA samples are rebuilt by ::fmindex_read.
+ */
+void fmindex_write(fmindex *fmi, FILE *stream);
+
+
+/**
+ * @brief Reads an index written with ::fmindex_write from a binary @p stream.
+ * @return The index, or NULL if the stream is not a valid index,
+ *         or is corrupt or truncated.
+ */
+fmindex *fmindex_read(FILE *stream);
+
+
+#endif
@@ -22,6 +22,7 @@
 #include <assert.h>
 #include <math.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,9 +36,11 @@
 #include "bytearr.h"
 #include "new.h"
 #include "cstrutil.h"
+#include "errlog.h"
 #include "strbuf.h"
 #include "huffcode.h"
 #include "mathutil.h"
+#include "memdbg.h"
 #include "strread.h"
 #include "xstr.h"
 #include "xstrread.h"
@@ -45,6 +48,19 @@
 static const byte_t LEFT = 0;
 static const byte_t RIGHT = 1;
 
+/*
+ * Decoding table: the next TABLE_BITS bits of the code index an entry
+ * which resolves up to TABLE_CHARS complete codewords at once.
+ */
+#define TABLE_BITS 11
+#define TABLE_CHARS 3
+
+typedef struct {
+	xchar_t chr[TABLE_CHARS];
+	byte_t nchrs; // number of chars resolved, 0 if codeword > TABLE_BITS
+	byte_t nbits; // total length of their codewords
+} dectbl_entry;
+
 struct _hufftnode {
 	size_t chr_rank;
 	hufftnode *chd[2];
@@ -56,6 +72,14 @@ struct _huffcode {
 	size_t size;
 	hufftnode *tree;
 	bitvec **code;
+	uint64_t *cword;     // canonical codeword of each char rank
+	byte_t *clen;        // codeword length of each char rank
+	size_t max_clen;
+	uint64_t *first;     // first codeword of each length
+	size_t *count;       // number of codewords of each length
+	size_t *offset;      // position of the first codeword of each length...
+	size_t *sorted;      // ...in the list of char ranks in canonical order
+	dectbl_entry *table;
 };
 
 typedef struct {
@@ -65,48 +89,30 @@ typedef struct {
 
 static int nodefreq_cmp(const void *p1, const void *p2)
 {
-	return (*((size_t *)p2) - *((size_t *)p1));
+	size_t f1 = *((size_t *)p1), f2 = *((size_t *)p2);
+	return (f2 > f1) - (f2 < f1);
 }
 
-static void fill_code_table(huffcode *hcode, const hufftnode *node,
-                            size_t code_len, byte_t *code)
+static int nodefreq_desc_cmp(const void *p1, const void *p2)
 {
-	if (hufftnode_is_leaf(node)) {
-		hcode->code[node->chr_rank] = bitvec_new_from_bitarr(code, code_len);
-		// printf("code of %c = %s\n",ab_char(hcode->ab, node->chr_rank), code);
-	}
-	else {
-		bitarr_set_bit(code, code_len, 0);
-		fill_code_table(hcode, hufftnode_left(node), code_len + 1, code);
-		bitarr_set_bit(code, code_len, 1);
-		fill_code_table(hcode, hufftnode_right(node), code_len + 1, code);
+	const nodefreq *nf1 = p1, *nf2 = p2;
+	if (nf1->freq != nf2->freq) {
+		return (nf1->freq < nf2->freq) - (nf1->freq > nf2->freq);
 	}
+	return (nf1->node > nf2->node) - (nf1->node < nf2->node);
 }
 
-huffcode *huffcode_new(const alphabet *ab, const size_t freqs[])
-{
-	huffcode *hcode;
-
-	hcode = NEW(huffcode);
-	hcode->ab = alphabet_clone(ab);
-	hcode->size = ab_size(ab);
-
-	size_t ab_bytesize = (size_t)DIVCEIL(hcode->size, BYTESIZE);
-	hcode->tree = ARR_NEW(hufftnode, MAX(0, 2 * hcode->size - 1));
-	for (size_t i = 0; i < hcode->size; i++) {
-		hcode->tree[i].chr_rank = i;
-		hcode->tree[i].chd[LEFT] = &hcode->tree[i];
-		hcode->tree[i].chd[RIGHT] = &hcode->tree[i];
-		hcode->tree[i].ab_mask = bytearr_new(ab_bytesize);
-		bitarr_set_bit(hcode->tree[i].ab_mask, i, 1);
-	}
 
+// unrestricted Huffman codeword lengths for n>=2 chars
+static void huffman_lens(size_t n, const size_t *freqs, size_t *lens)
+{
+	size_t *parent = ARR_NEW(size_t, 2 * n - 1);
 	binheap *nfheap = binheap_new(sizeof(nodefreq), nodefreq_cmp);
-	for (size_t i = 0; i < hcode->size; i++) {
+	for (size_t i = 0; i < n; i++) {
 		nodefreq nf = {.node = i, .freq = freqs[i]};
 		binheap_ins(nfheap, &nf);
 	}
-	size_t next = hcode->size;
+	size_t next = n;
 	while (binheap_size(nfheap) > 1) {
 		nodefreq smallest, snd_smallest, new_nf;
 		binheap_remv(nfheap, &smallest);
@@ -114,23 +120,234 @@ huffcode *huffcode_new(const alphabet *ab, const size_t freqs[])
 		new_nf.node = next;
 		new_nf.freq = smallest.freq + snd_smallest.freq;
 		binheap_ins(nfheap, &new_nf);
-		hcode->tree[next].chd[LEFT] = &hcode->tree[smallest.node];
-		hcode->tree[next].chd[RIGHT] = &hcode->tree[snd_smallest.node];
-		hcode->tree[next].ab_mask = bytearr_new(ab_bytesize);
-		hcode->tree[next].chr_rank = hcode->size;
-		bitarr_or(hcode->tree[next].ab_mask,
-		          hcode->tree[smallest.node].ab_mask, hcode->size);
-		bitarr_or(hcode->tree[next].ab_mask,
-		          hcode->tree[snd_smallest.node].ab_mask, hcode->size);
+		parent[smallest.node] = next;
+		parent[snd_smallest.node] = next;
 		next++;
 	}
-	// assert(next==(2*hcode->size-1));
+	DESTROY_FLAT(nfheap, binheap);
+	// parents come after their children, and the root is the last node
+	size_t *depth = ARR_NEW(size_t, 2 * n - 1);
+	depth[2 * n - 2] = 0;
+	for (size_t i = 2 * n - 2; i > 0; i--) {
+		depth[i - 1] = depth[parent[i - 1]] + 1;
+	}
+	memcpy(lens, depth, n * sizeof(size_t));
+	FREE(depth);
+	FREE(parent);
+}
+
+
+/*
+ * Restricts the codeword lengths of n>=2 chars to max_len while keeping
+ * the code complete, by the heuristic of the JPEG standard (Annex K.3),
+ * and reassigns the resulting lengths by decreasing char frequency.
+ */
+static void limit_lens(size_t n, const size_t *freqs, size_t *lens,
+                       size_t max_len)
+{
+	size_t cur_max = 0;
+	for (size_t i = 0; i < n; i++) {
+		cur_max = MAX(cur_max, lens[i]);
+	}
+	if (cur_max <= max_len) {
+		return;
+	}
+	size_t *bl_count = ARR_OF_0_NEW(size_t, cur_max + 1);
+	for (size_t i = 0; i < n; i++) {
+		bl_count[lens[i]]++;
+	}
+	for (size_t l = cur_max; l > max_len; l--) {
+		while (bl_count[l] > 0) {
+			size_t j = l - 2;
+			while (bl_count[j] == 0) {
+				j--;
+			}
+			// move a pair of leaves at level l up, making one of them
+			// the sibling of a former leaf at level j
+			bl_count[l] -= 2;
+			bl_count[l - 1] += 1;
+			bl_count[j + 1] += 2;
+			bl_count[j] -= 1;
+		}
+	}
+	nodefreq *byfreq = ARR_NEW(nodefreq, n);
+	for (size_t i = 0; i < n; i++) {
+		byfreq[i] = (nodefreq) {
+			.freq = freqs[i], .node = i
+		};
+	}
+	qsort(byfreq, n, sizeof(nodefreq), nodefreq_desc_cmp);
+	for (size_t l = 1, k = 0; l <= max_len; l++) {
+		for (size_t c = 0; c < bl_count[l]; c++) {
+			lens[byfreq[k++].node] = l;
+		}
+	}
+	FREE(byfreq);
+	FREE(bl_count);
+}
+
+
+// assigns canonical codewords in (length, char rank) order
+static void assign_codewords(huffcode *hcode)
+{
+	size_t n = hcode->size, L = hcode->max_clen;
+	hcode->count = ARR_OF_0_NEW(size_t, L + 1);
+	hcode->offset = ARR_NEW(size_t, L + 2);
+	hcode->first = ARR_NEW(uint64_t, L + 1);
+	hcode->sorted = ARR_NEW(size_t, n);
+	for (size_t i = 0; i < n; i++) {
+		hcode->count[hcode->clen[i]]++;
+	}
+	hcode->offset[0] = 0;
+	for (size_t l = 0; l <= L; l++) {
+		hcode->offset[l + 1] = hcode->offset[l] + hcode->count[l];
+	}
+	size_t *pos = ARR_NEW(size_t, L + 1);
+	memcpy(pos, hcode->offset, (L + 1) * sizeof(size_t));
+	for (size_t i = 0; i < n; i++) {
+		hcode->sorted[pos[hcode->clen[i]]++] = i;
+	}
+	FREE(pos);
+	uint64_t cw = 0;
+	hcode->first[0] = 0;
+	for (size_t l = 1; l <= L; l++) {
+		cw = (cw + ((l > 1) ? hcode->count[l - 1] : 0)) << 1;
+		hcode->first[l] = cw;
+		for (size_t k = 0; k < hcode->count[l]; k++) {
+			hcode->cword[hcode->sorted[hcode->offset[l] + k]] = cw + k;
+		}
+	}
+}
+
+
+static void init_node(huffcode *hcode, hufftnode *node, size_t chr_rank)
+{
+	node->chr_rank = chr_rank;
+	node->chd[LEFT] = (chr_rank < hcode->size) ? node : NULL;
+	node->chd[RIGHT] = (chr_rank < hcode->size) ? node : NULL;
+	node->ab_mask = bytearr_new((size_t)DIVCEIL(hcode->size, BYTESIZE));
+}
+
+
+// builds the code tree by inserting the codewords of all chars
+static void build_tree(huffcode *hcode)
+{
+	size_t n = hcode->size;
+	hcode->tree = ARR_NEW(hufftnode, MAX(0, 2 * n - 1));
+	for (size_t i = 0; i < n; i++) {
+		init_node(hcode, hcode->tree + i, i);
+		bitarr_set_bit(hcode->tree[i].ab_mask, i, 1);
+	}
+	if (n < 2) {
+		return;
+	}
+	hufftnode *root = hcode->tree + (2 * n) - 2;
+	init_node(hcode, root, n);
+	size_t next = n;
+	for (size_t i = 0; i < n; i++) {
+		hufftnode *cur = root;
+		for (size_t b = hcode->clen[i]; b > 1; b--) {
+			bitarr_set_bit(cur->ab_mask, i, 1);
+			byte_t dir = (hcode->cword[i] >> (b - 1)) & 1;
+			if (cur->chd[dir] == NULL) {
+				init_node(hcode, hcode->tree + next, n);
+				cur->chd[dir] = hcode->tree + next;
+				next++;
+			}
+			cur = cur->chd[dir];
+		}
+		bitarr_set_bit(cur->ab_mask, i, 1);
+		cur->chd[hcode->cword[i] & 1] = hcode->tree + i;
+	}
+	assert(next == 2 * n - 2);
+}
+
+
+// decodes the first codeword of the left-aligned bits, if length <= max_len
+static inline bool decode_one(const huffcode *hcode, uint64_t bits,
+                              size_t min_len, size_t max_len, size_t *chr_rank, size_t *len)
+{
+	for (size_t l = min_len; l <= max_len; l++) {
+		uint64_t cw = bits >> (64 - l);
+		if (cw - hcode->first[l] < hcode->count[l]) {
+			*chr_rank = hcode->sorted[hcode->offset[l] + (cw - hcode->first[l])];
+			*len = l;
+			return true;
+		}
+	}
+	return false;
+}
 
-	hcode->code = ARR_NEW(bitvec *, hcode->size);
-	if (hcode->size) {
-		byte_t *chrcode = bitarr_new(hcode->size);
-		fill_code_table(hcode, huffcode_tree(hcode), 0, chrcode);
-		FREE(chrcode);
+
+static void build_table(huffcode *hcode)
+{
+	size_t nentries = (size_t)1 << TABLE_BITS;
+	hcode->table = ARR_NEW(dectbl_entry, nentries);
+	for (size_t v = 0; v < nentries; v++) {
+		dectbl_entry *e = hcode->table + v;
+		e->nchrs = 0;
+		e->nbits = 0;
+		uint64_t bits = (uint64_t)v << (64 - TABLE_BITS);
+		size_t r, l;
+		while (e->nchrs < TABLE_CHARS
+		        && decode_one(hcode, bits, 1,
+		                      MIN(hcode->max_clen, TABLE_BITS - e->nbits), &r, &l)) {
+			e->chr[e->nchrs++] = ab_char(hcode->ab, r);
+			e->nbits += l;
+			bits <<= l;
+		}
+	}
+}
+
+
+huffcode *huffcode_new(const alphabet *ab, const size_t freqs[])
+{
+	size_t n = ab_size(ab);
+	size_t min_len = (n > 1) ? (size_t)ceil(log2(n)) : 0;
+	return huffcode_new_lenlim(ab, freqs, MAX(HUFFCODE_MAX_CODELEN, min_len));
+}
+
+
+huffcode *huffcode_new_lenlim(const alphabet *ab, const size_t freqs[],
+                              size_t max_codelen)
+{
+	size_t n = ab_size(ab);
+	if (max_codelen > 64 || (n > 1 && (max_codelen == 0
+	                                   || (max_codelen < 64 && n > ((size_t)1 << max_codelen))))) {
+		WARN("Cannot build a Huffman code for %zu chars with codewords of at most %zu bits.\n",
+		     n, max_codelen);
+		return NULL;
+	}
+
+	huffcode *hcode;
+	hcode = NEW(huffcode);
+	hcode->ab = alphabet_clone(ab);
+	hcode->size = n;
+
+	hcode->clen = ARR_OF_0_NEW(byte_t, n);
+	hcode->cword = ARR_OF_0_NEW(uint64_t, n);
+	hcode->max_clen = 0;
+	if (n > 1) {
+		size_t *lens = ARR_NEW(size_t, n);
+		huffman_lens(n, freqs, lens);
+		limit_lens(n, freqs, lens, max_codelen);
+		for (size_t i = 0; i < n; i++) {
+			hcode->clen[i] = lens[i];
+			hcode->max_clen = MAX(hcode->max_clen, lens[i]);
+		}
+		FREE(lens);
+	}
+	assign_codewords(hcode);
+	build_tree(hcode);
+
+	hcode->code = ARR_NEW(bitvec *, n);
+	for (size_t i = 0; i < n; i++) {
+		hcode->code[i] = bitvec_new_with_capacity(hcode->clen[i]);
+		bitvec_push_word(hcode->code[i], hcode->cword[i], hcode->clen[i]);
+	}
+	hcode->table = NULL;
+	if (n > 1) {
+		build_table(hcode);
 	}
 	return hcode;
 }
@@ -189,6 +406,13 @@ void huffcode_free(huffcode *hcode)
 		bitvec_free(hcode->code[i]);
 	}
 	FREE(hcode->code);
+	FREE(hcode->cword);
+	FREE(hcode->clen);
+	FREE(hcode->first);
+	FREE(hcode->count);
+	FREE(hcode->offset);
+	FREE(hcode->sorted);
+	FREE(hcode->table);
 	for (size_t i = 0; hcode->size > 0 && i < (2 * hcode->size) - 1; i++) {
 		if (hcode->tree[i].ab_mask)
 			FREE(hcode->tree[i].ab_mask);
@@ -245,6 +469,40 @@ void huffcode_print(FILE *stream, const huffcode *hcode)
 	fprintf(stream, "} // end of huffcode@%p\n", (void *)hcode);
 }
 
+/*
+ * Codewords are accumulated in a 64-bit buffer which is appended to the
+ * destination bitvector whenever the next codeword does not fit.
+ */
+typedef struct {
+	bitvec *dest;
+	uint64_t buf;
+	size_t nbits;
+} bitsink;
+
+
+static inline void bitsink_put(bitsink *sink, const huffcode *hcode,
+                               size_t chr_rank)
+{
+	size_t len = hcode->clen[chr_rank];
+	if (sink->nbits + len > 64) {
+		bitvec_push_word(sink->dest, sink->buf, sink->nbits);
+		sink->buf = 0;
+		sink->nbits = 0;
+	}
+	sink->buf = (len < 64) ? (sink->buf << len) | hcode->cword[chr_rank]
+	            : hcode->cword[chr_rank];
+	sink->nbits += len;
+}
+
+
+static inline void bitsink_flush(bitsink *sink)
+{
+	bitvec_push_word(sink->dest, sink->buf, sink->nbits);
+	sink->buf = 0;
+	sink->nbits = 0;
+}
+
+
 bitvec *huffcode_encode(const char *src, size_t len, const huffcode *hcode)
 {
 	bitvec *enc = bitvec_new();
@@ -255,9 +513,11 @@ bitvec *huffcode_encode(const char *src, size_t len, const huffcode *hcode)
 void huffcode_encode_to(bitvec *dest, const char *src, size_t len,
                         const huffcode *hcode)
 {
-	for (int i = 0; i < len; i++) {
-		bitvec_cat(dest, hcode->code[ab_rank(hcode->ab, src[i])]);
+	bitsink sink = {.dest = dest, .buf = 0, .nbits = 0};
+	for (size_t i = 0; i < len; i++) {
+		bitsink_put(&sink, hcode, ab_rank(hcode->ab, src[i]));
 	}
+	bitsink_flush(&sink);
 }
 
 bitvec *huffcode_encode_xstr(const xstr *src, const huffcode *hcode)
@@ -270,9 +530,11 @@ bitvec *huffcode_encode_xstr(const xstr *src, const huffcode *hcode)
 void huffcode_encode_xstr_to(bitvec *dest, const xstr *src,
                              const huffcode *hcode)
 {
+	bitsink sink = {.dest = dest, .buf = 0, .nbits = 0};
 	FOREACH_IN_XSTR(c, src) {
-		bitvec_cat(dest, hcode->code[ab_rank(hcode->ab, c)]);
+		bitsink_put(&sink, hcode, ab_rank(hcode->ab, c));
 	}
+	bitsink_flush(&sink);
 }
 
 bitvec *huffcode_encode_strread(strread *src, const huffcode *hcode)
@@ -285,9 +547,11 @@ bitvec *huffcode_encode_strread(strread *src, const huffcode *hcode)
 void huffcode_encode_strread_to(bitvec *dest, strread *src,
                                 const huffcode *hcode)
 {
+	bitsink sink = {.dest = dest, .buf = 0, .nbits = 0};
 	for (int c; (c = strread_getc(src)) != EOF;) {
-		bitvec_cat(dest, hcode->code[ab_rank(hcode->ab, c)]);
+		bitsink_put(&sink, hcode, ab_rank(hcode->ab, c));
 	}
+	bitsink_flush(&sink);
 }
 
 bitvec *huffcode_encode_xstrread(xstrread *src, const huffcode *hcode)
@@ -300,23 +564,93 @@ bitvec *huffcode_encode_xstrread(xstrread *src, const huffcode *hcode)
 void huffcode_encode_xstrread_to(bitvec *dest, xstrread *src,
                                  const huffcode *hcode)
 {
+	bitsink sink = {.dest = dest, .buf = 0, .nbits = 0};
 	for (xchar_wt c; (c = xstrread_getc(src)) != XEOF;) {
-		bitvec_cat(dest, hcode->code[ab_rank(hcode->ab, c)]);
+		bitsink_put(&sink, hcode, ab_rank(hcode->ab, c));
 	}
+	bitsink_flush(&sink);
 }
 
+
+// returns the 64 bits starting at position pos, zero-padded past the end
+static inline uint64_t peek_bits(const byte_t *bytes, size_t nbytes, size_t pos)
+{
+	size_t b = pos / BYTESIZE, off = pos % BYTESIZE;
+	uint64_t ret = 0;
+	if (b + sizeof(uint64_t) < nbytes) {
+		for (size_t k = 0; k < sizeof(uint64_t); k++) {
+			ret = (ret << BYTESIZE) | bytes[b + k];
+		}
+		if (off) {
+			ret = (ret << off) | (bytes[b + sizeof(uint64_t)] >> (BYTESIZE - off));
+		}
+		return ret;
+	}
+	for (size_t k = 0; k <= sizeof(uint64_t); k++) {
+		byte_t next = (b + k < nbytes) ? bytes[b + k] : 0;
+		ret = (k < sizeof(uint64_t)) ? (ret << BYTESIZE) | next
+		      : (off ? (ret << off) | (next >> (BYTESIZE - off)) : ret);
+	}
+	return ret;
+}
+
+
+// writes a char in the layout of an xstr with chars of the given size
+static inline void put_chr(byte_t *dest, xchar_t c, size_t sizeof_char)
+{
+	switch (sizeof_char) {
+	case 1:
+		*dest = (byte_t)c;
+		break;
+	default:
+#if ENDIANNESS==LITTLE
+		memcpy(dest, &c, sizeof_char);
+#elif ENDIANNESS==BIG
+		memcpy(dest, ((byte_t *)&c) + (sizeof(xchar_t) - sizeof_char), sizeof_char);
+#endif
+		break;
+	}
+}
+
+
 xstr *huffcode_decode(const bitvec *bcode, const huffcode *hcode)
 {
-	xstr *dec = xstr_new(nbytes(ab_size(hcode->ab)));
-	hufftnode *cur = (hufftnode *)huffcode_tree(hcode);
-	for (size_t i = 0, l = bitvec_len(bcode); i < l; i++) {
-		cur = cur->chd[bitvec_get_bit(bcode, i)];
-		if (hufftnode_is_leaf(cur)) {
-			xstr_push(dec, ab_char(hcode->ab, cur->chr_rank));
-			cur = (hufftnode *)huffcode_tree(hcode);
+	size_t sizeof_char = nbytes(ab_size(hcode->ab));
+	if (hcode->size < 2) {
+		return xstr_new(sizeof_char);
+	}
+	const byte_t *bytes = bitvec_as_bytes(bcode);
+	size_t len = bitvec_len(bcode);
+	size_t nb = (size_t)DIVCEIL(len, BYTESIZE);
+	// decoded chars are written straight to a raw buffer later
+	// wrapped in the returned xstr
+	size_t n = 0, cap = (len / hcode->max_clen) + TABLE_CHARS;
+	byte_t *dec = malloc(cap * sizeof_char);
+	for (size_t pos = 0; pos < len;) {
+		if (n + TABLE_CHARS > cap) {
+			cap = 2 * cap;
+			dec = realloc(dec, cap * sizeof_char);
+		}
+		uint64_t bits = peek_bits(bytes, nb, pos);
+		const dectbl_entry *e = hcode->table + (bits >> (64 - TABLE_BITS));
+		if (e->nchrs > 0 && pos + e->nbits <= len) {
+			for (size_t k = 0; k < e->nchrs; k++) {
+				put_chr(dec + (n++ * sizeof_char), e->chr[k], sizeof_char);
+			}
+			pos += e->nbits;
+		}
+		else {
+			// long codeword, or near the end of the code
+			size_t r, l;
+			if (!decode_one(hcode, bits, 1, hcode->max_clen, &r, &l)
+			        || pos + l > len) {
+				break;
+			}
+			put_chr(dec + (n++ * sizeof_char), ab_char(hcode->ab, r), sizeof_char);
+			pos += l;
 		}
 	}
-	return dec;
+	return xstr_new_from_arr(dec, n, sizeof_char);
 }
 
 const bitvec *huffcode_charcode(const huffcode *hcode, size_t char_rank)
@@ -324,6 +658,11 @@ const bitvec *huffcode_charcode(const huffcode *hcode, size_t char_rank)
 	return hcode->code[char_rank];
 }
 
+size_t huffcode_codelen(const huffcode *hcode, size_t char_rank)
+{
+	return hcode->clen[char_rank];
+}
+
 const hufftnode *huffcode_tree(const huffcode *code)
 {
 	return (code->size > 0) ? code->tree + (2 * code->size) - 2 : NULL;
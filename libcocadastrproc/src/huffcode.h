@@ -52,7 +52,20 @@
  * trie - The Huffman Tree (HT) - with L leaves, each corresponding to a
  * different character of A. The codeword of a char c is given by the label
  * of the path from the root of the HT to its corresponding leaf.
+ *
+ * The codes built here are canonical: codewords of the same length are
+ * consecutive integers assigned in lexicographic order of the chars, and
+ * shorter codewords precede longer ones. Codeword lengths are limited
+ * (by default to HUFFCODE_MAX_CODELEN bits), so that encoding and decoding
+ * can work on whole machine words, the latter resolving several chars per
+ * lookup in a decoding table.
+ */
+
+
+/**
+ * Default maximum codeword length.
  */
+#define HUFFCODE_MAX_CODELEN 32
 
 
 /**
@@ -75,6 +88,19 @@ typedef struct _hufftnode hufftnode;
 huffcode *huffcode_new(const alphabet *ab, const size_t *freqs);
 
 
+/**
+ * @brief Creates a HC for an alphabet with associated letter frequencies,
+ * with codewords of at most @p max_codelen <= 64 bits.
+ * The code is optimal if the unrestricted HC satisfies the limit; otherwise
+ * the codeword lengths are adjusted heuristically.
+ * @return The code, or NULL if the alphabet has more than 2^max_codelen letters.
+ * @param ab (no transfer) The base alphabet.
+ * @param freqs (no transfer) Individual letter frequencies in lexycographic order.
+ */
+huffcode *huffcode_new_lenlim(const alphabet *ab, const size_t *freqs,
+                              size_t max_codelen);
+
+
 /**
  * @brief Creates a HC for an alphabet from a source string.
  * @param ab (no transfer) The base alphabet.
@@ -186,6 +212,13 @@ xstr *huffcode_decode(const bitvec *code, const huffcode *hcode);
 const bitvec *huffcode_charcode(const huffcode *hcode, size_t char_rank);
 
 
+/**
+ * @brief Returns the length of the code of a char
+ * @param char_rank The rank of the char w.r.t. the code alphabet
+ */
+size_t huffcode_codelen(const huffcode *hcode, size_t char_rank);
+
+
 /**
  * @brief Returns the (root of the) Huffman tree corresponding to a given HC.
  * @warning Do NOT modify or destroy the returned value
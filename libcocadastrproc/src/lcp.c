@@ -0,0 +1,446 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arrays.h"
+#include "bitarr.h"
+#include "bitbyte.h"
+#include "bytearr.h"
+#include "csrsbitarr.h"
+#include "errlog.h"
+#include "lcp.h"
+#include "mathutil.h"
+#include "new.h"
+#include "vec.h"
+
+
+#define DAC_CHUNK_BITS 8
+#define DAC_CHUNK_MASK 0xFF
+
+// RMQ: minima of blocks of RMQ_BLK entries, and a sparse table
+// over the superblocks of RMQ_SBLK blocks
+#define RMQ_BLK 64
+#define RMQ_SBLK 64
+
+
+struct _lcparray {
+	size_t        len;
+	size_t        nlevels;
+	size_t       *lvl_len;
+	byte_t      **chunks;   // chunks[l][k] = l-th byte of the k-th entry with more than l bytes
+	csrsbitarr  **more;     // more[l][k] = whether that entry has more than l+1 bytes
+	size_t        nblks;
+	size_t       *blkmin;   // blkmin[b] = min LCP[b*RMQ_BLK:(b+1)*RMQ_BLK]
+	size_t        nsblks;
+	size_t        nlogs;
+	size_t      **sparse;   // sparse[j][s] = leftmost min block of superblocks [s, s+2^j)
+};
+
+
+size_t *lcp_kasai(const char *str, size_t len, const size_t *sa)
+{
+	size_t *lcp = ARR_NEW(size_t, len + 1);
+	size_t *rank = ARR_NEW(size_t, len + 1);
+	for (size_t i = 0; i <= len; i++) {
+		rank[sa[i]] = i;
+	}
+	lcp[0] = 0;
+	for (size_t p = 0, h = 0, q, r; p < len; p++) {
+		r = rank[p];
+		q = sa[r - 1];
+		while (p + h < len && q + h < len && str[p + h] == str[q + h]) {
+			h++;
+		}
+		lcp[r] = h;
+		h -= (h > 0);
+	}
+	FREE(rank);
+	return lcp;
+}
+
+
+size_t *lcp_plcp(const char *str, size_t len, const size_t *sa)
+{
+	// phi[SA[i]] = SA[i-1], then overwritten with PLCP in text order
+	size_t *plcp = ARR_NEW(size_t, MAX(len, 1));
+	for (size_t i = 1; i <= len; i++) {
+		plcp[sa[i]] = sa[i - 1];
+	}
+	for (size_t p = 0, h = 0, q; p < len; p++) {
+		q = plcp[p];
+		while (p + h < len && q + h < len && str[p + h] == str[q + h]) {
+			h++;
+		}
+		plcp[p] = h;
+		h -= (h > 0);
+	}
+	return plcp;
+}
+
+
+size_t *lcp_phi(const char *str, size_t len, const size_t *sa)
+{
+	size_t *plcp = lcp_plcp(str, len, sa);
+	size_t *lcp = ARR_NEW(size_t, len + 1);
+	lcp[0] = 0;
+	for (size_t i = 1; i <= len; i++) {
+		lcp[i] = plcp[sa[i]];
+	}
+	FREE(plcp);
+	return lcp;
+}
+
+
+static void dac_init(lcparray *lcpa, const size_t *lcp)
+{
+	size_t n = lcpa->len;
+	size_t maxval = 0;
+	for (size_t i = 0; i < n; i++) {
+		maxval = MAX(maxval, lcp[i]);
+	}
+	size_t nlevels = 1;
+	while (nlevels < sizeof(size_t) && (maxval >> (nlevels * DAC_CHUNK_BITS))) {
+		nlevels++;
+	}
+	lcpa->nlevels = nlevels;
+	lcpa->lvl_len = ARR_NEW(size_t, nlevels);
+	lcpa->chunks = ARR_NEW(byte_t *, nlevels);
+	lcpa->more = ARR_NEW(csrsbitarr *, nlevels);
+	for (size_t l = 0; l < nlevels; l++) {
+		size_t shift = l * DAC_CHUNK_BITS;
+		size_t lvl_len = 0;
+		for (size_t i = 0; i < n; i++) {
+			lvl_len += (l == 0 || (lcp[i] >> shift));
+		}
+		lcpa->lvl_len[l] = lvl_len;
+		lcpa->chunks[l] = ARR_NEW(byte_t, MAX(lvl_len, 1));
+		byte_t *more_bits = NULL;
+		if (l + 1 < nlevels) {
+			// padded for the word-sized reads of csrsbitarr
+			more_bits = bytearr_new((size_t)DIVCEIL(lvl_len, BYTESIZE)
+			                        + sizeof(uint64_t));
+		}
+		for (size_t i = 0, k = 0; i < n; i++) {
+			if (l > 0 && !(lcp[i] >> shift)) {
+				continue;
+			}
+			lcpa->chunks[l][k] = (byte_t)((lcp[i] >> shift) & DAC_CHUNK_MASK);
+			if (more_bits && (lcp[i] >> (shift + DAC_CHUNK_BITS))) {
+				bitarr_set_bit(more_bits, k, 1);
+			}
+			k++;
+		}
+		lcpa->more[l] = more_bits ? csrsbitarr_new(more_bits, lvl_len) : NULL;
+	}
+}
+
+
+static void rmq_init(lcparray *lcpa, const size_t *lcp)
+{
+	size_t n = lcpa->len;
+	lcpa->nblks = (size_t)DIVCEIL(n, RMQ_BLK);
+	lcpa->blkmin = ARR_NEW(size_t, MAX(lcpa->nblks, 1));
+	for (size_t b = 0; b < lcpa->nblks; b++) {
+		size_t m = SIZE_MAX;
+		for (size_t i = b * RMQ_BLK, to = MIN(n, (b + 1) * RMQ_BLK); i < to; i++) {
+			m = MIN(m, lcp[i]);
+		}
+		lcpa->blkmin[b] = m;
+	}
+
+	lcpa->nsblks = (size_t)DIVCEIL(lcpa->nblks, RMQ_SBLK);
+	lcpa->nlogs = 1;
+	while (((size_t)1 << lcpa->nlogs) <= lcpa->nsblks) {
+		lcpa->nlogs++;
+	}
+	lcpa->sparse = ARR_NEW(size_t *, lcpa->nlogs);
+	lcpa->sparse[0] = ARR_NEW(size_t, MAX(lcpa->nsblks, 1));
+	for (size_t s = 0; s < lcpa->nsblks; s++) {
+		size_t best = s * RMQ_SBLK;
+		for (size_t b = best + 1, to = MIN(lcpa->nblks, (s + 1) * RMQ_SBLK); b < to; b++) {
+			if (lcpa->blkmin[b] < lcpa->blkmin[best]) {
+				best = b;
+			}
+		}
+		lcpa->sparse[0][s] = best;
+	}
+	for (size_t j = 1; j < lcpa->nlogs; j++) {
+		size_t half = (size_t)1 << (j - 1);
+		size_t cnt = lcpa->nsblks + 1 - (2 * half);
+		lcpa->sparse[j] = ARR_NEW(size_t, cnt);
+		for (size_t s = 0; s < cnt; s++) {
+			size_t l = lcpa->sparse[j - 1][s];
+			size_t r = lcpa->sparse[j - 1][s + half];
+			lcpa->sparse[j][s] = (lcpa->blkmin[r] < lcpa->blkmin[l]) ? r : l;
+		}
+	}
+}
+
+
+lcparray *lcparray_new(const size_t *lcp, size_t n)
+{
+	lcparray *ret = NEW(lcparray);
+	ret->len = n;
+	dac_init(ret, lcp);
+	rmq_init(ret, lcp);
+	return ret;
+}
+
+
+lcparray *lcparray_new_from_sa(const char *str, size_t len,
+                               const size_t *sa)
+{
+	size_t *lcp = lcp_phi(str, len, sa);
+	lcparray *ret = lcparray_new(lcp, len + 1);
+	FREE(lcp);
+	return ret;
+}
+
+
+void lcparray_free(lcparray *lcpa)
+{
+	if (lcpa == NULL) return;
+	for (size_t l = 0; l < lcpa->nlevels; l++) {
+		FREE(lcpa->chunks[l]);
+		csrsbitarr_free(lcpa->more[l], true);
+	}
+	FREE(lcpa->chunks);
+	FREE(lcpa->more);
+	FREE(lcpa->lvl_len);
+	FREE(lcpa->blkmin);
+	for (size_t j = 0; j < lcpa->nlogs; j++) {
+		FREE(lcpa->sparse[j]);
+	}
+	FREE(lcpa->sparse);
+	FREE(lcpa);
+}
+
+
+size_t lcparray_len(lcparray *lcpa)
+{
+	return lcpa->len;
+}
+
+
+size_t lcparray_memsize(lcparray *lcpa)
+{
+	size_t size = sizeof(lcparray);
+	for (size_t l = 0; l < lcpa->nlevels; l++) {
+		size += lcpa->lvl_len[l];
+		if (lcpa->more[l]) {
+			// bits plus roughly the same for the rank/select samples
+			size += 2 * (size_t)DIVCEIL(lcpa->lvl_len[l], BYTESIZE);
+		}
+	}
+	size += lcpa->nblks * sizeof(size_t);
+	for (size_t j = 0; j < lcpa->nlogs; j++) {
+		size += (lcpa->nsblks + 1 - MIN(lcpa->nsblks, (size_t)1 << j))
+		        * sizeof(size_t);
+	}
+	return size;
+}
+
+
+size_t lcparray_get(lcparray *lcpa, size_t i)
+{
+	size_t val = 0;
+	for (size_t l = 0, k = i; ; l++) {
+		val |= ((size_t)lcpa->chunks[l][k]) << (l * DAC_CHUNK_BITS);
+		if (lcpa->more[l] == NULL || !csrsbitarr_get(lcpa->more[l], k)) {
+			break;
+		}
+		k = csrsbitarr_rank1(lcpa->more[l], k);
+	}
+	return val;
+}
+
+
+// leftmost argmin of LCP[from:to] by linear scan
+static size_t scan_min(lcparray *lcpa, size_t from, size_t to, size_t *min)
+{
+	size_t best = from;
+	*min = lcparray_get(lcpa, from);
+	for (size_t i = from + 1, v; i < to && *min > 0; i++) {
+		v = lcparray_get(lcpa, i);
+		if (v < *min) {
+			*min = v;
+			best = i;
+		}
+	}
+	return best;
+}
+
+
+// leftmost min block in blocks [b0, b1), b0 < b1
+static size_t min_block(lcparray *lcpa, size_t b0, size_t b1)
+{
+	size_t best = b0;
+	size_t s0 = (size_t)DIVCEIL(b0, RMQ_SBLK), s1 = b1 / RMQ_SBLK;
+	if (s0 >= s1) {
+		for (size_t b = b0 + 1; b < b1; b++) {
+			if (lcpa->blkmin[b] < lcpa->blkmin[best]) best = b;
+		}
+		return best;
+	}
+	for (size_t b = b0 + 1; b < s0 * RMQ_SBLK; b++) {
+		if (lcpa->blkmin[b] < lcpa->blkmin[best]) best = b;
+	}
+	size_t j = 0;
+	while (((size_t)2 << j) <= s1 - s0) {
+		j++;
+	}
+	size_t l = lcpa->sparse[j][s0];
+	size_t r = lcpa->sparse[j][s1 - ((size_t)1 << j)];
+	size_t mid = (lcpa->blkmin[r] < lcpa->blkmin[l]) ? r : l;
+	if (lcpa->blkmin[mid] < lcpa->blkmin[best]) best = mid;
+	for (size_t b = s1 * RMQ_SBLK; b < b1; b++) {
+		if (lcpa->blkmin[b] < lcpa->blkmin[best]) best = b;
+	}
+	return best;
+}
+
+
+size_t lcparray_rmq(lcparray *lcpa, size_t from, size_t to)
+{
+	assert(from < to && to <= lcpa->len);
+	size_t bf = from / RMQ_BLK, bl = (to - 1) / RMQ_BLK;
+	size_t min, v, pos;
+	if (bl <= bf + 1) {
+		return scan_min(lcpa, from, to, &min);
+	}
+	size_t best = scan_min(lcpa, from, (bf + 1) * RMQ_BLK, &min);
+	size_t b = min_block(lcpa, bf + 1, bl);
+	if (lcpa->blkmin[b] < min) {
+		best = scan_min(lcpa, b * RMQ_BLK, (b + 1) * RMQ_BLK, &min);
+	}
+	pos = scan_min(lcpa, bl * RMQ_BLK, to, &v);
+	if (v < min) {
+		best = pos;
+	}
+	return best;
+}
+
+
+lcp_interval lcparray_interval(lcparray *lcpa, size_t lb, size_t rb)
+{
+	assert(lb < rb);
+	lcp_interval ret = {.lcp = lcparray_get(lcpa, lcparray_rmq(lcpa, lb + 1, rb + 1)),
+	                    .lb = lb,
+	                    .rb = rb
+	                   };
+	return ret;
+}
+
+
+static void push_child(lcparray *lcpa, size_t lb, size_t rb, vec *children)
+{
+	lcp_interval child = {.lcp = 0, .lb = lb, .rb = rb};
+	if (lb < rb) {
+		child = lcparray_interval(lcpa, lb, rb);
+	}
+	vec_push(children, &child);
+}
+
+
+void lcparray_child_intervals(lcparray *lcpa, const lcp_interval *parent,
+                              vec *children)
+{
+	if (parent->lb >= parent->rb) {
+		return;
+	}
+	size_t lb = parent->lb;
+	size_t to = parent->rb + 1;
+	size_t k = lcparray_rmq(lcpa, lb + 1, to);
+	size_t ell = lcparray_get(lcpa, k);
+	while (true) {
+		push_child(lcpa, lb, k - 1, children);
+		lb = k;
+		if (k + 1 >= to) {
+			break;
+		}
+		k = lcparray_rmq(lcpa, k + 1, to);
+		if (lcparray_get(lcpa, k) != ell) {
+			break;
+		}
+	}
+	push_child(lcpa, lb, parent->rb, children);
+}
+
+
+// left character states for the maximal repeats traversal
+#define LEFT_NONE (-1)
+#define LEFT_DIVERSE (UCHAR_MAX + 1)
+
+
+static inline int left_merge(int a, int b)
+{
+	if (a == LEFT_NONE) return b;
+	if (b == LEFT_NONE || a == b) return a;
+	return LEFT_DIVERSE;
+}
+
+
+typedef struct {
+	size_t lcp;
+	size_t lb;
+	int    left;
+} mr_frame;
+
+
+void lcparray_maximal_repeats(lcparray *lcpa, const char *str,
+                              const size_t *sa, size_t minlen,
+                              vec *repeats)
+{
+	size_t n = lcpa->len;
+	vec *stack = vec_new(sizeof(mr_frame));
+	mr_frame root = {.lcp = 0, .lb = 0, .left = LEFT_NONE};
+	vec_push(stack, &root);
+	for (size_t i = 1; i <= n; i++) {
+		size_t h = (i < n) ? lcparray_get(lcpa, i) : 0;
+		size_t lb = i - 1;
+		int cur = (sa[i - 1] == 0) ? LEFT_DIVERSE
+		          : (int)(unsigned char)str[sa[i - 1] - 1];
+		mr_frame *top = (mr_frame *)vec_last_mut(stack);
+		while (h < top->lcp) {
+			mr_frame iv;
+			vec_pop(stack, vec_len(stack) - 1, &iv);
+			cur = left_merge(iv.left, cur);
+			if (iv.lcp >= minlen && cur == LEFT_DIVERSE) {
+				lcp_interval rep = {.lcp = iv.lcp, .lb = iv.lb, .rb = i - 1};
+				vec_push(repeats, &rep);
+			}
+			lb = iv.lb;
+			top = (mr_frame *)vec_last_mut(stack);
+		}
+		if (h > top->lcp) {
+			mr_frame iv = {.lcp = h, .lb = lb, .left = cur};
+			vec_push(stack, &iv);
+		}
+		else {
+			top->left = left_merge(top->left, cur);
+		}
+	}
+	DESTROY_FLAT(stack, vec);
+}
@@ -0,0 +1,193 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#ifndef LCP_H
+#define LCP_H
+
+#include <stddef.h>
+
+#include "vec.h"
+
+/**
+ * @file lcp.h
+ * @author Paulo Fonseca
+ *
+ * @brief Longest Common Prefix (LCP) array and Enhanced Suffix Array
+ *        operations.
+ *
+ * The LCP array of a string T of length n with suffix array SA (as
+ * returned by sais(), with SA[0]=n) has n+1 entries, where
+ * LCP[0] = 0 and LCP[i] is the length of the longest common prefix of
+ * the suffixes T[SA[i-1]:] and T[SA[i]:], for 0 < i <= n.
+ *
+ * The ::lcparray is a compressed representation of the LCP array
+ * using Directly Addressable Codes (DAC) with byte-sized chunks
+ * (N.R.Brisaboa, S.Ladra and G.Navarro, Directly addressable
+ * variable-length codes, SPIRE 2009), plus a Range Minimum Query (RMQ)
+ * structure. Together they support the bottom-up and top-down
+ * traversals of the Enhanced Suffix Array
+ * (M.I.Abouelhoda, S.Kurtz and E.Ohlebusch, Replacing suffix trees with
+ * enhanced suffix arrays, JDA 2004).
+ *
+ * An lcp-interval l-[lb..rb] (0 <= lb < rb <= n) is an interval
+ * of the SA s.t. LCP[lb] < l, LCP[rb+1] < l (if rb<n),
+ * LCP[k] >= l for lb < k <= rb, and LCP[k] = l for at least one such k.
+ * It corresponds to an internal node of the suffix tree with string
+ * depth l.
+ */
+
+
+/**
+ * @brief An interval [@p lb..@p rb] (inclusive) of the suffix array and
+ *        the length @p lcp of the common prefix of its suffixes.
+ *        Singleton intervals (@p lb == @p rb) are leaves, and have
+ *        @p lcp = 0.
+ */
+typedef struct {
+	size_t lcp;
+	size_t lb;
+	size_t rb;
+} lcp_interval;
+
+
+/**
+ * @brief Computes the LCP array of the string @p str of length
+ *        @p len with suffix array @p sa using the algorithm of
+ *        Kasai et al.
+ *        (Linear-time longest-common-prefix computation in suffix
+ *        arrays and its applications, CPM 2001).
+ *
+ * Uses n words of working space for the inverse SA.
+ */
+size_t *lcp_kasai(const char *str, size_t len, const size_t *sa);
+
+
+/**
+ * @brief Computes the LCP array of the string @p str of length
+ *        @p len with suffix array @p sa using the Phi algorithm of
+ *        Karkkainen, Manzini and Puglisi
+ *        (Permuted longest-common-prefix array, CPM 2009).
+ *
+ * Uses n words of working space for the Phi/PLCP array, which is scanned
+ * in text order, so it is usually faster than lcp_kasai().
+ */
+size_t *lcp_phi(const char *str, size_t len, const size_t *sa);
+
+
+/**
+ * @brief Computes the permuted LCP array PLCP of the string @p str
+ *        of length @p len with suffix array @p sa, where
+ *        PLCP[SA[i]] = LCP[i] for 0 < i <= @p len.
+ *        The array has @p len entries.
+ */
+size_t *lcp_plcp(const char *str, size_t len, const size_t *sa);
+
+
+/**
+ * @brief Compressed LCP array with RMQ support.
+ */
+typedef struct _lcparray lcparray;
+
+
+/**
+ * @brief Creates a compressed LCP array from the plain LCP
+ *        array @p lcp with @p n entries. The array @p lcp is not
+ *        retained.
+ */
+lcparray *lcparray_new(const size_t *lcp, size_t n);
+
+
+/**
+ * @brief Creates a compressed LCP array for the string @p str of
+ *        length @p len with suffix array @p sa.
+ */
+lcparray *lcparray_new_from_sa(const char *str, size_t len,
+                               const size_t *sa);
+
+
+/**
+ * @brief Destructor.
+ */
+void lcparray_free(lcparray *lcpa);
+
+
+/**
+ * @brief Returns the number of entries.
+ */
+size_t lcparray_len(lcparray *lcpa);
+
+
+/**
+ * @brief Returns the size in bytes of the representation.
+ */
+size_t lcparray_memsize(lcparray *lcpa);
+
+
+/**
+ * @brief Returns LCP[@p i].
+ */
+size_t lcparray_get(lcparray *lcpa, size_t i);
+
+
+/**
+ * @brief Returns the leftmost position of the minimum of
+ *        LCP[@p from:@p to]. Requires @p from < @p to.
+ */
+size_t lcparray_rmq(lcparray *lcpa, size_t from, size_t to);
+
+
+/**
+ * @brief Returns the lcp-interval [@p lb..@p rb], that is the
+ *        interval with the length of the longest common prefix of the
+ *        suffixes SA[@p lb], ..., SA[@p rb].
+ *        Requires @p lb < @p rb.
+ */
+lcp_interval lcparray_interval(lcparray *lcpa, size_t lb, size_t rb);
+
+
+/**
+ * @brief Pushes the child intervals of the lcp-interval @p parent
+ *        into the vector of ::lcp_interval @p children, in
+ *        lexicographic order.
+ *        The children are delimited by the l-indices of @p parent,
+ *        i.e. the positions lb < k <= rb with LCP[k] = @p parent->lcp,
+ *        which are found by successive RMQs.
+ */
+void lcparray_child_intervals(lcparray *lcpa, const lcp_interval *parent,
+                              vec *children);
+
+
+/**
+ * @brief Pushes into the vector of ::lcp_interval @p repeats the
+ *        lcp-intervals of all maximal repeats of length at least
+ *        @p minlen of the string @p str with suffix array @p sa.
+ *
+ * A repeat T[SA[lb]:SA[lb]+lcp] is maximal iff its lcp-interval is
+ * left-diverse, i.e. the characters preceding its occurrences are not
+ * all equal (the suffix T[0:] counts as preceded by a unique character).
+ * The intervals are reported in a bottom-up traversal, so children come
+ * before their parents.
+ */
+void lcparray_maximal_repeats(lcparray *lcpa, const char *str,
+                              const size_t *sa, size_t minlen,
+                              vec *repeats);
+
+#endif
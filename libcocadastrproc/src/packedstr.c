@@ -0,0 +1,338 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alphabet.h"
+#include "arrays.h"
+#include "bitbyte.h"
+#include "errlog.h"
+#include "mathutil.h"
+#include "new.h"
+#include "packedstr.h"
+#include "xstr.h"
+
+
+#define WORD_BITS 64
+
+
+struct _packedstr {
+	uint64_t *words;
+	size_t    len;     // # of chars
+	size_t    cap;     // capacity in chars, a multiple of cpw
+	size_t    b;       // bits per char
+	size_t    cpw;     // chars per word
+	uint64_t  mask;    // lowest b bits set
+};
+
+
+static inline size_t _nwords(size_t nchars, size_t cpw)
+{
+	return (nchars + cpw - 1) / cpw;
+}
+
+
+static void _check_and_resize(packedstr *self, size_t n)
+{
+	if (self->len + n <= self->cap)
+		return;
+	size_t old_nw = _nwords(self->cap, self->cpw);
+	size_t new_cap = MAX(self->cpw, self->cap);
+	while (new_cap < self->len + n)
+		new_cap *= 2;
+	size_t new_nw = _nwords(new_cap, self->cpw);
+	self->words = realloc(self->words, new_nw * sizeof(uint64_t));
+	memset(self->words + old_nw, 0, (new_nw - old_nw) * sizeof(uint64_t));
+	self->cap = new_nw * self->cpw;
+}
+
+
+size_t packedstr_bits_for(size_t nvalues)
+{
+	if (nvalues <= 2) return 1;
+	if (nvalues <= 4) return 2;
+	if (nvalues <= 16) return 4;
+	return 0;
+}
+
+
+packedstr *packedstr_new(size_t bits_per_char)
+{
+	return packedstr_new_with_capacity(bits_per_char, 0);
+}
+
+
+packedstr *packedstr_new_with_capacity(size_t bits_per_char, size_t cap)
+{
+	if (bits_per_char != 1 && bits_per_char != 2 && bits_per_char != 4) {
+		WARN("Invalid number of bits per char %zu. Must be 1, 2 or 4.\n",
+		     bits_per_char);
+		return NULL;
+	}
+	packedstr *ret = NEW(packedstr);
+	ret->b = bits_per_char;
+	ret->cpw = WORD_BITS / bits_per_char;
+	ret->mask = (UINT64_C(1) << bits_per_char) - 1;
+	ret->len = 0;
+	size_t nw = MAX(1, _nwords(cap, ret->cpw));
+	ret->cap = nw * ret->cpw;
+	ret->words = ARR_OF_0_NEW(uint64_t, nw);
+	return ret;
+}
+
+
+#define PACK_BLOCK 1024
+
+// Packs the ranks of the chars of either a plain string str or an
+// xstr xs, a word at a time.
+static void _pack(packedstr *self, alphabet *ab, size_t len, const char *str,
+                  const xstr *xs)
+{
+	_check_and_resize(self, len);
+	size_t lim = self->mask + 1;
+	uint64_t acc = 0;
+	size_t nacc = 0, w = 0;
+	byte_t rks[PACK_BLOCK];
+	for (size_t i=0; i<len; i++) {
+		size_t r;
+		if (str != NULL) {
+			if (i % PACK_BLOCK == 0)
+				ab_rank_bytes(ab, str + i, MIN(PACK_BLOCK, len - i), rks);
+			r = rks[i % PACK_BLOCK];
+		} else {
+			r = ab_rank(ab, xstr_get(xs, i));
+		}
+		acc = (acc << self->b) | ((r < lim) ? r : 0);
+		if (++nacc == self->cpw) {
+			self->words[w++] = acc;
+			acc = 0;
+			nacc = 0;
+		}
+	}
+	if (nacc)
+		self->words[w] = acc << (self->b * (self->cpw - nacc));
+	self->len = len;
+}
+
+
+packedstr *packedstr_new_from_str(alphabet *ab, const char *str, size_t len)
+{
+	size_t b = packedstr_bits_for(ab_size(ab));
+	if (b == 0) {
+		WARN("Alphabet too large (%zu chars) for a packed string.\n",
+		     ab_size(ab));
+		return NULL;
+	}
+	packedstr *ret = packedstr_new_with_capacity(b, len);
+	_pack(ret, ab, len, str, NULL);
+	return ret;
+}
+
+
+packedstr *packedstr_new_from_xstr(alphabet *ab, const xstr *src)
+{
+	size_t b = packedstr_bits_for(ab_size(ab));
+	if (b == 0) {
+		WARN("Alphabet too large (%zu chars) for a packed string.\n",
+		     ab_size(ab));
+		return NULL;
+	}
+	size_t len = xstr_len(src);
+	packedstr *ret = packedstr_new_with_capacity(b, len);
+	_pack(ret, ab, len, NULL, src);
+	return ret;
+}
+
+
+void packedstr_free(packedstr *self)
+{
+	if (self == NULL) return;
+	FREE(self->words);
+	FREE(self);
+}
+
+
+size_t packedstr_len(const packedstr *self)
+{
+	return self->len;
+}
+
+
+size_t packedstr_bits_per_char(const packedstr *self)
+{
+	return self->b;
+}
+
+
+const uint64_t *packedstr_words(const packedstr *self)
+{
+	return self->words;
+}
+
+
+size_t packedstr_nbytes(const packedstr *self)
+{
+	return _nwords(self->cap, self->cpw) * sizeof(uint64_t);
+}
+
+
+xchar_t packedstr_get(const packedstr *self, size_t pos)
+{
+	size_t o = pos * self->b;
+	size_t shift = WORD_BITS - self->b - (o % WORD_BITS);
+	return (xchar_t)((self->words[o / WORD_BITS] >> shift) & self->mask);
+}
+
+
+void packedstr_set(packedstr *self, size_t pos, xchar_t rank)
+{
+	size_t o = pos * self->b;
+	size_t shift = WORD_BITS - self->b - (o % WORD_BITS);
+	uint64_t *w = self->words + (o / WORD_BITS);
+	*w = (*w & ~(self->mask << shift))
+	     | (((uint64_t)rank & self->mask) << shift);
+}
+
+
+void packedstr_push(packedstr *self, xchar_t rank)
+{
+	_check_and_resize(self, 1);
+	packedstr_set(self, self->len++, rank);
+}
+
+
+void packedstr_clear(packedstr *self)
+{
+	memset(self->words, 0, _nwords(self->len, self->cpw) * sizeof(uint64_t));
+	self->len = 0;
+}
+
+
+uint64_t packedstr_kmer(const packedstr *self, size_t pos, size_t k)
+{
+	size_t nbits = k * self->b;
+	if (nbits == 0) return 0;
+	size_t o = pos * self->b;
+	size_t i = o / WORD_BITS, off = o % WORD_BITS;
+	uint64_t hi = self->words[i] << off;
+	if (off + nbits > WORD_BITS)
+		hi |= self->words[i+1] >> (WORD_BITS - off);
+	return hi >> (WORD_BITS - nbits);
+}
+
+
+int packedstr_ncmp(const packedstr *self, const packedstr *other, size_t n)
+{
+	assert(self->b == other->b);
+	size_t lt = self->len;
+	size_t lo = other->len;
+	size_t m = MIN3(n, lt, lo);
+	size_t nfull = (m * self->b) / WORD_BITS;
+	for (size_t i=0; i<nfull; i++) {
+		if (self->words[i] != other->words[i])
+			return (self->words[i] < other->words[i]) ? -1 : +1;
+	}
+	size_t rem = (m * self->b) % WORD_BITS;
+	if (rem) {
+		uint64_t mask = ~UINT64_C(0) << (WORD_BITS - rem);
+		uint64_t a = self->words[nfull] & mask;
+		uint64_t b = other->words[nfull] & mask;
+		if (a != b)
+			return (a < b) ? -1 : +1;
+	}
+	if (n <= MIN(lt, lo)) return 0;
+	else {
+		if (lt == lo) return 0;
+		else if (lt < lo) return -1;
+		else return +1;
+	}
+}
+
+
+int packedstr_cmp(const packedstr *self, const packedstr *other)
+{
+	return packedstr_ncmp(self, other, MAX(self->len, other->len));
+}
+
+
+// Reverses the order of the b-bit chars of a word
+static inline uint64_t _rev_chars(uint64_t w, size_t b)
+{
+	if (b == 1)
+		w = ((w >> 1) & UINT64_C(0x5555555555555555))
+		    | ((w & UINT64_C(0x5555555555555555)) << 1);
+	if (b <= 2)
+		w = ((w >> 2) & UINT64_C(0x3333333333333333))
+		    | ((w & UINT64_C(0x3333333333333333)) << 2);
+	w = ((w >> 4) & UINT64_C(0x0F0F0F0F0F0F0F0F))
+	    | ((w & UINT64_C(0x0F0F0F0F0F0F0F0F)) << 4);
+	w = ((w >> 8) & UINT64_C(0x00FF00FF00FF00FF))
+	    | ((w & UINT64_C(0x00FF00FF00FF00FF)) << 8);
+	w = ((w >> 16) & UINT64_C(0x0000FFFF0000FFFF))
+	    | ((w & UINT64_C(0x0000FFFF0000FFFF)) << 16);
+	return (w >> 32) | (w << 32);
+}
+
+
+packedstr *packedstr_revcomp(const packedstr *self)
+{
+	packedstr *ret = packedstr_new_with_capacity(self->b, self->len);
+	size_t nw = _nwords(self->len, self->cpw);
+	if (nw == 0) return ret;
+	for (size_t j=0; j<nw; j++)
+		ret->words[j] = _rev_chars(~self->words[nw-1-j], self->b);
+	// the (complemented) padding of the last word is now at the top
+	// of the first one: shift it out
+	size_t pad = nw * WORD_BITS - self->len * self->b;
+	if (pad) {
+		for (size_t j=0; j<nw; j++) {
+			ret->words[j] <<= pad;
+			if (j+1 < nw)
+				ret->words[j] |= ret->words[j+1] >> (WORD_BITS - pad);
+		}
+	}
+	ret->len = self->len;
+	return ret;
+}
+
+
+xstr *packedstr_to_xstr(const packedstr *self, alphabet *ab, size_t from,
+                        size_t n)
+{
+	size_t sizeof_char = (ab_type(ab) == CHAR_TYPE)
+	                     ? sizeof(char) : nbytes(ab_size(ab));
+	xstr *ret = xstr_new_with_capacity(sizeof_char, n);
+	for (size_t i=0; i<n; i++)
+		xstr_push(ret, ab_char(ab, packedstr_get(self, from+i)));
+	return ret;
+}
+
+
+void packedstr_to_str(const packedstr *self, alphabet *ab, size_t from,
+                      size_t n, char *dest)
+{
+	for (size_t i=0; i<n; i++)
+		dest[i] = (char)ab_char(ab, packedstr_get(self, from+i));
+	dest[n] = '\0';
+}
@@ -0,0 +1,222 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#ifndef PACKEDSTR_H
+#define PACKEDSTR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "alphabet.h"
+#include "xchar.h"
+#include "xstr.h"
+
+/**
+ * @file packedstr.h
+ * @author Paulo Fonseca
+ *
+ * @brief Bit-packed strings over small alphabets.
+ *
+ * A packedstr stores the *ranks* of its chars in a fixed number b of
+ * bits per position, with b = 1, 2 or 4. Thus a DNA sequence takes
+ * 2 bits per base (4x less than a byte string), and the 16 IUPAC
+ * nucleotide codes fit in 4 bits.
+ *
+ * The chars are packed into 64-bit words from the most significant
+ * bits downwards, so that comparing two aligned words as integers
+ * compares the corresponding substrings lexicographically. Likewise,
+ * the k-mer starting at any position can be extracted as a single
+ * integer with a shift and a mask (see ::packedstr_kmer), and the
+ * order of those integers is the lexicographic order of the k-mers.
+ *
+ * Conversions from/to plain strings and xstrs are done through an
+ * alphabet which maps chars to ranks.
+ */
+
+
+/**
+ * @brief Bit-packed string type.
+ */
+typedef struct _packedstr packedstr;
+
+
+/**
+ * @brief Returns the smallest number of bits per char (1, 2 or 4)
+ *        able to represent @p nvalues distinct ranks, or 0 if
+ *        @p nvalues > 16.
+ */
+size_t packedstr_bits_for(size_t nvalues);
+
+
+/**
+ * @brief Creates a new empty string.
+ * @param bits_per_char The number of bits per char: 1, 2 or 4.
+ * @return The new string or NULL with a warning if @p bits_per_char
+ *         is invalid.
+ */
+packedstr *packedstr_new(size_t bits_per_char);
+
+
+/**
+ * @brief Same as ::packedstr_new with a given initial capacity in
+ *        chars.
+ */
+packedstr *packedstr_new_with_capacity(size_t bits_per_char, size_t cap);
+
+
+/**
+ * @brief Creates a new string with the ranks of the chars of the
+ *        plain string @p str w.r.t. the alphabet @p ab, using the
+ *        smallest number of bits per char fit for @p ab.
+ *
+ * Chars not in the alphabet are stored as rank 0 if the size of the
+ * alphabet is a power of 2, e.g. an `N` becomes an `A` in a 2-bit DNA
+ * string, as usual in such encodings. Otherwise they are stored as
+ * rank ab_size(ab), as returned by ::ab_rank.
+ *
+ * @return The new string or NULL with a warning if the alphabet
+ *         has more than 16 chars.
+ */
+packedstr *packedstr_new_from_str(alphabet *ab, const char *str, size_t len);
+
+
+/**
+ * @brief Same as ::packedstr_new_from_str for an xstr source.
+ */
+packedstr *packedstr_new_from_xstr(alphabet *ab, const xstr *src);
+
+
+/**
+ * @brief Destructor.
+ */
+void packedstr_free(packedstr *self);
+
+
+/**
+ * @brief Returns the length of the string.
+ */
+size_t packedstr_len(const packedstr *self);
+
+
+/**
+ * @brief Returns the number of bits per char.
+ */
+size_t packedstr_bits_per_char(const packedstr *self);
+
+
+/**
+ * @brief Returns the internal 64-bit words of the string.
+ * The char at position i is in word i*b/64, from the most
+ * significant bits down. The unused bits of the last word are 0.
+ * @warning The returned information is not meant to be directly modified.
+ */
+const uint64_t *packedstr_words(const packedstr *self);
+
+
+/**
+ * @brief Returns the physical size of the internal representation
+ *        in bytes.
+ */
+size_t packedstr_nbytes(const packedstr *self);
+
+
+/**
+ * @brief Returns the rank stored at position @p pos.
+ * @warning No out-of-bounds verification is assumed.
+ */
+xchar_t packedstr_get(const packedstr *self, size_t pos);
+
+
+/**
+ * @brief Sets the rank at position @p pos to @p rank.
+ * @warning No out-of-bounds verification is assumed.
+ * @warning Only the lowest bits_per_char bits of @p rank are kept.
+ */
+void packedstr_set(packedstr *self, size_t pos, xchar_t rank);
+
+
+/**
+ * @brief Appends a rank to the string.
+ * @warning Only the lowest bits_per_char bits of @p rank are kept.
+ */
+void packedstr_push(packedstr *self, xchar_t rank);
+
+
+/**
+ * @brief Clears the string.
+ */
+void packedstr_clear(packedstr *self);
+
+
+/**
+ * @brief Returns the k-mer of ranks starting at position @p pos as the
+ *        integer sum_{i<k} rank[pos+i] * 2^(b*(k-1-i)), i.e. the first
+ *        char in the most significant bits.
+ * @warning Requires k * bits_per_char <= 64 and pos + k <= len. No
+ *        verification is assumed.
+ */
+uint64_t packedstr_kmer(const packedstr *self, size_t pos, size_t k);
+
+
+/**
+ * @brief Lexicographically compares the ranks of the first @p n chars
+ *        of two strings with the same number of bits per char, a word at
+ *        a time.
+ * @return -1 if self < other, 0 if self==other, +1 if self > other,
+ *         with the same conventions as ::xstr_ncmp.
+ */
+int packedstr_ncmp(const packedstr *self, const packedstr *other, size_t n);
+
+
+/**
+ * @brief Lexicographically compares two strings.
+ * @see packedstr_ncmp
+ */
+int packedstr_cmp(const packedstr *self, const packedstr *other);
+
+
+/**
+ * @brief Returns a new string with the reverse complement of @p self,
+ *        computed a word at a time. The complement of rank r is taken
+ *        to be 2^b - 1 - r, which holds for the 2-bit DNA alphabet in
+ *        lexicographic order `ACGT` (see dna.h).
+ */
+packedstr *packedstr_revcomp(const packedstr *self);
+
+
+/**
+ * @brief Returns a new xstr with the chars of alphabet @p ab of the
+ *        ranks in positions [@p from, @p from + @p n) of the string.
+ */
+xstr *packedstr_to_xstr(const packedstr *self, alphabet *ab, size_t from,
+                        size_t n);
+
+
+/**
+ * @brief Writes the chars of the (char-type) alphabet @p ab of the
+ *        ranks in positions [@p from, @p from + @p n) into @p dest,
+ *        followed by a '\0'. @p dest must have room for n+1 chars.
+ */
+void packedstr_to_str(const packedstr *self, alphabet *ab, size_t from,
+                      size_t n, char *dest);
+
+
+#endif
@@ -0,0 +1,484 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alphabet.h"
+#include "arrays.h"
+#include "bitbyte.h"
+#include "bitvec.h"
+#include "cstrutil.h"
+#include "errlog.h"
+#include "mathutil.h"
+#include "memdbg.h"
+#include "new.h"
+#include "ranscode.h"
+#include "xstr.h"
+
+
+#define RANS_L (1U << 16) // lower bound of the normalised state interval
+#define WORD_BITS 16
+#define CHECKSUM_OFF sizeof(uint64_t)
+#define STATES_OFF (CHECKSUM_OFF + sizeof(uint32_t))
+#define HEADER_SIZE (STATES_OFF + (RANSCODE_NSTREAMS * sizeof(uint32_t)))
+
+#define NS RANSCODE_NSTREAMS
+#define SCALE RANSCODE_SCALE
+#define SCALE_BITS RANSCODE_SCALE_BITS
+
+/*
+ * With two or more chars every char has quantised probability at most
+ * (SCALE-1)/SCALE, hence costs more than 1/SCALE bits. Counting the
+ * final states, a code whose states and words take m bytes therefore
+ * holds fewer than 8 * SCALE * m chars.
+ */
+#define MAX_CHARS_PER_BYTE (BYTESIZE * SCALE)
+
+
+// decoding table entry
+typedef struct {
+	uint16_t rank;
+	uint16_t freq;
+	uint16_t start;
+} rans_dsym;
+
+
+// quantised static distribution
+typedef struct {
+	uint32_t *freq;  // quantised frequency of each char rank
+	uint32_t *cum;   // cumulative quantised frequency
+	rans_dsym *dec;  // decoding table indexed by slot
+} rans_model;
+
+
+struct _ranscode {
+	alphabet *ab;
+	size_t size;
+	size_t order;
+	xchar_t *chars;
+	size_t nctx;
+	rans_model **ctx;  // model of each context
+	rans_model *flat;  // shared by order 1 contexts without data
+};
+
+
+/*
+ * Quantises the given frequencies (uniform if NULL) to a total of SCALE,
+ * giving every char a share of at least 1.
+ */
+static rans_model *model_new(size_t n, const size_t *freqs)
+{
+	rans_model *m = NEW(rans_model);
+	m->freq = ARR_NEW(uint32_t, n);
+	m->cum = ARR_NEW(uint32_t, n + 1);
+	m->dec = ARR_NEW(rans_dsym, SCALE);
+
+	double total = 0;
+	for (size_t i = 0; i < n; i++) {
+		total += freqs ? freqs[i] : 1;
+	}
+	size_t sum = 0, imax = 0;
+	for (size_t i = 0; i < n; i++) {
+		double f = freqs ? freqs[i] : 1;
+		m->freq[i] = 1 + (uint32_t)((f / total) * (SCALE - n));
+		sum += m->freq[i];
+		imax = (m->freq[i] > m->freq[imax]) ? i : imax;
+	}
+	// the remainder goes to the most frequent char
+	if (sum <= SCALE) {
+		m->freq[imax] += SCALE - sum;
+	}
+	else {
+		while (sum > SCALE) {
+			imax = 0;
+			for (size_t i = 1; i < n; i++) {
+				imax = (m->freq[i] > m->freq[imax]) ? i : imax;
+			}
+			size_t d = MIN(sum - SCALE, m->freq[imax] - 1);
+			m->freq[imax] -= d;
+			sum -= d;
+		}
+	}
+
+	m->cum[0] = 0;
+	for (size_t i = 0; i < n; i++) {
+		m->cum[i + 1] = m->cum[i] + m->freq[i];
+		for (uint32_t s = m->cum[i]; s < m->cum[i + 1]; s++) {
+			m->dec[s] = (rans_dsym) {
+				.rank = i, .freq = m->freq[i], .start = m->cum[i]
+			};
+		}
+	}
+	assert(m->cum[n] == SCALE);
+	return m;
+}
+
+
+static void model_free(rans_model *m)
+{
+	FREE(m->freq);
+	FREE(m->cum);
+	FREE(m->dec);
+	FREE(m);
+}
+
+
+ranscode *ranscode_new(const alphabet *ab, const size_t *freqs, size_t order)
+{
+	size_t n = ab_size(ab);
+	if (n == 0 || n > SCALE || order > 1) {
+		WARN("Cannot build an order %zu rANS code for %zu chars.\n", order, n);
+		return NULL;
+	}
+	ranscode *rcode = NEW(ranscode);
+	rcode->ab = alphabet_clone(ab);
+	rcode->size = n;
+	rcode->order = order;
+	rcode->chars = ARR_NEW(xchar_t, n);
+	for (size_t i = 0; i < n; i++) {
+		rcode->chars[i] = ab_char(ab, i);
+	}
+	if (order == 0) {
+		rcode->nctx = 1;
+		rcode->ctx = ARR_NEW(rans_model *, 1);
+		rcode->ctx[0] = model_new(n, freqs);
+		rcode->flat = NULL;
+	}
+	else {
+		rcode->nctx = n;
+		rcode->ctx = ARR_NEW(rans_model *, n);
+		rcode->flat = model_new(n, NULL);
+		for (size_t c = 0; c < n; c++) {
+			const size_t *row = freqs + (c * n);
+			size_t rowsum = 0;
+			for (size_t i = 0; i < n; i++) {
+				rowsum += row[i];
+			}
+			rcode->ctx[c] = rowsum ? model_new(n, row) : rcode->flat;
+		}
+	}
+	return rcode;
+}
+
+
+ranscode *ranscode_new_from_str(const alphabet *ab, const char *src,
+                                size_t order)
+{
+	size_t n = ab_size(ab);
+	size_t *counts = ARR_OF_0_NEW(size_t, (order == 1) ? n * n : n);
+	size_t prev = 0;
+	FOREACH_IN_CSTR(c, src) {
+		size_t r = ab_rank(ab, c);
+		counts[(order == 1) ? (prev * n) + r : r]++;
+		prev = r;
+	}
+	ranscode *rc = ranscode_new(ab, counts, order);
+	FREE(counts);
+	return rc;
+}
+
+
+ranscode *ranscode_new_from_xstr(const alphabet *ab, const xstr *src,
+                                 size_t order)
+{
+	size_t n = ab_size(ab);
+	size_t *counts = ARR_OF_0_NEW(size_t, (order == 1) ? n * n : n);
+	size_t prev = 0;
+	FOREACH_IN_XSTR(c, src) {
+		size_t r = ab_rank(ab, c);
+		counts[(order == 1) ? (prev * n) + r : r]++;
+		prev = r;
+	}
+	ranscode *rc = ranscode_new(ab, counts, order);
+	FREE(counts);
+	return rc;
+}
+
+
+void ranscode_free(ranscode *rcode)
+{
+	if (rcode == NULL) {
+		return;
+	}
+	for (size_t c = 0; c < rcode->nctx; c++) {
+		if (rcode->ctx[c] != rcode->flat) {
+			model_free(rcode->ctx[c]);
+		}
+	}
+	if (rcode->flat) {
+		model_free(rcode->flat);
+	}
+	FREE(rcode->ctx);
+	FREE(rcode->chars);
+	alphabet_free(rcode->ab);
+	FREE(rcode);
+}
+
+
+size_t ranscode_order(const ranscode *rcode)
+{
+	return rcode->order;
+}
+
+
+const alphabet *ranscode_ab(const ranscode *rcode)
+{
+	return rcode->ab;
+}
+
+
+static inline void put_le(byte_t *dest, uint64_t val, size_t nbytes)
+{
+	for (size_t i = 0; i < nbytes; i++, val >>= BYTESIZE) {
+		dest[i] = val & BYTE_MAX;
+	}
+}
+
+
+static inline uint64_t get_le(const byte_t *src, size_t nbytes)
+{
+	uint64_t ret = 0;
+	for (size_t i = nbytes; i > 0; i--) {
+		ret = (ret << BYTESIZE) | src[i - 1];
+	}
+	return ret;
+}
+
+
+// model for the char at position p of a segment starting at position from
+/*
+ * 32-bit FNV-1a hash of the ranks, taken as little-endian 16-bit words.
+ */
+static uint32_t ranks_checksum(const uint16_t *ranks, size_t n)
+{
+	uint32_t h = 2166136261U;
+	for (size_t i = 0; i < n; i++) {
+		h = (h ^ (ranks[i] & 0xFF)) * 16777619U;
+		h = (h ^ (ranks[i] >> BYTESIZE)) * 16777619U;
+	}
+	return h;
+}
+
+
+static inline const rans_model *model_at(const ranscode *rcode,
+        const uint16_t *ranks, size_t from, size_t p)
+{
+	return rcode->ctx[(rcode->order && p > from) ? ranks[p - 1] : 0];
+}
+
+
+// encodes a char, writing renormalisation words backwards
+static inline void rans_put(uint32_t *x, byte_t **ptr, const rans_model *m,
+                            size_t rank)
+{
+	uint32_t f = m->freq[rank];
+	uint64_t x_max = ((uint64_t)(RANS_L >> SCALE_BITS) << WORD_BITS) * f;
+	if (*x >= x_max) {
+		*ptr -= 2;
+		put_le(*ptr, *x & 0xFFFF, 2);
+		*x >>= WORD_BITS;
+	}
+	*x = ((*x / f) << SCALE_BITS) + (*x % f) + m->cum[rank];
+}
+
+
+/*
+ * The string is split into NS segments of q = n/NS chars, the last one
+ * taking the remainder. Segment k is coded with state k, and chars are
+ * interleaved in the order they are decoded: the j-th char of every
+ * segment, for j = 0..q-1, and then the remainder of the last segment.
+ * rANS works in reverse, so encoding runs through this order backwards.
+ */
+static bitvec *encode_ranks(const uint16_t *ranks, size_t n,
+                            const ranscode *rcode)
+{
+	size_t q = n / NS;
+	// at most one word per char
+	size_t cap = HEADER_SIZE + (2 * n);
+	byte_t *buf = malloc(cap);
+	byte_t *ptr = buf + cap;
+	uint32_t x[NS];
+	for (size_t k = 0; k < NS; k++) {
+		x[k] = RANS_L;
+	}
+	for (size_t p = n; p > NS * q; p--) {
+		rans_put(&x[NS - 1], &ptr,
+		         model_at(rcode, ranks, (NS - 1) * q, p - 1), ranks[p - 1]);
+	}
+	for (size_t j = q; j > 0; j--) {
+		for (size_t k = NS; k > 0; k--) {
+			size_t from = (k - 1) * q;
+			rans_put(&x[k - 1], &ptr, model_at(rcode, ranks, from, from + j - 1),
+			         ranks[from + j - 1]);
+		}
+	}
+	ptr -= NS * sizeof(uint32_t);
+	for (size_t k = 0; k < NS; k++) {
+		put_le(ptr + (k * sizeof(uint32_t)), x[k], sizeof(uint32_t));
+	}
+	ptr -= sizeof(uint32_t);
+	put_le(ptr, ranks_checksum(ranks, n), sizeof(uint32_t));
+	ptr -= sizeof(uint64_t);
+	put_le(ptr, n, sizeof(uint64_t));
+	size_t size = (buf + cap) - ptr;
+	bitvec *ret = bitvec_new_from_bitarr(ptr, size * BYTESIZE);
+	FREE(buf);
+	return ret;
+}
+
+
+bitvec *ranscode_encode(const char *src, size_t len, const ranscode *rcode)
+{
+	uint16_t *ranks = ARR_NEW(uint16_t, MAX(1, len));
+	for (size_t i = 0; i < len; i++) {
+		ranks[i] = ab_rank(rcode->ab, src[i]);
+		assert(ranks[i] < rcode->size);
+	}
+	bitvec *ret = encode_ranks(ranks, len, rcode);
+	FREE(ranks);
+	return ret;
+}
+
+
+bitvec *ranscode_encode_xstr(const xstr *src, const ranscode *rcode)
+{
+	size_t len = xstr_len(src);
+	uint16_t *ranks = ARR_NEW(uint16_t, MAX(1, len));
+	for (size_t i = 0; i < len; i++) {
+		ranks[i] = ab_rank(rcode->ab, xstr_get(src, i));
+		assert(ranks[i] < rcode->size);
+	}
+	bitvec *ret = encode_ranks(ranks, len, rcode);
+	FREE(ranks);
+	return ret;
+}
+
+
+// decodes a char, reading renormalisation words forwards
+static inline bool rans_get(uint32_t *x, const byte_t **ptr, const byte_t *end,
+                            const rans_model *m, uint16_t *rank)
+{
+	uint32_t slot = *x & (SCALE - 1);
+	rans_dsym d = m->dec[slot];
+	*x = (d.freq * (*x >> SCALE_BITS)) + slot - d.start;
+	if (*x < RANS_L) {
+		if (*ptr + 2 > end) {
+			return false;
+		}
+		*x = (*x << WORD_BITS) | (uint32_t)get_le(*ptr, 2);
+		*ptr += 2;
+	}
+	*rank = d.rank;
+	return true;
+}
+
+
+static bool decode_ranks(const byte_t *ptr, const byte_t *end,
+                         uint16_t *ranks, size_t n, const ranscode *rcode)
+{
+	uint32_t x[NS];
+	for (size_t k = 0; k < NS; k++) {
+		x[k] = get_le(ptr, sizeof(uint32_t));
+		ptr += sizeof(uint32_t);
+	}
+	size_t q = n / NS;
+	bool ok = true;
+	rans_model *const *ctx = rcode->ctx;
+	size_t order = rcode->order;
+	// the NS states are independent, which lets the CPU overlap their updates
+	for (size_t j = 0; ok && j < q; j++) {
+		for (size_t k = 0; k < NS; k++) {
+			size_t p = (k * q) + j;
+			const rans_model *m = ctx[(order && j) ? ranks[p - 1] : 0];
+			ok &= rans_get(&x[k], &ptr, end, m, ranks + p);
+		}
+	}
+	for (size_t p = NS * q; ok && p < n; p++) {
+		const rans_model *m = ctx[(order && p > (NS - 1) * q) ? ranks[p - 1] : 0];
+		ok &= rans_get(&x[NS - 1], &ptr, end, m, ranks + p);
+	}
+	// the encoder started from the lowest state
+	for (size_t k = 0; k < NS; k++) {
+		ok &= (x[k] == RANS_L);
+	}
+	return ok && ptr == end;
+}
+
+
+xstr *ranscode_decode(const bitvec *code, const ranscode *rcode)
+{
+	size_t size = bitvec_len(code) / BYTESIZE;
+	if ((bitvec_len(code) % BYTESIZE) || size < HEADER_SIZE) {
+		WARN("Invalid rANS code.\n");
+		return NULL;
+	}
+	const byte_t *bytes = bitvec_as_bytes(code);
+	size_t n = get_le(bytes, sizeof(uint64_t));
+	size_t payload = size - STATES_OFF;
+	if ((rcode->size > 1 && n / MAX_CHARS_PER_BYTE >= payload)
+	        || n > SIZE_MAX / sizeof(xchar_t)) {
+		WARN("Invalid rANS code.\n");
+		return NULL;
+	}
+	uint16_t *ranks = ARR_NEW(uint16_t, MAX(1, n));
+	if (ranks == NULL) {
+		WARN("Unable to allocate %zu chars for the decoded string.\n", n);
+		return NULL;
+	}
+	uint32_t checksum = get_le(bytes + CHECKSUM_OFF, sizeof(uint32_t));
+	if (!decode_ranks(bytes + STATES_OFF, bytes + size, ranks, n, rcode)
+	        || ranks_checksum(ranks, n) != checksum) {
+		WARN("Invalid rANS code.\n");
+		FREE(ranks);
+		return NULL;
+	}
+	// chars are written in the layout of the xstr which takes the buffer
+	size_t sizeof_char = nbytes(rcode->size);
+	byte_t *dec = malloc(MAX(1, n) * sizeof_char);
+	if (dec == NULL) {
+		WARN("Unable to allocate %zu chars for the decoded string.\n", n);
+		FREE(ranks);
+		return NULL;
+	}
+	if (sizeof_char == 1) {
+		for (size_t i = 0; i < n; i++) {
+			dec[i] = (byte_t)rcode->chars[ranks[i]];
+		}
+	}
+	else {
+		for (size_t i = 0; i < n; i++) {
+			xchar_t c = rcode->chars[ranks[i]];
+#if ENDIANNESS==LITTLE
+			memcpy(dec + (i * sizeof_char), &c, sizeof_char);
+#elif ENDIANNESS==BIG
+			memcpy(dec + (i * sizeof_char), ((byte_t *)&c) + (sizeof(xchar_t) - sizeof_char),
+			       sizeof_char);
+#endif
+		}
+	}
+	FREE(ranks);
+	return xstr_new_from_arr(dec, n, sizeof_char);
+}
@@ -0,0 +1,155 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#ifndef RANSCODE_H
+#define RANSCODE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "alphabet.h"
+#include "bitvec.h"
+#include "xstr.h"
+
+/**
+ * @file ranscode.h
+ * @author Paulo Fonseca
+ *
+ * @brief Range Asymmetric Numeral Systems (rANS) entropy coding.
+ *
+ * rANS (J. Duda, 2013) encodes a string in a single integer state which
+ * is updated for each char c according to its probability P(c), so that
+ * the number of bits grows by -log P(c). Unlike Huffman codes
+ * (see huffcode.h), which need an integral number of bits per char,
+ * the average code length is thus close to the entropy of the source
+ * even for very skewed distributions.
+ *
+ * The probabilities are given by a static model, either of order 0
+ * (char frequencies) or of order 1 (char frequencies conditioned on the
+ * previous char), quantised to a total of RANSCODE_SCALE. The string is
+ * split into RANSCODE_NSTREAMS segments coded with independent states
+ * interleaved in a single output, so that the decoder can work on
+ * several chars at a time.
+ *
+ * The code of a string of length n is byte aligned and consists of
+ * (in little-endian order) the 64-bit length n, a 32-bit checksum of
+ * the string, the final 32-bit states of the segments, and the 16-bit
+ * renormalisation words. The decoder verifies the states and the
+ * checksum, so a corrupted code is rejected except with probability
+ * about 2^-32.
+ */
+
+
+/**
+ * Sum of the quantised char frequencies of a model, which is also
+ * the maximum alphabet size.
+ */
+#define RANSCODE_SCALE_BITS 12
+#define RANSCODE_SCALE (1 << RANSCODE_SCALE_BITS)
+
+/**
+ * Number of interleaved states.
+ */
+#define RANSCODE_NSTREAMS 4
+
+
+/**
+ * rANS code type
+ */
+typedef struct _ranscode ranscode;
+
+
+/**
+ * @brief Creates a rANS code for an alphabet with associated letter
+ * frequencies.
+ * For order 0, @p freqs[i] is the frequency of the letter of rank i.
+ * For order 1, @p freqs[(i * ab_size(ab)) + j] is the frequency of the
+ * letter of rank j after the letter of rank i. The first char of the
+ * string is taken to follow the letter of rank 0.
+ * Every letter is given a nonzero probability in every context.
+ * @param ab (no transfer) The base alphabet.
+ * @param freqs (no transfer) Letter frequencies.
+ * @param order The model order (0 or 1).
+ * @return The code, or NULL if the alphabet is empty or has more than
+ * RANSCODE_SCALE letters.
+ */
+ranscode *ranscode_new(const alphabet *ab, const size_t *freqs, size_t order);
+
+
+/**
+ * @brief Creates a rANS code for an alphabet from a source string.
+ * @param ab (no transfer) The base alphabet.
+ * @param src (no transfer) Source string from which letter frequencies are to be estimated.
+ * @param order The model order (0 or 1).
+ */
+ranscode *ranscode_new_from_str(const alphabet *ab, const char *src,
+                                size_t order);
+
+
+/**
+ * @brief Creates a rANS code for an alphabet from a source string.
+ * @param ab (no transfer) The base alphabet.
+ * @param src (no transfer) Source string from which letter frequencies are to be estimated.
+ * @param order The model order (0 or 1).
+ */
+ranscode *ranscode_new_from_xstr(const alphabet *ab, const xstr *src,
+                                 size_t order);
+
+
+/**
+ * @brief Destructor.
+ */
+void ranscode_free(ranscode *rcode);
+
+
+/**
+ * @brief Returns the order of the model.
+ */
+size_t ranscode_order(const ranscode *rcode);
+
+
+/**
+ * @brief Returns the alphabet.
+ * @warning Do NOT modify or destroy the returned value
+ */
+const alphabet *ranscode_ab(const ranscode *rcode);
+
+
+/**
+ * @brief Encodes a string @p src of length @p len.
+ */
+bitvec *ranscode_encode(const char *src, size_t len, const ranscode *rcode);
+
+
+/**
+ * @brief Encodes a string @p src.
+ */
+bitvec *ranscode_encode_xstr(const xstr *src, const ranscode *rcode);
+
+
+/**
+ * @brief Decodes a code to a string.
+ * @return The decoded string, or NULL if the code is invalid or fails
+ * the integrity check.
+ */
+xstr *ranscode_decode(const bitvec *code, const ranscode *rcode);
+
+#endif
@@ -20,24 +20,31 @@
  */
 
 #include <assert.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "bitarr.h"
-#include "bitvec.h"
+#include "bitbyte.h"
 #include "errlog.h"
+#include "iter.h"
 #include "mathutil.h"
 #include "memdbg.h"
 #include "new.h"
-#include "order.h"
 #include "roaring.h"
-#include "vec.h"
 #include "segtree.h"
 
 
 #define MAX_ARRAY_SIZE 4096
-#define BITVEC_SIZE (1<<16)
+#define MIN_BITVEC_SIZE (MAX_ARRAY_SIZE / 2)
 #define CTNR_SIZE (1<<16)
+#define BITVEC_WORDS (CTNR_SIZE / 64)
+#define BITVEC_BYTES (CTNR_SIZE / BYTESIZE)
+#define MAX_RUNS (BITVEC_BYTES / sizeof(rle_run))
 
 
 #define MSB(u32_) ((u32_) >> 16)
@@ -47,465 +54,1963 @@
 typedef enum {
 	EMPTY = 0,
 	ARRAY_TYPE = 1,
-	BITVEC_TYPE = 2
+	BITVEC_TYPE = 2,
+	RUN_TYPE = 3
 } ctnr_type;
 
 
+/*
+ * A run of consecutive positions [start, start + len],
+ * i.e. len is the run length minus one, as in the Roaring format.
+ */
+typedef struct {
+	uint16_t start;
+	uint16_t len;
+} rle_run;
+
+
+/*
+ * Container data by type:
+ * - ARRAY_TYPE: sorted array of card uint16_t positions.
+ * - BITVEC_TYPE: BITVEC_WORDS uint64_t words, position i being
+ *   bit (i % 64) (least significant first) of word i / 64.
+ * - RUN_TYPE: sorted array of disjoint, non-adjacent rle_run.
+ * The size and capacity are in number of elements of the data array.
+ * A container with nonnull data and zero capacity borrows its data
+ * from a buffer it does not own (e.g. a mapped file), and copies it
+ * before any modification.
+ */
 typedef struct {
 	ctnr_type type;
 	uint32_t  card;
+	uint32_t  size;
+	uint32_t  cap;
 	void *data;
 } ctnr_t;
 
 
+/*
+ * Only the containers in use are stored, sorted by key (the high 16
+ * bits of their positions). The container cardinalities are kept in a
+ * segment tree over the container indices, which is rebuilt lazily
+ * (dirty flag) when containers are inserted.
+ */
 struct _roaringbitvec {
 	size_t len;
-	size_t ncntrs;
+	size_t nctnrs;
+	size_t cap;
+	uint16_t *keys;
 	ctnr_t *ctnrs;
 	segtree *count_st;
+	bool dirty;
+	void *map;
+	size_t map_size;
 };
 
 
-size_t roaringbitvec_memsize(roaringbitvec *self)
+typedef enum {
+	OP_AND,
+	OP_OR,
+	OP_XOR,
+	OP_ANDNOT
+} rbv_op;
+
+
+static const ctnr_t EMPTY_CTNR = {.type = EMPTY, .card = 0, .size = 0, .cap = 0, .data = NULL};
+
+
+static inline bool op_eval(rbv_op op, bool a, bool b)
 {
-	size_t ret = sizeof(struct _roaringbitvec);
-	ret += self->ncntrs * sizeof(ctnr_t);
-	for (size_t i = 0; i < self->ncntrs; i++) {
-		ctnr_t *ctnr = self->ctnrs + i;
-		switch (ctnr->type) {
-		case EMPTY:
-			break;
-		case ARRAY_TYPE:
-			ret += vec_memsize(ctnr->data);
-			break;
-		case BITVEC_TYPE:
-			ret += bitvec_memsize(ctnr->data);
-			break;
-		default:
-			break;
-		}
+	switch (op) {
+	case OP_AND:
+		return a && b;
+	case OP_OR:
+		return a || b;
+	case OP_XOR:
+		return a != b;
+	default:
+		return a && !b;
 	}
-	return ret;
 }
 
 
-void arrctnr_init(ctnr_t *ctnr)
+static inline uint64_t op_eval_word(rbv_op op, uint64_t a, uint64_t b)
 {
-	ctnr->type = ARRAY_TYPE;
-	ctnr->data = vec_new_uint16_t();
+	switch (op) {
+	case OP_AND:
+		return a & b;
+	case OP_OR:
+		return a | b;
+	case OP_XOR:
+		return a ^ b;
+	default:
+		return a & ~b;
+	}
 }
 
 
-size_t arrctnr_succ(ctnr_t *ctnr, size_t val)
+static size_t ctnr_typesize(ctnr_type type)
 {
-	if (vec_len(ctnr->data) == 0 || val <= vec_first_uint16_t(ctnr->data)) {
+	switch (type) {
+	case ARRAY_TYPE:
+		return sizeof(uint16_t);
+	case BITVEC_TYPE:
+		return sizeof(uint64_t);
+	case RUN_TYPE:
+		return sizeof(rle_run);
+	default:
 		return 0;
 	}
-	else if (vec_last_uint16_t(ctnr->data) < val) {
-		return vec_len(ctnr->data);
-	}
-	size_t l = 0, r = vec_len(ctnr->data) - 1; // successor in (l,r]
-	while ((r - l) > 1) {
-		size_t m = MEAN(l, r);
-		if (val <= vec_get_uint16_t(ctnr->data, m)) {
-			r = m;
-		}
-		else {
-			l = m;
-		}
-	}
-	return r;
 }
 
 
-bool arrctnr_get(ctnr_t *ctnr, size_t index)
+static void ctnr_init(ctnr_t *ctnr, ctnr_type type, uint32_t cap)
 {
-	return vec_bsearch(ctnr->data, &index, cmp_uint16_t) < vec_len(ctnr->data);
+	ctnr->type = type;
+	ctnr->card = 0;
+	ctnr->size = 0;
+	ctnr->cap = cap;
+	ctnr->data = (type != EMPTY) ? malloc(cap * ctnr_typesize(type)) : NULL;
 }
 
 
-// returns the change in the container size after this operation
-// possible values: -1 (decrement), 0 (no effect), +1 (increment)
-int arrctnr_set(ctnr_t *ctnr, size_t index, bool val)
+#define BORROWED(ctnr) ((ctnr)->cap == 0 && (ctnr)->data != NULL)
+
+static void ctnr_clear(ctnr_t *ctnr)
 {
-	size_t pos = arrctnr_succ(ctnr, index);
-	if ((pos == vec_len(ctnr->data))
-	        || (vec_get_uint16_t(ctnr->data, pos) != index)) {
-		if (val) {
-			vec_ins_uint16_t(ctnr->data, pos, index);
-			ctnr->card++;
-			return +1;
-		}
+	if (!BORROWED(ctnr)) {
+		FREE(ctnr->data);
 	}
-	else {   // ctnr->data[pos] == val
-		if (!val) {
-			vec_del(ctnr->data, pos);
-			ctnr->card--;
-			return -1;
-		}
-	}
-	return 0;
+	*ctnr = EMPTY_CTNR;
 }
 
 
-size_t arrctnr_rank(ctnr_t *ctnr, size_t index)
+// takes a private copy of borrowed data
+static void ctnr_own(ctnr_t *ctnr)
 {
-	return arrctnr_succ(ctnr, index);
+	if (BORROWED(ctnr)) {
+		void *data = malloc(ctnr->size * ctnr_typesize(ctnr->type));
+		memcpy(data, ctnr->data, ctnr->size * ctnr_typesize(ctnr->type));
+		ctnr->data = data;
+		ctnr->cap = ctnr->size;
+	}
 }
 
 
-#define NZEROSUPTO(i) (vec_get_uint16_t(ctnr->data, (i)) - (i))
-
-static size_t arrctnr_select(ctnr_t *ctnr, bool bit, size_t rank)
+static void ctnr_reserve(ctnr_t *ctnr, uint32_t cap)
 {
-	if (bit) {
-		return vec_get_uint16_t(ctnr->data, rank);
-	} 
-	else {
-		size_t c0 = NZEROSUPTO(0);
-		if ( rank < c0 ) {
-			return rank;
-		} 
-		size_t l = 0, m;
-		size_t r = vec_len(ctnr->data);
-		while ((r - l) > 1) {
-			m = MEAN(l, r);
-			c0 = NZEROSUPTO(m);
-			if ( rank < c0 ) {
-				r = m;
-			} else {
-				l = m;
-			}
-		}
-		c0 = NZEROSUPTO(l);
-		return vec_get_int16_t(ctnr->data, l) + (rank - c0) + 1;
+	ctnr_own(ctnr);
+	if (cap > ctnr->cap) {
+		cap = MAX(cap, 2 * ctnr->cap);
+		ctnr->data = realloc(ctnr->data, cap * ctnr_typesize(ctnr->type));
+		ctnr->cap = cap;
 	}
 }
 
 
-void convert_arr_to_bitvec_ctnr(ctnr_t *ctnr)
+static void ctnr_fit(ctnr_t *ctnr)
 {
-	vec *v = ctnr->data;
-	bitvec *b = bitvec_new_with_len(BITVEC_SIZE);
-	for (size_t i = 0, l = vec_len(v); i < l; i++) {
-		bitvec_set_bit(b, vec_get_uint16_t(v, i), 1);
+	// empty data arrays are kept so that the capacity stays nonzero
+	if (ctnr->type != EMPTY && ctnr->cap > ctnr->size && ctnr->size > 0) {
+		ctnr->data = realloc(ctnr->data, ctnr->size * ctnr_typesize(ctnr->type));
+		ctnr->cap = ctnr->size;
 	}
-	ctnr->data = b;
-	ctnr->type = BITVEC_TYPE;
-	DESTROY_FLAT(v, vec);
 }
 
 
-void convert_bitvec_to_arr_ctnr(ctnr_t *ctnr)
+/*
+ * Chooses the most compact representation for a container with
+ * given cardinality and number of runs.
+ */
+static ctnr_type best_type(uint32_t card, uint32_t nruns, bool allow_run)
 {
-	vec *v = vec_new_with_capacity(sizeof(uint16_t), ctnr->card);
-	bitvec *b = ctnr->data;
-	for (size_t i = 0; i < BITVEC_SIZE; i++) {
-		if (bitvec_get_bit(b, i)) {
-			vec_push_uint16_t(v, i);
-		}
+	if (card == 0) {
+		return EMPTY;
+	}
+	if (allow_run
+	        && nruns * sizeof(rle_run) < MIN(card * sizeof(uint16_t), BITVEC_BYTES)) {
+		return RUN_TYPE;
 	}
-	ctnr->data = v;
-	ctnr->type = ARRAY_TYPE;
-	bitvec_free(b);
+	return (card <= MAX_ARRAY_SIZE) ? ARRAY_TYPE : BITVEC_TYPE;
 }
 
 
-void bitvecctnr_init(ctnr_t *ctnr)
+/*
+ * Bitmap words
+ */
+
+static inline uint64_t word_mask(uint32_t from, uint32_t to)
 {
-	ctnr->type = BITVEC_TYPE;
-	ctnr->data = bitvec_new_with_capacity(BITVEC_SIZE);
+	// bits [from, to] of a word, 0 <= from <= to < 64
+	return (~(uint64_t)0 << from) & (~(uint64_t)0 >> (63 - to));
 }
 
 
-bool bitvecctnr_get(ctnr_t *ctnr, size_t index)
+// sets positions [from, to] in the bitmap
+static void words_set_range(uint64_t *words, uint32_t from, uint32_t to)
 {
-	return bitvec_get_bit((const bitvec *)ctnr->data, index);
+	uint32_t fw = from / 64, lw = to / 64;
+	if (fw == lw) {
+		words[fw] |= word_mask(from % 64, to % 64);
+		return;
+	}
+	words[fw] |= word_mask(from % 64, 63);
+	for (uint32_t w = fw + 1; w < lw; w++) {
+		words[w] = ~(uint64_t)0;
+	}
+	words[lw] |= word_mask(0, to % 64);
 }
 
 
-// returns the change in the container size after this operation
-// possible values: -1 (decrement), 0 (no effect), +1 (increment)
-int bitvecctnr_set(ctnr_t *ctnr, size_t index, bool val)
+static uint32_t words_card(const uint64_t *words)
 {
-	if (bitvec_get_bit(ctnr->data, index) != val) {
-		bitvec_set_bit(ctnr->data, index, val);
-		ctnr->card += ((val) ? 1 : -1);
-		return val ? +1 : -1;
+	uint32_t card = 0;
+	for (size_t w = 0; w < BITVEC_WORDS; w++) {
+		card += uint64_bitcount1(words[w]);
 	}
-	return 0;
+	return card;
 }
 
 
-size_t bitvecctnr_rank(ctnr_t *ctnr, size_t index)
+static uint32_t words_nruns(const uint64_t *words)
 {
-	return bitvec_count_range(ctnr->data, 1, 0, index);
+	uint32_t nruns = 0;
+	uint64_t carry = 0;
+	for (size_t w = 0; w < BITVEC_WORDS; w++) {
+		// a run starts at each 1 preceded by a 0
+		nruns += uint64_bitcount1(words[w] & ~((words[w] << 1) | carry));
+		carry = words[w] >> 63;
+	}
+	return nruns;
 }
 
 
-size_t bitvecctnr_select(ctnr_t *ctnr, bool bit, size_t rank)
+// first position >= from with a given bit value, or CTNR_SIZE
+static uint32_t words_next(const uint64_t *words, uint32_t from, bool bit)
 {
-	return bitvec_select(ctnr->data, bit, rank);
+	if (from >= CTNR_SIZE) {
+		return CTNR_SIZE;
+	}
+	size_t w = from / 64;
+	uint64_t x = (bit ? words[w] : ~words[w]) & (~(uint64_t)0 << (from % 64));
+	while (x == 0) {
+		if (++w == BITVEC_WORDS) {
+			return CTNR_SIZE;
+		}
+		x = bit ? words[w] : ~words[w];
+	}
+	return (w * 64) + uint64_lobit(x);
 }
 
 
-static size_t ctnr_card(roaringbitvec *self,  size_t ctnr_index)
+// position of the 1 bit of given rank in x
+static inline uint32_t word_select1(uint64_t x, uint32_t rank)
 {
-	return self->ctnrs[ctnr_index].card;
+	for (; rank; rank--) {
+		x &= (x - 1);
+	}
+	return uint64_lobit(x);
 }
 
 
-static const uint32_t ZERO32 = 0;
+/*
+ * Array containers
+ */
 
-roaringbitvec *roaringbitvec_new(uint32_t n)
+// index of the first value >= val
+static uint32_t arr_lb(const uint16_t *vals, uint32_t n, uint32_t val)
 {
-	roaringbitvec *ret = NEW(roaringbitvec);
-	ret->len = n;
-	ret->ncntrs = (size_t)DIVCEIL(n, BITVEC_SIZE);
-	ret->ctnrs = calloc(ret->ncntrs, sizeof(ctnr_t));
-	for (size_t i = 0; i < ret->ncntrs; i++) {
-		ret->ctnrs[i] = (ctnr_t) {
-			.type = EMPTY, .card = 0, .data = NULL
-		};
-	}
-	ret->count_st = segtree_new(ret->ncntrs, sizeof(uint32_t),
-	                            segtree_merge_sum_uint32_t, &ZERO32);
-	return ret;
+	uint32_t l = 0, r = n;
+	while (l < r) {
+		uint32_t m = MEAN(l, r);
+		if (vals[m] < val) {
+			l = m + 1;
+		}
+		else {
+			r = m;
+		}
+	}
+	return l;
 }
 
 
-roaringbitvec *roaringbitvec_new_from_bitarr(byte_t *b, uint32_t n)
+static uint32_t arr_nruns(const uint16_t *vals, uint32_t n)
 {
-	roaringbitvec *ret = roaringbitvec_new(n);
-	for (size_t i = 0; i < n; i++) {
-		if (bitarr_get_bit(b, i)) {
-			roaringbitvec_set(ret, i, 1);
-		}
+	uint32_t nruns = (n > 0);
+	for (uint32_t i = 1; i < n; i++) {
+		nruns += (vals[i] != vals[i - 1] + 1);
 	}
-	return ret;
+	return nruns;
 }
 
 
-void roaringbitvec_free(roaringbitvec *self)
+/*
+ * Run containers
+ */
+
+// number of runs starting at or before val
+static uint32_t run_ub(const rle_run *runs, uint32_t n, uint32_t val)
 {
-	for (size_t i = 0; i < self->ncntrs; i++) {
-		switch (self->ctnrs[i].type) {
-		case ARRAY_TYPE:
-			DESTROY_FLAT(self->ctnrs[i].data, vec);
-			break;
-		case BITVEC_TYPE:
-			bitvec_free(self->ctnrs[i].data);
-			break;
-		default:
-			break;
+	uint32_t l = 0, r = n;
+	while (l < r) {
+		uint32_t m = MEAN(l, r);
+		if (runs[m].start <= val) {
+			l = m + 1;
+		}
+		else {
+			r = m;
 		}
 	}
-	FREE(self->ctnrs);
-	segtree_free(self->count_st);
-	FREE(self);
+	return l;
 }
 
 
-size_t roaringbitvec_len(roaringbitvec *self)
-{
-	return self->len;
-}
-
+#define RUN_END(r) ((uint32_t)(r).start + (r).len)
 
-size_t roaringbitvec_card(roaringbitvec *self)
+static void run_ins(ctnr_t *ctnr, uint32_t k, rle_run run)
 {
-	return self->len ? segtree_range_qry_uint32_t(self->count_st, 0, self->ncntrs) : 0;
+	ctnr_reserve(ctnr, ctnr->size + 1);
+	rle_run *runs = ctnr->data;
+	memmove(runs + k + 1, runs + k, (ctnr->size - k) * sizeof(rle_run));
+	runs[k] = run;
+	ctnr->size++;
 }
 
 
-size_t roaringbitvec_count(roaringbitvec *self, bool bit)
+static void run_del(ctnr_t *ctnr, uint32_t k)
 {
-	return bit ? roaringbitvec_card(self) : self->len - roaringbitvec_card(self);
+	rle_run *runs = ctnr->data;
+	memmove(runs + k, runs + k + 1, (ctnr->size - k - 1) * sizeof(rle_run));
+	ctnr->size--;
 }
 
 
-void roaringbitvec_set(roaringbitvec *self, size_t pos, bool val)
+// returns the change in the container cardinality (-1, 0 or +1)
+static int run_set(ctnr_t *ctnr, uint32_t index, bool val)
 {
-	assert(pos < self->len);
-	size_t bucket = MSB(pos);
-	size_t index = LSB(pos);
-	ctnr_t *ctnr = self->ctnrs + bucket;
-	size_t old_card = ctnr_card(self, bucket);
-	int card_incr = 0;
-	switch (ctnr->type) {
-	case EMPTY:
-		if (val) {
-			arrctnr_init(ctnr);
+	rle_run *runs = ctnr->data;
+	uint32_t k = run_ub(runs, ctnr->size, index);
+	bool inside = (k > 0 && index <= RUN_END(runs[k - 1]));
+	if (val) {
+		if (inside) {
+			return 0;
 		}
-		else {
-			break;
+		bool joinl = (k > 0 && RUN_END(runs[k - 1]) + 1 == index);
+		bool joinr = (k < ctnr->size && runs[k].start == index + 1);
+		if (joinl && joinr) {
+			runs[k - 1].len += runs[k].len + 2;
+			run_del(ctnr, k);
 		}
-	case ARRAY_TYPE:
-		card_incr = arrctnr_set(ctnr, index, val);
-		if (ctnr->card > MAX_ARRAY_SIZE) {
-			convert_arr_to_bitvec_ctnr(ctnr);
+		else if (joinl) {
+			runs[k - 1].len++;
 		}
-		break;
-	case BITVEC_TYPE:
-		card_incr = bitvecctnr_set(ctnr, index, val);
-		if (ctnr->card <= MAX_ARRAY_SIZE) {
-			convert_bitvec_to_arr_ctnr(ctnr);
+		else if (joinr) {
+			runs[k].start--;
+			runs[k].len++;
 		}
-		break;
-	default:
-		break;
+		else {
+			run_ins(ctnr, k, (rle_run) {
+				.start = index, .len = 0
+			});
+		}
+		ctnr->card++;
+		return +1;
 	}
-	if (card_incr) {
-		segtree_upd_uint32_t(self->count_st, bucket, old_card + card_incr);
+	else {
+		if (!inside) {
+			return 0;
+		}
+		rle_run *run = runs + (k - 1);
+		uint32_t start = run->start, end = RUN_END(*run);
+		if (start == end) {
+			run_del(ctnr, k - 1);
+		}
+		else if (index == start) {
+			run->start++;
+			run->len--;
+		}
+		else if (index == end) {
+			run->len--;
+		}
+		else {
+			run->len = index - 1 - start;
+			run_ins(ctnr, k, (rle_run) {
+				.start = index + 1, .len = end - index - 1
+			});
+		}
+		ctnr->card--;
+		return -1;
 	}
 }
 
 
-bool roaringbitvec_get(roaringbitvec *self, size_t pos)
+/*
+ * Generic containers
+ */
+
+static bool ctnr_get(const ctnr_t *ctnr, uint32_t index)
 {
-	assert(pos < self->len);
-	size_t bucket = MSB(pos);
-	size_t index = LSB(pos);
-	ctnr_t *ctnr = self->ctnrs + bucket;
 	switch (ctnr->type) {
 	case EMPTY:
 		return 0;
-		break;
-	case ARRAY_TYPE:
-		return arrctnr_get(ctnr, index);
-		break;
+	case ARRAY_TYPE: {
+		const uint16_t *vals = ctnr->data;
+		uint32_t k = arr_lb(vals, ctnr->size, index);
+		return k < ctnr->size && vals[k] == index;
+	}
 	case BITVEC_TYPE:
-		return bitvecctnr_get(ctnr, index);
-		break;
+		return (((const uint64_t *)ctnr->data)[index / 64] >> (index % 64)) & 1;
+	case RUN_TYPE: {
+		const rle_run *runs = ctnr->data;
+		uint32_t k = run_ub(runs, ctnr->size, index);
+		return k > 0 && index <= RUN_END(runs[k - 1]);
+	}
 	default:
 		ERROR("Invalid container type");
 		return 0;
-		break;
 	}
 }
 
 
-void roaringbitvec_fit(roaringbitvec *self)
+static void ctnr_to_words(const ctnr_t *ctnr, uint64_t *words)
 {
-	for (size_t i = 0; i < self->ncntrs; i++) {
-		ctnr_t *ctnr = self->ctnrs + i;
-		switch (ctnr->type) {
-		case EMPTY:
-			break;
-		case ARRAY_TYPE:
-			vec_fit(ctnr->data);
-			break;
-		case BITVEC_TYPE:
-			bitvec_fit(ctnr->data);
-			break;
-		default:
-			break;
+	if (ctnr->type == BITVEC_TYPE) {
+		memcpy(words, ctnr->data, BITVEC_BYTES);
+		return;
+	}
+	memset(words, 0, BITVEC_BYTES);
+	if (ctnr->type == ARRAY_TYPE) {
+		const uint16_t *vals = ctnr->data;
+		for (uint32_t i = 0; i < ctnr->size; i++) {
+			words[vals[i] / 64] |= ((uint64_t)1 << (vals[i] % 64));
+		}
+	}
+	else if (ctnr->type == RUN_TYPE) {
+		const rle_run *runs = ctnr->data;
+		for (uint32_t k = 0; k < ctnr->size; k++) {
+			words_set_range(words, runs[k].start, RUN_END(runs[k]));
 		}
 	}
 }
 
 
-size_t roaringbitvec_rank1(roaringbitvec *self, size_t pos)
+// fills an EMPTY container with the positions set in a bitmap
+static void ctnr_from_words(ctnr_t *ctnr, const uint64_t *words, bool allow_run)
 {
-	pos = MIN(self->len, pos);
-	size_t bucket = MSB(pos);
-	size_t index = LSB(pos);
-	size_t ret = 0;
-	ret += segtree_range_qry_uint32_t(self->count_st, 0, bucket);
-	ctnr_t *ctnr = self->ctnrs + bucket;
-	switch (ctnr->type) {
+	uint32_t card = words_card(words);
+	uint32_t nruns = allow_run ? words_nruns(words) : 0;
+	switch (best_type(card, nruns, allow_run)) {
 	case EMPTY:
+		*ctnr = EMPTY_CTNR;
 		break;
-	case ARRAY_TYPE:
-		ret += arrctnr_rank(ctnr, index);
+	case ARRAY_TYPE: {
+		ctnr_init(ctnr, ARRAY_TYPE, card);
+		uint16_t *vals = ctnr->data;
+		for (size_t w = 0; w < BITVEC_WORDS; w++) {
+			for (uint64_t x = words[w]; x; x &= (x - 1)) {
+				vals[ctnr->size++] = (w * 64) + uint64_lobit(x);
+			}
+		}
 		break;
+	}
 	case BITVEC_TYPE:
-		ret += bitvecctnr_rank(ctnr, index);
+		ctnr_init(ctnr, BITVEC_TYPE, BITVEC_WORDS);
+		memcpy(ctnr->data, words, BITVEC_BYTES);
+		ctnr->size = BITVEC_WORDS;
 		break;
-	default:
+	case RUN_TYPE: {
+		ctnr_init(ctnr, RUN_TYPE, nruns);
+		rle_run *runs = ctnr->data;
+		uint32_t start, end = 0;
+		while ((start = words_next(words, end, 1)) < CTNR_SIZE) {
+			end = words_next(words, start, 0);
+			runs[ctnr->size++] = (rle_run) {
+				.start = start, .len = end - start - 1
+			};
+		}
 		break;
 	}
-	return ret;
+	}
+	ctnr->card = card;
 }
 
 
-size_t roaringbitvec_rank0(roaringbitvec *self, size_t pos)
+// fills an EMPTY container with the positions covered by a list of runs
+static void ctnr_from_runs(ctnr_t *ctnr, const rle_run *runs, uint32_t nruns,
+                           uint32_t card, bool allow_run)
 {
-    return MIN(self->len, pos) - roaringbitvec_rank1(self, pos);
+	switch (best_type(card, nruns, allow_run)) {
+	case EMPTY:
+		*ctnr = EMPTY_CTNR;
+		break;
+	case ARRAY_TYPE: {
+		ctnr_init(ctnr, ARRAY_TYPE, card);
+		uint16_t *vals = ctnr->data;
+		for (uint32_t k = 0; k < nruns; k++) {
+			for (uint32_t v = runs[k].start, e = RUN_END(runs[k]); v <= e; v++) {
+				vals[ctnr->size++] = v;
+			}
+		}
+		break;
+	}
+	case BITVEC_TYPE: {
+		ctnr_init(ctnr, BITVEC_TYPE, BITVEC_WORDS);
+		uint64_t *words = ctnr->data;
+		memset(words, 0, BITVEC_BYTES);
+		for (uint32_t k = 0; k < nruns; k++) {
+			words_set_range(words, runs[k].start, RUN_END(runs[k]));
+		}
+		ctnr->size = BITVEC_WORDS;
+		break;
+	}
+	case RUN_TYPE:
+		ctnr_init(ctnr, RUN_TYPE, nruns);
+		memcpy(ctnr->data, runs, nruns * sizeof(rle_run));
+		ctnr->size = nruns;
+		break;
+	}
+	ctnr->card = card;
 }
 
 
-size_t roaringbitvec_rank(roaringbitvec *self, bool bit, size_t pos)
+// re-encodes a container as its most compact representation
+static void ctnr_repack(ctnr_t *ctnr, bool allow_run)
 {
-	return bit ? roaringbitvec_rank1(self, pos) : roaringbitvec_rank0(self, pos);
+	uint64_t words[BITVEC_WORDS];
+	ctnr_to_words(ctnr, words);
+	ctnr_clear(ctnr);
+	ctnr_from_words(ctnr, words, allow_run);
 }
 
 
-#define BKTRANK0(b) MIN(self->len, (b) * CTNR_SIZE) - segtree_range_qry_uint32_t(self->count_st, 0, b)
-#define BKTRANK1(b) segtree_range_qry_uint32_t(self->count_st, 0, (b))
-#define BKTRANK(bkt, bit) ((bit) ? BKTRANK1((bkt)) : BKTRANK0((bkt)))
-
-size_t roaringbitvec_select(roaringbitvec *self, bool bit, size_t rank)
+static uint32_t ctnr_nruns(const ctnr_t *ctnr)
 {
-	
-	if (rank >= roaringbitvec_count(self, bit)) { // self->size || rank > BKTRANK(self->ncntrs - 1, bit)) {
-		return self->len;
-	}
-	// find the bucket on which to look for the right bit
-	size_t l = 0, r = self->ncntrs, bkt_rank = 0; 
-	while ( (r - l) > 1) { // bucket in [l, r)
-		size_t m = MEAN(l, r);
-		bkt_rank = BKTRANK(m, bit);
-		if (rank < bkt_rank) {
-			r =  m;
-		} else {
-			l = m;
-		}
+	switch (ctnr->type) {
+	case ARRAY_TYPE:
+		return arr_nruns(ctnr->data, ctnr->size);
+	case BITVEC_TYPE:
+		return words_nruns(ctnr->data);
+	case RUN_TYPE:
+		return ctnr->size;
+	default:
+		return 0;
 	}
-	bkt_rank = BKTRANK(l, bit);
-	size_t ret = l * CTNR_SIZE;
-	ctnr_t *ctnr = self->ctnrs + l;
-	assert(rank >= bkt_rank);
+}
+
+
+// returns the change in the container cardinality (-1, 0 or +1)
+static int ctnr_set(ctnr_t *ctnr, uint32_t index, bool val)
+{
+	int incr = 0;
+	ctnr_own(ctnr);
 	switch (ctnr->type) {
 	case EMPTY:
-		ret += (rank - bkt_rank);
+		if (!val) {
+			return 0;
+		}
+		ctnr_init(ctnr, ARRAY_TYPE, 4);
+	// fallthrough
+	case ARRAY_TYPE: {
+		uint16_t *vals = ctnr->data;
+		uint32_t k = arr_lb(vals, ctnr->size, index);
+		bool present = (k < ctnr->size && vals[k] == index);
+		if (val && !present) {
+			ctnr_reserve(ctnr, ctnr->size + 1);
+			vals = ctnr->data;
+			memmove(vals + k + 1, vals + k, (ctnr->size - k) * sizeof(uint16_t));
+			vals[k] = index;
+			ctnr->size++;
+			incr = +1;
+		}
+		else if (!val && present) {
+			memmove(vals + k, vals + k + 1, (ctnr->size - k - 1) * sizeof(uint16_t));
+			ctnr->size--;
+			incr = -1;
+		}
+		ctnr->card += incr;
+		if (ctnr->card > MAX_ARRAY_SIZE) {
+			ctnr_repack(ctnr, false);
+		}
 		break;
-	case ARRAY_TYPE:
-		ret += arrctnr_select(ctnr, bit, rank - bkt_rank);
+	}
+	case BITVEC_TYPE: {
+		uint64_t *words = ctnr->data;
+		uint64_t mask = (uint64_t)1 << (index % 64);
+		if (((words[index / 64] & mask) != 0) != val) {
+			words[index / 64] ^= mask;
+			incr = val ? +1 : -1;
+			ctnr->card += incr;
+		}
+		// converting back only well below the threshold avoids
+		// thrashing between representations
+		if (ctnr->card < MIN_BITVEC_SIZE) {
+			ctnr_repack(ctnr, false);
+		}
 		break;
-	case BITVEC_TYPE:
-		ret += bitvecctnr_select(ctnr, bit, rank - bkt_rank);
+	}
+	case RUN_TYPE:
+		incr = run_set(ctnr, index, val);
+		if (ctnr->size > MAX_RUNS) {
+			ctnr_repack(ctnr, false);
+		}
 		break;
 	default:
-		ERROR("Invalid container type\n");
-		return self->len;
 		break;
 	}
-	return ret;
+	if (ctnr->card == 0 && ctnr->type != EMPTY) {
+		ctnr_clear(ctnr);
+	}
+	return incr;
 }
 
 
-size_t roaringbitvec_select0(roaringbitvec *self, size_t rank)
+// number of 1s in [0, index)
+static uint32_t ctnr_rank1(const ctnr_t *ctnr, uint32_t index)
 {
-	return roaringbitvec_select(self, 0, rank);
+	switch (ctnr->type) {
+	case ARRAY_TYPE:
+		return arr_lb(ctnr->data, ctnr->size, index);
+	case BITVEC_TYPE: {
+		// count from the nearest end of the bitmap
+		const uint64_t *words = ctnr->data;
+		uint32_t w = index / 64, ret = 0;
+		if (w < BITVEC_WORDS / 2) {
+			for (uint32_t k = 0; k < w; k++) {
+				ret += uint64_bitcount1(words[k]);
+			}
+			if (index % 64) {
+				ret += uint64_bitcount1(words[w] & word_mask(0, (index % 64) - 1));
+			}
+			return ret;
+		}
+		for (uint32_t k = w + 1; k < BITVEC_WORDS; k++) {
+			ret += uint64_bitcount1(words[k]);
+		}
+		ret += uint64_bitcount1(words[w] & word_mask(index % 64, 63));
+		return ctnr->card - ret;
+	}
+	case RUN_TYPE: {
+		const rle_run *runs = ctnr->data;
+		uint32_t ret = 0;
+		for (uint32_t k = 0; k < ctnr->size && runs[k].start < index; k++) {
+			ret += MIN(RUN_END(runs[k]) + 1, index) - runs[k].start;
+		}
+		return ret;
+	}
+	default:
+		return 0;
+	}
 }
 
 
-size_t roaringbitvec_select1(roaringbitvec *self, size_t rank)
+// the position with a given bit value and rank, assumed to exist
+static uint32_t ctnr_select(const ctnr_t *ctnr, bool bit, uint32_t rank)
 {
-	return roaringbitvec_select(self, 1, rank);
+	switch (ctnr->type) {
+	case EMPTY:
+		return rank;
+	case ARRAY_TYPE: {
+		const uint16_t *vals = ctnr->data;
+		if (bit) {
+			return vals[rank];
+		}
+		// vals[i] - i = number of zeros before vals[i]
+		if (rank < vals[0]) {
+			return rank;
+		}
+		uint32_t l = 0, r = ctnr->size;
+		while ((r - l) > 1) {
+			uint32_t m = MEAN(l, r);
+			if (rank < (uint32_t)vals[m] - m) {
+				r = m;
+			}
+			else {
+				l = m;
+			}
+		}
+		return rank + l + 1;
+	}
+	case BITVEC_TYPE: {
+		const uint64_t *words = ctnr->data;
+		// the zeros past the end of a partial last container are not
+		// accounted for, so only 1s are searched for backwards
+		uint32_t total = ctnr->card;
+		if (!bit || rank < total / 2) {
+			for (uint32_t w = 0; w < BITVEC_WORDS; w++) {
+				uint64_t x = bit ? words[w] : ~words[w];
+				uint32_t c = uint64_bitcount1(x);
+				if (rank < c) {
+					return (w * 64) + word_select1(x, rank);
+				}
+				rank -= c;
+			}
+			return CTNR_SIZE;
+		}
+		// scan backwards for the (total - rank)-th 1 from the end
+		rank = total - rank;
+		for (uint32_t w = BITVEC_WORDS; w-- > 0;) {
+			uint64_t x = words[w];
+			uint32_t c = uint64_bitcount1(x);
+			if (rank <= c) {
+				return (w * 64) + word_select1(x, c - rank);
+			}
+			rank -= c;
+		}
+		return CTNR_SIZE;
+	}
+	case RUN_TYPE: {
+		const rle_run *runs = ctnr->data;
+		uint32_t ones = 0;
+		for (uint32_t k = 0; k < ctnr->size; k++) {
+			if (bit) {
+				if (rank <= runs[k].len) {
+					return runs[k].start + rank;
+				}
+				rank -= (uint32_t)runs[k].len + 1;
+			}
+			else {
+				if (rank < runs[k].start - ones) {
+					return rank + ones;
+				}
+				ones += (uint32_t)runs[k].len + 1;
+			}
+		}
+		return bit ? CTNR_SIZE : rank + ones;
+	}
+	default:
+		ERROR("Invalid container type");
+		return CTNR_SIZE;
+	}
+}
+
+
+// first position >= index set to 1, or CTNR_SIZE
+static uint32_t ctnr_next(const ctnr_t *ctnr, uint32_t index)
+{
+	switch (ctnr->type) {
+	case ARRAY_TYPE: {
+		const uint16_t *vals = ctnr->data;
+		uint32_t k = arr_lb(vals, ctnr->size, index);
+		return (k < ctnr->size) ? vals[k] : CTNR_SIZE;
+	}
+	case BITVEC_TYPE:
+		return words_next(ctnr->data, index, 1);
+	case RUN_TYPE: {
+		const rle_run *runs = ctnr->data;
+		uint32_t k = run_ub(runs, ctnr->size, index);
+		if (k > 0 && index <= RUN_END(runs[k - 1])) {
+			return index;
+		}
+		return (k < ctnr->size) ? runs[k].start : CTNR_SIZE;
+	}
+	default:
+		return CTNR_SIZE;
+	}
+}
+
+
+/*
+ * Container set operations
+ */
+
+// interval k of an ARRAY or RUN container
+static inline void ctnr_interval(const ctnr_t *ctnr, uint32_t k,
+                                 uint32_t *start, uint32_t *end)
+{
+	if (ctnr->type == ARRAY_TYPE) {
+		*start = *end = ((const uint16_t *)ctnr->data)[k];
+	}
+	else {
+		rle_run run = ((const rle_run *)ctnr->data)[k];
+		*start = run.start;
+		*end = RUN_END(run);
+	}
+}
+
+
+/*
+ * Sweeps the intervals of two ARRAY/RUN/EMPTY containers, writing
+ * the maximal runs of the result to out (if not NULL) and its
+ * cardinality to card. Returns the number of runs.
+ */
+static uint32_t ctnr_sweep(const ctnr_t *a, const ctnr_t *b, rbv_op op,
+                           rle_run *out, uint32_t *card)
+{
+	uint32_t na = a->size, nb = b->size, ia = 0, ib = 0;
+	uint32_t nout = 0, pos = 0, last_end = 0;
+	uint32_t sa = 0, ea = 0, sb = 0, eb = 0;
+	*card = 0;
+	while (pos < CTNR_SIZE) {
+		if ((op == OP_AND && (ia == na || ib == nb))
+		        || (op == OP_ANDNOT && ia == na)
+		        || (ia == na && ib == nb)) {
+			break;
+		}
+		uint32_t next = CTNR_SIZE;
+		bool ina = false, inb = false;
+		if (ia < na) {
+			ctnr_interval(a, ia, &sa, &ea);
+			ina = (sa <= pos);
+			next = ina ? MIN(next, ea + 1) : MIN(next, sa);
+		}
+		if (ib < nb) {
+			ctnr_interval(b, ib, &sb, &eb);
+			inb = (sb <= pos);
+			next = inb ? MIN(next, eb + 1) : MIN(next, sb);
+		}
+		if (op_eval(op, ina, inb)) {
+			if (nout > 0 && last_end + 1 == pos) {
+				if (out) {
+					out[nout - 1].len += next - pos;
+				}
+			}
+			else {
+				if (out) {
+					out[nout] = (rle_run) {
+						.start = pos, .len = next - pos - 1
+					};
+				}
+				nout++;
+			}
+			last_end = next - 1;
+			*card += next - pos;
+		}
+		pos = next;
+		if (ina && pos > ea) {
+			ia++;
+		}
+		if (inb && pos > eb) {
+			ib++;
+		}
+	}
+	return nout;
+}
+
+
+// word-wise operation, with at least one BITVEC operand
+static void ctnr_words_op(const ctnr_t *a, const ctnr_t *b, rbv_op op,
+                          uint64_t *dest)
+{
+	uint64_t bufa[BITVEC_WORDS], bufb[BITVEC_WORDS];
+	const uint64_t *wa = a->data, *wb = b->data;
+	if (a->type != BITVEC_TYPE) {
+		ctnr_to_words(a, bufa);
+		wa = bufa;
+	}
+	if (b->type != BITVEC_TYPE) {
+		ctnr_to_words(b, bufb);
+		wb = bufb;
+	}
+	for (size_t w = 0; w < BITVEC_WORDS; w++) {
+		dest[w] = op_eval_word(op, wa[w], wb[w]);
+	}
+}
+
+
+/*
+ * Keeps the values of the ARRAY container a which are (keep=true)
+ * or are not (keep=false) in b, writing the result to dest
+ * if not NULL. Returns the resulting cardinality.
+ */
+static uint32_t ctnr_probe(const ctnr_t *a, const ctnr_t *b, bool keep,
+                           ctnr_t *dest)
+{
+	const uint16_t *vals = a->data;
+	uint16_t *out = NULL;
+	if (dest) {
+		ctnr_init(dest, ARRAY_TYPE, a->size);
+		out = dest->data;
+	}
+	uint32_t card = 0;
+	for (uint32_t i = 0; i < a->size; i++) {
+		if (ctnr_get(b, vals[i]) == keep) {
+			if (out) {
+				out[card] = vals[i];
+			}
+			card++;
+		}
+	}
+	if (dest) {
+		dest->size = dest->card = card;
+		if (card == 0) {
+			ctnr_clear(dest);
+		}
+	}
+	return card;
+}
+
+
+/*
+ * Computes `a op b` into the EMPTY container dest, or only its
+ * cardinality if dest is NULL.
+ */
+static uint32_t ctnr_op(const ctnr_t *a, const ctnr_t *b, rbv_op op,
+                        ctnr_t *dest)
+{
+	bool allow_run = (a->type == RUN_TYPE || b->type == RUN_TYPE);
+	if (a->type == ARRAY_TYPE && b->type != ARRAY_TYPE
+	        && (op == OP_AND || op == OP_ANDNOT)) {
+		return ctnr_probe(a, b, op == OP_AND, dest);
+	}
+	else if (b->type == ARRAY_TYPE && a->type != ARRAY_TYPE && op == OP_AND) {
+		return ctnr_probe(b, a, true, dest);
+	}
+	else if (a->type == BITVEC_TYPE || b->type == BITVEC_TYPE) {
+		uint64_t words[BITVEC_WORDS];
+		ctnr_words_op(a, b, op, words);
+		if (dest) {
+			ctnr_from_words(dest, words, allow_run);
+			return dest->card;
+		}
+		return words_card(words);
+	}
+	else {
+		uint32_t card;
+		if (!dest) {
+			ctnr_sweep(a, b, op, NULL, &card);
+			return card;
+		}
+		rle_run *runs = malloc((a->size + b->size + 1) * sizeof(rle_run));
+		uint32_t nruns = ctnr_sweep(a, b, op, runs, &card);
+		ctnr_from_runs(dest, runs, nruns, card, allow_run);
+		FREE(runs);
+		return card;
+	}
+}
+
+
+/*
+ * Roaring bitvector
+ */
+
+size_t roaringbitvec_memsize(roaringbitvec *self)
+{
+	size_t ret = sizeof(struct _roaringbitvec);
+	ret += self->cap * (sizeof(uint16_t) + sizeof(ctnr_t));
+	for (size_t i = 0; i < self->nctnrs; i++) {
+		ret += self->ctnrs[i].cap * ctnr_typesize(self->ctnrs[i].type);
+	}
+	return ret;
+}
+
+
+static const uint64_t ZERO64 = 0;
+
+// rebuilds the container counts after containers are added or removed
+static void recount(roaringbitvec *self)
+{
+	if (!self->dirty) {
+		return;
+	}
+	segtree_free(self->count_st);
+	self->count_st = segtree_new(self->nctnrs, sizeof(uint64_t),
+	                             segtree_merge_sum_uint64_t, &ZERO64);
+	for (size_t i = 0; i < self->nctnrs; i++) {
+		if (self->ctnrs[i].card) {
+			segtree_upd_uint64_t(self->count_st, i, self->ctnrs[i].card);
+		}
+	}
+	self->dirty = false;
+}
+
+
+// number of 1s in the containers before index k
+static size_t prefix_card(roaringbitvec *self, size_t k)
+{
+	recount(self);
+	return k ? segtree_range_qry_uint64_t(self->count_st, 0, k) : 0;
+}
+
+
+static void reserve(roaringbitvec *self, size_t cap)
+{
+	if (cap > self->cap) {
+		cap = MAX(cap, 2 * self->cap);
+		self->keys = realloc(self->keys, cap * sizeof(uint16_t));
+		self->ctnrs = realloc(self->ctnrs, cap * sizeof(ctnr_t));
+		self->cap = cap;
+	}
+}
+
+
+// index of the first container with key >= key
+static size_t key_lb(roaringbitvec *self, size_t key)
+{
+	size_t l = 0, r = self->nctnrs;
+	while (l < r) {
+		size_t m = MEAN(l, r);
+		if (self->keys[m] < key) {
+			l = m + 1;
+		}
+		else {
+			r = m;
+		}
+	}
+	return l;
+}
+
+
+// the container with a given key or NULL
+static ctnr_t *find_ctnr(roaringbitvec *self, size_t key)
+{
+	size_t k = key_lb(self, key);
+	return (k < self->nctnrs && self->keys[k] == key) ? self->ctnrs + k : NULL;
+}
+
+
+// appends a container, taking ownership of its data
+static void push_ctnr(roaringbitvec *self, size_t key, ctnr_t *ctnr)
+{
+	reserve(self, self->nctnrs + 1);
+	self->keys[self->nctnrs] = key;
+	self->ctnrs[self->nctnrs] = *ctnr;
+	self->nctnrs++;
+	self->dirty = true;
+}
+
+
+roaringbitvec *roaringbitvec_new(size_t n)
+{
+	ERROR_ASSERT(n <= ROARINGBITVEC_MAX_LEN, "Length %zu exceeds the maximum.", n);
+	roaringbitvec *ret = NEW(roaringbitvec);
+	ret->len = n;
+	ret->nctnrs = 0;
+	ret->cap = 0;
+	ret->keys = NULL;
+	ret->ctnrs = NULL;
+	ret->count_st = segtree_new(0, sizeof(uint64_t),
+	                            segtree_merge_sum_uint64_t, &ZERO64);
+	ret->dirty = false;
+	ret->map = NULL;
+	ret->map_size = 0;
+	return ret;
+}
+
+
+roaringbitvec *roaringbitvec_new_from_bitarr(byte_t *b, size_t n)
+{
+	roaringbitvec *ret = roaringbitvec_new(n);
+	uint64_t words[BITVEC_WORDS];
+	for (size_t c = 0, nbkts = (size_t)DIVCEIL(n, CTNR_SIZE); c < nbkts; c++) {
+		size_t from = c * CTNR_SIZE;
+		size_t nbits = MIN((size_t)CTNR_SIZE, n - from);
+		size_t nbytes = (size_t)DIVCEIL(nbits, BYTESIZE);
+		memset(words, 0, BITVEC_BYTES);
+		// the bitarray is MSB-first within each byte
+		for (size_t j = 0; j < nbytes; j++) {
+			byte_t x = b[(from / BYTESIZE) + j];
+			byte_reverse(&x);
+			words[j / 8] |= (uint64_t)x << (8 * (j % 8));
+		}
+		if (nbits < CTNR_SIZE) {
+			for (size_t w = nbits / 64; w < BITVEC_WORDS; w++) {
+				words[w] &= (w == nbits / 64 && nbits % 64)
+				            ? word_mask(0, (nbits % 64) - 1) : 0;
+			}
+		}
+		ctnr_t ctnr;
+		ctnr_from_words(&ctnr, words, true);
+		if (ctnr.type != EMPTY) {
+			push_ctnr(ret, c, &ctnr);
+		}
+	}
+	return ret;
+}
+
+
+roaringbitvec *roaringbitvec_new_from_sorted(const uint32_t *pos, size_t n,
+        size_t length)
+{
+	roaringbitvec *ret = roaringbitvec_new(length);
+	rle_run *runs = malloc(MIN(n, (size_t)CTNR_SIZE) * sizeof(rle_run));
+	for (size_t i = 0; i < n; ) {
+		WARN_ASSERT(pos[i] < length, "Position %"PRIu32" out of range.", pos[i]);
+		size_t bucket = MSB(pos[i]);
+		uint32_t nruns = 0, card = 0;
+		for (; i < n && MSB(pos[i]) == bucket; i++) {
+			uint32_t v = LSB(pos[i]);
+			if (nruns > 0 && v <= RUN_END(runs[nruns - 1])) {
+				continue;
+			}
+			if (nruns > 0 && v == RUN_END(runs[nruns - 1]) + 1) {
+				runs[nruns - 1].len++;
+			}
+			else {
+				runs[nruns++] = (rle_run) {
+					.start = v, .len = 0
+				};
+			}
+			card++;
+		}
+		ctnr_t ctnr;
+		ctnr_from_runs(&ctnr, runs, nruns, card, true);
+		push_ctnr(ret, bucket, &ctnr);
+	}
+	FREE(runs);
+	return ret;
+}
+
+
+void roaringbitvec_free(roaringbitvec *self)
+{
+	for (size_t i = 0; i < self->nctnrs; i++) {
+		ctnr_clear(self->ctnrs + i);
+	}
+	FREE(self->keys);
+	FREE(self->ctnrs);
+	segtree_free(self->count_st);
+	if (self->map) {
+		munmap(self->map, self->map_size);
+	}
+	FREE(self);
+}
+
+
+size_t roaringbitvec_len(roaringbitvec *self)
+{
+	return self->len;
+}
+
+
+size_t roaringbitvec_card(roaringbitvec *self)
+{
+	return prefix_card(self, self->nctnrs);
+}
+
+
+size_t roaringbitvec_count(roaringbitvec *self, bool bit)
+{
+	return bit ? roaringbitvec_card(self) : self->len - roaringbitvec_card(self);
+}
+
+
+void roaringbitvec_set(roaringbitvec *self, size_t pos, bool val)
+{
+	assert(pos < self->len);
+	size_t bucket = MSB(pos);
+	size_t k = key_lb(self, bucket);
+	if (k == self->nctnrs || self->keys[k] != bucket) {
+		if (!val) {
+			return;
+		}
+		reserve(self, self->nctnrs + 1);
+		memmove(self->keys + k + 1, self->keys + k,
+		        (self->nctnrs - k) * sizeof(uint16_t));
+		memmove(self->ctnrs + k + 1, self->ctnrs + k,
+		        (self->nctnrs - k) * sizeof(ctnr_t));
+		self->keys[k] = bucket;
+		self->ctnrs[k] = EMPTY_CTNR;
+		self->nctnrs++;
+		// counts are rebuilt lazily, so that a sequence of insertions
+		// does not pay for one rebuild each
+		self->dirty = true;
+	}
+	ctnr_t *ctnr = self->ctnrs + k;
+	if (ctnr_set(ctnr, LSB(pos), val) && !self->dirty) {
+		segtree_upd_uint64_t(self->count_st, k, ctnr->card);
+	}
+}
+
+
+bool roaringbitvec_get(roaringbitvec *self, size_t pos)
+{
+	assert(pos < self->len);
+	ctnr_t *ctnr = find_ctnr(self, MSB(pos));
+	return ctnr && ctnr_get(ctnr, LSB(pos));
+}
+
+
+void roaringbitvec_fit(roaringbitvec *self)
+{
+	// drop containers emptied by updates
+	size_t n = 0;
+	for (size_t i = 0; i < self->nctnrs; i++) {
+		if (self->ctnrs[i].type == EMPTY) {
+			continue;
+		}
+		ctnr_fit(self->ctnrs + i);
+		self->keys[n] = self->keys[i];
+		self->ctnrs[n++] = self->ctnrs[i];
+	}
+	self->dirty |= (n < self->nctnrs);
+	self->nctnrs = n;
+	if (self->cap > n) {
+		self->keys = realloc(self->keys, n * sizeof(uint16_t));
+		self->ctnrs = realloc(self->ctnrs, n * sizeof(ctnr_t));
+		self->cap = n;
+	}
+}
+
+
+bool roaringbitvec_run_optimize(roaringbitvec *self)
+{
+	bool has_runs = false;
+	for (size_t i = 0; i < self->nctnrs; i++) {
+		ctnr_t *ctnr = self->ctnrs + i;
+		if (ctnr->type == EMPTY) {
+			continue;
+		}
+		if (best_type(ctnr->card, ctnr_nruns(ctnr), true) != ctnr->type) {
+			ctnr_repack(ctnr, true);
+		}
+		has_runs |= (ctnr->type == RUN_TYPE);
+	}
+	return has_runs;
+}
+
+
+size_t roaringbitvec_rank1(roaringbitvec *self, size_t pos)
+{
+	pos = MIN(self->len, pos);
+	size_t bucket = MSB(pos);
+	size_t k = key_lb(self, bucket);
+	size_t ret = prefix_card(self, k);
+	if (k < self->nctnrs && self->keys[k] == bucket) {
+		ret += ctnr_rank1(self->ctnrs + k, LSB(pos));
+	}
+	return ret;
+}
+
+
+size_t roaringbitvec_rank0(roaringbitvec *self, size_t pos)
+{
+	return MIN(self->len, pos) - roaringbitvec_rank1(self, pos);
+}
+
+
+size_t roaringbitvec_rank(roaringbitvec *self, bool bit, size_t pos)
+{
+	return bit ? roaringbitvec_rank1(self, pos) : roaringbitvec_rank0(self, pos);
+}
+
+
+// number of 0s before the container at index k
+#define ZEROS_BEFORE(k) ((size_t)self->keys[(k)] * CTNR_SIZE - prefix_card(self, (k)))
+
+size_t roaringbitvec_select1(roaringbitvec *self, size_t rank)
+{
+	if (rank >= roaringbitvec_card(self)) {
+		return self->len;
+	}
+	// last container k with prefix_card(k) <= rank
+	size_t l = 0, r = self->nctnrs;
+	while ((r - l) > 1) {
+		size_t m = MEAN(l, r);
+		if (prefix_card(self, m) <= rank) {
+			l = m;
+		}
+		else {
+			r = m;
+		}
+	}
+	return ((size_t)self->keys[l] * CTNR_SIZE)
+	       + ctnr_select(self->ctnrs + l, 1, rank - prefix_card(self, l));
+}
+
+
+size_t roaringbitvec_select0(roaringbitvec *self, size_t rank)
+{
+	if (rank >= roaringbitvec_count(self, 0)) {
+		return self->len;
+	}
+	if (self->nctnrs == 0 || rank < ZEROS_BEFORE(0)) {
+		return rank;
+	}
+	// last container k with ZEROS_BEFORE(k) <= rank
+	size_t l = 0, r = self->nctnrs;
+	while ((r - l) > 1) {
+		size_t m = MEAN(l, r);
+		if (ZEROS_BEFORE(m) <= rank) {
+			l = m;
+		}
+		else {
+			r = m;
+		}
+	}
+	size_t base = (size_t)self->keys[l] * CTNR_SIZE;
+	size_t zeros = MIN((size_t)CTNR_SIZE, self->len - base) - self->ctnrs[l].card;
+	rank -= ZEROS_BEFORE(l);
+	if (rank < zeros) {
+		return base + ctnr_select(self->ctnrs + l, 0, rank);
+	}
+	// the gap up to the next container holds only 0s
+	return base + CTNR_SIZE + (rank - zeros);
+}
+
+
+size_t roaringbitvec_select(roaringbitvec *self, bool bit, size_t rank)
+{
+	return bit ? roaringbitvec_select1(self, rank) : roaringbitvec_select0(self, rank);
+}
+
+
+/*
+ * Steps through the containers of a and b merged by key. Sets ca
+ * (NULL if the key is not in a) and cb (EMPTY_CTNR if not in b) and
+ * returns false at the end. For AND and ANDNOT, keys that cannot yield
+ * a nonempty result are skipped.
+ */
+static bool merge_next(roaringbitvec *a, roaringbitvec *b, rbv_op op,
+                       size_t *i, size_t *j, size_t *key,
+                       ctnr_t **ca, const ctnr_t **cb)
+{
+	while (*i < a->nctnrs || *j < b->nctnrs) {
+		*ca = NULL;
+		*cb = &EMPTY_CTNR;
+		if (*j == b->nctnrs || (*i < a->nctnrs && a->keys[*i] < b->keys[*j])) {
+			*key = a->keys[*i];
+			*ca = a->ctnrs + (*i)++;
+		}
+		else if (*i == a->nctnrs || b->keys[*j] < a->keys[*i]) {
+			*key = b->keys[*j];
+			*cb = b->ctnrs + (*j)++;
+		}
+		else {
+			*key = a->keys[*i];
+			*ca = a->ctnrs + (*i)++;
+			*cb = b->ctnrs + (*j)++;
+		}
+		if ((op == OP_AND && (*ca == NULL || (*cb)->type == EMPTY))
+		        || (op == OP_ANDNOT && *ca == NULL)) {
+			continue;
+		}
+		return true;
+	}
+	return false;
+}
+
+
+static roaringbitvec *rbv_op_new(roaringbitvec *a, roaringbitvec *b, rbv_op op)
+{
+	size_t len = (op == OP_ANDNOT) ? a->len : MAX(a->len, b->len);
+	roaringbitvec *ret = roaringbitvec_new(len);
+	size_t i = 0, j = 0, key;
+	ctnr_t *ca, res;
+	const ctnr_t *cb;
+	while (merge_next(a, b, op, &i, &j, &key, &ca, &cb)) {
+		ctnr_op(ca ? ca : &EMPTY_CTNR, cb, op, &res);
+		if (res.type != EMPTY) {
+			push_ctnr(ret, key, &res);
+		}
+	}
+	return ret;
+}
+
+
+static size_t rbv_op_card(roaringbitvec *a, roaringbitvec *b, rbv_op op)
+{
+	size_t i = 0, j = 0, key, card = 0;
+	ctnr_t *ca;
+	const ctnr_t *cb;
+	while (merge_next(a, b, op, &i, &j, &key, &ca, &cb)) {
+		card += ctnr_op(ca ? ca : &EMPTY_CTNR, cb, op, NULL);
+	}
+	return card;
+}
+
+
+static void rbv_op_inplace(roaringbitvec *a, roaringbitvec *b, rbv_op op)
+{
+	size_t len = (op == OP_ANDNOT) ? a->len : MAX(a->len, b->len);
+	roaringbitvec *ret = roaringbitvec_new(len);
+	size_t i = 0, j = 0, key;
+	ctnr_t *ca, res;
+	const ctnr_t *cb;
+	while (merge_next(a, b, op, &i, &j, &key, &ca, &cb)) {
+		if (ca && cb->type == EMPTY) {
+			// unchanged: move the container over
+			push_ctnr(ret, key, ca);
+			*ca = EMPTY_CTNR;
+			continue;
+		}
+		ctnr_op(ca ? ca : &EMPTY_CTNR, cb, op, &res);
+		if (res.type != EMPTY) {
+			push_ctnr(ret, key, &res);
+		}
+	}
+	// swap contents and dispose of the old ones, keeping the mapping
+	// which moved containers may still refer to
+	roaringbitvec tmp = *a;
+	*a = *ret;
+	*ret = tmp;
+	a->map = ret->map;
+	a->map_size = ret->map_size;
+	ret->map = NULL;
+	roaringbitvec_free(ret);
+}
+
+
+roaringbitvec *roaringbitvec_and(roaringbitvec *a, roaringbitvec *b)
+{
+	return rbv_op_new(a, b, OP_AND);
+}
+
+
+roaringbitvec *roaringbitvec_or(roaringbitvec *a, roaringbitvec *b)
+{
+	return rbv_op_new(a, b, OP_OR);
+}
+
+
+roaringbitvec *roaringbitvec_xor(roaringbitvec *a, roaringbitvec *b)
+{
+	return rbv_op_new(a, b, OP_XOR);
+}
+
+
+roaringbitvec *roaringbitvec_andnot(roaringbitvec *a, roaringbitvec *b)
+{
+	return rbv_op_new(a, b, OP_ANDNOT);
+}
+
+
+size_t roaringbitvec_and_card(roaringbitvec *a, roaringbitvec *b)
+{
+	return rbv_op_card(a, b, OP_AND);
+}
+
+
+size_t roaringbitvec_or_card(roaringbitvec *a, roaringbitvec *b)
+{
+	return rbv_op_card(a, b, OP_OR);
+}
+
+
+size_t roaringbitvec_xor_card(roaringbitvec *a, roaringbitvec *b)
+{
+	return rbv_op_card(a, b, OP_XOR);
+}
+
+
+size_t roaringbitvec_andnot_card(roaringbitvec *a, roaringbitvec *b)
+{
+	return rbv_op_card(a, b, OP_ANDNOT);
+}
+
+
+void roaringbitvec_and_inplace(roaringbitvec *a, roaringbitvec *b)
+{
+	rbv_op_inplace(a, b, OP_AND);
+}
+
+
+void roaringbitvec_or_inplace(roaringbitvec *a, roaringbitvec *b)
+{
+	rbv_op_inplace(a, b, OP_OR);
+}
+
+
+void roaringbitvec_xor_inplace(roaringbitvec *a, roaringbitvec *b)
+{
+	rbv_op_inplace(a, b, OP_XOR);
+}
+
+
+void roaringbitvec_andnot_inplace(roaringbitvec *a, roaringbitvec *b)
+{
+	rbv_op_inplace(a, b, OP_ANDNOT);
+}
+
+
+struct _roaringbitvec_iter {
+	iter _t_iter;
+	roaringbitvec *src;
+	size_t next;
+	size_t cur;
+};
+
+
+// first position >= pos set to 1, or the length
+static size_t rbv_next(roaringbitvec *self, size_t pos)
+{
+	for (size_t k = key_lb(self, MSB(pos)); k < self->nctnrs; k++) {
+		size_t bucket = self->keys[k];
+		uint32_t index = (bucket == MSB(pos)) ? LSB(pos) : 0;
+		if (self->ctnrs[k].card > 0) {
+			uint32_t next = ctnr_next(self->ctnrs + k, index);
+			if (next < CTNR_SIZE) {
+				return (bucket * CTNR_SIZE) + next;
+			}
+		}
+	}
+	return self->len;
+}
+
+
+static bool _roaringbitvec_iter_has_next(iter *it)
+{
+	roaringbitvec_iter *rit = (roaringbitvec_iter *)it->impltor;
+	return rit->next < rit->src->len;
+}
+
+
+static const void *_roaringbitvec_iter_next(iter *it)
+{
+	roaringbitvec_iter *rit = (roaringbitvec_iter *)it->impltor;
+	rit->cur = rit->next;
+	rit->next = rbv_next(rit->src, rit->cur + 1);
+	return &rit->cur;
+}
+
+
+static iter_vt _roaringbitvec_iter_vt = {_roaringbitvec_iter_has_next, _roaringbitvec_iter_next};
+
+
+roaringbitvec_iter *roaringbitvec_get_iter(roaringbitvec *self)
+{
+	roaringbitvec_iter *ret = NEW(roaringbitvec_iter);
+	ret->_t_iter.impltor = ret;
+	ret->_t_iter.vt = &_roaringbitvec_iter_vt;
+	ret->src = self;
+	ret->cur = 0;
+	ret->next = rbv_next(self, 0);
+	return ret;
+}
+
+IMPL_TRAIT(roaringbitvec_iter, iter)
+
+
+/*
+ * Portable serialisation
+ * (https://github.com/RoaringBitmap/RoaringFormatSpec)
+ */
+
+#define SERIAL_COOKIE_NO_RUNCONTAINER 12346
+#define SERIAL_COOKIE 12347
+#define NO_OFFSET_THRESHOLD 4
+
+
+static bool host_is_le()
+{
+	const uint16_t one = 1;
+	return *(const byte_t *)&one == 1;
+}
+
+
+static inline uint16_t get_u16(const byte_t *p)
+{
+	return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+
+static inline uint32_t get_u32(const byte_t *p)
+{
+	return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+
+static inline uint64_t get_u64(const byte_t *p)
+{
+	return (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+
+static inline void put_u16(FILE *stream, uint16_t v)
+{
+	byte_t b[2] = {v & 0xFF, v >> 8};
+	fwrite(b, 1, 2, stream);
+}
+
+
+static inline void put_u32(FILE *stream, uint32_t v)
+{
+	put_u16(stream, v & 0xFFFF);
+	put_u16(stream, v >> 16);
+}
+
+
+static inline void put_u64(FILE *stream, uint64_t v)
+{
+	put_u32(stream, v & 0xFFFFFFFF);
+	put_u32(stream, v >> 32);
+}
+
+
+// the format infers the type of non-run containers from their cardinality
+static ctnr_type serial_type(const ctnr_t *ctnr)
+{
+	if (ctnr->type == RUN_TYPE) {
+		return RUN_TYPE;
+	}
+	return (ctnr->card <= MAX_ARRAY_SIZE) ? ARRAY_TYPE : BITVEC_TYPE;
+}
+
+
+static size_t serial_ctnr_size(const ctnr_t *ctnr)
+{
+	switch (serial_type(ctnr)) {
+	case ARRAY_TYPE:
+		return ctnr->card * sizeof(uint16_t);
+	case BITVEC_TYPE:
+		return BITVEC_BYTES;
+	default:
+		return sizeof(uint16_t) + ctnr->size * sizeof(rle_run);
+	}
+}
+
+
+// number of nonempty containers and whether any is a run container
+static size_t serial_nctnrs(roaringbitvec *self, bool *hasrun)
+{
+	size_t n = 0;
+	*hasrun = false;
+	for (size_t i = 0; i < self->nctnrs; i++) {
+		n += (self->ctnrs[i].card > 0);
+		*hasrun |= (self->ctnrs[i].card > 0 && self->ctnrs[i].type == RUN_TYPE);
+	}
+	return n;
+}
+
+
+static size_t serial_header_size(size_t n, bool hasrun)
+{
+	size_t ret = hasrun ? sizeof(uint32_t) + (size_t)DIVCEIL(n, BYTESIZE)
+	             : 2 * sizeof(uint32_t);
+	ret += n * 2 * sizeof(uint16_t);
+	if (!hasrun || n >= NO_OFFSET_THRESHOLD) {
+		ret += n * sizeof(uint32_t);
+	}
+	return ret;
+}
+
+
+size_t roaringbitvec_serialised_size(roaringbitvec *self)
+{
+	bool hasrun;
+	size_t n = serial_nctnrs(self, &hasrun);
+	size_t ret = serial_header_size(n, hasrun);
+	for (size_t i = 0; i < self->nctnrs; i++) {
+		if (self->ctnrs[i].card > 0) {
+			ret += serial_ctnr_size(self->ctnrs + i);
+		}
+	}
+	return ret;
+}
+
+
+static void write_ctnr(FILE *stream, const ctnr_t *ctnr, bool le)
+{
+	switch (serial_type(ctnr)) {
+	case ARRAY_TYPE:
+		if (ctnr->type == ARRAY_TYPE && le) {
+			fwrite(ctnr->data, sizeof(uint16_t), ctnr->size, stream);
+		}
+		else {
+			for (uint32_t v = ctnr_next(ctnr, 0); v < CTNR_SIZE; v = ctnr_next(ctnr, v + 1)) {
+				put_u16(stream, v);
+			}
+		}
+		break;
+	case BITVEC_TYPE: {
+		uint64_t words[BITVEC_WORDS];
+		ctnr_to_words(ctnr, words);
+		if (le) {
+			fwrite(words, sizeof(uint64_t), BITVEC_WORDS, stream);
+		}
+		else {
+			for (size_t w = 0; w < BITVEC_WORDS; w++) {
+				put_u64(stream, words[w]);
+			}
+		}
+		break;
+	}
+	case RUN_TYPE: {
+		put_u16(stream, ctnr->size);
+		const rle_run *runs = ctnr->data;
+		if (le) {
+			fwrite(runs, sizeof(rle_run), ctnr->size, stream);
+		}
+		else {
+			for (uint32_t k = 0; k < ctnr->size; k++) {
+				put_u16(stream, runs[k].start);
+				put_u16(stream, runs[k].len);
+			}
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+
+size_t roaringbitvec_write(roaringbitvec *self, FILE *stream)
+{
+	bool le = host_is_le(), hasrun;
+	size_t n = serial_nctnrs(self, &hasrun);
+	if (hasrun) {
+		put_u32(stream, SERIAL_COOKIE | ((uint32_t)(n - 1) << 16));
+		byte_t flags[(CTNR_SIZE / BYTESIZE) + 1];
+		memset(flags, 0, (size_t)DIVCEIL(n, BYTESIZE));
+		for (size_t i = 0, k = 0; i < self->nctnrs; i++) {
+			if (self->ctnrs[i].card > 0) {
+				flags[k / 8] |= (self->ctnrs[i].type == RUN_TYPE) << (k % 8);
+				k++;
+			}
+		}
+		fwrite(flags, 1, (size_t)DIVCEIL(n, BYTESIZE), stream);
+	}
+	else {
+		put_u32(stream, SERIAL_COOKIE_NO_RUNCONTAINER);
+		put_u32(stream, n);
+	}
+	for (size_t i = 0; i < self->nctnrs; i++) {
+		if (self->ctnrs[i].card > 0) {
+			put_u16(stream, self->keys[i]);
+			put_u16(stream, self->ctnrs[i].card - 1);
+		}
+	}
+	size_t offset = serial_header_size(n, hasrun);
+	if (!hasrun || n >= NO_OFFSET_THRESHOLD) {
+		for (size_t i = 0; i < self->nctnrs; i++) {
+			if (self->ctnrs[i].card > 0) {
+				put_u32(stream, offset);
+				offset += serial_ctnr_size(self->ctnrs + i);
+			}
+		}
+	}
+	for (size_t i = 0; i < self->nctnrs; i++) {
+		if (self->ctnrs[i].card > 0) {
+			write_ctnr(stream, self->ctnrs + i, le);
+		}
+	}
+	if (ferror(stream)) {
+		WARN("Error writing roaring bitvector.\n");
+		return 0;
+	}
+	return roaringbitvec_serialised_size(self);
+}
+
+
+/*
+ * Checks that loaded container data is consistent with its cardinality
+ * and type invariants, and that its largest position is below maxpos.
+ */
+static bool ctnr_valid(const ctnr_t *ctnr, uint32_t maxpos)
+{
+	uint32_t card = 0, last = 0;
+	switch (ctnr->type) {
+	case ARRAY_TYPE: {
+		const uint16_t *vals = ctnr->data;
+		for (uint32_t i = 1; i < ctnr->size; i++) {
+			if (vals[i] <= vals[i - 1]) {
+				return false;
+			}
+		}
+		card = ctnr->size;
+		last = vals[ctnr->size - 1];
+		break;
+	}
+	case BITVEC_TYPE: {
+		const uint64_t *words = ctnr->data;
+		card = words_card(words);
+		for (size_t w = BITVEC_WORDS; w > 0; w--) {
+			if (words[w - 1]) {
+				last = ((w - 1) * 64) + uint64_hibit(words[w - 1]);
+				break;
+			}
+		}
+		if (card <= MAX_ARRAY_SIZE) {
+			return false;
+		}
+		break;
+	}
+	default: {
+		const rle_run *runs = ctnr->data;
+		if (ctnr->size == 0 || ctnr->size > MAX_RUNS) {
+			return false;
+		}
+		for (uint32_t k = 0; k < ctnr->size; k++) {
+			if (RUN_END(runs[k]) >= CTNR_SIZE
+			        || (k > 0 && runs[k].start <= RUN_END(runs[k - 1]) + 1)) {
+				return false;
+			}
+			card += (uint32_t)runs[k].len + 1;
+		}
+		last = RUN_END(runs[ctnr->size - 1]);
+		break;
+	}
+	}
+	return card == ctnr->card && last <= maxpos;
+}
+
+
+/*
+ * Points the container to its serialised data when the host byte order
+ * and the data alignment allow it, or decodes a private copy otherwise.
+ * Returns false, releasing any copy, if the data is invalid.
+ */
+static bool load_ctnr(ctnr_t *ctnr, const byte_t *src, bool le,
+                      uint32_t maxpos)
+{
+	size_t typesize = ctnr_typesize(ctnr->type);
+	// alignment of the element fields (uint16_t for runs)
+	size_t align = (ctnr->type == BITVEC_TYPE) ? sizeof(uint64_t) : sizeof(uint16_t);
+	if (le && ((uintptr_t)src % align) == 0) {
+		ctnr->data = (void *)src;
+		ctnr->cap = 0;
+		return ctnr_valid(ctnr, maxpos);
+	}
+	ctnr->data = malloc(ctnr->size * typesize);
+	ctnr->cap = ctnr->size;
+	for (size_t i = 0; i < ctnr->size; i++) {
+		switch (ctnr->type) {
+		case ARRAY_TYPE:
+			((uint16_t *)ctnr->data)[i] = get_u16(src + (i * typesize));
+			break;
+		case BITVEC_TYPE:
+			((uint64_t *)ctnr->data)[i] = get_u64(src + (i * typesize));
+			break;
+		default:
+			((rle_run *)ctnr->data)[i] = (rle_run) {
+				.start = get_u16(src + (i * typesize)),
+				.len = get_u16(src + (i * typesize) + 2)
+			};
+			break;
+		}
+	}
+	if (!ctnr_valid(ctnr, maxpos)) {
+		FREE(ctnr->data);
+		return false;
+	}
+	return true;
+}
+
+
+roaringbitvec *roaringbitvec_new_from_buffer(const void *buf, size_t size,
+        size_t length)
+{
+	const byte_t *b = buf;
+	size_t off = 0, n = 0;
+	bool hasrun = false;
+	const byte_t *runflags = NULL, *desc = NULL, *offsets = NULL;
+	roaringbitvec *ret = NULL;
+
+#define NEED(NBYTES) if (off + (NBYTES) > size) goto truncated;
+
+	NEED(sizeof(uint32_t));
+	uint32_t cookie = get_u32(b);
+	off += sizeof(uint32_t);
+	if ((cookie & 0xFFFF) == SERIAL_COOKIE) {
+		hasrun = true;
+		n = (cookie >> 16) + 1;
+		NEED((size_t)DIVCEIL(n, BYTESIZE));
+		runflags = b + off;
+		off += (size_t)DIVCEIL(n, BYTESIZE);
+	}
+	else if (cookie == SERIAL_COOKIE_NO_RUNCONTAINER) {
+		NEED(sizeof(uint32_t));
+		n = get_u32(b + off);
+		off += sizeof(uint32_t);
+		if (n > CTNR_SIZE) {
+			WARN("Invalid roaring bitvector: %zu containers.\n", n);
+			return NULL;
+		}
+	}
+	else {
+		WARN("Invalid roaring bitvector cookie %"PRIu32".\n", cookie);
+		return NULL;
+	}
+	NEED(n * 2 * sizeof(uint16_t));
+	desc = b + off;
+	off += n * 2 * sizeof(uint16_t);
+	if (!hasrun || n >= NO_OFFSET_THRESHOLD) {
+		NEED(n * sizeof(uint32_t));
+		offsets = b + off;
+		off += n * sizeof(uint32_t);
+	}
+
+	bool le = host_is_le();
+	ret = roaringbitvec_new(length);
+	reserve(ret, n);
+	for (size_t i = 0; i < n; i++) {
+		size_t key = get_u16(desc + (4 * i));
+		uint32_t card = (uint32_t)get_u16(desc + (4 * i) + 2) + 1;
+		if ((i > 0 && key <= ret->keys[i - 1]) || key * CTNR_SIZE >= length) {
+			WARN("Invalid roaring bitvector: container key %zu.\n", key);
+			roaringbitvec_free(ret);
+			return NULL;
+		}
+		if (offsets) {
+			off = get_u32(offsets + (4 * i));
+		}
+		ctnr_t ctnr = {.card = card};
+		if (hasrun && (runflags[i / 8] >> (i % 8)) & 1) {
+			NEED(sizeof(uint16_t));
+			ctnr.type = RUN_TYPE;
+			ctnr.size = get_u16(b + off);
+			off += sizeof(uint16_t);
+		}
+		else if (card <= MAX_ARRAY_SIZE) {
+			ctnr.type = ARRAY_TYPE;
+			ctnr.size = card;
+		}
+		else {
+			ctnr.type = BITVEC_TYPE;
+			ctnr.size = BITVEC_WORDS;
+		}
+		NEED(ctnr.size * ctnr_typesize(ctnr.type));
+		uint32_t maxpos = MIN(CTNR_SIZE, length - (key * CTNR_SIZE)) - 1;
+		if (!load_ctnr(&ctnr, b + off, le, maxpos)) {
+			WARN("Invalid roaring bitvector: container %zu.\n", key);
+			roaringbitvec_free(ret);
+			return NULL;
+		}
+		off += ctnr.size * ctnr_typesize(ctnr.type);
+		push_ctnr(ret, key, &ctnr);
+	}
+	return ret;
+
+truncated:
+	WARN("Truncated roaring bitvector.\n");
+	if (ret) {
+		roaringbitvec_free(ret);
+	}
+	return NULL;
+
+#undef NEED
+}
+
+
+roaringbitvec *roaringbitvec_open_mmap(const char *path, size_t length)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		WARN("Unable to open roaring bitvector file %s.\n", path);
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		WARN("Unable to read roaring bitvector file %s.\n", path);
+		close(fd);
+		return NULL;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		WARN("Unable to map roaring bitvector file %s.\n", path);
+		return NULL;
+	}
+	roaringbitvec *ret = roaringbitvec_new_from_buffer(map, st.st_size, length);
+	if (!ret) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	ret->map = map;
+	ret->map_size = st.st_size;
+	return ret;
 }
 
 
 void roaringbitvec_fprint(FILE *stream, roaringbitvec *self)
 {
-	char *types[3] = {"EMPTY", "ARRAY", "BITVEC"};
+	char *types[4] = {"EMPTY", "ARRAY", "BITVEC", "RUN"};
 	fprintf(stream, "roaringbitvec@%p {\n", self);
 	fprintf(stream, "   size=%zu\n", self->len);
-	for (size_t b = 0; b < self->ncntrs; b++) {
-		fprintf(stream, "   [%zu] type=%s card=%"PRIu32"\n", b, 
-                types[self->ctnrs[b].type],
-		        self->ctnrs[b].card);
+	for (size_t i = 0; i < self->nctnrs; i++) {
+		fprintf(stream, "   [%"PRIu16"] type=%s card=%"PRIu32"\n", self->keys[i],
+		        types[self->ctnrs[i].type],
+		        self->ctnrs[i].card);
 	}
 	fprintf(stream, "}\n");
 }
@@ -27,12 +27,26 @@
 #include <stdio.h>
 
 #include "coretype.h"
+#include "iter.h"
 
 /**
  * @file roaring.h
  * @brief Roaring bitvector
  * @author Paulo Fonseca
+ *
+ * The positions are split into chunks of 2^16 bits, each kept in a
+ * container of one of three kinds: a sorted array of positions (sparse
+ * chunks), a plain bitmap (dense chunks) or a list of runs of
+ * consecutive set positions (clustered chunks). Run containers are
+ * created by bulk construction, by roaringbitvec_run_optimize() and by
+ * set operations involving run containers.
+ */
+
+/**
+ * @brief Maximum length of a roaring bitvector (2^32).
  */
+#define ROARINGBITVEC_MAX_LEN ((size_t)1 << 32)
+
 
 /**
  * @brief Roaring bitvector opaque type
@@ -40,17 +54,27 @@
 typedef struct _roaringbitvec roaringbitvec;
 
 /**
- * @brief Constructs a new roaring bitvector with a given @p length, 
- * with all bits initially set to 0.
+ * @brief Constructs a new roaring bitvector with a given @p length
+ * (at most ::ROARINGBITVEC_MAX_LEN), with all bits initially set to 0.
  */
-roaringbitvec *roaringbitvec_new(uint32_t length);
+roaringbitvec *roaringbitvec_new(size_t length);
 
 
 /**
  * @brief Constructs a new roaring bitvector from a raw bitarray 
  * @p src, with given @p length.
  */
-roaringbitvec *roaringbitvec_new_from_bitarr(byte_t *src, uint32_t length);
+roaringbitvec *roaringbitvec_new_from_bitarr(byte_t *src, size_t length);
+
+
+/**
+ * @brief Constructs a new roaring bitvector with a given @p length
+ * from the @p n positions in @p pos, given in nondecreasing order,
+ * which are set to 1. Each container receives the most compact of
+ * its three possible representations.
+ */
+roaringbitvec *roaringbitvec_new_from_sorted(const uint32_t *pos, size_t n,
+        size_t length);
 
 
 /**
@@ -71,6 +95,12 @@ size_t roaringbitvec_len(roaringbitvec *self);
 size_t roaringbitvec_count(roaringbitvec *self, bool bit);
 
 
+/**
+ * @brief Same as roaringbitvec_count(self, 1).
+ */
+size_t roaringbitvec_card(roaringbitvec *self);
+
+
 /**
  * @brief Returns the physical size of the roaring bitvector in bytes.
  */
@@ -85,6 +115,15 @@ size_t roaringbitvec_memsize(roaringbitvec *self);
 void roaringbitvec_fit(roaringbitvec *self);
 
 
+/**
+ * @brief Converts every container to run-length encoding when this is
+ * its most compact representation, and run containers back to arrays or
+ * bitmaps when it is not.
+ * @return true if some run container remains after the operation.
+ */
+bool roaringbitvec_run_optimize(roaringbitvec *self);
+
+
 /**
  * @brief Sets the bit at position @p pos to a given boolean value @p val.
  */
@@ -143,6 +182,152 @@ size_t roaringbitvec_select1(roaringbitvec *self, size_t rank);
 size_t roaringbitvec_select(roaringbitvec *self, bool bit, size_t rank);
 
 
+/**
+ * @brief Returns a new bitvector with the intersection @p a AND @p b.
+ * The result has length max(len(@p a), len(@p b)).
+ */
+roaringbitvec *roaringbitvec_and(roaringbitvec *a, roaringbitvec *b);
+
+
+/**
+ * @brief Returns a new bitvector with the union @p a OR @p b.
+ * The result has length max(len(@p a), len(@p b)).
+ */
+roaringbitvec *roaringbitvec_or(roaringbitvec *a, roaringbitvec *b);
+
+
+/**
+ * @brief Returns a new bitvector with the symmetric difference
+ * @p a XOR @p b.
+ * The result has length max(len(@p a), len(@p b)).
+ */
+roaringbitvec *roaringbitvec_xor(roaringbitvec *a, roaringbitvec *b);
+
+
+/**
+ * @brief Returns a new bitvector with the difference @p a AND NOT @p b.
+ * The result has the length of @p a.
+ */
+roaringbitvec *roaringbitvec_andnot(roaringbitvec *a, roaringbitvec *b);
+
+
+/**
+ * @brief Returns the cardinality of @p a AND @p b without
+ * materialising the result.
+ */
+size_t roaringbitvec_and_card(roaringbitvec *a, roaringbitvec *b);
+
+
+/**
+ * @brief Returns the cardinality of @p a OR @p b without
+ * materialising the result.
+ */
+size_t roaringbitvec_or_card(roaringbitvec *a, roaringbitvec *b);
+
+
+/**
+ * @brief Returns the cardinality of @p a XOR @p b without
+ * materialising the result.
+ */
+size_t roaringbitvec_xor_card(roaringbitvec *a, roaringbitvec *b);
+
+
+/**
+ * @brief Returns the cardinality of @p a AND NOT @p b without
+ * materialising the result.
+ */
+size_t roaringbitvec_andnot_card(roaringbitvec *a, roaringbitvec *b);
+
+
+/**
+ * @brief In-place intersection `a = a AND b`.
+ * The length of @p a is extended to that of @p b if needed.
+ */
+void roaringbitvec_and_inplace(roaringbitvec *a, roaringbitvec *b);
+
+
+/**
+ * @brief In-place union `a = a OR b`.
+ * The length of @p a is extended to that of @p b if needed.
+ */
+void roaringbitvec_or_inplace(roaringbitvec *a, roaringbitvec *b);
+
+
+/**
+ * @brief In-place symmetric difference `a = a XOR b`.
+ * The length of @p a is extended to that of @p b if needed.
+ */
+void roaringbitvec_xor_inplace(roaringbitvec *a, roaringbitvec *b);
+
+
+/**
+ * @brief In-place difference `a = a AND NOT b`.
+ */
+void roaringbitvec_andnot_inplace(roaringbitvec *a, roaringbitvec *b);
+
+
+/**
+ * @brief Iterator over the positions set to 1, in increasing order.
+ * Implements the iter trait, with ::iter_next returning a pointer to
+ * a `size_t` position. The bitvector must not be modified while
+ * being iterated.
+ */
+typedef struct _roaringbitvec_iter roaringbitvec_iter;
+
+
+/**
+ * @brief Returns a new iterator over the 1 positions of @p self.
+ * The iterator should be disposed of with FREE.
+ */
+roaringbitvec_iter *roaringbitvec_get_iter(roaringbitvec *self);
+
+
+DECL_TRAIT(roaringbitvec_iter, iter)
+
+
+/**
+ * @brief Returns the size in bytes of the serialised form of @p self.
+ * @see roaringbitvec_write()
+ */
+size_t roaringbitvec_serialised_size(roaringbitvec *self);
+
+
+/**
+ * @brief Writes @p self to a binary @p stream in the portable Roaring
+ * format (https://github.com/RoaringBitmap/RoaringFormatSpec), which
+ * other Roaring implementations can read. The length of the bitvector
+ * is not part of the format.
+ * @return The number of bytes written, or 0 on error.
+ */
+size_t roaringbitvec_write(roaringbitvec *self, FILE *stream);
+
+
+/**
+ * @brief Builds a roaring bitvector with a given @p length from a
+ * buffer @p buf of @p size bytes holding its portable serialised form.
+ * The containers are used in place, without copying, whenever the
+ * host is little-endian and their data is suitably aligned (bitmap
+ * containers need 8-byte alignment), and are copied otherwise, or when
+ * first modified. The buffer must outlive the returned bitvector.
+ * @return The bitvector, or NULL if the buffer is invalid.
+ * @see roaringbitvec_write()
+ */
+roaringbitvec *roaringbitvec_new_from_buffer(const void *buf, size_t size,
+        size_t length);
+
+
+/**
+ * @brief Opens a roaring bitvector with a given @p length from a file
+ * in the portable Roaring format, mapping it into memory.
+ * Containers are read in place from the mapping as in
+ * roaringbitvec_new_from_buffer(), so that pages of the file are only
+ * loaded when the corresponding containers are accessed.
+ * The mapping is released by roaringbitvec_free().
+ * @return The bitvector, or NULL if the file cannot be mapped or is invalid.
+ */
+roaringbitvec *roaringbitvec_open_mmap(const char *path, size_t length);
+
+
 /**
  * @brief Prints a text representation of the bitvector to
  * the output @p stream. 
@@ -0,0 +1,417 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "errlog.h"
+#include "iter.h"
+#include "mathutil.h"
+#include "memdbg.h"
+#include "new.h"
+#include "roaring.h"
+#include "roaring64.h"
+
+
+#define HI(u64_) ((uint32_t)((u64_) >> 32))
+#define LO(u64_) ((u64_) & 0xFFFFFFFF)
+#define CHUNK_SIZE ((uint64_t)1 << 32)
+
+
+/*
+ * The chunk of key keys[i] is stored in bvs[i].
+ * cum[i] holds the total count of 1s in bvs[0..i) and is recomputed
+ * lazily after updates.
+ */
+struct _roaring64bitvec {
+	uint64_t len;
+	size_t nkeys;
+	size_t cap;
+	uint32_t *keys;
+	roaringbitvec **bvs;
+	uint64_t *cum;
+	bool dirty;
+};
+
+
+roaring64bitvec *roaring64bitvec_new(uint64_t length)
+{
+	roaring64bitvec *ret = NEW(roaring64bitvec);
+	ret->len = length;
+	ret->nkeys = 0;
+	ret->cap = 0;
+	ret->keys = NULL;
+	ret->bvs = NULL;
+	ret->cum = calloc(1, sizeof(uint64_t));
+	ret->dirty = false;
+	return ret;
+}
+
+
+// the length of the chunk with a given key
+static size_t chunk_len(roaring64bitvec *self, uint32_t key)
+{
+	return (size_t)MIN(CHUNK_SIZE, self->len - ((uint64_t)key << 32));
+}
+
+
+static void reserve(roaring64bitvec *self, size_t cap)
+{
+	if (cap > self->cap) {
+		cap = MAX(cap, 2 * self->cap);
+		self->keys = realloc(self->keys, cap * sizeof(uint32_t));
+		self->bvs = realloc(self->bvs, cap * sizeof(roaringbitvec *));
+		self->cum = realloc(self->cum, (cap + 1) * sizeof(uint64_t));
+		self->cap = cap;
+	}
+}
+
+
+roaring64bitvec *roaring64bitvec_new_from_sorted(const uint64_t *pos, size_t n,
+        uint64_t length)
+{
+	roaring64bitvec *ret = roaring64bitvec_new(length);
+	uint32_t *lo = NULL;
+	size_t lo_cap = 0;
+	for (size_t i = 0; i < n; ) {
+		WARN_ASSERT(pos[i] < length, "Position %"PRIu64" out of range.", pos[i]);
+		uint32_t key = HI(pos[i]);
+		size_t j = i;
+		while (j < n && HI(pos[j]) == key) {
+			j++;
+		}
+		if (j - i > lo_cap) {
+			lo_cap = j - i;
+			lo = realloc(lo, lo_cap * sizeof(uint32_t));
+		}
+		for (size_t k = i; k < j; k++) {
+			lo[k - i] = LO(pos[k]);
+		}
+		reserve(ret, ret->nkeys + 1);
+		ret->keys[ret->nkeys] = key;
+		ret->bvs[ret->nkeys] = roaringbitvec_new_from_sorted(lo, j - i,
+		                       chunk_len(ret, key));
+		ret->nkeys++;
+		i = j;
+	}
+	FREE(lo);
+	ret->dirty = true;
+	return ret;
+}
+
+
+void roaring64bitvec_free(roaring64bitvec *self)
+{
+	for (size_t i = 0; i < self->nkeys; i++) {
+		roaringbitvec_free(self->bvs[i]);
+	}
+	FREE(self->keys);
+	FREE(self->bvs);
+	FREE(self->cum);
+	FREE(self);
+}
+
+
+uint64_t roaring64bitvec_len(roaring64bitvec *self)
+{
+	return self->len;
+}
+
+
+static void update_cum(roaring64bitvec *self)
+{
+	if (!self->dirty) {
+		return;
+	}
+	self->cum[0] = 0;
+	for (size_t i = 0; i < self->nkeys; i++) {
+		self->cum[i + 1] = self->cum[i] + roaringbitvec_card(self->bvs[i]);
+	}
+	self->dirty = false;
+}
+
+
+uint64_t roaring64bitvec_card(roaring64bitvec *self)
+{
+	update_cum(self);
+	return self->cum[self->nkeys];
+}
+
+
+uint64_t roaring64bitvec_count(roaring64bitvec *self, bool bit)
+{
+	return bit ? roaring64bitvec_card(self) : self->len - roaring64bitvec_card(self);
+}
+
+
+size_t roaring64bitvec_memsize(roaring64bitvec *self)
+{
+	size_t ret = sizeof(struct _roaring64bitvec);
+	ret += self->cap * (sizeof(uint32_t) + sizeof(roaringbitvec *) + sizeof(uint64_t));
+	ret += sizeof(uint64_t);
+	for (size_t i = 0; i < self->nkeys; i++) {
+		ret += roaringbitvec_memsize(self->bvs[i]);
+	}
+	return ret;
+}
+
+
+void roaring64bitvec_fit(roaring64bitvec *self)
+{
+	if (self->cap > self->nkeys) {
+		self->keys = realloc(self->keys, self->nkeys * sizeof(uint32_t));
+		self->bvs = realloc(self->bvs, self->nkeys * sizeof(roaringbitvec *));
+		self->cum = realloc(self->cum, (self->nkeys + 1) * sizeof(uint64_t));
+		self->cap = self->nkeys;
+	}
+	for (size_t i = 0; i < self->nkeys; i++) {
+		roaringbitvec_fit(self->bvs[i]);
+	}
+}
+
+
+bool roaring64bitvec_run_optimize(roaring64bitvec *self)
+{
+	bool ret = false;
+	for (size_t i = 0; i < self->nkeys; i++) {
+		ret |= roaringbitvec_run_optimize(self->bvs[i]);
+	}
+	return ret;
+}
+
+
+// index of the first key >= key
+static size_t key_lb(roaring64bitvec *self, uint32_t key)
+{
+	size_t l = 0, r = self->nkeys;
+	while (l < r) {
+		size_t m = MEAN(l, r);
+		if (self->keys[m] < key) {
+			l = m + 1;
+		}
+		else {
+			r = m;
+		}
+	}
+	return l;
+}
+
+
+void roaring64bitvec_set(roaring64bitvec *self, uint64_t pos, bool val)
+{
+	assert(pos < self->len);
+	uint32_t key = HI(pos);
+	size_t lo = LO(pos);
+	size_t k = key_lb(self, key);
+	if (k == self->nkeys || self->keys[k] != key) {
+		if (!val) {
+			return;
+		}
+		reserve(self, self->nkeys + 1);
+		memmove(self->keys + k + 1, self->keys + k,
+		        (self->nkeys - k) * sizeof(uint32_t));
+		memmove(self->bvs + k + 1, self->bvs + k,
+		        (self->nkeys - k) * sizeof(roaringbitvec *));
+		self->keys[k] = key;
+		self->bvs[k] = roaringbitvec_new(chunk_len(self, key));
+		self->nkeys++;
+	}
+	roaringbitvec_set(self->bvs[k], lo, val);
+	self->dirty = true;
+}
+
+
+bool roaring64bitvec_get(roaring64bitvec *self, uint64_t pos)
+{
+	assert(pos < self->len);
+	uint32_t key = HI(pos);
+	size_t k = key_lb(self, key);
+	if (k == self->nkeys || self->keys[k] != key) {
+		return 0;
+	}
+	return roaringbitvec_get(self->bvs[k], LO(pos));
+}
+
+
+uint64_t roaring64bitvec_rank1(roaring64bitvec *self, uint64_t pos)
+{
+	update_cum(self);
+	pos = MIN(self->len, pos);
+	uint32_t key = HI(pos);
+	size_t k = key_lb(self, key);
+	uint64_t ret = self->cum[k];
+	if (k < self->nkeys && self->keys[k] == key) {
+		ret += roaringbitvec_rank1(self->bvs[k], LO(pos));
+	}
+	return ret;
+}
+
+
+uint64_t roaring64bitvec_rank0(roaring64bitvec *self, uint64_t pos)
+{
+	return MIN(self->len, pos) - roaring64bitvec_rank1(self, pos);
+}
+
+
+uint64_t roaring64bitvec_rank(roaring64bitvec *self, bool bit, uint64_t pos)
+{
+	return bit ? roaring64bitvec_rank1(self, pos) : roaring64bitvec_rank0(self, pos);
+}
+
+
+uint64_t roaring64bitvec_select1(roaring64bitvec *self, uint64_t rank)
+{
+	if (rank >= roaring64bitvec_card(self)) {
+		return self->len;
+	}
+	// last chunk k with cum[k] <= rank
+	size_t l = 0, r = self->nkeys;
+	while ((r - l) > 1) {
+		size_t m = MEAN(l, r);
+		if (self->cum[m] <= rank) {
+			l = m;
+		}
+		else {
+			r = m;
+		}
+	}
+	return ((uint64_t)self->keys[l] << 32)
+	       + roaringbitvec_select1(self->bvs[l], rank - self->cum[l]);
+}
+
+
+// zeros to the left of the chunk of keys[k]
+#define ZEROS_BEFORE(k) (((uint64_t)self->keys[(k)] << 32) - self->cum[(k)])
+
+uint64_t roaring64bitvec_select0(roaring64bitvec *self, uint64_t rank)
+{
+	if (rank >= roaring64bitvec_count(self, 0)) {
+		return self->len;
+	}
+	if (self->nkeys == 0 || rank < ZEROS_BEFORE(0)) {
+		return rank;
+	}
+	// last chunk k with ZEROS_BEFORE(k) <= rank
+	size_t l = 0, r = self->nkeys;
+	while ((r - l) > 1) {
+		size_t m = MEAN(l, r);
+		if (ZEROS_BEFORE(m) <= rank) {
+			l = m;
+		}
+		else {
+			r = m;
+		}
+	}
+	uint64_t base = (uint64_t)self->keys[l] << 32;
+	rank -= ZEROS_BEFORE(l);
+	size_t zeros = roaringbitvec_count(self->bvs[l], 0);
+	if (rank < zeros) {
+		return base + roaringbitvec_select0(self->bvs[l], rank);
+	}
+	// the gap up to the next chunk holds only 0s
+	return base + CHUNK_SIZE + (rank - zeros);
+}
+
+
+uint64_t roaring64bitvec_select(roaring64bitvec *self, bool bit, uint64_t rank)
+{
+	return bit ? roaring64bitvec_select1(self, rank) : roaring64bitvec_select0(self, rank);
+}
+
+
+struct _roaring64bitvec_iter {
+	iter _t_iter;
+	roaring64bitvec *src;
+	size_t key_index;
+	roaringbitvec_iter *inner;
+	uint64_t cur;
+};
+
+
+// moves the inner iterator to the next chunk with 1s, if any
+static void iter_advance_chunk(roaring64bitvec_iter *it)
+{
+	while (it->key_index < it->src->nkeys
+	        && !iter_has_next(roaringbitvec_iter_as_iter(it->inner))) {
+		FREE(it->inner);
+		it->inner = NULL;
+		if (++it->key_index < it->src->nkeys) {
+			it->inner = roaringbitvec_get_iter(it->src->bvs[it->key_index]);
+		}
+	}
+}
+
+
+static bool _roaring64bitvec_iter_has_next(iter *it)
+{
+	roaring64bitvec_iter *rit = (roaring64bitvec_iter *)it->impltor;
+	return rit->key_index < rit->src->nkeys;
+}
+
+
+static const void *_roaring64bitvec_iter_next(iter *it)
+{
+	roaring64bitvec_iter *rit = (roaring64bitvec_iter *)it->impltor;
+	size_t lo = *(size_t *)iter_next(roaringbitvec_iter_as_iter(rit->inner));
+	rit->cur = ((uint64_t)rit->src->keys[rit->key_index] << 32) + lo;
+	iter_advance_chunk(rit);
+	return &rit->cur;
+}
+
+
+static iter_vt _roaring64bitvec_iter_vt = {_roaring64bitvec_iter_has_next, _roaring64bitvec_iter_next};
+
+
+roaring64bitvec_iter *roaring64bitvec_get_iter(roaring64bitvec *self)
+{
+	roaring64bitvec_iter *ret = NEW(roaring64bitvec_iter);
+	ret->_t_iter.impltor = ret;
+	ret->_t_iter.vt = &_roaring64bitvec_iter_vt;
+	ret->src = self;
+	ret->key_index = 0;
+	ret->inner = (self->nkeys > 0) ? roaringbitvec_get_iter(self->bvs[0]) : NULL;
+	ret->cur = 0;
+	iter_advance_chunk(ret);
+	return ret;
+}
+
+
+void roaring64bitvec_iter_free(roaring64bitvec_iter *it)
+{
+	FREE(it->inner);
+	FREE(it);
+}
+
+IMPL_TRAIT(roaring64bitvec_iter, iter)
+
+
+void roaring64bitvec_fprint(FILE *stream, roaring64bitvec *self)
+{
+	fprintf(stream, "roaring64bitvec@%p {\n", self);
+	fprintf(stream, "   size=%"PRIu64"\n", self->len);
+	for (size_t i = 0; i < self->nkeys; i++) {
+		fprintf(stream, "   [%"PRIu32"] card=%zu\n", self->keys[i],
+		        roaringbitvec_card(self->bvs[i]));
+	}
+	fprintf(stream, "}\n");
+}
@@ -0,0 +1,199 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#ifndef ROARING64_H
+#define ROARING64_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "coretype.h"
+#include "iter.h"
+
+/**
+ * @file roaring64.h
+ * @brief 64-bit addressable roaring bitvector
+ * @author Paulo Fonseca
+ *
+ * Two-level structure: positions are split into a high 32-bit key
+ * and a low 32-bit offset. A sorted map from the keys in use to
+ * 32-bit roaring bitvectors holds the offsets. The 32-bit bitvectors
+ * are created on demand, and themselves only store their nonempty
+ * containers, so that memory is proportional to the populated part
+ * of the universe.
+ *
+ * @see roaring.h
+ */
+
+/**
+ * @brief 64-bit roaring bitvector opaque type
+ */
+typedef struct _roaring64bitvec roaring64bitvec;
+
+
+/**
+ * @brief Constructs a new 64-bit roaring bitvector with a given
+ * @p length, with all bits initially set to 0.
+ */
+roaring64bitvec *roaring64bitvec_new(uint64_t length);
+
+
+/**
+ * @brief Constructs a new 64-bit roaring bitvector with a given
+ * @p length from the @p n positions in @p pos, given in nondecreasing
+ * order, which are set to 1.
+ */
+roaring64bitvec *roaring64bitvec_new_from_sorted(const uint64_t *pos, size_t n,
+        uint64_t length);
+
+
+/**
+ * @brief Destructor
+ */
+void roaring64bitvec_free(roaring64bitvec *self);
+
+
+/**
+ * @brief Returns the length of the bitvector.
+ */
+uint64_t roaring64bitvec_len(roaring64bitvec *self);
+
+
+/**
+ * @brief Returns the number of positions with a given @p bit value.
+ */
+uint64_t roaring64bitvec_count(roaring64bitvec *self, bool bit);
+
+
+/**
+ * @brief Same as roaring64bitvec_count(self, 1).
+ */
+uint64_t roaring64bitvec_card(roaring64bitvec *self);
+
+
+/**
+ * @brief Returns the physical size of the bitvector in bytes.
+ */
+size_t roaring64bitvec_memsize(roaring64bitvec *self);
+
+
+/**
+ * @brief Discards unused memory.
+ * @see roaringbitvec_fit()
+ */
+void roaring64bitvec_fit(roaring64bitvec *self);
+
+
+/**
+ * @brief Converts containers to or from run-length encoding.
+ * @return true if some run container remains after the operation.
+ * @see roaringbitvec_run_optimize()
+ */
+bool roaring64bitvec_run_optimize(roaring64bitvec *self);
+
+
+/**
+ * @brief Sets the bit at position @p pos to a given boolean value @p val.
+ */
+void roaring64bitvec_set(roaring64bitvec *self, uint64_t pos, bool val);
+
+
+/**
+ * @brief Returns the value of the bit at position @p pos.
+ */
+bool roaring64bitvec_get(roaring64bitvec *self, uint64_t pos);
+
+
+/**
+ * @brief Same as roaring64bitvec_rank(self, 0, pos)
+ * @see roaring64bitvec_rank()
+ */
+uint64_t roaring64bitvec_rank0(roaring64bitvec *self, uint64_t pos);
+
+
+/**
+ * @brief Same as roaring64bitvec_rank(self, 1, pos)
+ * @see roaring64bitvec_rank()
+ */
+uint64_t roaring64bitvec_rank1(roaring64bitvec *self, uint64_t pos);
+
+
+/**
+ * @brief Returns the number of positions to the left of @p pos
+ * with value @p bit.
+ */
+uint64_t roaring64bitvec_rank(roaring64bitvec *self, bool bit, uint64_t pos);
+
+
+/**
+ * @brief Same as roaring64bitvec_select(self, 0, rank)
+ * @see roaring64bitvec_select()
+ */
+uint64_t roaring64bitvec_select0(roaring64bitvec *self, uint64_t rank);
+
+
+/**
+ * @brief Same as roaring64bitvec_select(self, 1, rank)
+ * @see roaring64bitvec_select()
+ */
+uint64_t roaring64bitvec_select1(roaring64bitvec *self, uint64_t rank);
+
+
+/**
+ * @brief Returns the position `j` with value @p bit such that there
+ * are exactly @p rank positions with that same value to the left
+ * of `j`. If no such position exists, the length of the bitvector
+ * is returned.
+ */
+uint64_t roaring64bitvec_select(roaring64bitvec *self, bool bit, uint64_t rank);
+
+
+/**
+ * @brief Iterator over the positions set to 1, in increasing order.
+ * Implements the iter trait, with ::iter_next returning a pointer to
+ * a `uint64_t` position. The bitvector must not be modified while
+ * being iterated.
+ */
+typedef struct _roaring64bitvec_iter roaring64bitvec_iter;
+
+
+/**
+ * @brief Returns a new iterator over the 1 positions of @p self.
+ */
+roaring64bitvec_iter *roaring64bitvec_get_iter(roaring64bitvec *self);
+
+
+/**
+ * @brief Destructor.
+ */
+void roaring64bitvec_iter_free(roaring64bitvec_iter *it);
+
+
+DECL_TRAIT(roaring64bitvec_iter, iter)
+
+
+/**
+ * @brief Prints a text representation of the bitvector to
+ * the output @p stream.
+ */
+void roaring64bitvec_fprint(FILE *stream, roaring64bitvec *self);
+
+#endif
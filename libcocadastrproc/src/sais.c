@@ -19,8 +19,11 @@
  *
  */
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "assert.h"
 #include "alphabet.h"
@@ -30,6 +33,8 @@
 #include "csarray.h"
 #include "cstrutil.h"
 #include "errlog.h"
+#include "mathutil.h"
+#include "sais.h"
 #include "strstream.h"
 
 
@@ -37,7 +42,108 @@ static const byte_t S = 0;
 static const byte_t L = 1;
 
 
-#define UNSET SIZE_MAX
+// Reduced-problem bucket sizes are kept in memory only when they
+// take little space compared to the string (or fit in the free part of
+// the SA). Otherwise they are recounted from the string when needed.
+#define CACHED_BKTS_MIN 256
+#define CACHED_BKTS_RATIO 16
+
+// Block sizes of the parallel induced sorting
+#define PAR_MIN_BLOCK 64
+#define PAR_MAX_BLOCK (1 << 16)
+
+// Size of the chunks in file I/O
+#define IO_CHUNK_BYTES (1 << 20)
+
+
+/*
+ * Packed array of fixed-width unsigned integers.
+ * The largest representable value is reserved to mark unset entries.
+ */
+typedef struct {
+	byte_t     *data;
+	sais_width  width;
+	size_t      unset;
+} intarr;
+
+
+static size_t width_max(sais_width width)
+{
+	switch (width) {
+	case SAIS_W32:
+		return UINT32_MAX;
+	case SAIS_W40:
+		return ((size_t)1 << 40) - 1;
+	default:
+		return SIZE_MAX;
+	}
+}
+
+
+static inline size_t intarr_get(const intarr *arr, size_t i)
+{
+	const byte_t *p;
+	switch (arr->width) {
+	case SAIS_W32:
+		return ((uint32_t *)arr->data)[i];
+	case SAIS_W40:
+		p = arr->data + (5 * i);
+		return (size_t)p[0] | ((size_t)p[1] << 8) | ((size_t)p[2] << 16)
+		       | ((size_t)p[3] << 24) | ((size_t)p[4] << 32);
+	default:
+		return ((size_t *)arr->data)[i];
+	}
+}
+
+
+static inline void intarr_set(intarr *arr, size_t i, size_t val)
+{
+	byte_t *p;
+	switch (arr->width) {
+	case SAIS_W32:
+		((uint32_t *)arr->data)[i] = (uint32_t)val;
+		break;
+	case SAIS_W40:
+		p = arr->data + (5 * i);
+		p[0] = (byte_t)val;
+		p[1] = (byte_t)(val >> 8);
+		p[2] = (byte_t)(val >> 16);
+		p[3] = (byte_t)(val >> 24);
+		p[4] = (byte_t)(val >> 32);
+		break;
+	default:
+		((size_t *)arr->data)[i] = val;
+		break;
+	}
+}
+
+
+static inline void intarr_fill(intarr *arr, size_t from, size_t to, size_t val)
+{
+	for (size_t i = from; i < to; i++) {
+		intarr_set(arr, i, val);
+	}
+}
+
+
+static intarr intarr_new(size_t len, sais_width width)
+{
+	intarr arr = {.data = ARR_NEW(byte_t, MAX(len, 1) * width),
+	              .width = width,
+	              .unset = width_max(width)
+	             };
+	return arr;
+}
+
+
+static intarr intarr_view(const intarr *arr, size_t from)
+{
+	intarr view = {.data = arr->data + (from * arr->width),
+	               .width = arr->width,
+	               .unset = arr->unset
+	              };
+	return view;
+}
 
 
 static inline llong cstr_char_at(void *str, size_t i)
@@ -50,45 +156,98 @@ static inline llong xstr_char_at(void *str, size_t i)
 	return (llong)xstr_get(str, i);
 }
 
-static inline llong size_t_char_at(void *str, size_t i)
+static inline llong intarr_char_at(void *str, size_t i)
 {
-	return (llong)(((size_t *)str)[i]);
+	return (llong)intarr_get((intarr *)str, i);
 }
 
 typedef llong (*char_at_fn)(void *, size_t);
 
 
-void build_sarr( void *str, size_t len, alphabet *ab, size_t *sarr,
-                 bool add_sentinel, char_at_fn char_at );
+/*
+ * State of one level of the recursion.
+ */
+typedef struct {
+	void       *str;
+	size_t      len;
+	size_t      n;            // len + add_sentinel
+	alphabet   *ab;
+	size_t      nbkts;        // ab_size + add_sentinel
+	bool        add_sentinel;
+	char_at_fn  char_at;
+	bitvec     *ls;
+	bitvec     *lms;
+	intarr      sa;
+	intarr      bkts;         // bucket sizes or data==NULL if recounted
+	intarr      offsets;
+	size_t      nthreads;
+} sais_ctx;
+
+
+static void build_sarr( void *str, size_t len, alphabet *ab, intarr *sa,
+                        bool add_sentinel, char_at_fn char_at,
+                        intarr *work, size_t work_len, size_t nthreads );
+
+
+static inline size_t bkt_of(sais_ctx *ctx, size_t i)
+{
+	return ab_rank(ctx->ab, ctx->char_at(ctx->str, i)) + ctx->add_sentinel;
+}
+
+
+static void count_bkts(sais_ctx *ctx, intarr *dest)
+{
+	intarr_fill(dest, 0, ctx->nbkts, 0);
+	for (size_t i = 0, b; i < ctx->len; i++) {
+		b = bkt_of(ctx, i);
+		intarr_set(dest, b, intarr_get(dest, b) + 1);
+	}
+	if (ctx->add_sentinel) {
+		intarr_set(dest, 0, 1);
+	}
+}
 
 
-static void get_bkt_start( size_t *bkts, size_t *dest, size_t l)
+static void get_bkt_start(sais_ctx *ctx, intarr *dest)
 {
-	for (size_t i = 0, sum = 0; i < l; i++) {
-		dest[i] = sum;
-		sum += bkts[i];
+	intarr *bkts = &ctx->bkts;
+	if (bkts->data == NULL) {
+		count_bkts(ctx, dest);
+		bkts = dest;
+	}
+	for (size_t i = 0, sum = 0, sz; i < ctx->nbkts; i++) {
+		sz = intarr_get(bkts, i);
+		intarr_set(dest, i, sum);
+		sum += sz;
 	}
 }
 
 
-static void get_bkt_end( size_t *bkts, size_t *dest, size_t l)
+static void get_bkt_end(sais_ctx *ctx, intarr *dest)
 {
-	for (size_t i = 0, sum = 0; i < l; i++) {
-		sum += bkts[i];
-		dest[i] = sum;
+	intarr *bkts = &ctx->bkts;
+	if (bkts->data == NULL) {
+		count_bkts(ctx, dest);
+		bkts = dest;
+	}
+	for (size_t i = 0, sum = 0; i < ctx->nbkts; i++) {
+		sum += intarr_get(bkts, i);
+		intarr_set(dest, i, sum);
 	}
 }
 
 
-static void init_LS( void *str, size_t len, alphabet *ab,
-                     bitvec *lsvec, bitvec *lmsvec, size_t *bkts,
-                     bool add_sentinel, char_at_fn char_at)
+static void init_LS(sais_ctx *ctx)
 {
+	void *str = ctx->str;
+	size_t len = ctx->len;
+	bitvec *lsvec = ctx->ls;
+	bitvec *lmsvec = ctx->lms;
 	size_t last = 0;
 	byte_t ls, lastls;
 	int cmp;
 	for (size_t i = 1; i < len; i++) {
-		cmp = ab_cmp(ab, char_at(str, i - 1), char_at(str, i));
+		cmp = ab_cmp(ctx->ab, ctx->char_at(str, i - 1), ctx->char_at(str, i));
 		if (cmp == 0) {
 			continue;
 		}
@@ -96,98 +255,298 @@ static void init_LS( void *str, size_t len, alphabet *ab,
 		bitvec_push_n(lsvec, i - last, ls);
 		bitvec_push(lmsvec, (last > 0 && ls == S && lastls == L));
 		bitvec_push_n(lmsvec, (i - last - 1), 0);
-		bkts[ab_rank(ab, char_at(str, i - 1)) + add_sentinel] += (i - last);
 		last = i;
 		lastls = ls;
 	}
-	if (add_sentinel) {
+	if (ctx->add_sentinel) {
 		// last run
 		bitvec_push_n(lsvec, len - last, L);
 		bitvec_push(lmsvec, (last > 0 && ls == S && lastls == L));
 		bitvec_push_n(lmsvec, (len - last - 1), 0);
-		bkts[ab_rank(ab, char_at(str, len - 1)) + add_sentinel] += (len - last);
 	}
 	// last run must be the sentinel
 	bitvec_push(lsvec, S);
 	bitvec_push(lmsvec, true);
-	bkts[0] = 1;
 }
 
 
-static void induce_L( void *str, alphabet *ab,
-                      size_t *sarr, bitvec *ls,
-                      size_t *bkts, size_t *offsets,
-                      bool add_sentinel, char_at_fn char_at)
+/*
+ * Puts suffix j of type `type` in the next free slot of its bucket b
+ * and returns the position of that slot.
+ */
+static inline size_t induce_put(sais_ctx *ctx, byte_t type, size_t j,
+                                size_t b)
+{
+	size_t p = intarr_get(&ctx->offsets, b);
+	if (type == L) {
+		intarr_set(&ctx->offsets, b, p + 1);
+	}
+	else {
+		intarr_set(&ctx->offsets, b, --p);
+	}
+	intarr_set(&ctx->sa, p, j);
+	return p;
+}
+
+
+/*
+ * Induces the suffix preceding the one at position i of the SA,
+ * if it has type `type`. Returns the position where it was put,
+ * or the unset value.
+ */
+static inline size_t induce_from(sais_ctx *ctx, byte_t type, size_t i)
 {
-	size_t l = ab_size(ab) + add_sentinel;
-	get_bkt_start(bkts, offsets, l);
-	size_t n = bitvec_len(ls);
-	for (size_t i = 0, j; i < n; i++) {
-		j = sarr[i];
-		if ( j != UNSET && j > 0 && bitvec_get_bit(ls, j - 1) == L ) {
-			j -= 1;
-			sarr[offsets[ab_rank(ab, char_at(str, j)) + add_sentinel]++] = j;
+	size_t j = intarr_get(&ctx->sa, i);
+	if ( j != ctx->sa.unset && j > 0 && bitvec_get_bit(ctx->ls, j - 1) == type ) {
+		j -= 1;
+		return induce_put(ctx, type, j, bkt_of(ctx, j));
+	}
+	return ctx->sa.unset;
+}
+
+
+typedef enum {
+	PF_EMPTY = 0,
+	PF_SKIP = 1,
+	PF_INDUCE = 2
+} prefetch_state;
+
+
+typedef struct {
+	sais_ctx          *ctx;
+	byte_t             type;
+	size_t             lo;
+	size_t             hi;
+	size_t            *pred;
+	size_t            *bkt;
+	byte_t            *state;
+	bool               done;
+	size_t             nthreads;  // threads that actually started, main included
+	pthread_mutex_t    start;     // held until the barrier is initialised
+	pthread_barrier_t  barrier;
+} induce_job;
+
+
+typedef struct {
+	induce_job *job;
+	size_t      tid;
+} induce_worker;
+
+
+static void induce_prefetch(induce_job *job, size_t tid)
+{
+	sais_ctx *ctx = job->ctx;
+	size_t blen = job->hi - job->lo;
+	size_t from = job->lo + ((blen * tid) / job->nthreads);
+	size_t to = job->lo + ((blen * (tid + 1)) / job->nthreads);
+	for (size_t i = from, j, k; i < to; i++) {
+		k = i - job->lo;
+		j = intarr_get(&ctx->sa, i);
+		if (j == ctx->sa.unset) {
+			job->state[k] = PF_EMPTY;
+		}
+		else if (j > 0 && bitvec_get_bit(ctx->ls, j - 1) == job->type) {
+			job->state[k] = PF_INDUCE;
+			job->pred[k] = j - 1;
+			job->bkt[k] = bkt_of(ctx, j - 1);
+		}
+		else {
+			job->state[k] = PF_SKIP;
+		}
+	}
+}
+
+
+static void *induce_worker_run(void *arg)
+{
+	induce_worker *worker = (induce_worker *)arg;
+	induce_job *job = worker->job;
+	pthread_mutex_lock(&job->start);
+	pthread_mutex_unlock(&job->start);
+	while (true) {
+		pthread_barrier_wait(&job->barrier);
+		if (job->done) {
+			break;
+		}
+		induce_prefetch(job, worker->tid);
+		pthread_barrier_wait(&job->barrier);
+	}
+	return NULL;
+}
+
+
+/*
+ * Applies the prefetched inductions of the current block in scan order.
+ * Slots of the block written meanwhile are marked empty, so that they
+ * are re-examined when the scan reaches them.
+ */
+static void induce_block(induce_job *job)
+{
+	sais_ctx *ctx = job->ctx;
+	size_t blen = job->hi - job->lo;
+	for (size_t t = 0, i, k, p; t < blen; t++) {
+		k = (job->type == L) ? t : (blen - 1 - t);
+		i = job->lo + k;
+		if (job->type == S && i == 0) {
+			continue;
+		}
+		switch (job->state[k]) {
+		case PF_INDUCE:
+			p = induce_put(ctx, job->type, job->pred[k], job->bkt[k]);
+			break;
+		case PF_EMPTY:
+			p = induce_from(ctx, job->type, i);
+			break;
+		default:
+			continue;
+		}
+		if (p != ctx->sa.unset && job->lo <= p && p < job->hi) {
+			job->state[p - job->lo] = PF_EMPTY;
+		}
+	}
+}
+
+
+static void induce_seq(sais_ctx *ctx, byte_t type)
+{
+	if (type == L) {
+		for (size_t i = 0; i < ctx->n; i++) {
+			induce_from(ctx, L, i);
+		}
+	}
+	else {
+		for (size_t i = ctx->n - 1; i > 0; i--) {
+			induce_from(ctx, S, i);
 		}
 	}
 }
 
 
-static void induce_S( void *str, alphabet *ab,
-                      size_t *sarr, bitvec *ls,
-                      size_t *bkts, size_t *offsets,
-                      bool add_sentinel, char_at_fn char_at)
+/*
+ * Workers wait on the start lock until the barrier is sized to the
+ * number of threads that could actually be created. If none could,
+ * falls back to the sequential induction.
+ */
+static void induce_par(sais_ctx *ctx, byte_t type)
 {
-	size_t l = ab_size(ab) + add_sentinel;
-	get_bkt_end(bkts, offsets, l);
-	size_t n = bitvec_len(ls);
-	for (size_t i = n - 1, j; i > 0; i--) {
-		j = sarr[i];
-		if ( j != UNSET && j > 0 && bitvec_get_bit(ls, j - 1) == S ) {
-			j -= 1;
-			sarr[--offsets[ab_rank(ab, char_at(str, j)) + add_sentinel]] = j;
+	size_t n = ctx->n;
+	size_t nthreads = ctx->nthreads;
+	size_t blk = MAX(PAR_MIN_BLOCK, MIN(PAR_MAX_BLOCK, n / (4 * nthreads)));
+
+	induce_job job = {.ctx = ctx, .type = type, .done = false};
+	job.pred = ARR_NEW(size_t, blk);
+	job.bkt = ARR_NEW(size_t, blk);
+	job.state = ARR_NEW(byte_t, blk);
+	pthread_mutex_init(&job.start, NULL);
+
+	pthread_t *threads = ARR_NEW(pthread_t, nthreads);
+	induce_worker *workers = ARR_NEW(induce_worker, nthreads);
+	pthread_mutex_lock(&job.start);
+	job.nthreads = 1;
+	for (size_t t = 1; t < nthreads; t++) {
+		workers[t].job = &job;
+		workers[t].tid = t;
+		if (pthread_create(threads + t, NULL, induce_worker_run, workers + t)) {
+			break;
+		}
+		job.nthreads++;
+	}
+	if (job.nthreads > 1) {
+		pthread_barrier_init(&job.barrier, NULL, job.nthreads);
+	}
+	pthread_mutex_unlock(&job.start);
+
+	if (job.nthreads == 1) {
+		WARN("Unable to start induction threads. Inducing sequentially.\n");
+		induce_seq(ctx, type);
+		goto cleanup;
+	}
+
+	for (size_t done = 0; done < n; done += blk) {
+		if (type == L) {
+			job.lo = done;
+			job.hi = MIN(n, done + blk);
+		}
+		else {
+			job.hi = n - done;
+			job.lo = (job.hi > blk) ? (job.hi - blk) : 0;
 		}
+		pthread_barrier_wait(&job.barrier);
+		induce_prefetch(&job, 0);
+		pthread_barrier_wait(&job.barrier);
+		induce_block(&job);
+	}
+
+	job.done = true;
+	pthread_barrier_wait(&job.barrier);
+	for (size_t t = 1; t < job.nthreads; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	pthread_barrier_destroy(&job.barrier);
+
+cleanup:
+	pthread_mutex_destroy(&job.start);
+	FREE(threads);
+	FREE(workers);
+	FREE(job.pred);
+	FREE(job.bkt);
+	FREE(job.state);
+}
+
+
+static void induce(sais_ctx *ctx, byte_t type)
+{
+	if (type == L) {
+		get_bkt_start(ctx, &ctx->offsets);
+	}
+	else {
+		get_bkt_end(ctx, &ctx->offsets);
+	}
+	if (ctx->nthreads > 1) {
+		induce_par(ctx, type);
+	}
+	else {
+		induce_seq(ctx, type);
 	}
 }
 
 
-static void sort_LMS( void *str, alphabet *ab,
-                      size_t *sarr, bitvec *ls, bitvec *lms,
-                      size_t *bkts, size_t *offsets,
-                      bool add_sentinel, char_at_fn char_at)
+static void sort_LMS(sais_ctx *ctx)
 {
-	//assert(char_at != size_t_char_at || add_sentinel == false);
-	size_t n = bitvec_len(ls);
-	size_t l = ab_size(ab) + add_sentinel;
+	void *str = ctx->str;
+	size_t n = ctx->n;
+	bool add_sentinel = ctx->add_sentinel;
+	bitvec *ls = ctx->ls;
+	bitvec *lms = ctx->lms;
+	intarr *sa = &ctx->sa;
+	intarr *offsets = &ctx->offsets;
+	size_t unset = sa->unset;
 
 	// 1. Sort LMS segments
-	get_bkt_end(bkts, offsets, l);
-	sarr[0] = n - 1;
-	for (size_t i = 0; i < n - 1; i++) {
+	get_bkt_end(ctx, offsets);
+	intarr_set(sa, 0, n - 1);
+	for (size_t i = 0, b, p; i < n - 1; i++) {
 		if (!bitvec_get_bit(lms, i)) {
 			continue;
 		}
-		sarr[--offsets[ab_rank(ab, char_at(str, i)) + add_sentinel]] = i;
+		b = bkt_of(ctx, i);
+		p = intarr_get(offsets, b) - 1;
+		intarr_set(offsets, b, p);
+		intarr_set(sa, p, i);
 	}
-	//printf("1)\n");
-	//ARR_PRINT(sarr, SA, %zu, 0, n, 10, "");
-	induce_L(str, ab, sarr, ls, bkts, offsets, add_sentinel, char_at);
-	//printf("2)\n");
-	//ARR_PRINT(sarr, SA, %zu, 0, n, 10, "");
-	induce_S(str, ab, sarr, ls, bkts, offsets, add_sentinel, char_at);
-	//printf("3)\n");
-	//ARR_PRINT(sarr, SA, %zu, 0, n, 10, "");
+	induce(ctx, L);
+	induce(ctx, S);
 
 	// 2. Reduce the problem
 	// 2.1 move sorted LMS segments to 1st half of the SA
 	size_t nlms = 0;
-	for (size_t i = 0; i < n; i++) {
-		if (bitvec_get_bit(lms, sarr[i])) {
-			sarr[nlms++] = sarr[i];
+	for (size_t i = 0, j; i < n; i++) {
+		j = intarr_get(sa, i);
+		if (bitvec_get_bit(lms, j)) {
+			intarr_set(sa, nlms++, j);
 		}
 	}
-	ARR_FILL(sarr, nlms, n, UNSET);
-	//printf("4)\n");
-	//ARR_PRINT(sarr, SA, %zu, 0, n, 10, "");
+	intarr_fill(sa, nlms, n, unset);
 
 	// 2.2 compute the # of different LMS segments
 	//     and rename each of them as different macro int character
@@ -195,30 +554,21 @@ static void sort_LMS( void *str, alphabet *ab,
 	size_t cur_lms = 0, prev_lms = 0, pos = 0;
 	bool diff = false;
 
-	//printf("ls=");
-	//bitvec_print(stdout, ls, 4);
-	//printf("lms=");
-	//bitvec_print(stdout, lms, 4);
-
 	for (size_t i = 0; i < nlms; i++) {
 		diff = false;
-		cur_lms = sarr[i];
+		cur_lms = intarr_get(sa, i);
 		for ( size_t k = 0; ; k++ ) {
-			//printf("comparing positions prev_lms+k=%zu to cur_lms+k=%zu \n", prev_lms+k, cur_lms+k);
 			if (i == 0 ||
 			        prev_lms + k + add_sentinel == n || cur_lms + k + add_sentinel == n ||
-			        char_at(str, prev_lms + k) != char_at(str, cur_lms + k) ||
+			        ctx->char_at(str, prev_lms + k) != ctx->char_at(str, cur_lms + k) ||
 			        bitvec_get_bit(ls, prev_lms + k) != bitvec_get_bit(ls, cur_lms + k)) {
 				diff = true;
-				//printf("break diff=true >\n");
 				break;
 			}
 			else if (k > 0 && ( bitvec_get_bit(lms, prev_lms + k)
 			                    || bitvec_get_bit(lms, cur_lms + k) )) {
 				break;
-				//printf("break diff==false>>\n");
 			}
-			//printf("prev_lms=%zu cur_lms=%zu k=%zu diff=%d\n", prev_lms, cur_lms, k, diff);
 		}
 		ndifflms += diff; // if(diff) ndifflms++;
 
@@ -227,76 +577,68 @@ static void sort_LMS( void *str, alphabet *ab,
 		// use the second half to store the macro characters
 		// initially at scatered positions
 		pos = ((cur_lms % 2) == 0) ? (cur_lms / 2) : ((cur_lms - 1) / 2);
-		sarr[nlms + pos] = ndifflms - 1;
+		intarr_set(sa, nlms + pos, ndifflms - 1);
 		prev_lms = cur_lms;
 	}
 
-	//printf("5)\n");
-	//ARR_PRINT(sarr, SA, %zu, 0, n, 10, "");
 	// and finally push all the macro chars towards the end of the SA
-	for (size_t i = n - 1, j = n - 1; i >= nlms; i--)
-		if (sarr[i] != UNSET) {
-			sarr[j] = sarr[i];
+	for (size_t i = n - 1, j = n - 1, c; i >= nlms; i--) {
+		c = intarr_get(sa, i);
+		if (c != unset) {
+			intarr_set(sa, j, c);
 			if (i != j) {
-				sarr[i] = UNSET;
+				intarr_set(sa, i, unset);
 			}
 			j--;
 		}
-
-	//printf("6)\n");
-	//ARR_PRINT(sarr, SA, %zu, 0, n, 10, "");
+	}
 
 	// 3. use the reduced string to sort the LMS suffixes
-	size_t *red_sarr = sarr;
-	size_t *red_str  = sarr + n - nlms;
+	//    the reduced SA takes the first nlms positions of the SA
+	intarr red_str  = intarr_view(sa, n - nlms);
 
 	// 3.1 if all (sorted) macro chars are distinct,
 	//     the LMS suffixes are already sorted
 	if (nlms == ndifflms) {
 		for (size_t i = 0; i < nlms; i++) {
-			red_sarr[red_str[i]] = i;
+			intarr_set(sa, intarr_get(&red_str, i), i);
 		}
 	}
-	// 3.2 otherwise, solve the reduced problem
+	// 3.2 otherwise, solve the reduced problem in place,
+	//     lending it the free middle of the SA as workspace
 	else {
-		//printf("reducing\n");
-		//ARR_PRINT(red_str, red_str, %zu, 0, nlms, 10, "");
 		alphabet *red_ab = int_alphabet_new(ndifflms);
-		build_sarr(red_str, nlms, red_ab, red_sarr, 0, size_t_char_at);
+		intarr work = intarr_view(sa, nlms);
+		build_sarr(&red_str, nlms, red_ab, sa, false, intarr_char_at,
+		           &work, n - (2 * nlms), ctx->nthreads);
 		alphabet_free(red_ab);
 	}
 	// now the first positions of sarr correspond to the number of
 	// LMS suffixes (not their original positions) in lexicographic order
 	// (sarr[0] = ndifflms-1)
 
-	// printf("7)\n");
-	// ARR_PRINT(sarr, SA, %zu, 0, n, 10, "");
-
 	// 4. finally put the starting positions of the sorted LMS suffixes
 	//    at their correct place in the SA
-	get_bkt_end(bkts, offsets, l);
+	get_bkt_end(ctx, offsets);
 	for (size_t i = 0, j = 0; i < n; i++) {
 		if (bitvec_get_bit(lms, i)) {
-			red_str[j++] = i;
+			intarr_set(&red_str, j++, i);
 		}
 	}
 
-	//printf("8)\n");
-	//ARR_PRINT(sarr, SA, %zu, 0, n, 10, "");
 	for (size_t i = 0; i < nlms; i++) {
-		red_sarr[i] = red_str[red_sarr[i]];
+		intarr_set(sa, i, intarr_get(&red_str, intarr_get(sa, i)));
 	}
-	ARR_FILL(sarr, nlms, n, UNSET);
-	//printf("9)\n");
-	//ARR_PRINT(sarr, SA, %zu, 0, n, 10, "");
-	for (size_t i = nlms - 1, j; i > 0; i--) {
-		j = sarr[i];
-		sarr[i] = UNSET;
-		sarr[--offsets[ab_rank(ab, char_at(str,j)) + add_sentinel]] = j;
+	intarr_fill(sa, nlms, n, unset);
+	for (size_t i = nlms - 1, j, b, p; i > 0; i--) {
+		j = intarr_get(sa, i);
+		intarr_set(sa, i, unset);
+		b = bkt_of(ctx, j);
+		p = intarr_get(offsets, b) - 1;
+		intarr_set(offsets, b, p);
+		intarr_set(sa, p, j);
 	}
 	// Done. All LMS suffixes are sorted and correctly placed in the SA
-	//printf("10)\n");
-	//ARR_PRINT(sarr, SA, %zu, 0, n, 10, "");
 }
 
 /*
@@ -304,44 +646,96 @@ static void sort_LMS( void *str, alphabet *ab,
  * If add_sentinel is true, a sentinel char is virtually appended to the string.
  * If add_sentinel is false, the smallest char in the alphabet must occur
  * exactly once at the end of the string.
+ * The first len+add_sentinel positions of sa receive the SA.
+ * The work_len entries of work, if any, are free for the bucket arrays.
  */
-void build_sarr( void *str, size_t len, alphabet *ab, size_t *sarr,
-                 bool add_sentinel, char_at_fn char_at)
-{
-	size_t ab_sz = ab_size(ab);
-
-	bitvec *ls   = bitvec_new_with_capacity(len + add_sentinel);
-	bitvec *lms  = bitvec_new_with_capacity(len + add_sentinel);
-	size_t *bkts = ARR_OF_0_NEW(size_t, ab_sz + add_sentinel);
-
-	init_LS(str, len, ab, ls, lms, bkts, add_sentinel, char_at);
-
-	// printf("-------------------------------------------------------------\n");
-	//printf("build_sarr\n");
-	//printf("ls\n");
-	//bitvec_print(stdout, ls, 4);
-	//printf("lms\n");
-	//bitvec_print(stdout, lms, 4);
-	//ARR_PRINT(bkts, bkts, %zu, 0, ab_sz + add_sentinel, 10, "");
-
-	ARR_FILL(sarr, 0, len+1, UNSET);
-	size_t *offsets = ARR_NEW(size_t, ab_sz + add_sentinel);
-
-	sort_LMS(str, ab, sarr, ls, lms, bkts, offsets, add_sentinel, char_at);
-	//printf("a)\n");
-	//ARR_PRINT(sarr, SA, %zu, 0, len+1, 10, "");
-	induce_L(str, ab, sarr, ls, bkts, offsets, add_sentinel, char_at);
-	//printf("b)\n");
-	//ARR_PRINT(sarr, SA, %zu, 0, len+1, 10, "");
-	induce_S(str, ab, sarr, ls, bkts, offsets, add_sentinel, char_at);
-	//printf("c)\n");
-	//ARR_PRINT(sarr, SA, %zu, 0, len+1, 10, "");
+static void build_sarr( void *str, size_t len, alphabet *ab, intarr *sa,
+                        bool add_sentinel, char_at_fn char_at,
+                        intarr *work, size_t work_len, size_t nthreads )
+{
+	sais_ctx ctx = {.str = str,
+	                .len = len,
+	                .n = len + add_sentinel,
+	                .ab = ab,
+	                .nbkts = ab_size(ab) + add_sentinel,
+	                .add_sentinel = add_sentinel,
+	                .char_at = char_at,
+	                .sa = *sa,
+	                .nthreads = nthreads
+	               };
+	ctx.ls = bitvec_new_with_capacity(ctx.n);
+	ctx.lms = bitvec_new_with_capacity(ctx.n);
+
+	init_LS(&ctx);
+
+	size_t nbkts = ctx.nbkts;
+	bool own_offsets = false, own_bkts = false;
+	if (work_len >= nbkts) {
+		ctx.offsets = intarr_view(work, 0);
+		work_len -= nbkts;
+	}
+	else {
+		ctx.offsets = intarr_new(nbkts, sa->width);
+		own_offsets = true;
+	}
+	if (work_len >= nbkts) {
+		ctx.bkts = intarr_view(work, nbkts);
+	}
+	else if (nbkts <= MAX(CACHED_BKTS_MIN, ctx.n / CACHED_BKTS_RATIO)) {
+		ctx.bkts = intarr_new(nbkts, sa->width);
+		own_bkts = true;
+	}
+	else {
+		ctx.bkts.data = NULL;
+	}
+	if (ctx.bkts.data != NULL) {
+		count_bkts(&ctx, &ctx.bkts);
+	}
+
+	intarr_fill(&ctx.sa, 0, ctx.n, ctx.sa.unset);
+
+	sort_LMS(&ctx);
+	induce(&ctx, L);
+	induce(&ctx, S);
 
 	// clean up
-	bitvec_free(ls);
-	bitvec_free(lms);
-	FREE(bkts);
-	FREE(offsets);
+	bitvec_free(ctx.ls);
+	bitvec_free(ctx.lms);
+	if (own_bkts) {
+		FREE(ctx.bkts.data);
+	}
+	if (own_offsets) {
+		FREE(ctx.offsets.data);
+	}
+}
+
+
+static size_t get_nthreads(size_t nthreads)
+{
+	if (nthreads == 0) {
+		long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (nprocs > 0) ? (size_t)nprocs : 1;
+	}
+	return nthreads;
+}
+
+
+static byte_t *build_packed(void *str, size_t len, alphabet *ab,
+                            char_at_fn char_at, sais_width width,
+                            size_t nthreads)
+{
+	ERROR_ASSERT(len < width_max(width),
+	             "String too long for a %d-byte suffix array", (int)width);
+	intarr sa = intarr_new(len + 1, width);
+	if (len < 2) {
+		for (size_t i = 0; i <= len; i++) {
+			intarr_set(&sa, i, len - i);
+		}
+		return sa.data;
+	}
+	build_sarr(str, len, ab, &sa, true, char_at, NULL, 0,
+	           get_nthreads(nthreads));
+	return sa.data;
 }
 
 
@@ -349,30 +743,105 @@ size_t *sais(char *str, size_t len, alphabet *ab)
 {
 	ERROR_ASSERT(ab_type(ab) == CHAR_TYPE,
 	             "Incompatible alphabet type for SA-IS");
-	if (len<2) {
-		size_t *sarr = ARR_NEW(size_t, len + 1);
-		for (size_t i = 0; i <= len; i++) {
-			sarr[i] = len - i;
+	return (size_t *)build_packed(str, len, ab, cstr_char_at, SAIS_W64, 1);
+}
+
+
+size_t *sais_xstr(xstr *str, alphabet *ab)
+{
+	return (size_t *)build_packed(str, xstr_len(str), ab, xstr_char_at,
+	                              SAIS_W64, 1);
+}
+
+
+size_t *sais_par(char *str, size_t len, alphabet *ab, size_t nthreads)
+{
+	ERROR_ASSERT(ab_type(ab) == CHAR_TYPE,
+	             "Incompatible alphabet type for SA-IS");
+	return (size_t *)build_packed(str, len, ab, cstr_char_at, SAIS_W64,
+	                              nthreads);
+}
+
+
+sais_width sais_min_width(size_t len)
+{
+	if (len < width_max(SAIS_W32)) {
+		return SAIS_W32;
+	}
+	else if (len < width_max(SAIS_W40)) {
+		return SAIS_W40;
+	}
+	return SAIS_W64;
+}
+
+
+byte_t *sais_packed(char *str, size_t len, alphabet *ab, sais_width width,
+                    size_t nthreads)
+{
+	ERROR_ASSERT(ab_type(ab) == CHAR_TYPE,
+	             "Incompatible alphabet type for SA-IS");
+	return build_packed(str, len, ab, cstr_char_at, width, nthreads);
+}
+
+
+byte_t *sais_xstr_packed(xstr *str, alphabet *ab, sais_width width,
+                         size_t nthreads)
+{
+	return build_packed(str, xstr_len(str), ab, xstr_char_at, width,
+	                    nthreads);
+}
+
+
+size_t sais_packed_get(const byte_t *sa, sais_width width, size_t i)
+{
+	intarr arr = {.data = (byte_t *)sa, .width = width};
+	return intarr_get(&arr, i);
+}
+
+
+size_t sais_packed_write(const byte_t *sa, sais_width width, size_t n,
+                         FILE *stream)
+{
+	size_t chunk = IO_CHUNK_BYTES / width;
+	size_t nwritten = 0;
+	while (nwritten < n) {
+		size_t m = MIN(chunk, n - nwritten);
+		size_t w = fwrite(sa + (nwritten * width), width, m, stream);
+		nwritten += w;
+		if (w < m) {
+			WARN("Error writing the suffix array to file.\n");
+			break;
 		}
-		return sarr;
 	}
-	size_t *sarr = ARR_NEW(size_t, len + 1);
-	build_sarr(str, len, ab, sarr, true, cstr_char_at);
-	return sarr;
+	return nwritten;
 }
 
 
-size_t *sais_xstr(xstr *str, alphabet *ab)
+size_t sais_file_get_range(FILE *stream, sais_width width, size_t from,
+                           size_t to, size_t *dest)
 {
-	size_t len = xstr_len(str);
-	if (len < 2) {
-		size_t *sarr = ARR_NEW(size_t, len + 1);
-		for (size_t i = 0; i <= len; i++) {
-			sarr[i] = len - i;
+	if (to <= from) {
+		return 0;
+	}
+	off_t base = ftello(stream);
+	if (fseeko(stream, base + (off_t)(from * width), SEEK_SET)) {
+		return 0;
+	}
+	size_t chunk = IO_CHUNK_BYTES / width;
+	intarr buf = intarr_new(MIN(chunk, to - from), width);
+	size_t nread = 0;
+	while (from + nread < to) {
+		size_t m = MIN(chunk, to - from - nread);
+		size_t r = fread(buf.data, width, m, stream);
+		for (size_t i = 0; i < r; i++) {
+			dest[nread + i] = intarr_get(&buf, i);
+		}
+		nread += r;
+		if (r < m) {
+			break;
 		}
-		return sarr;
 	}
-	size_t *sarr = ARR_NEW(size_t, len + 1);
-	build_sarr(str, len, ab, sarr, true, xstr_char_at);
-	return sarr;
+	FREE(buf.data);
+	fseeko(stream, base, SEEK_SET);
+	return nread;
 }
\ No newline at end of file
@@ -23,8 +23,10 @@
 #define SAIS_H
 
 #include <stddef.h>
+#include <stdio.h>
 
 #include "alphabet.h"
+#include "coretype.h"
 #include "xstr.h"
 
 /**
@@ -34,7 +36,37 @@
  * @brief G.Nong, S.Zhang and W.H.Chan Suffix Array Induced Sorting (SA-IS)
  *        linear time construction algorithm.
  *        http://ieeexplore.ieee.org/document/5582081/
+ *
+ * Besides the plain `size_t` suffix arrays, the SA can be built in
+ * packed form with 32, 40 or 64 bits per entry (see ::sais_width).
+ * In every width the reduced problems are solved inside the output
+ * array itself, and their bucket arrays are stored in the free part
+ * of the SA when they fit (otherwise they are recomputed from the
+ * text on demand), so the working memory stays close to the size
+ * of the output plus two bits per character.
+ *
+ * The construction can optionally use several threads. Induced
+ * sorting scans the SA in blocks; the (cache-unfriendly) lookups of
+ * the preceding suffix, its L/S type and its bucket are done in
+ * parallel for the whole block and the writes are then applied
+ * sequentially, so the result is identical to the sequential one.
+ */
+
+
+/**
+ * @brief Number of bytes per entry of a packed suffix array.
+ *
+ * A packed SA for a string of length `len` has `len+1` entries of
+ * `width` bytes each. A width can hold SAs of strings of length up
+ * to 2^(8*width)-2. 40-bit entries are stored little-endian;
+ * 32 and 64-bit entries use the host representation of
+ * `uint32_t` and `size_t`, so a ::SAIS_W64 array is a `size_t` array.
  */
+typedef enum {
+	SAIS_W32 = 4,
+	SAIS_W40 = 5,
+	SAIS_W64 = 8
+} sais_width;
 
 
 /**
@@ -58,4 +90,72 @@ size_t *sais(char *str, size_t len, alphabet *ab);
  */
 size_t *sais_xstr(xstr *str, alphabet *ab);
 
+
+/**
+ * @brief Same as sais() using @p nthreads threads.
+ * If @p nthreads is zero, uses the number of online processors.
+ */
+size_t *sais_par(char *str, size_t len, alphabet *ab, size_t nthreads);
+
+
+/**
+ * @brief Returns the smallest width able to hold the suffix array of
+ *        a string of length @p len.
+ */
+sais_width sais_min_width(size_t len);
+
+
+/**
+ * @brief Builds the suffix array for the string @p str over the
+ *        alphabet @p ab, packed with @p width bytes per entry,
+ *        using @p nthreads threads (zero means the number of online
+ *        processors). Entries are read with sais_packed_get().
+ *
+ * The array has @p len+1 entries, the first being @p len, as in sais().
+ * It is an error to request a width too narrow for @p len.
+ */
+byte_t *sais_packed(char *str, size_t len, alphabet *ab, sais_width width,
+                    size_t nthreads);
+
+
+/**
+ * @brief Same as sais_packed() for the xstring @p str over the int
+ *        alphabet @p ab.
+ */
+byte_t *sais_xstr_packed(xstr *str, alphabet *ab, sais_width width,
+                         size_t nthreads);
+
+
+/**
+ * @brief Returns the entry @p i of the packed suffix array @p sa.
+ */
+size_t sais_packed_get(const byte_t *sa, sais_width width, size_t i);
+
+
+/**
+ * @brief Writes the first @p n entries of the packed suffix array @p sa
+ *        to @p stream in fixed-size chunks, in the same layout as in
+ *        memory (@p n entries of @p width bytes).
+ *
+ * This only serialises an array already built by sais_packed() or
+ * sais_xstr_packed(): peak memory is that of the in-memory construction.
+ *
+ * @return The number of entries written, which is less than @p n
+ *         on write errors.
+ */
+size_t sais_packed_write(const byte_t *sa, sais_width width, size_t n,
+                         FILE *stream);
+
+
+/**
+ * @brief Reads the entries [@p from, @p to) of a packed suffix array
+ *        written to @p stream by sais_packed_write() into @p dest, in chunks.
+ *        The array is assumed to start at the current position of
+ *        @p stream, which is restored before returning.
+ *
+ * @return The number of entries read.
+ */
+size_t sais_file_get_range(FILE *stream, sais_width width, size_t from,
+                           size_t to, size_t *dest);
+
 #endif
\ No newline at end of file
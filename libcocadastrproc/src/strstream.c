@@ -25,6 +25,8 @@
 
 #include "new.h"
 #include "mathutil.h"
+#include "strfilereader.h"
+#include "strread.h"
 #include "strstream.h"
 #include "xchar.h"
 #include "xstr.h"
@@ -41,6 +43,7 @@ typedef enum {
 struct _strstream {
 	union {
 		FILE    *file;
+		strfilereader *rdr;
 		char    *str;
 		xstr *xstr;
 	} src;
@@ -92,7 +95,11 @@ strstream *strstream_open_file(char *filename)
 	strstream *sst;
 	sst = NEW(strstream);
 	sst->type = SSTR_FILE;
-	sst->src.file = fopen(filename, "r");
+	sst->src.rdr = strfilereader_new_from_path(filename);
+	if (sst->src.rdr == NULL) {
+		FREE(sst);
+		return NULL;
+	}
 	sst->pos = 0;
 	sst->bytes_per_char = sizeof(char);
 	return sst;
@@ -124,7 +131,7 @@ void strstream_reset(strstream *sst)
 		sst->pos = 0;
 		break;
 	case SSTR_FILE:
-		rewind(sst->src.file);
+		strread_reset(strfilereader_as_strread(sst->src.rdr));
 		break;
 	case SSTR_XSTR:
 		sst->pos = 0;
@@ -142,7 +149,7 @@ bool strstream_end(strstream *sst)
 		return sst->slen <= sst->pos;
 		break;
 	case SSTR_FILE:
-		return feof(sst->src.file);
+		return strfilereader_end(sst->src.rdr);
 		break;
 	case SSTR_XSTR:
 		return sst->slen <= sst->pos;
@@ -165,7 +172,7 @@ xchar_t strstream_getc(strstream *sst)
 			return (xchar_t)sst->src.str[sst->pos++];
 		break;
 	case SSTR_FILE:
-		return fgetc(sst->src.file);
+		return strread_getc(strfilereader_as_strread(sst->src.rdr));
 		break;
 	case SSTR_XSTR:
 		if (sst->pos>=xstr_len(sst->src.xstr))
@@ -196,7 +203,7 @@ size_t strstream_reads(strstream *sst, char *dest, size_t n)
 		return nread;
 		break;
 	case SSTR_FILE:
-		return fread(dest, 1, n, sst->src.file);
+		return strread_read_str(strfilereader_as_strread(sst->src.rdr), dest, n);
 		break;
 	default:
 		return 0;
@@ -241,7 +248,7 @@ void strstream_close(strstream *sst)
 	case SSTR_STR:
 		break;
 	case SSTR_FILE:
-		fclose(sst->src.file);
+		strfilereader_free(sst->src.rdr);
 		break;
 	default:
 		break;
@@ -60,7 +60,9 @@ strstream *strstream_open_xstr(xstr *xstr);
 
 
 /**
- * @brief Opens a stream for a source text file.
+ * @brief Opens a stream for a source text file, read through a
+ * buffered ::strfilereader.
+ * @returns NULL if the file cannot be open for reading.
  */
 strstream *strstream_open_file(char *filename);
 
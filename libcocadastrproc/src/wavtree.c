@@ -22,14 +22,17 @@
 #include <assert.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "alphabet.h"
 #include "arrays.h"
+#include "bitarr.h"
 #include "bitbyte.h"
 #include "bitvec.h"
 #include "bytearr.h"
@@ -109,6 +112,7 @@ void chrcode_incr(bitvec *code)
 typedef struct _tmp_wtnode {
 	size_t               index;
 	size_t               offset;
+	size_t               len;
 	size_t               height;
 	byte_t               nxt_chd;
 	bitvec           *bv;
@@ -127,7 +131,8 @@ typedef struct _tmp_wavtree {
 	bool            own_alphabet;
 	vec       *chrcodes;
 	huffcode       *hcode;
-	bitvec      *raw_bits;
+	size_t          nbits;
+	byte_t         *raw_bits;
 	tmp_wtnode     *tmp_root;
 }
 tmp_wavtree;
@@ -138,6 +143,7 @@ static tmp_wtnode *tmp_wtnode_new(size_t size)
 	tmp_wtnode *node = NEW(tmp_wtnode);
 	node->index      = 0;
 	node->offset     = 0;
+	node->len        = 0;
 	node->height     = 0;
 	node->nxt_chd    = LEFT;
 	node->bv         = bitvec_new_with_capacity(size);
@@ -171,30 +177,36 @@ static tmp_wavtree *tmp_wavtree_new(const alphabet *ab, bool own_alphabet)
 	twt->len      = 0;
 	twt->nchars   = 0;
 	twt->hcode    = NULL;
-	twt->raw_bits = bitvec_new();
+	twt->nbits    = 0;
+	twt->raw_bits = NULL;
 	twt->tmp_root = tmp_wtnode_new(0);
 	return twt;
 }
 
 
 // Requires: node != NULL
-static void _tmp_wt_init_bal( tmp_wtnode *node, alphabet *ab,
-                              size_t l, size_t r, size_t crk, size_t depth )
+//           r-l >= 1
+// The char ranks [l, r) are split in halves so that every subtree
+// holds a contiguous range of ranks, and the leaves are in rank order.
+static void _tmp_wt_init_bal( tmp_wavtree *twt, tmp_wtnode *node,
+                              size_t l, size_t r, const bitvec *code )
 {
 	size_t mid = (size_t)(ceil((l+r)/2.0));
-	if (mid-l == 1) {
-		node->chr[LEFT] = ab_char(ab, crk);
-	}
-	else if (mid-l >= 2) {
-		node->chd[LEFT] = tmp_wtnode_new(0);
-		_tmp_wt_init_bal(node->chd[LEFT], ab, l, mid, crk, depth+1);
-	}
-	if (r-mid == 1) {
-		node->chr[RIGHT] = ab_char(ab, crk|(1<<depth));
-	}
-	else if (r-mid >= 2) {
-		node->chd[RIGHT] = tmp_wtnode_new(0);
-		_tmp_wt_init_bal(node->chd[RIGHT], ab, mid, r, crk|(1<<depth), depth+1);
+	for (byte_t dir=LEFT; dir<=RIGHT; dir++) {
+		size_t lo = (dir==LEFT) ? l : mid;
+		size_t hi = (dir==LEFT) ? mid : r;
+		if (hi <= lo) continue;
+		bitvec *chd_code = bitvec_cropped_clone(code, bitvec_len(code));
+		bitvec_push(chd_code, dir);
+		if (hi-lo == 1) {
+			node->chr[dir] = ab_char(twt->ab, lo);
+			set_charcode(twt->chrcodes, node->chr[dir], chd_code);
+		}
+		else {
+			node->chd[dir] = tmp_wtnode_new(0);
+			_tmp_wt_init_bal(twt, node->chd[dir], lo, hi, chd_code);
+			bitvec_free(chd_code);
+		}
 	}
 }
 
@@ -204,13 +216,11 @@ static tmp_wavtree *tmp_wt_init_bal(alphabet *ab, bool own_ab)
 	tmp_wavtree *twt = tmp_wavtree_new(ab, own_ab);
 	if (ab==NULL) return twt;
 	twt->nchars = ab_size(ab);
-	for (size_t i=0; i<twt->nchars; i++) {
-		set_charcode( twt->chrcodes, ab_char(ab, i),
-		              bitvec_clone(twt->nxt_charcode));
-		chrcode_incr(twt->nxt_charcode);
-	}
+	if (twt->nchars == 0) return twt;
 	// twt already has one empty root node
-	_tmp_wt_init_bal(twt->tmp_root, ab, 0, twt->nchars, 0, 0);
+	bitvec *code = bitvec_new();
+	_tmp_wt_init_bal(twt, twt->tmp_root, 0, twt->nchars, code);
+	bitvec_free(code);
 	return twt;
 }
 
@@ -265,6 +275,8 @@ static void tmp_wt_free(tmp_wavtree *twt)
 {
 	alphabet_free(twt->ab);
 	huffcode_free(twt->hcode);
+	FREE(twt->raw_bits);
+	bitvec_free(twt->nxt_charcode);
 	DESTROY_FLAT(twt->chrcodes, vec);
 	tmp_wtnode_free(twt->tmp_root);
 	FREE(twt);
@@ -294,10 +306,13 @@ static void tmp_wt_app_new_char(tmp_wtnode *root, xchar_t c, bitvec *chcode)
 			parent->nxt_chd ^= 0x1;
 		}
 		else {
-			// case first & second symbols: 'ignore'
-			if (bitvec_len(chcode) < 2) return;
-			// add new leaf
 			byte_t bit = parent->nxt_chd^0x1;
+			// case first & second symbols: leaves of the root
+			if (bitvec_len(chcode) < 2) {
+				parent->chr[bit] = c;
+				return;
+			}
+			// add new leaf
 			size_t q = bitvec_count(parent->bv, bit);
 			tmp_wtnode *new_node = tmp_wtnode_new(q);
 			bitvec_push_n(new_node->bv, q-1, 0x0);
@@ -311,16 +326,6 @@ static void tmp_wt_app_new_char(tmp_wtnode *root, xchar_t c, bitvec *chcode)
 }
 
 
-static void tmp_wt_fill( tmp_wavtree *twt, xstrread *rdr )
-{
-	xstrread_reset(rdr);
-	for (xchar_wt c; (c=xstrread_getc(rdr)) != XEOF;) {
-		tmp_wt_app_char( twt->tmp_root, get_charcode(twt->chrcodes, c) );
-		(twt->len)++;
-	}
-}
-
-
 // online construction only available for CHAR_TYPE alphabets
 static void tmp_wt_fill_online( tmp_wavtree *twt, strread *src )
 {
@@ -340,7 +345,8 @@ static void tmp_wt_fill_online( tmp_wavtree *twt, strread *src )
 		}
 		(twt->len)++;
 	}
-	twt->ab = alphabet_new(strbuf_len(ab_chars), strbuf_detach(ab_chars));
+	twt->ab = alphabet_new(strbuf_len(ab_chars), strbuf_as_str(ab_chars));
+	strbuf_free(ab_chars);
 	twt->own_alphabet = true;
 }
 
@@ -360,18 +366,17 @@ static size_t tmp_wt_init_height(tmp_wtnode *root)
 
 
 static void _tmp_wavtree_init_veb_layout( tmp_wtnode *node, size_t heig,
-        size_t *vebindex, size_t *offset, bitvec *raw_bits )
+        size_t *vebindex, size_t *offset )
 {
 	if (heig==1) {
 		node->index = (*vebindex)++;
 		node->offset = *offset;
-		(*offset) += bitvec_len(node->bv);
-		bitvec_cat(raw_bits, node->bv);
+		(*offset) += node->len;
 		//printf("[id=%zu pos=%zu len=%zu]\n",node->id, node->offset, node->len);
 	}
 	else {
 		size_t depth, nxtchd;
-		_tmp_wavtree_init_veb_layout(node, heig/2, vebindex, offset, raw_bits);
+		_tmp_wavtree_init_veb_layout(node, heig/2, vebindex, offset);
 		stack *stknode = stack_new(sizeof(tmp_wtnode *));
 		stack *stkdepth = stack_new(sizeof(size_t));
 		stack *stknxtchd = stack_new(sizeof(size_t));
@@ -389,13 +394,13 @@ static void _tmp_wavtree_init_veb_layout( tmp_wtnode *node, size_t heig,
 					_tmp_wavtree_init_veb_layout( node->chd[LEFT],
 					                              MIN( node->chd[LEFT]->height,
 					                                   heig-(heig/2) ),
-					                              vebindex, offset, raw_bits );
+					                              vebindex, offset );
 				}
 				if (node->chd[RIGHT]!=NULL) {
 					_tmp_wavtree_init_veb_layout( node->chd[RIGHT],
 					                              MIN( node->chd[RIGHT]->height,
 					                                   heig-(heig/2) ),
-					                              vebindex, offset, raw_bits );
+					                              vebindex, offset );
 				}
 			}
 			else if (nxtchd<2) {
@@ -417,6 +422,9 @@ static void _tmp_wavtree_init_veb_layout( tmp_wtnode *node, size_t heig,
 /*
  * The nodes of the WT are arranged in an array according to the
  * van Emde Boas recursive partitioning of the tree to explore memory locality.
+ * Requires the length of every node to be known. The bits of the nodes
+ * are laid out contiguously in the same order into a single zeroed
+ * raw bit array of twt->nbits bits.
  */
 static void tmp_wavtree_init_veb_layout( tmp_wavtree *twt )
 {
@@ -426,8 +434,53 @@ static void tmp_wavtree_init_veb_layout( tmp_wavtree *twt )
 	size_t offset = 0;
 	tmp_wt_init_height(twt->tmp_root);
 	_tmp_wavtree_init_veb_layout( twt->tmp_root, twt->tmp_root->height,
-	                              &vebindex, &offset, twt->raw_bits );
+	                              &vebindex, &offset );
 	twt->nnodes = vebindex;
+	twt->nbits = offset;
+	// the rank/select directory reads whole 64-bit words, hence the padding
+	twt->raw_bits = bytearr_new( (size_t)DIVCEIL(offset, BYTESIZE)
+	                             + sizeof(uint64_t) );
+}
+
+
+/*
+ * Computes the node lengths from the number of occurrences
+ * of each char (indexed by rank). Returns the length of the
+ * subtree root.
+ */
+static size_t tmp_wt_init_len( tmp_wtnode *node, const alphabet *ab,
+                               const size_t *counts )
+{
+	node->len = 0;
+	for (byte_t dir=LEFT; dir<=RIGHT; dir++) {
+		if (node->chd[dir] != NULL)
+			node->len += tmp_wt_init_len(node->chd[dir], ab, counts);
+		else if (node->chr[dir] != XEOF)
+			node->len += counts[ab_rank(ab, node->chr[dir])];
+	}
+	return node->len;
+}
+
+
+/*
+ * Used by the online construction, where the bits are first
+ * accumulated in the node bitvectors.
+ */
+static void tmp_wt_init_len_from_bv(tmp_wtnode *node)
+{
+	if (node == NULL) return;
+	node->len = bitvec_len(node->bv);
+	tmp_wt_init_len_from_bv(node->chd[LEFT]);
+	tmp_wt_init_len_from_bv(node->chd[RIGHT]);
+}
+
+
+static void tmp_wt_flush_bv(tmp_wtnode *node, byte_t *raw_bits)
+{
+	if (node == NULL) return;
+	bitarr_write(raw_bits, node->offset, bitvec_as_bytes(node->bv), 0, node->len);
+	tmp_wt_flush_bv(node->chd[LEFT], raw_bits);
+	tmp_wt_flush_bv(node->chd[RIGHT], raw_bits);
 }
 
 
@@ -446,7 +499,7 @@ static void tmp_wtnode_print(FILE *stream, tmp_wtnode *node, size_t depth)
 	}
 	else {
 		fprintf(stream, "%s@tmp_wtree_node %p\n",margin, node);
-		fprintf(stream, "%ssize: %zu\n", margin, bitvec_len(node->bv));
+		fprintf(stream, "%ssize: %zu\n", margin, node->len);
 		fprintf(stream, "%snxt_chd: %c\n",margin, node->nxt_chd?'1':'0');
 		fprintf(stream, "%sbits: \n", margin);
 		bitvec_print(stream, node->bv, 8);
@@ -476,6 +529,8 @@ typedef struct _wtnode {
 	size_t len;
 	size_t offset;
 	size_t cumul_bits[2];
+	size_t rk_lo;   // min and max rank of the chars in the subtree
+	size_t rk_hi;
 	byte_t has_chd; //code: 0=none (leaf), 1=left chd only, 2=right only, 3=both
 	size_or_xchar cc[2]; // if leaf stores left/right chars;
 	// else stores left/right children indexes.
@@ -491,6 +546,7 @@ struct _wavtree {
 	bool          own_ab;
 	vec     *chrcodes;
 	size_t        len;
+	bool          ordered; // leaves in increasing char rank order
 	csrsbitarr *bitarr;
 };
 
@@ -498,7 +554,7 @@ struct _wavtree {
 static void _wt_build_from_tmp(wtnode *nodes, tmp_wtnode *tnode)
 {
 	if (tnode == NULL) return;
-	nodes[tnode->index].len = bitvec_len(tnode->bv);
+	nodes[tnode->index].len = tnode->len;
 	nodes[tnode->index].offset = tnode->offset;
 	nodes[tnode->index].has_chd = 0x0;
 	if (tnode->chd[LEFT] != NULL) {
@@ -520,17 +576,39 @@ static void _wt_build_from_tmp(wtnode *nodes, tmp_wtnode *tnode)
 }
 
 
+static void _wt_init_rank_bounds(wavtree *wt, size_t cur)
+{
+	wtnode *node = wt->nodes + cur;
+	size_t lo[2], hi[2];
+	for (byte_t dir=LEFT; dir<=RIGHT; dir++) {
+		lo[dir] = SIZE_MAX;
+		hi[dir] = 0;
+		if (node->has_chd & (dir+1)) {
+			_wt_init_rank_bounds(wt, node->cc[dir].chd);
+			lo[dir] = wt->nodes[node->cc[dir].chd].rk_lo;
+			hi[dir] = wt->nodes[node->cc[dir].chd].rk_hi;
+		}
+		else if (node->cc[dir].chr != XEOF) {
+			lo[dir] = hi[dir] = ab_rank(wt->ab, node->cc[dir].chr);
+		}
+	}
+	node->rk_lo = MIN(lo[LEFT], lo[RIGHT]);
+	node->rk_hi = MAX(hi[LEFT], hi[RIGHT]);
+	if (lo[LEFT] != SIZE_MAX && lo[RIGHT] != SIZE_MAX && hi[LEFT] >= lo[RIGHT])
+		wt->ordered = false;
+}
+
+
+// Requires: layout already computed and raw bits filled
 static wavtree *wt_build_from_tmp( tmp_wavtree *twt, wtshape shape )
 {
-	tmp_wavtree_init_veb_layout(twt);
 	wavtree *wt = NEW(wavtree);
+	wt->shape = shape;
 	wt->nnodes = twt->nnodes;
 	wt->nodes = ARR_NEW(wtnode, twt->nnodes);
 	_wt_build_from_tmp(wt->nodes, twt->tmp_root);
 	wt->len = twt->len;
-	size_t nbits = bitvec_len(twt->raw_bits);
-	//bitvec_print(tmp_wt->raw_bits, 4);
-	wt->bitarr = csrsbitarr_new(bitvec_detach(twt->raw_bits), nbits);
+	wt->bitarr = csrsbitarr_new(twt->raw_bits, twt->nbits);
 	twt->raw_bits = NULL; // prevents from freeing on twt destruction
 	for (size_t i = 0; i < wt->nnodes; ++i) {
 		wt->nodes[i].cumul_bits[1] = csrsbitarr_rank1( wt->bitarr,
@@ -544,55 +622,374 @@ static wavtree *wt_build_from_tmp( tmp_wavtree *twt, wtshape shape )
 	twt->ab = NULL;
 	wt->chrcodes = twt->chrcodes;
 	twt->chrcodes = NULL;
+	wt->ordered = true;
+	if (wt->nnodes > 0)
+		_wt_init_rank_bounds(wt, 0);
 	return wt;
 }
 
 
-static wavtree *wt_build( alphabet *ab, xstrread *rdr,
-                          wtshape shape )
+/*
+ * Builds the tree skeleton of the given shape, computes the
+ * node lengths from the char counts (indexed by rank) and lays
+ * out the nodes over a zeroed raw bit array.
+ */
+static tmp_wavtree *tmp_wt_init( alphabet *ab, wtshape shape,
+                                 const size_t *counts )
 {
-	tmp_wavtree *twt;
+	tmp_wavtree *twt = NULL;
 	switch (shape) {
 	case WT_BALANCED:
 		twt =  tmp_wt_init_bal(ab, ab==NULL);
 		break;
 	case WT_HUFFMAN:
 		;
-		huffcode *hcode;
-		hcode = huffcode_new_from_xstrread(ab, rdr);
-		//huffcode_print(hcode);
+		huffcode *hcode = huffcode_new(ab, counts);
 		twt = tmp_wt_init_huff(hcode, ab==NULL);
+		twt->hcode = hcode;
 		break;
 	}
-	tmp_wt_fill(twt, rdr);
+	for (size_t r=0; r<twt->nchars; r++)
+		twt->len += counts[r];
+	tmp_wt_init_len(twt->tmp_root, twt->ab, counts);
+	tmp_wavtree_init_veb_layout(twt);
+	return twt;
+}
+
+
+/*
+ * Root-to-leaf paths of every char, indexed by rank:
+ * the d-th node of the path of the char of rank r is node[r*height+d]
+ * and the bit written to it is bit[r*height+d].
+ */
+typedef struct {
+	size_t  nchars;
+	size_t  nnodes;
+	size_t  height;
+	size_t *depth;
+	size_t *node;
+	byte_t *bit;
+	size_t *offset;
+} wt_paths;
+
+
+static void _wt_paths_init_offsets(size_t *offset, tmp_wtnode *node)
+{
+	if (node == NULL) return;
+	offset[node->index] = node->offset;
+	_wt_paths_init_offsets(offset, node->chd[LEFT]);
+	_wt_paths_init_offsets(offset, node->chd[RIGHT]);
+}
+
+
+static wt_paths *wt_paths_new(tmp_wavtree *twt)
+{
+	wt_paths *paths = NEW(wt_paths);
+	paths->nchars = twt->nchars;
+	paths->nnodes = twt->nnodes;
+	paths->height = twt->tmp_root->height;
+	paths->depth  = ARR_NEW(size_t, MAX(1, paths->nchars));
+	paths->node   = ARR_NEW(size_t, MAX(1, paths->nchars * paths->height));
+	paths->bit    = ARR_NEW(byte_t, MAX(1, paths->nchars * paths->height));
+	paths->offset = ARR_NEW(size_t, MAX(1, paths->nnodes));
+	_wt_paths_init_offsets(paths->offset, twt->tmp_root);
+	for (size_t r=0; r<paths->nchars; r++) {
+		charcode_iter codeit = { .code=get_charcode(twt->chrcodes, ab_char(twt->ab, r)),
+		                         .pos=0
+		                       };
+		size_t d = 0;
+		for (tmp_wtnode *node=twt->tmp_root; node!=NULL; d++) {
+			byte_t bit = charcode_iter_next(&codeit);
+			paths->node[r*paths->height + d] = node->index;
+			paths->bit[r*paths->height + d] = bit;
+			node = node->chd[bit];
+		}
+		paths->depth[r] = d;
+	}
+	return paths;
+}
+
+
+static void wt_paths_free(wt_paths *paths)
+{
+	FREE(paths->depth);
+	FREE(paths->node);
+	FREE(paths->bit);
+	FREE(paths->offset);
+	FREE(paths);
+}
+
+
+/*
+ * Appends the char of rank @p r to the nodes of its path, advancing
+ * the per node write cursors. The raw bits are assumed zeroed,
+ * so only the 1s are actually written. Positions outside
+ * [safe_from[v], safe_to[v]) may lie in a byte shared with a
+ * concurrent writer and are set atomically.
+ */
+static inline void wt_put_char( byte_t *bits, const wt_paths *paths,
+                                size_t r, size_t *cursor,
+                                const size_t *safe_from, const size_t *safe_to )
+{
+	const size_t *node = paths->node + (r * paths->height);
+	const byte_t *bit = paths->bit + (r * paths->height);
+	for (size_t d=0, l=paths->depth[r]; d<l; d++) {
+		size_t v = node[d];
+		size_t pos = cursor[v]++;
+		if (!bit[d]) continue;
+		if (safe_from==NULL || (safe_from[v] <= pos && pos < safe_to[v]))
+			bits[pos/BYTESIZE] |= BITMASK(pos%BYTESIZE);
+		else
+			__atomic_fetch_or( bits + (pos/BYTESIZE), BITMASK(pos%BYTESIZE),
+			                   __ATOMIC_RELAXED );
+	}
+}
+
+
+static wavtree *wt_build_from_reader( alphabet *ab, xstrread *rdr,
+                                      wtshape shape )
+{
+	size_t nchars = ab_size(ab);
+	size_t *counts = ARR_OF_0_NEW(size_t, nchars+1);
+	xstrread_reset(rdr);
+	for (xchar_wt c; (c=xstrread_getc(rdr)) != XEOF;) {
+		counts[ab_rank(ab, c)]++;
+	}
+	tmp_wavtree *twt = tmp_wt_init(ab, shape, counts);
+	wt_paths *paths = wt_paths_new(twt);
+	size_t *cursor = ARR_NEW(size_t, MAX(1, twt->nnodes));
+	memcpy(cursor, paths->offset, twt->nnodes * sizeof(size_t));
+	xstrread_reset(rdr);
+	for (xchar_wt c; (c=xstrread_getc(rdr)) != XEOF;) {
+		size_t r = ab_rank(ab, c);
+		if (r < nchars)
+			wt_put_char(twt->raw_bits, paths, r, cursor, NULL, NULL);
+	}
 	wavtree *wt = wt_build_from_tmp(twt, shape);
-	wt->shape = shape;
+	FREE(cursor);
+	FREE(counts);
+	wt_paths_free(paths);
 	tmp_wt_free(twt);
 	return wt;
 }
 
 
-wavtree *wavtree_new( alphabet *ab, char *str, size_t len, wtshape shape )
+/*
+ * In-memory source: either a plain char string or an xstring.
+ */
+typedef struct {
+	const char *str;
+	const xstr *xs;
+	size_t      len;
+} wt_src;
+
+
+// Number of chars read at a time from an xstring source.
+#define WT_SRC_BLOCK 1024
+
+
+// Copies the chars [from, from+n) of the source into dest.
+static inline void wt_src_get_range(const wt_src *src, size_t from, size_t n,
+                                    xchar_t *dest)
+{
+	if (src->str != NULL) {
+		for (size_t i=0; i<n; i++)
+			dest[i] = (unsigned char)src->str[from+i];
+	} else {
+		xstr_get_range(src->xs, from, n, dest);
+	}
+}
+
+
+/*
+ * A contiguous slice [from, to) of the source handled by one thread.
+ * The cursor, safe_from and safe_to arrays are indexed by node.
+ */
+typedef struct {
+	const wt_src   *src;
+	const alphabet *ab;
+	const wt_paths *paths;
+	byte_t         *bits;
+	size_t          from;
+	size_t          to;
+	size_t         *counts;
+	size_t         *cursor;
+	size_t         *safe_from;
+	size_t         *safe_to;
+} wt_chunk;
+
+
+static void *wt_chunk_count(void *arg)
+{
+	wt_chunk *chunk = (wt_chunk *)arg;
+	xchar_t buf[WT_SRC_BLOCK];
+	for (size_t i=chunk->from; i<chunk->to; i+=WT_SRC_BLOCK) {
+		size_t n = MIN(WT_SRC_BLOCK, chunk->to - i);
+		wt_src_get_range(chunk->src, i, n, buf);
+		for (size_t j=0; j<n; j++)
+			chunk->counts[ab_rank(chunk->ab, buf[j])]++;
+	}
+	return NULL;
+}
+
+
+static void *wt_chunk_fill(void *arg)
 {
-	xstrreader *rdr = xstrreader_open_str(str, len);
-	wavtree *wt = wt_build(ab, xstrreader_as_xstrread(rdr), shape);
-	xstrreader_close(rdr);
+	wt_chunk *chunk = (wt_chunk *)arg;
+	size_t nchars = chunk->paths->nchars;
+	xchar_t buf[WT_SRC_BLOCK];
+	for (size_t i=chunk->from; i<chunk->to; i+=WT_SRC_BLOCK) {
+		size_t n = MIN(WT_SRC_BLOCK, chunk->to - i);
+		wt_src_get_range(chunk->src, i, n, buf);
+		for (size_t j=0; j<n; j++) {
+			size_t r = ab_rank(chunk->ab, buf[j]);
+			if (r < nchars)
+				wt_put_char( chunk->bits, chunk->paths, r, chunk->cursor,
+				             chunk->safe_from, chunk->safe_to );
+		}
+	}
+	return NULL;
+}
+
+
+/*
+ * Runs @p fn over all chunks, one thread per chunk. Falls back to
+ * running a chunk in the calling thread if the thread cannot be created.
+ */
+static void wt_run_chunks( void *(*fn)(void *), wt_chunk *chunks,
+                           size_t nchunks )
+{
+	if (nchunks == 1) {
+		fn(chunks);
+		return;
+	}
+	pthread_t *threads = ARR_NEW(pthread_t, nchunks);
+	bool *started = ARR_OF_0_NEW(bool, nchunks);
+	for (size_t t=0; t<nchunks; t++) {
+		started[t] = (pthread_create(threads+t, NULL, fn, chunks+t) == 0);
+		if (!started[t]) fn(chunks+t);
+	}
+	for (size_t t=0; t<nchunks; t++) {
+		if (started[t]) pthread_join(threads[t], NULL);
+	}
+	FREE(started);
+	FREE(threads);
+}
+
+
+/*
+ * Two-pass construction writing directly into the final bit array.
+ * The source is split into nthreads contiguous chunks. The first pass
+ * counts the chars of every chunk, from which the node lengths and
+ * the exact position at which every chunk starts writing within
+ * every node are derived. The second pass fills the chunks
+ * independently. Distinct chunks write to disjoint bit ranges, so
+ * only the first and last bytes of each range need atomic updates.
+ */
+static wavtree *wt_build_par( alphabet *ab, const wt_src *src,
+                              wtshape shape, size_t nthreads )
+{
+	if (nthreads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (ncpus > 0) ? (size_t)ncpus : 1;
+	}
+	size_t nchunks = MAX(1, MIN(nthreads, src->len));
+	size_t nchars = ab_size(ab);
+
+	wt_chunk *chunks = ARR_NEW(wt_chunk, nchunks);
+	for (size_t t=0; t<nchunks; t++) {
+		chunks[t].src = src;
+		chunks[t].ab = ab;
+		chunks[t].paths = NULL;
+		chunks[t].bits = NULL;
+		chunks[t].from = (t * src->len) / nchunks;
+		chunks[t].to = ((t+1) * src->len) / nchunks;
+		chunks[t].counts = ARR_OF_0_NEW(size_t, nchars+1);
+		chunks[t].cursor = NULL;
+		chunks[t].safe_from = NULL;
+		chunks[t].safe_to = NULL;
+	}
+	wt_run_chunks(wt_chunk_count, chunks, nchunks);
+
+	size_t *counts = ARR_OF_0_NEW(size_t, nchars+1);
+	for (size_t t=0; t<nchunks; t++)
+		for (size_t r=0; r<nchars; r++)
+			counts[r] += chunks[t].counts[r];
+	tmp_wavtree *twt = tmp_wt_init(ab, shape, counts);
+	wt_paths *paths = wt_paths_new(twt);
+	size_t nnodes = MAX(1, twt->nnodes);
+
+	// chunk t starts writing node v right after chunks 0..t-1
+	size_t *start = ARR_NEW(size_t, nnodes);
+	memcpy(start, paths->offset, twt->nnodes * sizeof(size_t));
+	for (size_t t=0; t<nchunks; t++) {
+		chunks[t].paths = paths;
+		chunks[t].bits = twt->raw_bits;
+		chunks[t].cursor = ARR_NEW(size_t, nnodes);
+		memcpy(chunks[t].cursor, start, twt->nnodes * sizeof(size_t));
+		for (size_t r=0; r<nchars; r++) {
+			for (size_t d=0; d<paths->depth[r]; d++)
+				start[paths->node[r*paths->height + d]] += chunks[t].counts[r];
+		}
+		if (nchunks > 1) {
+			chunks[t].safe_from = ARR_NEW(size_t, nnodes);
+			chunks[t].safe_to = ARR_NEW(size_t, nnodes);
+			for (size_t v=0; v<twt->nnodes; v++) {
+				chunks[t].safe_from[v] = ( (chunks[t].cursor[v] + BYTESIZE - 1)
+				                           / BYTESIZE ) * BYTESIZE;
+				chunks[t].safe_to[v] = (start[v] / BYTESIZE) * BYTESIZE;
+			}
+		}
+	}
+	wt_run_chunks(wt_chunk_fill, chunks, nchunks);
+
+	wavtree *wt = wt_build_from_tmp(twt, shape);
+	for (size_t t=0; t<nchunks; t++) {
+		FREE(chunks[t].counts);
+		FREE(chunks[t].cursor);
+		FREE(chunks[t].safe_from);
+		FREE(chunks[t].safe_to);
+	}
+	FREE(chunks);
+	FREE(start);
+	FREE(counts);
+	wt_paths_free(paths);
+	tmp_wt_free(twt);
 	return wt;
 }
 
 
+wavtree *wavtree_new( alphabet *ab, char *str, size_t len, wtshape shape )
+{
+	return wavtree_new_par(ab, str, len, shape, 1);
+}
+
+
+wavtree *wavtree_new_par( alphabet *ab, char *str, size_t len, wtshape shape,
+                          size_t nthreads )
+{
+	wt_src src = {.str=str, .xs=NULL, .len=len};
+	return wt_build_par(ab, &src, shape, nthreads);
+}
+
+
 wavtree *wavtree_new_from_xstr( alphabet *ab, xstr *str, wtshape shape )
 {
-	xstrreader *rdr = xstrreader_open(str);
-	wavtree *wt = wt_build(ab, xstrreader_as_xstrread(rdr), shape);
-	xstrreader_close(rdr);
-	return wt;
+	return wavtree_new_from_xstr_par(ab, str, shape, 1);
+}
+
+
+wavtree *wavtree_new_from_xstr_par( alphabet *ab, xstr *str, wtshape shape,
+                                    size_t nthreads )
+{
+	wt_src src = {.str=NULL, .xs=str, .len=xstr_len(str)};
+	return wt_build_par(ab, &src, shape, nthreads);
 }
 
 
 wavtree *wavtree_new_from_reader( alphabet *ab, xstrread *src, wtshape shape )
 {
-	return wt_build( ab, src, shape);
+	return wt_build_from_reader( ab, src, shape);
 }
 
 
@@ -600,8 +997,10 @@ wavtree *wavtree_new_online( strread *src )
 {
 	tmp_wavtree *twt =  tmp_wt_init_bal(NULL, true);
 	tmp_wt_fill_online(twt, src);
+	tmp_wt_init_len_from_bv(twt->tmp_root);
+	tmp_wavtree_init_veb_layout(twt);
+	tmp_wt_flush_bv(twt->tmp_root, twt->raw_bits);
 	wavtree *wt = wt_build_from_tmp(twt, WT_BALANCED);
-	wt->shape = WT_BALANCED;
 	tmp_wt_free(twt);
 	return wt;
 }
@@ -611,6 +1010,10 @@ void wavtree_free(wavtree *wt)
 {
 	if (wt==NULL) return;
 	if (wt->own_ab) alphabet_free(wt->ab);
+	for (size_t i=0, l=vec_len(wt->chrcodes); i<l; i++) {
+		bitvec *code = *((bitvec **)vec_get(wt->chrcodes, i));
+		if (code != NULL_CODE) bitvec_free(code);
+	}
 	DESTROY_FLAT(wt->chrcodes, vec);
 	csrsbitarr_free(wt->bitarr, true);
 	FREE(wt->nodes);
@@ -717,6 +1120,13 @@ size_t wavtree_succ(wavtree *wt, size_t pos, xchar_t c)
 
 
 xchar_t wavtree_char(wavtree *wt, size_t pos)
+{
+	size_t rank;
+	return wavtree_char_rank(wt, pos, &rank);
+}
+
+
+xchar_t wavtree_char_rank(wavtree *wt, size_t pos, size_t *rank_pos)
 {
 	if ( pos >= wt->len ) return XEOF;
 	size_t cur = 0;
@@ -731,10 +1141,187 @@ xchar_t wavtree_char(wavtree *wt, size_t pos)
 		else
 			break;
 	}
+	*rank_pos = rank;
 	return wt->nodes[cur].cc[bit].chr;
 }
 
 
+// Range operations
+
+/*
+ * Number of 1s in the first @p pos bits of node @p cur.
+ */
+static inline size_t _wt_node_rank1(wavtree *wt, size_t cur, size_t pos)
+{
+	return csrsbitarr_rank1(wt->bitarr, wt->nodes[cur].offset + pos)
+	       - wt->nodes[cur].cumul_bits[1];
+}
+
+
+static size_t _wt_range_count( wavtree *wt, size_t cur, size_t lo, size_t hi,
+                               size_t rkmin, size_t rkmax )
+{
+	wtnode *node = wt->nodes + cur;
+	if (lo >= hi || node->rk_hi < rkmin || rkmax < node->rk_lo)
+		return 0;
+	if (rkmin <= node->rk_lo && node->rk_hi <= rkmax)
+		return hi - lo;
+	size_t lo1 = _wt_node_rank1(wt, cur, lo);
+	size_t hi1 = _wt_node_rank1(wt, cur, hi);
+	size_t l[2] = {lo-lo1, lo1};
+	size_t h[2] = {hi-hi1, hi1};
+	size_t count = 0;
+	for (byte_t dir=LEFT; dir<=RIGHT; dir++) {
+		if (node->has_chd & (dir+1)) {
+			count += _wt_range_count( wt, node->cc[dir].chd, l[dir], h[dir],
+			                          rkmin, rkmax );
+		}
+		else if (node->cc[dir].chr != XEOF) {
+			size_t rk = ab_rank(wt->ab, node->cc[dir].chr);
+			if (rkmin <= rk && rk <= rkmax)
+				count += h[dir] - l[dir];
+		}
+	}
+	return count;
+}
+
+
+size_t wavtree_range_count( wavtree *wt, size_t lo, size_t hi,
+                            xchar_t cmin, xchar_t cmax )
+{
+	hi = MIN(hi, wt->len);
+	size_t rkmin = ab_rank(wt->ab, cmin);
+	size_t rkmax = ab_rank(wt->ab, cmax);
+	size_t nchars = ab_size(wt->ab);
+	if (lo >= hi || rkmin >= nchars || rkmax >= nchars || rkmin > rkmax)
+		return 0;
+	return _wt_range_count(wt, 0, lo, hi, rkmin, rkmax);
+}
+
+
+static void _wt_rank_all(wavtree *wt, size_t cur, size_t pos, size_t *counts)
+{
+	if (pos == 0) return;
+	wtnode *node = wt->nodes + cur;
+	size_t pos1 = _wt_node_rank1(wt, cur, pos);
+	size_t p[2] = {pos-pos1, pos1};
+	for (byte_t dir=LEFT; dir<=RIGHT; dir++) {
+		if (node->has_chd & (dir+1))
+			_wt_rank_all(wt, node->cc[dir].chd, p[dir], counts);
+		else if (node->cc[dir].chr != XEOF)
+			counts[ab_rank(wt->ab, node->cc[dir].chr)] = p[dir];
+	}
+}
+
+
+void wavtree_rank_all(wavtree *wt, size_t pos, size_t *counts)
+{
+	memset(counts, 0, ab_size(wt->ab) * sizeof(size_t));
+	if (wt->len == 0) return;
+	_wt_rank_all(wt, 0, MIN(pos, wt->len), counts);
+}
+
+
+/*
+ * Occurrence counts of every char (by rank) in [lo, hi).
+ * Used by the range queries on trees whose leaves are not in
+ * rank order.
+ */
+static size_t *_wt_range_counts(wavtree *wt, size_t lo, size_t hi)
+{
+	size_t nchars = ab_size(wt->ab);
+	size_t *counts = ARR_NEW(size_t, MAX(1, nchars));
+	size_t *lo_counts = ARR_NEW(size_t, MAX(1, nchars));
+	wavtree_rank_all(wt, hi, counts);
+	wavtree_rank_all(wt, lo, lo_counts);
+	for (size_t r=0; r<nchars; r++)
+		counts[r] -= lo_counts[r];
+	FREE(lo_counts);
+	return counts;
+}
+
+
+xchar_t wavtree_range_quantile(wavtree *wt, size_t lo, size_t hi, size_t k)
+{
+	hi = MIN(hi, wt->len);
+	if (lo >= hi || k >= hi-lo) return XEOF;
+	if (!wt->ordered) {
+		size_t *counts = _wt_range_counts(wt, lo, hi);
+		size_t r = 0;
+		while (k >= counts[r])
+			k -= counts[r++];
+		FREE(counts);
+		return ab_char(wt->ab, r);
+	}
+	size_t cur = 0;
+	while (true) {
+		size_t lo1 = _wt_node_rank1(wt, cur, lo);
+		size_t hi1 = _wt_node_rank1(wt, cur, hi);
+		size_t nzeros = (hi-hi1) - (lo-lo1);
+		byte_t bit = (k >= nzeros);
+		if (bit) {
+			k -= nzeros;
+			lo = lo1;
+			hi = hi1;
+		}
+		else {
+			lo -= lo1;
+			hi -= hi1;
+		}
+		if (wt->nodes[cur].has_chd & (bit+1))
+			cur = wt->nodes[cur].cc[bit].chd;
+		else
+			return wt->nodes[cur].cc[bit].chr;
+	}
+}
+
+
+static size_t _wt_range_distinct( wavtree *wt, size_t cur, size_t lo,
+                                  size_t hi, xchar_t *chars, size_t *counts,
+                                  size_t ndist )
+{
+	if (lo >= hi) return ndist;
+	wtnode *node = wt->nodes + cur;
+	size_t lo1 = _wt_node_rank1(wt, cur, lo);
+	size_t hi1 = _wt_node_rank1(wt, cur, hi);
+	size_t l[2] = {lo-lo1, lo1};
+	size_t h[2] = {hi-hi1, hi1};
+	for (byte_t dir=LEFT; dir<=RIGHT; dir++) {
+		if (node->has_chd & (dir+1)) {
+			ndist = _wt_range_distinct( wt, node->cc[dir].chd, l[dir], h[dir],
+			                            chars, counts, ndist );
+		}
+		else if (h[dir] > l[dir]) {
+			chars[ndist] = node->cc[dir].chr;
+			counts[ndist] = h[dir] - l[dir];
+			ndist++;
+		}
+	}
+	return ndist;
+}
+
+
+size_t wavtree_range_distinct( wavtree *wt, size_t lo, size_t hi,
+                               xchar_t *chars, size_t *counts )
+{
+	hi = MIN(hi, wt->len);
+	if (lo >= hi) return 0;
+	if (wt->ordered)
+		return _wt_range_distinct(wt, 0, lo, hi, chars, counts, 0);
+	size_t *rkcounts = _wt_range_counts(wt, lo, hi);
+	size_t ndist = 0;
+	for (size_t r=0, nchars=ab_size(wt->ab); r<nchars; r++) {
+		if (rkcounts[r] > 0) {
+			chars[ndist] = ab_char(wt->ab, r);
+			counts[ndist] = rkcounts[r];
+			ndist++;
+		}
+	}
+	FREE(rkcounts);
+	return ndist;
+}
+
+
 // Print
 
 void _wt_node_print(wavtree *wt, size_t cur, size_t depth)
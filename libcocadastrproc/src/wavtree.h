@@ -71,6 +71,25 @@ typedef struct _wavtree wavtree;
 wavtree *wavtree_new(alphabet *ab, char *src, size_t len, wtshape shape);
 
 
+/**
+ * @brief Parallel version of ::wavtree_new.
+ *
+ * The source is split into @p nthreads contiguous chunks which are
+ * counted and then written directly into the final bit array by
+ * concurrent threads. The resulting tree is identical to the one
+ * built by ::wavtree_new.
+ *
+ * @param ab The base alphabet.
+ * @param src The source string.
+ * @param len The length of the source string.
+ * @param shape The WT shape.
+ * @param nthreads The number of threads. If 0, uses the number of
+ *        online processors.
+ */
+wavtree *wavtree_new_par(alphabet *ab, char *src, size_t len, wtshape shape,
+                         size_t nthreads);
+
+
 /**
  * @brief Creates a wavelet tree from a stream with known alphabet @p ab.
  * @param ab The base alphabet.
@@ -90,6 +109,14 @@ wavtree *wavtree_new_from_reader(alphabet *ab, xstrread *src, wtshape shape);
  */
 wavtree *wavtree_new_from_xstr(alphabet *ab, xstr *src, wtshape shape);
 
+
+/**
+ * @brief Parallel version of ::wavtree_new_from_xstr.
+ * @see wavtree_new_par
+ */
+wavtree *wavtree_new_from_xstr_par(alphabet *ab, xstr *src, wtshape shape,
+                                   size_t nthreads);
+
 /**
  * @brief Create a balanced wavelet tree from a stream with unknown alphabet
  * as described in
@@ -164,6 +191,64 @@ size_t wavtree_succ(wavtree *wt, size_t pos, xchar_t c);
 xchar_t wavtree_char(wavtree *wt, size_t pos);
 
 
+/**
+ * @brief Returns the char c at position @p pos and stores its
+ *        rank (see ::wavtree_rank_pos) in @p rank_pos, in a single
+ *        descent of the tree. This is the basic step of the
+ *        LF-mapping of an FM-index.
+ *        Returns XEOF if @p pos is out of range, in which case
+ *        @p rank_pos is left untouched.
+ */
+xchar_t wavtree_char_rank(wavtree *wt, size_t pos, size_t *rank_pos);
+
+
+/**
+ * @brief Computes the number of positions @p lo <= j < @p hi such that
+ *        the rank of str[j] is between the ranks of @p cmin and @p cmax
+ *        (inclusive) in the WT alphabet, where str is the string
+ *        represented by the WT.
+ *        Returns 0 if either char is not in the alphabet.
+ */
+size_t wavtree_range_count( wavtree *wt, size_t lo, size_t hi,
+                            xchar_t cmin, xchar_t cmax );
+
+
+/**
+ * @brief Returns the @p k-th smallest char (0-based, in alphabet rank
+ *        order) of str[@p lo:@p hi], where str is the string represented
+ *        by the WT, i.e. the char that would be at position @p k if
+ *        str[@p lo:@p hi] were sorted. Returns XEOF if @p k >= @p hi-@p lo.
+ *
+ * Takes O(log σ) rank operations on balanced trees built over a known
+ * alphabet, whose leaves are in rank order.
+ * Other trees fall back to ::wavtree_rank_all.
+ */
+xchar_t wavtree_range_quantile(wavtree *wt, size_t lo, size_t hi, size_t k);
+
+
+/**
+ * @brief Lists the distinct chars occurring in str[@p lo:@p hi],
+ *        where str is the string represented by the WT.
+ *        The chars are written to @p chars in increasing rank order
+ *        and their respective number of occurrences to @p counts.
+ *        Both arrays must have room for at least as many
+ *        entries as the alphabet size.
+ * @return The number of distinct chars.
+ */
+size_t wavtree_range_distinct( wavtree *wt, size_t lo, size_t hi,
+                               xchar_t *chars, size_t *counts );
+
+
+/**
+ * @brief Computes the c-rank of @p pos for every char c of the
+ *        alphabet in a single traversal of the tree, that is,
+ *        @p counts[r] = wavtree_rank(@p wt, @p pos, c) where r is the
+ *        rank of c.
+ *        @p counts must have room for as many entries as the alphabet size.
+ */
+void wavtree_rank_all(wavtree *wt, size_t pos, size_t *counts);
+
+
 /**
  * @brief Prints a representation of the WT to standard output.
  */
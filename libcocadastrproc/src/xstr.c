@@ -119,30 +119,129 @@ void xstr_free(xstr *self)
 }
 
 
-xchar_t xstr_get(const xstr *self, size_t pos)
+// Generic accessors for char sizes without a native integer type
+static inline xchar_t _get_any(const void *buf, size_t pos, size_t sizeof_char)
 {
 	xchar_t ret = 0;
 #if ENDIANNESS==LITTLE
-	memcpy(&ret, self->buf + (pos * self->sizeof_char), self->sizeof_char);
+	memcpy(&ret, buf + (pos * sizeof_char), sizeof_char);
 #elif ENDIANNESS==BIG
-	memcpy(&ret + (XCHAR_BYTES - self->sizeof_char),
-	       self->buf + (pos * self->sizeof_char), self->sizeof_char);
+	memcpy((byte_t *)&ret + (XCHAR_BYTES - sizeof_char),
+	       buf + (pos * sizeof_char), sizeof_char);
 #endif
 	return ret;
 }
 
 
-void xstr_set(xstr *self, size_t pos, xchar_t val)
+static inline void _set_any(void *buf, size_t pos, size_t sizeof_char,
+                            xchar_t val)
 {
 #if ENDIANNESS==LITTLE
-	memcpy(self->buf + (pos * self->sizeof_char), &val, self->sizeof_char);
+	memcpy(buf + (pos * sizeof_char), &val, sizeof_char);
 #elif ENDIANNESS==BIG
-	memcpy(self->buf + (pos * self->sizeof_char),
-	       &val + (XCHAR_BYTES - self->sizeof_char));
+	memcpy(buf + (pos * sizeof_char),
+	       (byte_t *)&val + (XCHAR_BYTES - sizeof_char), sizeof_char);
 #endif
 }
 
 
+xchar_t xstr_get(const xstr *self, size_t pos)
+{
+	switch (self->sizeof_char) {
+	case 1:
+		return ((const uint8_t *)self->buf)[pos];
+	case 2:
+		return ((const uint16_t *)self->buf)[pos];
+	case 4:
+		return ((const uint32_t *)self->buf)[pos];
+	default:
+		return _get_any(self->buf, pos, self->sizeof_char);
+	}
+}
+
+
+void xstr_set(xstr *self, size_t pos, xchar_t val)
+{
+	switch (self->sizeof_char) {
+	case 1:
+		((uint8_t *)self->buf)[pos] = (uint8_t)val;
+		break;
+	case 2:
+		((uint16_t *)self->buf)[pos] = (uint16_t)val;
+		break;
+	case 4:
+		((uint32_t *)self->buf)[pos] = (uint32_t)val;
+		break;
+	default:
+		_set_any(self->buf, pos, self->sizeof_char, val);
+	}
+}
+
+
+#define XSTR_GET_RANGE(TYPE) { \
+		const TYPE *src = (const TYPE *)self->buf + from; \
+		for (size_t i=0; i<n; i++) dest[i] = src[i]; \
+	}
+
+void xstr_get_range(const xstr *self, size_t from, size_t n, xchar_t *dest)
+{
+	switch (self->sizeof_char) {
+	case 1:
+		XSTR_GET_RANGE(uint8_t);
+		break;
+	case 2:
+		XSTR_GET_RANGE(uint16_t);
+		break;
+	case 4:
+		XSTR_GET_RANGE(uint32_t);
+		break;
+	default:
+		for (size_t i=0; i<n; i++)
+			dest[i] = _get_any(self->buf, from+i, self->sizeof_char);
+	}
+}
+
+
+#define XSTR_SET_RANGE(TYPE) { \
+		TYPE *dest = (TYPE *)self->buf + from; \
+		for (size_t i=0; i<n; i++) dest[i] = (TYPE)src[i]; \
+	}
+
+void xstr_set_range(xstr *self, size_t from, size_t n, const xchar_t *src)
+{
+	if (from + n > self->len) {
+		check_and_resize_by(self, from + n - self->len);
+		self->len = from + n;
+	}
+	switch (self->sizeof_char) {
+	case 1:
+		XSTR_SET_RANGE(uint8_t);
+		break;
+	case 2:
+		XSTR_SET_RANGE(uint16_t);
+		break;
+	case 4:
+		XSTR_SET_RANGE(uint32_t);
+		break;
+	default:
+		for (size_t i=0; i<n; i++)
+			_set_any(self->buf, from+i, self->sizeof_char, src[i]);
+	}
+}
+
+
+#define XSTR_AS_IMPL(TYPE, ...) \
+	TYPE *xstr_as_##TYPE(xstr *self) \
+	{ \
+		ERROR_ASSERT(self->sizeof_char == sizeof(TYPE), \
+		             "Cannot view xstr of %zu-byte chars as "#TYPE".\n", \
+		             self->sizeof_char); \
+		return (TYPE *)self->buf; \
+	}
+
+XSTR_VIEW_TYPES(XSTR_AS_IMPL)
+
+
 void xstr_nset(xstr *self, size_t n, xchar_t val)
 {
 	size_t l = MIN(xstr_len(self), n);
@@ -188,13 +287,11 @@ void xstr_push(xstr *self, xchar_t c)
 void xstr_push_n(xstr *self, xchar_t c, size_t n)
 {
 	check_and_resize_by(self, n);
-	void *last = self->buf + (self->len * self->sizeof_char);
-	for (size_t i=0; i<n; i++, last += self->sizeof_char) {
-#if ENDIANNESS==LITTLE
-		memcpy(last, &c, self->sizeof_char);
-#elif ENDIANNESS==BIG
-		memcpy(last, &c + (XCHAR_BYTES - self->sizeof_char), self->sizeof_char);
-#endif
+	if (self->sizeof_char == 1) {
+		memset(self->buf + self->len, (uint8_t)c, n);
+	} else {
+		for (size_t i=0; i<n; i++)
+			xstr_set(self, self->len + i, c);
 	}
 	self->len += n;
 }
@@ -218,13 +315,18 @@ void xstr_cpy(xstr *self, const xstr *src)
 void xstr_ncpy( xstr *self, size_t from_dest, const xstr *src,
                 size_t from_src, size_t n )
 {
-	size_t l = MIN(n, xstr_len(self)-from_dest);
-	for (size_t i=0; i < l; i++ ) {
-		xstr_set(self, from_dest + i, xstr_get(src, from_src + i));
+	if (from_dest + n > self->len) {
+		check_and_resize_by(self, from_dest + n - self->len);
+		self->len = from_dest + n;
 	}
-	for (size_t i=l; i<n; i++) {
-		xstr_push(self, xstr_get(src, from_src + i));
+	if (self->sizeof_char != src->sizeof_char) {
+		for (size_t i=0; i<n; i++)
+			xstr_set(self, from_dest + i, xstr_get(src, from_src + i));
+		return;
 	}
+	memcpy( self->buf + (from_dest * self->sizeof_char),
+	        src->buf + (from_src * src->sizeof_char),
+	        n * self->sizeof_char );
 }
 
 
@@ -275,15 +377,39 @@ void *xstr_detach(xstr *self)
 }
 
 
+// Position of the first differing byte of two buffers, or n if equal.
+// Compares a word at a time.
+static size_t _first_diff_byte(const byte_t *a, const byte_t *b, size_t n)
+{
+	size_t i = 0;
+	for (uint64_t wa, wb; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+		memcpy(&wa, a + i, sizeof(uint64_t));
+		memcpy(&wb, b + i, sizeof(uint64_t));
+		if (wa != wb) break;
+	}
+	while (i < n && a[i] == b[i])
+		i++;
+	return i;
+}
+
+
 int xstr_ncmp(const xstr *self, const xstr *other, size_t n)
 {
 	size_t lt = xstr_len(self);
 	size_t lo = xstr_len(other);
 	size_t m = MIN3(n, lt, lo);
-	intmax_t cmp;
-	for (size_t i=0; i<m;  i++) {
-		cmp = (intmax_t)xstr_get(self, i) - (intmax_t)xstr_get(other, i);
-		if (cmp) return cmp/abs(cmp);
+	if (self->sizeof_char == other->sizeof_char) {
+		size_t sz = self->sizeof_char;
+		size_t d = _first_diff_byte(self->buf, other->buf, m * sz) / sz;
+		if (d < m) {
+			xchar_t a = xstr_get(self, d), b = xstr_get(other, d);
+			return (a < b) ? -1 : +1;
+		}
+	} else {
+		for (size_t i=0; i<m;  i++) {
+			xchar_t a = xstr_get(self, i), b = xstr_get(other, i);
+			if (a != b) return (a < b) ? -1 : +1;
+		}
 	}
 	if (n <= MIN(lt, lo)) return 0;
 	else {
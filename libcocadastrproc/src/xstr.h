@@ -22,6 +22,8 @@
 #ifndef XSTR_H
 #define XSTR_H
 
+#include <stdint.h>
+
 #include "new.h"
 #include "xchar.h"
 
@@ -174,6 +176,57 @@ xchar_t xstr_get(const xstr *self, size_t pos);
 void xstr_set(xstr *self, size_t pos, xchar_t val);
 
 
+/**
+ * @brief Copies the @p n chars starting at position @p from into the
+ *        native array @p dest. Much faster than @p n calls to ::xstr_get.
+ * @warning  No out-of-bounds verification is assumed.
+ */
+void xstr_get_range(const xstr *self, size_t from, size_t n, xchar_t *dest);
+
+
+/**
+ * @brief Copies the @p n chars of the native array @p src over the
+ *        positions [@p from, @p from + @p n) of the xstr, extending
+ *        it if necessary. Much faster than @p n calls to ::xstr_set.
+ * @warning  No out-of-bounds verification is assumed, i.e.
+ *        @p from must be at most xstr_len(self).
+ * @warning  May result in information loss if the internal representation uses a
+ *        smaller number of bytes for each position than sizeof(xchar_t).
+ */
+void xstr_set_range(xstr *self, size_t from, size_t n, const xchar_t *src);
+
+
+/**
+ * @brief Typed views. For each native type TYPE among those listed in
+ * XSTR_VIEW_TYPES, the function
+ * ```C
+ * TYPE *xstr_as_TYPE(xstr *self);
+ * ```
+ * returns the internal buffer of an xstr whose chars have exactly
+ * sizeof(TYPE) bytes as a plain TYPE array, so that hot loops can
+ * be specialised at compile time, e.g.
+ * ```C
+ * if (xstr_sizeof_char(s) == 1) {
+ *     uint8_t *v = xstr_as_uint8_t(s);
+ *     for (size_t i=0, l=xstr_len(s); i<l; i++) v[i] = ...;
+ * }
+ * ```
+ * It is a fatal error to request a view of a different char size.
+ * @warning The view is invalidated by any operation that may grow
+ * the xstr (push, cat, ncpy, set_range...).
+ */
+#define XSTR_VIEW_TYPES(XX, ...) \
+	XX(uint8_t, __VA_ARGS__) \
+	XX(uint16_t, __VA_ARGS__) \
+	XX(uint32_t, __VA_ARGS__) \
+	XX(uint64_t, __VA_ARGS__)
+
+#define XSTR_AS_DECL(TYPE, ...) \
+	TYPE *xstr_as_##TYPE(xstr *self);
+
+XSTR_VIEW_TYPES(XSTR_AS_DECL)
+
+
 /**
  * @brief Sets the first n chars to a specified value
  * @warning  No out-of-bounds verification is assumed.
@@ -220,11 +273,12 @@ void xstr_cpy(xstr *self, const xstr *src);
  *        position @p from_self. That is, copies and pastes
  *        @p other[@p from_other : @p from_other + @p n] over
  *        @p self[@p from_self : @p from_self + @p n].
- *        Source and destination may not overlap.
+ *        Source and destination may not overlap. The destination is
+ *        extended if @p from_self + @p n exceeds its length.
+ *        When both xstrs have the same internal character bytesize,
+ *        the chars are copied in bulk.
  *
- * @warning Assumes without verification that both xstrs have the same internal
- *       character bytesize.
- * @warning The destination must be large enough, or a buffer overrun will occur.
+ * @warning @p from_self must be at most xstr_len(self).
  *       No out-of-bounds verification is performed.
  */
 void xstr_ncpy( xstr *self, size_t from_self, const xstr *other,
@@ -21,14 +21,20 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "alphabet.h"
 #include "arrays.h"
-#include "math.h"
+#include "errlog.h"
+#include "mathutil.h"
 #include "new.h"
 #include "xstr.h"
 #include "xstrhash.h"
 
+// # of chars processed at a time by the bulk functions
+#define ROLL_BLOCK 1024
+
+
 struct _xstrhash {
 	alphabet *ab;
 	size_t max_exp;
@@ -46,9 +52,9 @@ static void _initpow(xstrhash *self)
 		p *= base;
 	}
 	self->max_exp = e;
-	self->pow = ARR_NEW(uint64_t, e);
+	self->pow = ARR_NEW(uint64_t, e+1);
 	p = 1;
-	for (size_t i=0; i<e; i++) {
+	for (size_t i=0; i<=e; i++) {
 		self->pow[i] = p;
 		p *= base;
 	}
@@ -78,6 +84,7 @@ void xstrhash_finalise(void *ptr, const finaliser *fnr)
 {
 	xstrhash *self = (xstrhash *)ptr;
 	DESTROY_FLAT(self->ab, alphabet);
+	FREE(self->pow);
 }
 
 
@@ -91,9 +98,15 @@ uint64_t xstrhash_lex_sub(const xstrhash *self, const xstr *s, size_t from,
                           size_t to)
 {
 	uint64_t hash = 0;
-	for (size_t i=from; i < to; i++) {
-		hash *= ab_size(self->ab);
-		hash += ab_rank(self->ab, xstr_get(s, i));
+	uint64_t base = ab_size(self->ab);
+	xchar_t buf[ROLL_BLOCK];
+	for (size_t i=from; i < to; i+=ROLL_BLOCK) {
+		size_t n = MIN(ROLL_BLOCK, to - i);
+		xstr_get_range(s, i, n, buf);
+		for (size_t j=0; j<n; j++) {
+			hash *= base;
+			hash += ab_rank(self->ab, buf[j]);
+		}
 	}
 	return hash;
 }
@@ -103,6 +116,7 @@ uint64_t xstrhash_roll_lex(const xstrhash *self, const xstr *s, uint64_t hash,
                            xchar_t c)
 {
 	hash -= _pow(self, xstr_len(s)-1) * ab_rank(self->ab, xstr_get(s, 0));
+	hash *= ab_size(self->ab);
 	hash += ab_rank(self->ab, c);
 	return hash;
 }
@@ -115,4 +129,324 @@ uint64_t xstrhash_roll_lex_sub(const xstrhash *self, const xstr *s, size_t from,
 	hash *= ab_size(self->ab);
 	hash += ab_rank(self->ab, c);
 	return hash;
-}
\ No newline at end of file
+}
+
+
+/*
+ * Rolling hashes
+ */
+
+#define MERSENNE61 ((UINT64_C(1) << 61) - 1)
+
+// ntHash seeds of A, C, G, T
+static const uint64_t NT_SEEDS[4] = {
+	UINT64_C(0x3c8bfbb395c60474), UINT64_C(0x3193c18562a02b4c),
+	UINT64_C(0x20323ed082572324), UINT64_C(0x295549f54be24456)
+};
+
+#define NT_MULTI_SEED  UINT64_C(0x90b45d39fb6da1fa)
+#define NT_MULTI_SHIFT 27
+
+
+struct _rollhash {
+	rollhash_type   type;
+	const alphabet *ab;
+	size_t          k;
+	size_t          nranks;  // ab_size + 1 for chars not in the alphabet
+	uint64_t        base;    // KR base
+	uint64_t       *in;      // contribution of a char entering the window
+	uint64_t       *out;     // contribution of a char leaving the window
+	uint64_t       *rc_in;   // same for the reverse complement (ntHash)
+	uint64_t       *rc_out;
+};
+
+
+static inline uint64_t _splitmix64(uint64_t *state)
+{
+	uint64_t z = (*state += UINT64_C(0x9e3779b97f4a7c15));
+	z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+	return z ^ (z >> 31);
+}
+
+
+static inline uint64_t _rotl(uint64_t x, size_t r)
+{
+	r &= 63;
+	return (x << r) | (x >> ((64 - r) & 63));
+}
+
+
+static inline uint64_t _rotr(uint64_t x, size_t r)
+{
+	return _rotl(x, 64 - (r & 63));
+}
+
+
+// x mod 2^61-1 for any 64-bit x
+static inline uint64_t _mod61(uint64_t x)
+{
+	x = (x & MERSENNE61) + (x >> 61);
+	return (x >= MERSENNE61) ? x - MERSENNE61 : x;
+}
+
+
+// a * b mod 2^61-1 for a, b < 2^61
+static inline uint64_t _mulmod61(uint64_t a, uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+	__uint128_t p = (__uint128_t)a * b;
+	return _mod61(((uint64_t)p & MERSENNE61) + (uint64_t)(p >> 61));
+#else
+	// a*b = hi 2^64 + mid 2^32 + lo, and 2^61 = 1 (mod 2^61-1)
+	uint64_t ah = a >> 32, al = a & UINT32_MAX;
+	uint64_t bh = b >> 32, bl = b & UINT32_MAX;
+	uint64_t lo = al * bl, mid = ah * bl + al * bh, hi = ah * bh;
+	uint64_t r = _mod61(lo) + ((mid & ((UINT64_C(1) << 29) - 1)) << 32)
+	             + (mid >> 29) + (hi << 3);
+	return _mod61(r);
+#endif
+}
+
+
+rollhash *rollhash_new(rollhash_type type, const alphabet *ab, size_t k,
+                       uint64_t seed)
+{
+	if (k == 0) {
+		WARN("Invalid rolling hash window length 0.\n");
+		return NULL;
+	}
+	if (type == ROLLHASH_NTHASH && ab_size(ab) != 4) {
+		WARN("ntHash requires a 4-letter alphabet (got %zu letters).\n",
+		     ab_size(ab));
+		return NULL;
+	}
+	rollhash *ret = NEW(rollhash);
+	ret->type = type;
+	ret->ab = ab;
+	ret->k = k;
+	ret->nranks = ab_size(ab) + 1;
+	ret->base = 0;
+	ret->in = ARR_NEW(uint64_t, ret->nranks);
+	ret->out = ARR_NEW(uint64_t, ret->nranks);
+	ret->rc_in = NULL;
+	ret->rc_out = NULL;
+	uint64_t state = seed;
+	switch (type) {
+	case ROLLHASH_KARP_RABIN:
+		ret->base = (_splitmix64(&state) % (MERSENNE61 - 2)) + 2;
+		uint64_t bk = 1;
+		for (size_t i=0; i<k; i++)
+			bk = _mulmod61(bk, ret->base);
+		for (size_t r=0; r<ret->nranks; r++) {
+			ret->in[r] = r + 1;
+			// subtracted from the window hash
+			ret->out[r] = MERSENNE61 - _mulmod61(r + 1, bk);
+		}
+		break;
+	case ROLLHASH_BUZHASH:
+		for (size_t r=0; r<ret->nranks; r++) {
+			ret->in[r] = _splitmix64(&state);
+			ret->out[r] = _rotl(ret->in[r], k);
+		}
+		break;
+	case ROLLHASH_NTHASH:
+		ret->rc_in = ARR_NEW(uint64_t, ret->nranks);
+		ret->rc_out = ARR_NEW(uint64_t, ret->nranks);
+		for (size_t r=0; r<4; r++)
+			ret->in[r] = NT_SEEDS[r] ^ ((seed != 0) ? _splitmix64(&state) : 0);
+		ret->in[4] = 0;
+		for (size_t r=0; r<5; r++) {
+			uint64_t comp = (r < 4) ? ret->in[3 - r] : 0;
+			ret->out[r] = _rotl(ret->in[r], k);
+			ret->rc_in[r] = _rotl(comp, k - 1);
+			ret->rc_out[r] = _rotr(comp, 1);
+		}
+		break;
+	}
+	return ret;
+}
+
+
+void rollhash_free(rollhash *self)
+{
+	if (self == NULL) return;
+	FREE(self->in);
+	FREE(self->out);
+	FREE(self->rc_in);
+	FREE(self->rc_out);
+	FREE(self);
+}
+
+
+size_t rollhash_k(const rollhash *self)
+{
+	return self->k;
+}
+
+
+uint64_t rollhash_value(const rollhash *self, const rollhash_state *st)
+{
+	return (self->type == ROLLHASH_NTHASH) ? MIN(st->fw, st->rc) : st->fw;
+}
+
+
+// Initial state of a window given by the ranks of its chars
+static void _init_ranks(const rollhash *self, rollhash_state *st,
+                        const size_t *rks)
+{
+	uint64_t fw = 0, rc = 0;
+	switch (self->type) {
+	case ROLLHASH_KARP_RABIN:
+		for (size_t i=0; i<self->k; i++)
+			fw = _mod61(_mulmod61(fw, self->base) + self->in[rks[i]]);
+		break;
+	case ROLLHASH_BUZHASH:
+		for (size_t i=0; i<self->k; i++)
+			fw = _rotl(fw, 1) ^ self->in[rks[i]];
+		break;
+	case ROLLHASH_NTHASH:
+		for (size_t i=0; i<self->k; i++) {
+			fw = _rotl(fw, 1) ^ self->in[rks[i]];
+			// rc = XOR_i rotl(comp(s[i]), i)
+			rc ^= _rotr(self->rc_in[rks[i]], self->k - 1 - i);
+		}
+		break;
+	}
+	st->fw = fw;
+	st->rc = rc;
+}
+
+
+static inline void _roll_ranks(const rollhash *self, rollhash_state *st,
+                               size_t out, size_t in)
+{
+	switch (self->type) {
+	case ROLLHASH_KARP_RABIN:
+		st->fw = _mod61( _mulmod61(st->fw, self->base) + self->in[in]
+		                 + self->out[out] );
+		break;
+	case ROLLHASH_BUZHASH:
+		st->fw = _rotl(st->fw, 1) ^ self->out[out] ^ self->in[in];
+		break;
+	case ROLLHASH_NTHASH:
+		st->fw = _rotl(st->fw, 1) ^ self->out[out] ^ self->in[in];
+		st->rc = _rotr(st->rc, 1) ^ self->rc_out[out] ^ self->rc_in[in];
+		break;
+	}
+}
+
+
+uint64_t rollhash_init(const rollhash *self, rollhash_state *st,
+                       const xstr *s, size_t from)
+{
+	size_t *rks = ARR_NEW(size_t, self->k);
+	for (size_t i=0; i<self->k; i++)
+		rks[i] = ab_rank(self->ab, xstr_get(s, from + i));
+	_init_ranks(self, st, rks);
+	FREE(rks);
+	return rollhash_value(self, st);
+}
+
+
+uint64_t rollhash_roll(const rollhash *self, rollhash_state *st,
+                       xchar_t out, xchar_t in)
+{
+	_roll_ranks(self, st, ab_rank(self->ab, out), ab_rank(self->ab, in));
+	return rollhash_value(self, st);
+}
+
+
+// Ranks of the n chars from position from of either a plain string
+// str or an xstr xs
+static void _get_ranks(const rollhash *self, const char *str, const xstr *xs,
+                       size_t from, size_t n, size_t *dest)
+{
+	if (str != NULL) {
+		byte_t rks[ROLL_BLOCK];
+		for (size_t i=0; i<n; i+=ROLL_BLOCK) {
+			size_t m = MIN(ROLL_BLOCK, n - i);
+			ab_rank_bytes(self->ab, str + from + i, m, rks);
+			for (size_t j=0; j<m; j++)
+				dest[i + j] = rks[j];
+		}
+	} else {
+		xchar_t chrs[ROLL_BLOCK];
+		for (size_t i=0; i<n; i+=ROLL_BLOCK) {
+			size_t m = MIN(ROLL_BLOCK, n - i);
+			xstr_get_range(xs, from + i, m, chrs);
+			for (size_t j=0; j<m; j++)
+				dest[i + j] = ab_rank(self->ab, chrs[j]);
+		}
+	}
+}
+
+
+static size_t _many(const rollhash *self, const char *str, const xstr *xs,
+                    size_t len, uint64_t *dest)
+{
+	size_t k = self->k;
+	if (len < k) return 0;
+	// the last k ranks are kept in front of each block
+	size_t *rks = ARR_NEW(size_t, k + ROLL_BLOCK);
+	_get_ranks(self, str, xs, 0, k, rks);
+	rollhash_state st;
+	_init_ranks(self, &st, rks);
+	dest[0] = rollhash_value(self, &st);
+	uint64_t fw = st.fw, rc = st.rc;
+	const uint64_t *tin = self->in, *tout = self->out;
+	const uint64_t *rin = self->rc_in, *rout = self->rc_out;
+	uint64_t base = self->base;
+	for (size_t pos=k; pos<len; pos+=ROLL_BLOCK) {
+		size_t n = MIN(ROLL_BLOCK, len - pos);
+		_get_ranks(self, str, xs, pos, n, rks + k);
+		// one loop per hash type, out of which the chars leaving the
+		// window are rks[j] and those entering are rks[k+j]
+		uint64_t *d = dest + (pos - k + 1);
+		switch (self->type) {
+		case ROLLHASH_KARP_RABIN:
+			for (size_t j=0; j<n; j++) {
+				fw = _mod61(_mulmod61(fw, base) + tin[rks[k+j]] + tout[rks[j]]);
+				d[j] = fw;
+			}
+			break;
+		case ROLLHASH_BUZHASH:
+			for (size_t j=0; j<n; j++) {
+				fw = _rotl(fw, 1) ^ tout[rks[j]] ^ tin[rks[k+j]];
+				d[j] = fw;
+			}
+			break;
+		case ROLLHASH_NTHASH:
+			for (size_t j=0; j<n; j++) {
+				fw = _rotl(fw, 1) ^ tout[rks[j]] ^ tin[rks[k+j]];
+				rc = _rotr(rc, 1) ^ rout[rks[j]] ^ rin[rks[k+j]];
+				d[j] = MIN(fw, rc);
+			}
+			break;
+		}
+		memmove(rks, rks + n, k * sizeof(size_t));
+	}
+	FREE(rks);
+	return len - k + 1;
+}
+
+
+size_t rollhash_many(const rollhash *self, const xstr *s, uint64_t *dest)
+{
+	return _many(self, NULL, s, xstr_len(s), dest);
+}
+
+
+size_t rollhash_many_str(const rollhash *self, const char *s, size_t len,
+                         uint64_t *dest)
+{
+	return _many(self, s, NULL, len, dest);
+}
+
+
+uint64_t rollhash_extra(const rollhash *self, uint64_t h, size_t i)
+{
+	if (i == 0) return h;
+	uint64_t ret = h * (i ^ (self->k * NT_MULTI_SEED));
+	return ret ^ (ret >> NT_MULTI_SHIFT);
+}
@@ -29,6 +29,36 @@
 #include "new.h"
 #include "xstr.h"
 
+/**
+ * @file xstrhash.h
+ * @author Paulo Fonseca
+ *
+ * @brief Hash functions for xstrings.
+ *
+ * The xstrhash functions compute the lexicographic hash of a string
+ * s[0..k-1], sum_i rank(s[i]) * sigma^(k-1-i) (mod 2^64), where sigma
+ * is the alphabet size. This is an injective (perfect) hash as long as
+ * k log2(sigma) <= 64, but overflows and collides for longer strings.
+ *
+ * For longer windows, a ::rollhash computes the hashes of all the
+ * windows of fixed length k of a string in O(1) time each, with one
+ * of the following functions:
+ *
+ * - ::ROLLHASH_KARP_RABIN  Polynomial (Karp-Rabin) hash
+ *   sum_i (rank(s[i])+1) * B^(k-1-i) mod 2^61-1, with a seeded
+ *   random base B. Two distinct windows collide with probability
+ *   at most k/(2^61-1).
+ * - ::ROLLHASH_BUZHASH  Cyclic polynomial hash XOR_i rotl(T[s[i]], k-1-i)
+ *   for a seeded random table T.
+ * - ::ROLLHASH_NTHASH  ntHash (Mohamadi et al., 2016) for the DNA
+ *   alphabet ACGT: the minimum of the cyclic polynomial hashes of the
+ *   window and of its reverse complement, so that a k-mer and its
+ *   reverse complement have the same (canonical) hash.
+ *
+ * Several hash values per window, as needed for Bloom filters and
+ * sketches, can be derived from one with ::rollhash_extra.
+ */
+
 typedef struct _xstrhash xstrhash;
 
 
@@ -44,11 +74,117 @@ uint64_t xstrhash_lex(const xstrhash *self, const xstr *s);
 uint64_t xstrhash_lex_sub(const xstrhash *self, const xstr *s, size_t from,
                           size_t to);
 
+/**
+ * @brief Given the @p hash of @p s, returns the hash of s[1..]c
+ */
 uint64_t xstrhash_roll_lex(const xstrhash *self, const xstr *s, uint64_t hash,
                            xchar_t c);
 
+/**
+ * @brief Given the @p hash of s[from..to-1], returns the hash of
+ *        s[from+1..to-1]c
+ */
 uint64_t xstrhash_roll_lex_sub(const xstrhash *self, const xstr *s, size_t from,
                                size_t to, uint64_t hash, xchar_t c);
 
 
+/**
+ * @brief Rolling hash function types.
+ */
+typedef enum {
+	ROLLHASH_KARP_RABIN = 0, /**< Polynomial hash modulo 2^61-1 */
+	ROLLHASH_BUZHASH    = 1, /**< Cyclic polynomial hash */
+	ROLLHASH_NTHASH     = 2  /**< Canonical DNA hash */
+} rollhash_type;
+
+
+/**
+ * @brief Rolling hash state of a window. The reverse complement hash
+ *        is only used by ::ROLLHASH_NTHASH.
+ */
+typedef struct {
+	uint64_t fw; /**< Hash of the window */
+	uint64_t rc; /**< Hash of the reverse complement of the window */
+} rollhash_state;
+
+
+/**
+ * @brief Rolling hasher type.
+ */
+typedef struct _rollhash rollhash;
+
+
+/**
+ * @brief Creates a rolling hasher for windows of length @p k.
+ * @param ab (no transfer) The alphabet. Chars not in the alphabet are
+ *        hashed as an extra letter of rank ab_size(ab). For
+ *        ::ROLLHASH_NTHASH it must have exactly 4 letters, with the
+ *        complement of rank r being 3-r, as in `ACGT`, and chars not in
+ *        the alphabet (e.g. N) contribute 0 to the hash.
+ * @param seed Selects the hash function from its family. For
+ *        ::ROLLHASH_NTHASH, seed 0 gives the original ntHash values.
+ * @return The hasher, or NULL with a warning if k==0 or if the
+ *        alphabet is not suitable.
+ */
+rollhash *rollhash_new(rollhash_type type, const alphabet *ab, size_t k,
+                       uint64_t seed);
+
+
+/**
+ * @brief Destructor.
+ */
+void rollhash_free(rollhash *self);
+
+
+/**
+ * @brief Returns the window length.
+ */
+size_t rollhash_k(const rollhash *self);
+
+
+/**
+ * @brief Computes from scratch the state of the window
+ *        s[from..from+k-1] into @p st, and returns its hash value.
+ */
+uint64_t rollhash_init(const rollhash *self, rollhash_state *st,
+                       const xstr *s, size_t from);
+
+
+/**
+ * @brief Slides the window of state @p st one position to the right,
+ *        removing the char @p out on the left and appending the
+ *        char @p in, and returns the new hash value.
+ */
+uint64_t rollhash_roll(const rollhash *self, rollhash_state *st,
+                       xchar_t out, xchar_t in);
+
+
+/**
+ * @brief Returns the hash value of a state.
+ */
+uint64_t rollhash_value(const rollhash *self, const rollhash_state *st);
+
+
+/**
+ * @brief Computes the hash values of all the len(s)-k+1 windows of
+ *        @p s into @p dest, processing the chars in blocks.
+ * @return The number of windows (0 if len(s) < k).
+ */
+size_t rollhash_many(const rollhash *self, const xstr *s, uint64_t *dest);
+
+
+/**
+ * @brief Same as ::rollhash_many for a plain string.
+ */
+size_t rollhash_many_str(const rollhash *self, const char *s, size_t len,
+                         uint64_t *dest);
+
+
+/**
+ * @brief Derives the @p i-th of several hash values of a window from
+ *        its hash value @p h, as done by ntHash. For i=0, returns @p h.
+ */
+uint64_t rollhash_extra(const rollhash *self, uint64_t h, size_t i);
+
+
 #endif
\ No newline at end of file
@@ -27,9 +27,20 @@
 
 
 CuSuite *alphabet_get_test_suite();
+CuSuite *bwt_get_test_suite();
+CuSuite *csarray_get_test_suite();
+CuSuite *dbgraph_get_test_suite();
+CuSuite *fmindex_get_test_suite();
+CuSuite *huffcode_get_test_suite();
+CuSuite *lcp_get_test_suite();
+CuSuite *packedstr_get_test_suite();
+CuSuite *ranscode_get_test_suite();
 CuSuite *roaringbitvec_get_test_suite();
+CuSuite *roaring64bitvec_get_test_suite();
 CuSuite *sais_get_test_suite();
+CuSuite *wavtree_get_test_suite();
 CuSuite *xstr_get_test_suite();
+CuSuite *xstrhash_get_test_suite();
 CuSuite *xstrreader_get_test_suite();
 
 
@@ -39,9 +50,20 @@ void run_all_tests(void)
 	CuSuite *suite = CuSuiteNew();
 
 	CuSuiteAddSuite(suite, alphabet_get_test_suite());
-	//CuSuiteAddSuite(suite, roaringbitvec_get_test_suite());
-	//CuSuiteAddSuite(suite, sais_get_test_suite());
-	//CuSuiteAddSuite(suite, xstr_get_test_suite());
+	CuSuiteAddSuite(suite, bwt_get_test_suite());
+	CuSuiteAddSuite(suite, csarray_get_test_suite());
+	CuSuiteAddSuite(suite, dbgraph_get_test_suite());
+	CuSuiteAddSuite(suite, fmindex_get_test_suite());
+	CuSuiteAddSuite(suite, huffcode_get_test_suite());
+	CuSuiteAddSuite(suite, lcp_get_test_suite());
+	CuSuiteAddSuite(suite, packedstr_get_test_suite());
+	CuSuiteAddSuite(suite, ranscode_get_test_suite());
+	CuSuiteAddSuite(suite, roaringbitvec_get_test_suite());
+	CuSuiteAddSuite(suite, roaring64bitvec_get_test_suite());
+	CuSuiteAddSuite(suite, sais_get_test_suite());
+	CuSuiteAddSuite(suite, wavtree_get_test_suite());
+	CuSuiteAddSuite(suite, xstr_get_test_suite());
+	CuSuiteAddSuite(suite, xstrhash_get_test_suite());
 	//CuSuiteAddSuite(suite, xstrreader_get_test_suite());
 
 	CuSuiteRun(suite);
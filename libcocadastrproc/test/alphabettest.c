@@ -20,12 +20,14 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "CuTest.h"
 
 #include "alphabet.h"
 #include "memdbg.h"
+#include "xstr.h"
 
 
 void test_ab(CuTest *tc)
@@ -93,11 +95,86 @@ void test_ab_with_equivs(CuTest *tc)
 	CuAssert(tc, "Memory leak", memdbg_is_empty());
 }
 
+static void _check_bulk_rank(CuTest *tc, alphabet *ab, const char *src,
+                             size_t len)
+{
+	size_t nunk = 0, first = len;
+	for (size_t i = 0; i < len; i++) {
+		if (!ab_contains(ab, (unsigned char)src[i])) {
+			if (nunk == 0) first = i;
+			nunk++;
+		}
+	}
+	byte_t *rks = malloc(len + 1);
+	CuAssertSizeTEquals(tc, nunk, ab_rank_bytes(ab, src, len, rks));
+	for (size_t i = 0; i < len; i++) {
+		CuAssertSizeTEquals(tc, ab_rank(ab, (unsigned char)src[i]), rks[i]);
+	}
+	free(rks);
+	size_t pos;
+	CuAssertSizeTEquals(tc, nunk, ab_validate_str(ab, src, len, &pos));
+	CuAssertSizeTEquals(tc, first, pos);
+	for (size_t sz = 1; sz <= 2; sz++) {
+		xstr *xs = xstr_new(sz);
+		CuAssertSizeTEquals(tc, nunk, ab_rank_str(ab, src, len, xs));
+		CuAssertSizeTEquals(tc, len, xstr_len(xs));
+		for (size_t i = 0; i < len; i++) {
+			CuAssertSizeTEquals(tc, ab_rank(ab, (unsigned char)src[i]),
+			                    xstr_get(xs, i));
+		}
+		if (nunk == 0 && ab_type(ab) == CHAR_TYPE) {
+			char *back = malloc(len + 1);
+			ab_char_str(ab, xs, back);
+			for (size_t i = 0; i < len; i++) {
+				CuAssertIntEquals(tc, ab_char(ab, ab_rank(ab, src[i])), back[i]);
+			}
+			CuAssertIntEquals(tc, '\0', back[len]);
+			free(back);
+		}
+		xstr_free(xs);
+	}
+}
+
+
+void test_ab_rank_str(CuTest *tc)
+{
+	char *nucl[4] = {"Aa", "Cc", "Gg", "Tt"};
+	char *mixed[4] = {"aA@0", "bB1", "cC2", "dD3"};
+	alphabet *abs[5] = {
+		alphabet_new_with_equivs(4, nucl),  // told apart by low nibble
+		alphabet_new_with_equivs(4, mixed), // not so
+		alphabet_new(20, "ACDEFGHIKLMNPQRSTVWY"),
+		alphabet_new(4, "acgt"),
+		int_alphabet_new(100)
+	};
+	const char *pool = "ACGTacgtNn@0123xyzQRS\x80\xff";
+	size_t len = 5000;
+	char *src = malloc(len);
+	for (size_t a = 0; a < 5; a++) {
+		for (size_t t = 0; t < 2; t++) {
+			for (size_t i = 0; i < len; i++) {
+				// mostly letters, with a few outliers
+				src[i] = (t == 0 || rand() % 50)
+				         ? "ACGTacgt"[rand() % 8]
+				         : pool[rand() % strlen(pool)];
+			}
+			for (size_t l = 0; l <= 40; l++) {
+				_check_bulk_rank(tc, abs[a], src + (l % 3), l);
+			}
+			_check_bulk_rank(tc, abs[a], src, len);
+		}
+		alphabet_free(abs[a]);
+	}
+	free(src);
+}
+
+
 CuSuite *alphabet_get_test_suite()
 {
 	CuSuite *suite = CuSuiteNew();
 	SUITE_ADD_TEST(suite, test_ab);
 	SUITE_ADD_TEST(suite, test_int_ab);
 	SUITE_ADD_TEST(suite, test_ab_with_equivs);
+	SUITE_ADD_TEST(suite, test_ab_rank_str);
 	return suite;
 }
\ No newline at end of file
@@ -19,9 +19,11 @@
  *
  */
 
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 
 #include "CuTest.h"
 
@@ -29,9 +31,11 @@
 #include "cstrutil.h"
 #include "bitbyte.h"
 #include "bossdbg.h"
+#include "iter.h"
 #include "strbuf.h"
 #include "mathutil.h"
 #include "strstream.h"
+#include "xstr.h"
 
 static size_t n;
 static alphabet **ab;
@@ -70,7 +74,8 @@ void dbgraph_test_setup(CuTest *tc)
 		slen[i] = 10*i;
 		str[i] = cstr_new(slen[i]);
 		random_seq(ab[i], str[i], slen[i]);
-		dbg_order[i] = 3 + rand()%((i+2)/2);
+		// large enough orders for the packed k+1-mers to span multiple words
+		dbg_order[i] = 3 + rand()%(i+2);
 
 
 
@@ -154,8 +159,9 @@ size_t _outdeg_bf(size_t cs, char *node, bool multigraph)
 	size_t slen = padslen[cs];
 	size_t k = dbg_order[cs];
 	alphabet *abt = bossdbg_ab(g[cs]);
-	bool *outletters = ARR_NEW(bool, ab_size(abt));
-	ARR_FILL(outletters, 0, ab_size(abt), false);
+	// the end sentinel ranks after the letters
+	bool *outletters = ARR_NEW(bool, ab_size(abt) + 1);
+	ARR_FILL(outletters, 0, ab_size(abt) + 1, false);
 	size_t ret = 0;
 	for (size_t i=0, l=slen-k; i<l; i++) {
 		size_t j = 0;
@@ -320,6 +326,7 @@ void test_dbgraph_child(CuTest *tc)
 		for (size_t nrk=0, V=bossdbg_nnodes(dbg); nrk<V; nrk++) {
 			size_t nid = bossdbg_node_id(dbg, nrk);
 			bossdbg_node_lbl(dbg, nid, xpar_lbl);
+			node_cstr(xpar_lbl, abt, par_lbl);
 			for (size_t cr=0, abs=ab_size(abt); cr<abs; cr++) {
 				xchar_t c = ab_char(abt, cr);
 				size_t chd = bossdbg_child(dbg, nid, c);
@@ -343,10 +350,12 @@ void test_dbgraph_child(CuTest *tc)
 		for (size_t nrk=0, V=bossdbg_nnodes(dbg); nrk<V; nrk++) {
 			size_t nid = bossdbg_node_id(dbg, nrk);
 			bossdbg_node_lbl(dbg, nid, xpar_lbl);
+			node_cstr(xpar_lbl, abt, par_lbl);
 			for (size_t cr=0, abs=ab_size(abt); cr<abs; cr++) {
 				char c = ab_char(abt, cr);
 				size_t chd = bossdbg_child(dbg, nid, c);
-				bossdbg_node_lbl(dbg, chd, chd_lbl);
+				bossdbg_node_lbl(dbg, chd, xchd_lbl);
+				node_cstr(xchd_lbl, abt, chd_lbl);
 				//printf("%zu=%s -- %c --> %zu=%s\n", nid, par_lbl, c, chd, chd_lbl);
 				_child_bf(i, par_lbl, c, bossdbg_is_multigraph(dbg), chd_lbl_bf);
 				CuAssertStrEquals(tc, chd_lbl_bf, chd_lbl);
@@ -359,6 +368,400 @@ void test_dbgraph_child(CuTest *tc)
 }
 
 
+static void _assert_same_graph(CuTest *tc, dbgraph *exp, dbgraph *act)
+{
+	CuAssertSizeTEquals(tc, bossdbg_nnodes(exp), bossdbg_nnodes(act));
+	CuAssertSizeTEquals(tc, bossdbg_nedges(exp), bossdbg_nedges(act));
+	alphabet *abt = bossdbg_ab(exp);
+	size_t k = bossdbg_k(exp);
+	size_t sizeof_char = nbytes(ab_size(bossdbg_ext_ab(exp)));
+	xstr *xexp = xstr_new_with_capacity(sizeof_char, k);
+	xstr *xact = xstr_new_with_capacity(sizeof_char, k);
+	for (size_t nrk=0, V=bossdbg_nnodes(exp); nrk<V; nrk++) {
+		size_t eid = bossdbg_node_id(exp, nrk);
+		size_t aid = bossdbg_node_id(act, nrk);
+		CuAssertSizeTEquals(tc, eid, aid);
+		bossdbg_node_lbl(exp, eid, xexp);
+		bossdbg_node_lbl(act, aid, xact);
+		CuAssertIntEquals(tc, 0, xstr_cmp(xexp, xact));
+		CuAssertSizeTEquals(tc, bossdbg_outdeg(exp, eid), bossdbg_outdeg(act, aid));
+		for (size_t cr=0; cr<ab_size(abt); cr++) {
+			xchar_t c = ab_char(abt, cr);
+			CuAssertSizeTEquals(tc, bossdbg_lbl_outdeg(exp, eid, c),
+			                    bossdbg_lbl_outdeg(act, aid, c));
+			CuAssertSizeTEquals(tc, bossdbg_child(exp, eid, c),
+			                    bossdbg_child(act, aid, c));
+		}
+	}
+	xstr_free(xexp);
+	xstr_free(xact);
+}
+
+
+// whether the k-mer at position pos occurs elsewhere in s
+static bool _kmer_repeats(char *s, size_t len, size_t pos, size_t k)
+{
+	for (size_t i=0; i+k<=len; i++)
+		if (i!=pos && strncmp(s+i, s+pos, k)==0)
+			return true;
+	return false;
+}
+
+
+void test_dbgraph_reads_single(CuTest *tc)
+{
+	dbgraph_test_setup(tc);
+	for (size_t i=0; i<n; i++) {
+		size_t k = dbg_order[i];
+		if (slen[i] <= k || _kmer_repeats(str[i], slen[i], 0, k)
+		        || _kmer_repeats(str[i], slen[i], slen[i]-k, k))
+			continue;
+		for (int multi=0; multi<2; multi++) {
+			strstream *sst = strstream_open_str(str[i], slen[i]);
+			dbgraph *rg = bossdbg_new_from_reads(ab[i], &sst, 1, k, multi, 1);
+			strstream_close(sst);
+			_assert_same_graph(tc, multi ? mg[i] : g[i], rg);
+			bossdbg_free(rg);
+		}
+	}
+	dbgraph_test_teardown(tc);
+}
+
+
+static size_t _node_by_lbl(dbgraph *g, char *lbl)
+{
+	alphabet *abt = bossdbg_ab(g);
+	size_t k = bossdbg_k(g);
+	xstr *xnode = xstr_new_with_capacity(nbytes(ab_size(bossdbg_ext_ab(g))), k);
+	char *node = cstr_new(k);
+	size_t ret = bossdbg_nedges(g);
+	for (size_t nrk=0, V=bossdbg_nnodes(g); nrk<V; nrk++) {
+		size_t nid = bossdbg_node_id(g, nrk);
+		bossdbg_node_lbl(g, nid, xnode);
+		node_cstr(xnode, abt, node);
+		if (strcmp(node, lbl)==0) {
+			ret = nid;
+			break;
+		}
+	}
+	xstr_free(xnode);
+	FREE(node);
+	return ret;
+}
+
+
+void test_dbgraph_reads(CuTest *tc)
+{
+	alphabet *abt = alphabet_new(4, "acgt");
+	char *reads[] = {"acgtac", "acgtac", "ggcgtt", "tt", "ggnttg"};
+	size_t nreads = 5, k = 3;
+	char node[4], chd[4];
+	for (size_t min_abund=1; min_abund<=2; min_abund++) {
+		dbgbuilder *bld = bossdbg_builder_new(abt, k, false, min_abund, 0, 2);
+		for (size_t r=0; r<nreads; r++)
+			bossdbg_builder_add_read(bld, reads[r], strlen(reads[r]));
+		dbgraph *rg = bossdbg_builder_build(bld);
+		bossdbg_builder_free(bld);
+
+		// no k-mers across reads (e.g. tac|acg, tac|ggc) or across the n
+		CuAssertSizeTEquals(tc, bossdbg_nedges(rg), _node_by_lbl(rg, "cac"));
+		CuAssertSizeTEquals(tc, bossdbg_nedges(rg), _node_by_lbl(rg, "cgg"));
+		CuAssertSizeTEquals(tc, bossdbg_nedges(rg), _node_by_lbl(rg, "ggt"));
+
+		// k+1-mers occurring twice are always present
+		char *kept[] = {"acgt", "cgta", "gtac"};
+		for (size_t i=0; i<3; i++) {
+			strncpy(node, kept[i], 3);
+			node[3] = '\0';
+			size_t nid = _node_by_lbl(rg, node);
+			CuAssertTrue(tc, nid < bossdbg_nedges(rg));
+			size_t cid = bossdbg_child(rg, nid, kept[i][3]);
+			CuAssertTrue(tc, cid < bossdbg_nedges(rg));
+			xstr *xchd = xstr_new_with_capacity(nbytes(ab_size(bossdbg_ext_ab(rg))), k);
+			bossdbg_node_lbl(rg, cid, xchd);
+			node_cstr(xchd, abt, chd);
+			xstr_free(xchd);
+			CuAssertStrEquals(tc, kept[i]+1, chd);
+		}
+
+		// those occurring once only if min_abund=1
+		size_t nid = _node_by_lbl(rg, "gcg");
+		if (min_abund==1) {
+			CuAssertTrue(tc, nid < bossdbg_nedges(rg));
+			CuAssertTrue(tc, bossdbg_child(rg, nid, 't') < bossdbg_nedges(rg));
+			nid = _node_by_lbl(rg, "cgt");
+			CuAssertSizeTEquals(tc, 2, bossdbg_outdeg(rg, nid));
+		} else {
+			CuAssertSizeTEquals(tc, bossdbg_nedges(rg), nid);
+			nid = _node_by_lbl(rg, "cgt");
+			CuAssertSizeTEquals(tc, 1, bossdbg_outdeg(rg, nid));
+		}
+		bossdbg_free(rg);
+	}
+	alphabet_free(abt);
+}
+
+
+void test_dbgraph_reads_spill(CuTest *tc)
+{
+	alphabet *abt = alphabet_new(4, "acgt");
+	size_t nreads = 400, rlen = 60, k = 7;
+	char *read = cstr_new(rlen);
+	dbgbuilder *mem = bossdbg_builder_new(abt, k, true, 2, 0, 1);
+	// a budget of ~10000 k+1-mers, sorted in 2 slices, spills twice
+	dbgbuilder *ext = bossdbg_builder_new(abt, k, true, 2, 10000 * 32, 4);
+	srand(11);
+	for (size_t r=0; r<nreads; r++) {
+		random_seq(abt, read, rlen);
+		// make some reads overlap
+		if (r%2 && r>1)
+			memcpy(read, read+rlen/2, rlen/2);
+		bossdbg_builder_add_read(mem, read, rlen);
+		bossdbg_builder_add_read(ext, read, rlen);
+	}
+	dbgraph *gm = bossdbg_builder_build(mem);
+	dbgraph *ge = bossdbg_builder_build(ext);
+	_assert_same_graph(tc, gm, ge);
+	bossdbg_free(gm);
+	bossdbg_free(ge);
+	bossdbg_builder_free(mem);
+	bossdbg_builder_free(ext);
+	FREE(read);
+	alphabet_free(abt);
+}
+
+
+void test_dbgraph_reads_spill_many(CuTest *tc)
+{
+	alphabet *abt = alphabet_new(4, "acgt");
+	size_t nreads = 4000, rlen = 60, k = 7;
+	char *read = cstr_new(rlen);
+	dbgbuilder *mem = bossdbg_builder_new(abt, k, true, 2, 0, 1);
+	// the smallest buffer gives ~50 runs, merged in groups as they come
+	dbgbuilder *ext = bossdbg_builder_new(abt, k, true, 2, 1, 2);
+	srand(13);
+	for (size_t r=0; r<nreads; r++) {
+		random_seq(abt, read, rlen);
+		bossdbg_builder_add_read(mem, read, rlen);
+		bossdbg_builder_add_read(ext, read, rlen);
+	}
+	dbgraph *gm = bossdbg_builder_build(mem);
+	dbgraph *ge = bossdbg_builder_build(ext);
+	_assert_same_graph(tc, gm, ge);
+	bossdbg_free(ge);
+
+	// runs that cannot be written make the construction fail
+	struct rlimit lim, old;
+	getrlimit(RLIMIT_FSIZE, &old);
+	lim = old;
+	lim.rlim_cur = 1024;
+	void (*handler)(int) = signal(SIGXFSZ, SIG_IGN);
+	CuAssertIntEquals(tc, 0, setrlimit(RLIMIT_FSIZE, &lim));
+	for (size_t r=0; r<nreads; r++) {
+		random_seq(abt, read, rlen);
+		bossdbg_builder_add_read(ext, read, rlen);
+	}
+	ge = bossdbg_builder_build(ext);
+	setrlimit(RLIMIT_FSIZE, &old);
+	signal(SIGXFSZ, handler);
+	CuAssertPtrEquals(tc, NULL, ge);
+
+	// the builder can be reused
+	bossdbg_builder_add_read(ext, read, rlen);
+	ge = bossdbg_builder_build(ext);
+	CuAssertPtrNotNull(tc, ge);
+	bossdbg_free(ge);
+
+	bossdbg_free(gm);
+	bossdbg_builder_free(mem);
+	bossdbg_builder_free(ext);
+	FREE(read);
+	alphabet_free(abt);
+}
+
+
+void test_dbgraph_children_all(CuTest *tc)
+{
+	dbgraph_test_setup(tc);
+	for (size_t i=0; i<2*n; i++) {
+		dbgraph *dbg = (i<n) ? g[i] : mg[i-n];
+		size_t E = bossdbg_nedges(dbg);
+		xchar_t *lbls = ARR_NEW(xchar_t, E);
+		size_t *chds = ARR_NEW(size_t, E);
+		size_t *indeg = ARR_OF_0_NEW(size_t, E);
+		for (size_t nrk=0, V=bossdbg_nnodes(dbg); nrk<V; nrk++) {
+			size_t nid = bossdbg_node_id(dbg, nrk);
+			size_t deg = bossdbg_children_all(dbg, nid, lbls, chds);
+			CuAssertSizeTEquals(tc, bossdbg_outdeg(dbg, nid), deg);
+			for (size_t j=0; j<deg; j++) {
+				if (lbls[j] == bossdbg_sentinel(dbg)) {
+					CuAssertSizeTEquals(tc, E, chds[j]);
+					continue;
+				}
+				CuAssertSizeTEquals(tc, bossdbg_child(dbg, nid, lbls[j]), chds[j]);
+				indeg[chds[j]]++;
+			}
+		}
+		for (size_t nrk=0, V=bossdbg_nnodes(dbg); nrk<V; nrk++) {
+			size_t nid = bossdbg_node_id(dbg, nrk);
+			CuAssertSizeTEquals(tc, indeg[nid], bossdbg_indeg(dbg, nid));
+			if (indeg[nid] == 0)
+				CuAssertSizeTEquals(tc, E, bossdbg_parent(dbg, nid));
+		}
+		FREE(lbls);
+		FREE(chds);
+		FREE(indeg);
+	}
+	dbgraph_test_teardown(tc);
+}
+
+
+void test_dbgraph_lbl_cache(CuTest *tc)
+{
+	dbgraph_test_setup(tc);
+	for (size_t i=0; i<n; i++) {
+		dbgraph *dbg = g[i];
+		size_t sizeof_char = nbytes(ab_size(bossdbg_ext_ab(dbg)));
+		xstr *xexp = xstr_new_with_capacity(sizeof_char, bossdbg_k(dbg));
+		xstr *xact = xstr_new_with_capacity(sizeof_char, bossdbg_k(dbg));
+		// tiny caches force collisions
+		for (size_t nslots=1; nslots<=64; nslots*=8) {
+			dbglblcache *cache = bossdbg_lblcache_new(dbg, nslots);
+			for (size_t rep=0; rep<2; rep++) {
+				// in order and in random order
+				for (size_t j=0, V=bossdbg_nnodes(dbg); j<V; j++) {
+					size_t nrk = rep ? (size_t)rand()%V : j;
+					size_t nid = bossdbg_node_id(dbg, nrk);
+					bossdbg_node_lbl(dbg, nid, xexp);
+					bossdbg_node_lbl_cached(cache, nid, xact);
+					CuAssertIntEquals(tc, 0, xstr_cmp(xexp, xact));
+				}
+			}
+			bossdbg_node_lbl_cached(cache, bossdbg_nedges(dbg), xact);
+			CuAssertSizeTEquals(tc, 0, xstr_len(xact));
+			bossdbg_lblcache_free(cache);
+		}
+		xstr_free(xexp);
+		xstr_free(xact);
+	}
+	dbgraph_test_teardown(tc);
+}
+
+
+void test_dbgraph_unitigs(CuTest *tc)
+{
+	dbgraph_test_setup(tc);
+	for (size_t i=0; i<n; i++) {
+		dbgraph *dbg = g[i];
+		size_t k = bossdbg_k(dbg);
+		size_t E = bossdbg_nedges(dbg);
+		size_t *seen = ARR_OF_0_NEW(size_t, E);
+		size_t nreal = 0, ncovered = 0, nunitigs = 0;
+		for (size_t nrk=0, V=bossdbg_nnodes(dbg); nrk<V; nrk++)
+			nreal += !bossdbg_is_dummy(dbg, bossdbg_node_id(dbg, nrk));
+		char *seq = cstr_new(slen[i] + k);
+		dbgunitig_iter *it = bossdbg_unitigs(dbg);
+		FOREACH_IN_ITER(u, dbgunitig, dbgunitig_iter_as_iter(it)) {
+			CuAssertTrue(tc, !bossdbg_is_dummy(dbg, u->first));
+			CuAssertTrue(tc, !bossdbg_is_dummy(dbg, u->last));
+			CuAssertSizeTEquals(tc, k + u->nnodes - 1, xstr_len(u->seq));
+			CuAssertTrue(tc, !u->cycle);
+			seen[u->first]++;
+			ncovered += u->nnodes;
+			nunitigs++;
+			// every k+1-mer of a unitig is an edge of the source string
+			for (size_t j=0, l=xstr_len(u->seq); j<l; j++)
+				seq[j] = (char)xstr_get(u->seq, j);
+			seq[xstr_len(u->seq)] = '\0';
+			for (size_t j=0; j+k<xstr_len(u->seq); j++) {
+				char kmer[k+2];
+				strncpy(kmer, seq+j, k+1);
+				kmer[k+1] = '\0';
+				CuAssertPtrNotNull(tc, strstr(str[i], kmer));
+			}
+			// with no repeated k-mers the string is a single unitig
+			if (slen[i] >= k && nreal == slen[i]-k+1)
+				CuAssertStrEquals(tc, str[i], seq);
+		}
+		bossdbg_unitigs_free(it);
+		CuAssertSizeTEquals(tc, nreal, ncovered);
+		for (size_t j=0; j<E; j++)
+			CuAssertTrue(tc, seen[j] <= 1);
+		FREE(seq);
+		FREE(seen);
+	}
+	dbgraph_test_teardown(tc);
+
+	// a read whose k-mers close an isolated cycle
+	alphabet *abt = alphabet_new(4, "acgt");
+	char *read = "acgtacg";
+	dbgbuilder *bld = bossdbg_builder_new(abt, 3, false, 1, 0, 1);
+	bossdbg_builder_add_read(bld, read, strlen(read));
+	dbgraph *cg = bossdbg_builder_build(bld);
+	bossdbg_builder_free(bld);
+	dbgunitig_iter *it = bossdbg_unitigs(cg);
+	size_t nunitigs = 0;
+	FOREACH_IN_ITER(u, dbgunitig, dbgunitig_iter_as_iter(it)) {
+		CuAssertTrue(tc, u->cycle);
+		CuAssertSizeTEquals(tc, 4, u->nnodes);
+		CuAssertSizeTEquals(tc, 6, xstr_len(u->seq));
+		nunitigs++;
+	}
+	CuAssertSizeTEquals(tc, 1, nunitigs);
+	bossdbg_unitigs_free(it);
+	bossdbg_free(cg);
+	alphabet_free(abt);
+}
+
+
+typedef struct {
+	dbgraph *g;
+	size_t  *visits;
+	size_t  *ok_lbls;
+} _foreach_ctx;
+
+
+static void _count_node(dbgraph *g, size_t nid, const xstr *lbl,
+                        size_t tid, void *ctx)
+{
+	_foreach_ctx *fc = (_foreach_ctx *)ctx;
+	fc->visits[nid]++;
+	xstr *exp = xstr_new_with_capacity(nbytes(ab_size(bossdbg_ext_ab(g))),
+	                                   bossdbg_k(g));
+	bossdbg_node_lbl(g, nid, exp);
+	fc->ok_lbls[nid] = (lbl != NULL && xstr_cmp(exp, lbl) == 0);
+	xstr_free(exp);
+}
+
+
+void test_dbgraph_foreach_node_par(CuTest *tc)
+{
+	dbgraph_test_setup(tc);
+	for (size_t i=0; i<n; i++) {
+		dbgraph *dbg = mg[i];
+		size_t E = bossdbg_nedges(dbg);
+		for (size_t nthreads=1; nthreads<=3; nthreads++) {
+			_foreach_ctx fc = {dbg, ARR_OF_0_NEW(size_t, E),
+			                   ARR_OF_0_NEW(size_t, E)
+			                  };
+			bossdbg_foreach_node_par(dbg, _count_node, true, &fc, nthreads);
+			size_t nvisits = 0;
+			for (size_t j=0; j<E; j++)
+				nvisits += fc.visits[j];
+			CuAssertSizeTEquals(tc, bossdbg_nnodes(dbg), nvisits);
+			for (size_t nrk=0, V=bossdbg_nnodes(dbg); nrk<V; nrk++) {
+				size_t nid = bossdbg_node_id(dbg, nrk);
+				CuAssertSizeTEquals(tc, 1, fc.visits[nid]);
+				CuAssertSizeTEquals(tc, 1, fc.ok_lbls[nid]);
+			}
+			FREE(fc.visits);
+			FREE(fc.ok_lbls);
+		}
+	}
+	dbgraph_test_teardown(tc);
+}
+
+
 CuSuite *dbgraph_get_test_suite()
 {
 	CuSuite *suite = CuSuiteNew();
@@ -366,5 +769,13 @@ CuSuite *dbgraph_get_test_suite()
 	SUITE_ADD_TEST(suite, test_dbgraph_outdeg);
 	SUITE_ADD_TEST(suite, test_bossdbg_lbl_outdeg);
 	SUITE_ADD_TEST(suite, test_dbgraph_child);
+	SUITE_ADD_TEST(suite, test_dbgraph_reads_single);
+	SUITE_ADD_TEST(suite, test_dbgraph_reads);
+	SUITE_ADD_TEST(suite, test_dbgraph_reads_spill);
+	SUITE_ADD_TEST(suite, test_dbgraph_children_all);
+	SUITE_ADD_TEST(suite, test_dbgraph_lbl_cache);
+	SUITE_ADD_TEST(suite, test_dbgraph_unitigs);
+	SUITE_ADD_TEST(suite, test_dbgraph_foreach_node_par);
+	SUITE_ADD_TEST(suite, test_dbgraph_reads_spill_many);
 	return suite;
 }
\ No newline at end of file
@@ -0,0 +1,180 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CuTest.h"
+
+#include "alphabet.h"
+#include "arrays.h"
+#include "bwt.h"
+#include "cstrutil.h"
+#include "memdbg.h"
+#include "randutil.h"
+#include "sais.h"
+#include "strstream.h"
+#include "wavtree.h"
+
+
+static char *bwt_random_str(alphabet *ab, size_t len, size_t period)
+{
+	char *ret = cstr_new(len);
+	for (size_t i=0; i < len; i++) {
+		ret[i] = (period && i >= period && rand_range_size_t(0, 50))
+		         ? ret[i - period]
+		         : (char)ab_char(ab, rand_range_size_t(0, ab_size(ab)));
+	}
+	return ret;
+}
+
+
+// BWT without the sentinel, from the SA
+static char *bwt_bf(char *str, size_t len, alphabet *ab, size_t *primary)
+{
+	size_t *sa = sais(str, len, ab);
+	char *bwt = cstr_new(len);
+	for (size_t i = 0, j = 0; i <= len; i++) {
+		if (sa[i] == 0) {
+			*primary = i;
+		}
+		else {
+			bwt[j++] = str[sa[i] - 1];
+		}
+	}
+	FREE(sa);
+	return bwt;
+}
+
+
+void test_bwt_from_stream(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = alphabet_new(4, "acgt");
+	size_t blksizes[6] = {1, 2, 3, 7, 64, 10000};
+	char *bwt = cstr_new(1000);
+	for (size_t len = 0; len < 600; len += (len < 20) ? 1 : 61) {
+		for (size_t period = 0; period < 30; period += 7) {
+			char *str = bwt_random_str(ab, len, period);
+			size_t exp_primary = 0;
+			char *exp_bwt = bwt_bf(str, len, ab, &exp_primary);
+			for (size_t s = 0; s < 6; s++) {
+				strstream *sst = strstream_open_str(str, len);
+				FILE *out = tmpfile();
+				size_t primary;
+				size_t n = bwt_from_stream(sst, ab,
+				                           blksizes[s] * BWT_BYTES_PER_BLOCK_CHAR,
+				                           out, &primary);
+				CuAssertSizeTEquals(tc, len, n);
+				CuAssertSizeTEquals(tc, exp_primary, primary);
+				rewind(out);
+				CuAssertSizeTEquals(tc, len, fread(bwt, 1, len, out));
+				bwt[len] = '\0';
+				CuAssertStrEquals(tc, exp_bwt, bwt);
+				fclose(out);
+				strstream_close(sst);
+			}
+			FREE(exp_bwt);
+			FREE(str);
+		}
+	}
+	FREE(bwt);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+void test_bwt_from_stream_write_error(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = alphabet_new(4, "acgt");
+	size_t len = 500;
+	char *str = bwt_random_str(ab, len, 0);
+
+	// the BWT cannot be written to a read-only stream
+	char path[] = "/tmp/bwttestXXXXXX";
+	int fd = mkstemp(path);
+	CuAssert(tc, "Unable to create temporary file", fd >= 0);
+	close(fd);
+	FILE *out = fopen(path, "r");
+	strstream *sst = strstream_open_str(str, len);
+	size_t primary = 7;
+	size_t n = bwt_from_stream(sst, ab, 64 * BWT_BYTES_PER_BLOCK_CHAR, out,
+	                           &primary);
+	CuAssertSizeTEquals(tc, SIZE_MAX, n);
+	CuAssertSizeTEquals(tc, 7, primary);
+	strstream_close(sst);
+	fclose(out);
+	remove(path);
+
+	FREE(str);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+void test_bwt_wavtree_from_file(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = alphabet_new(5, "acgtn");
+	size_t len = 3000;
+	char *str = bwt_random_str(ab, len, 11);
+	size_t exp_primary = 0;
+	char *exp_bwt = bwt_bf(str, len, ab, &exp_primary);
+
+	char path[] = "/tmp/bwttestXXXXXX";
+	int fd = mkstemp(path);
+	CuAssert(tc, "Unable to create temporary file", fd >= 0);
+	FILE *out = fdopen(fd, "w");
+	strstream *sst = strstream_open_str(str, len);
+	size_t primary;
+	bwt_from_stream(sst, ab, 200 * BWT_BYTES_PER_BLOCK_CHAR, out, &primary);
+	strstream_close(sst);
+	fclose(out);
+	CuAssertSizeTEquals(tc, exp_primary, primary);
+
+	wavtree *wt = bwt_wavtree_from_file(path, ab, WT_BALANCED);
+	CuAssertPtrNotNull(tc, wt);
+	for (size_t i = 0; i < len; i++) {
+		CuAssertIntEquals(tc, exp_bwt[i], wavtree_char(wt, i));
+	}
+	CuAssertSizeTEquals(tc, 0, wavtree_rank(wt, 0, 'a'));
+	wavtree_free(wt);
+	remove(path);
+
+	FREE(exp_bwt);
+	FREE(str);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+CuSuite *bwt_get_test_suite()
+{
+	CuSuite *suite = CuSuiteNew();
+	SUITE_ADD_TEST(suite, test_bwt_from_stream);
+	SUITE_ADD_TEST(suite, test_bwt_from_stream_write_error);
+	SUITE_ADD_TEST(suite, test_bwt_wavtree_from_file);
+	return suite;
+}
@@ -29,6 +29,7 @@
 #include "bytearr.h"
 #include "cstrutil.h"
 #include "csarray.h"
+#include "mathutil.h"
 #include "sais.h"
 #include "strstream.h"
 
@@ -240,6 +241,61 @@ void csarray_test_get_char(CuTest *tc)
 }
 
 
+void csarray_test_sampled(CuTest *tc)
+{
+	size_t rates[4] = {0, 1, 3, 16};
+	alphabet *sab = seq_ab(4);
+	for (size_t len=0; len<300; len+=(len<20)?1:37) {
+		char *str = random_str(sab, len);
+		size_t *sa = sais(str, len, sab);
+		size_t *sainv = ARR_NEW(size_t, len+1);
+		sarr_invert(sa, len+1, sainv);
+		size_t *range = ARR_NEW(size_t, len+1);
+		for (size_t r=0; r<4; r++) {
+			csarray *csa = csarray_new_sampled(str, len, sab, rates[r]);
+			CuAssertSizeTEquals(tc, MAX(1, rates[r]), csarray_sa_rate(csa));
+			CuAssertSizeTEquals(tc, len+1, csarray_len(csa));
+			for (size_t i=0; i<=len; i++) {
+				CuAssertSizeTEquals(tc, sa[i], csarray_get(csa, i));
+				CuAssertSizeTEquals(tc, sainv[i], csarray_get_inv(csa, i));
+				CuAssertSizeTEquals(tc, phi_bf(sa, len+1, i), csarray_phi(csa, i));
+			}
+			for (size_t i=0; i<len; i++) {
+				CuAssertCharEquals(tc, str[i], (char)csarray_get_char(csa, i));
+			}
+			for (size_t from=0; from<=len; from+=1+len/5) {
+				for (size_t to=from; to<=len+2; to+=1+len/3) {
+					csarray_get_range(csa, from, to, range);
+					for (size_t j=from; j<MIN(to, len+1); j++)
+						CuAssertSizeTEquals(tc, sa[j], range[j-from]);
+				}
+			}
+			csarray_free(csa);
+		}
+		FREE(range);
+		FREE(sainv);
+		FREE(sa);
+		FREE(str);
+	}
+	alphabet_free(sab);
+}
+
+
+void csarray_test_get_range(CuTest *tc)
+{
+	for (size_t k=0; k<Narr; k+=7) {
+		csarray *csa = csarrays[k];
+		size_t *sa = sarrays[k];
+		size_t sa_len = csarray_len(csa);
+		size_t *range = ARR_NEW(size_t, sa_len);
+		csarray_get_range(csa, 0, sa_len, range);
+		for (size_t i=0; i<sa_len; i++)
+			CuAssertSizeTEquals(tc, sa[i], range[i]);
+		FREE(range);
+	}
+}
+
+
 CuSuite *csarray_get_test_suite()
 {
 	CuSuite *suite = CuSuiteNew();
@@ -248,6 +304,8 @@ CuSuite *csarray_get_test_suite()
 	SUITE_ADD_TEST(suite, csarray_test_get);
 	SUITE_ADD_TEST(suite, csarray_test_get_inv);
 	SUITE_ADD_TEST(suite, csarray_test_get_char);
+	SUITE_ADD_TEST(suite, csarray_test_get_range);
+	SUITE_ADD_TEST(suite, csarray_test_sampled);
 	SUITE_ADD_TEST(suite, csarray_test_teardown);
 	return suite;
 }
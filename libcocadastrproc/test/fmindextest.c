@@ -0,0 +1,281 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "CuTest.h"
+
+#include "alphabet.h"
+#include "arrays.h"
+#include "cstrutil.h"
+#include "errlog.h"
+#include "fmindex.h"
+#include "mathutil.h"
+#include "memdbg.h"
+#include "randutil.h"
+#include "sort.h"
+#include "vec.h"
+
+
+static char *fmi_random_str(alphabet *ab, size_t len)
+{
+	char *ret = cstr_new(len);
+	for (size_t i=0; i < len; i++) {
+		ret[i] = (char)ab_char(ab, rand_range_size_t(0, ab_size(ab)));
+	}
+	return ret;
+}
+
+
+static size_t count_bf(char *str, size_t len, char *pat, size_t patlen)
+{
+	size_t count = 0;
+	for (size_t i=0; i + patlen <= len; i++) {
+		if (strncmp(str + i, pat, patlen) == 0) {
+			count++;
+		}
+	}
+	return count;
+}
+
+
+static int size_t_cmp(const void *l, const void *r)
+{
+	size_t a = *((size_t *)l), b = *((size_t *)r);
+	return (a < b) ? -1 : ((a > b) ? +1 : 0);
+}
+
+
+static void check_fmindex(CuTest *tc, fmindex *fmi, char *str, size_t len)
+{
+	CuAssertSizeTEquals(tc, len, fmindex_len(fmi));
+	// patterns sampled from the text and random ones
+	for (size_t patlen = 1; patlen <= 6; patlen++) {
+		for (size_t i = 0; i + patlen <= len; i += 1 + len/20) {
+			char *pat = str + i;
+			CuAssertSizeTEquals(tc, count_bf(str, len, pat, patlen),
+			                    fmindex_count(fmi, pat, patlen));
+			vec *occs = vec_new(sizeof(size_t));
+			size_t nocc = fmindex_locate(fmi, pat, patlen, occs);
+			CuAssertSizeTEquals(tc, nocc, vec_len(occs));
+			CuAssertSizeTEquals(tc, count_bf(str, len, pat, patlen), nocc);
+			vec_qsort(occs, size_t_cmp);
+			for (size_t k = 0; k < nocc; k++) {
+				size_t pos = vec_get_size_t(occs, k);
+				CuAssertTrue(tc, strncmp(str + pos, pat, patlen) == 0);
+				CuAssertTrue(tc, k == 0 || vec_get_size_t(occs, k-1) < pos);
+			}
+			DESTROY_FLAT(occs, vec);
+		}
+	}
+	CuAssertSizeTEquals(tc, 0, fmindex_count(fmi, "#", 1));
+	for (size_t from = 0; from <= len; from += 1 + len/10) {
+		for (size_t to = from; to <= len + 2; to += 1 + len/7) {
+			char *sub = fmindex_extract(fmi, from, to);
+			size_t sublen = MIN(to, len) - from;
+			CuAssertSizeTEquals(tc, sublen, strlen(sub));
+			CuAssertTrue(tc, strncmp(str + from, sub, sublen) == 0);
+			FREE(sub);
+		}
+	}
+}
+
+
+void test_fmindex_count_locate_extract(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = alphabet_new(4, "acgt");
+	size_t lens[5] = {0, 1, 7, 100, 2000};
+	size_t rates[4] = {0, 1, 5, 32};
+	for (size_t l = 0; l < 5; l++) {
+		char *str = fmi_random_str(ab, lens[l]);
+		for (size_t r = 0; r < 4; r++) {
+			fmindex *fmi = fmindex_new(ab, str, lens[l], rates[r]);
+			CuAssertSizeTEquals(tc, MAX(1, rates[r]), fmindex_sa_rate(fmi));
+			check_fmindex(tc, fmi, str, lens[l]);
+			fmindex_free(fmi);
+		}
+		FREE(str);
+	}
+	char *str = "mississippi";
+	fmindex *fmi = fmindex_new(ab, str, 0, 4);
+	fmindex_free(fmi);
+	alphabet *ab2 = alphabet_new(4, "imps");
+	fmi = fmindex_new(ab2, str, strlen(str), 3);
+	CuAssertSizeTEquals(tc, 4, fmindex_count(fmi, "i", 1));
+	CuAssertSizeTEquals(tc, 2, fmindex_count(fmi, "issi", 4));
+	CuAssertSizeTEquals(tc, 0, fmindex_count(fmi, "pis", 3));
+	check_fmindex(tc, fmi, str, strlen(str));
+	fmindex_free(fmi);
+	alphabet_free(ab2);
+	// letters above 127
+	alphabet *ab3 = alphabet_new(4, "a\xe7\xe9\xfc");
+	str = fmi_random_str(ab3, 500);
+	fmi = fmindex_new(ab3, str, 500, 4);
+	check_fmindex(tc, fmi, str, 500);
+	fmindex_free(fmi);
+	FREE(str);
+	alphabet_free(ab3);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+void test_fmindex_count_batch(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = alphabet_new(4, "acgt");
+	size_t len = 5000, npats = 200;
+	char *str = fmi_random_str(ab, len);
+	fmindex *fmi = fmindex_new(ab, str, len, 16);
+	char **pats = ARR_NEW(char *, npats);
+	size_t *patlens = ARR_NEW(size_t, npats);
+	size_t *counts = ARR_NEW(size_t, npats);
+	for (size_t i = 0; i < npats; i++) {
+		patlens[i] = rand_range_size_t(1, 9);
+		pats[i] = (i % 2) ? str + rand_range_size_t(0, len - patlens[i])
+		          : fmi_random_str(ab, patlens[i]);
+	}
+	for (size_t nthreads = 0; nthreads <= 4; nthreads++) {
+		memset(counts, 0, npats * sizeof(size_t));
+		fmindex_count_batch(fmi, pats, patlens, npats, counts, nthreads);
+		for (size_t i = 0; i < npats; i++) {
+			CuAssertSizeTEquals(tc, count_bf(str, len, pats[i], patlens[i]),
+			                    counts[i]);
+		}
+	}
+	for (size_t i = 0; i < npats; i += 2) {
+		FREE(pats[i]);
+	}
+	FREE(pats);
+	FREE(patlens);
+	FREE(counts);
+	fmindex_free(fmi);
+	FREE(str);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+void test_fmindex_write_read(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = alphabet_new(4, "acgt");
+	size_t lens[3] = {0, 10, 3000};
+	for (size_t l = 0; l < 3; l++) {
+		char *str = fmi_random_str(ab, lens[l]);
+		fmindex *fmi = fmindex_new(ab, str, lens[l], 8);
+		FILE *stream = tmpfile();
+		fmindex_write(fmi, stream);
+		fmindex_free(fmi);
+		rewind(stream);
+		fmi = fmindex_read(stream);
+		fclose(stream);
+		CuAssertPtrNotNull(tc, fmi);
+		CuAssertSizeTEquals(tc, 8, fmindex_sa_rate(fmi));
+		check_fmindex(tc, fmi, str, lens[l]);
+		fmindex_free(fmi);
+		FREE(str);
+	}
+	FILE *stream = tmpfile();
+	fwrite("FMX", 1, 3, stream);
+	rewind(stream);
+	CuAssertPtrEquals(tc, NULL, fmindex_read(stream));
+	fclose(stream);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+/*
+ * Reads an index from a copy of the serialised index @p data, of
+ * @p size bytes, with the @p n bytes at @p pos replaced by @p patch.
+ */
+static fmindex *read_patched(const char *data, size_t size, size_t pos,
+                             const void *patch, size_t n)
+{
+	FILE *stream = tmpfile();
+	fwrite(data, 1, size, stream);
+	fseek(stream, pos, SEEK_SET);
+	fwrite(patch, 1, n, stream);
+	rewind(stream);
+	fmindex *fmi = fmindex_read(stream);
+	fclose(stream);
+	return fmi;
+}
+
+
+void test_fmindex_read_corrupt(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = alphabet_new(4, "acgt");
+	size_t len = 100;
+	char *str = fmi_random_str(ab, len);
+	fmindex *fmi = fmindex_new(ab, str, len, 8);
+	FILE *stream = tmpfile();
+	fmindex_write(fmi, stream);
+	fmindex_free(fmi);
+	size_t size = ftell(stream);
+	char *data = malloc(size);
+	rewind(stream);
+	CuAssertSizeTEquals(tc, size, fread(data, 1, size, stream));
+	fclose(stream);
+
+	// header: magic, len, sa_rate, primary, nchars; then letters, BWT, ISA
+	size_t hdr = 4 + 4 * sizeof(size_t);
+	fmi = read_patched(data, size, 0, "FMI", 0);
+	CuAssertPtrNotNull(tc, fmi);
+	fmindex_free(fmi);
+	size_t big = SIZE_MAX / 4, huge_nchars = 1000, primary = len + 1;
+	CuAssertPtrEquals(tc, NULL, read_patched(data, size, 4, &big, sizeof(size_t)));
+	CuAssertPtrEquals(tc, NULL, read_patched(data, size, 4 + 2 * sizeof(size_t),
+	                  &primary, sizeof(size_t)));
+	CuAssertPtrEquals(tc, NULL, read_patched(data, size, 4 + 3 * sizeof(size_t),
+	                  &huge_nchars, sizeof(size_t)));
+	// letter not distinct, BWT char not in the alphabet, ISA sample > len
+	CuAssertPtrEquals(tc, NULL, read_patched(data, size, hdr + 1, "a", 1));
+	CuAssertPtrEquals(tc, NULL, read_patched(data, size, hdr + 4 + 50, "x", 1));
+	CuAssertPtrEquals(tc, NULL, read_patched(data, size, size - sizeof(size_t),
+	                  &primary, sizeof(size_t)));
+	// truncated
+	stream = tmpfile();
+	fwrite(data, 1, size - 1, stream);
+	rewind(stream);
+	CuAssertPtrEquals(tc, NULL, fmindex_read(stream));
+	fclose(stream);
+
+	free(data);
+	FREE(str);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+CuSuite *fmindex_get_test_suite()
+{
+	CuSuite *suite = CuSuiteNew();
+	SUITE_ADD_TEST(suite, test_fmindex_count_locate_extract);
+	SUITE_ADD_TEST(suite, test_fmindex_count_batch);
+	SUITE_ADD_TEST(suite, test_fmindex_write_read);
+	SUITE_ADD_TEST(suite, test_fmindex_read_corrupt);
+	return suite;
+}
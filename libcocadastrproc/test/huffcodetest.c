@@ -19,12 +19,15 @@
  *
  */
 
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "CuTest.h"
 
 #include "alphabet.h"
+#include "arrays.h"
 #include "bitvec.h"
 #include "bytearr.h"
 #include "cstrutil.h"
@@ -75,11 +78,141 @@ void test_huffcode_codec(CuTest *tc)
 }
 
 
+// checks that the code is canonical, complete and within the length limit
+static void check_canonical(CuTest *tc, const huffcode *hc, size_t max_codelen)
+{
+	size_t n = ab_size(huffcode_ab(hc));
+	double kraft = 0;
+	for (size_t i = 0; i < n; i++) {
+		size_t li = huffcode_codelen(hc, i);
+		CuAssertSizeTEquals(tc, li, bitvec_len(huffcode_charcode(hc, i)));
+		CuAssert(tc, "Codeword too long", li <= max_codelen);
+		kraft += pow(2, -(double)li);
+		for (size_t j = i + 1; j < n; j++) {
+			// codewords of equal length follow char order,
+			// and shorter codewords are numerically smaller prefixes
+			size_t lj = huffcode_codelen(hc, j);
+			const bitvec *ci = huffcode_charcode(hc, i), *cj = huffcode_charcode(hc, j);
+			uint64_t vi = 0, vj = 0;
+			for (size_t k = 0; k < MIN(li, lj); k++) {
+				vi = (vi << 1) | bitvec_get_bit(ci, k);
+				vj = (vj << 1) | bitvec_get_bit(cj, k);
+			}
+			CuAssert(tc, "Not prefix-free", vi != vj);
+			if (li == lj) {
+				CuAssert(tc, "Not canonical", vi < vj);
+			}
+			else if (li < lj) {
+				CuAssert(tc, "Not canonical", vi < vj);
+			}
+			else {
+				CuAssert(tc, "Not canonical", vi > vj);
+			}
+		}
+	}
+	if (n > 1) {
+		CuAssertDblEquals(tc, 1.0, kraft, 1e-9);
+	}
+}
+
+
+void test_huffcode_canonical(CuTest *tc)
+{
+	char *letters = "abcdefghijklmnopqrstuvwxyz";
+	for (size_t n = 1; n <= 26; n++) {
+		alphabet *ab = alphabet_new(n, letters);
+		size_t *freqs = ARR_NEW(size_t, n);
+		for (size_t i = 0; i < n; i++) {
+			freqs[i] = rand_range_size_t(0, 1000);
+		}
+		huffcode *hc = huffcode_new(ab, freqs);
+		check_canonical(tc, hc, HUFFCODE_MAX_CODELEN);
+		huffcode_free(hc);
+		FREE(freqs);
+		alphabet_free(ab);
+	}
+}
+
+
+void test_huffcode_lenlim(CuTest *tc)
+{
+	// Fibonacci frequencies yield a maximally unbalanced tree
+	size_t n = 40;
+	alphabet *ab = int_alphabet_new(n);
+	size_t *freqs = ARR_NEW(size_t, n);
+	freqs[0] = freqs[1] = 1;
+	for (size_t i = 2; i < n; i++) {
+		freqs[i] = freqs[i - 1] + freqs[i - 2];
+	}
+	huffcode *hc = huffcode_new_lenlim(ab, freqs, 64);
+	CuAssertSizeTEquals(tc, n - 1, huffcode_codelen(hc, 0));
+	huffcode_free(hc);
+
+	CuAssertPtrEquals(tc, NULL, huffcode_new_lenlim(ab, freqs, 5));
+	size_t limits[3] = {6, 14, HUFFCODE_MAX_CODELEN};
+	for (size_t l = 0; l < 3; l++) {
+		hc = huffcode_new_lenlim(ab, freqs, limits[l]);
+		CuAssertPtrNotNull(tc, hc);
+		check_canonical(tc, hc, limits[l]);
+		CuAssertSizeTEquals(tc, limits[l], huffcode_codelen(hc, 0));
+		// more frequent chars never get longer codewords
+		for (size_t i = 1; i < n; i++) {
+			CuAssert(tc, "Length not monotone",
+			         huffcode_codelen(hc, i) <= huffcode_codelen(hc, i - 1));
+		}
+		huffcode_free(hc);
+	}
+	FREE(freqs);
+	alphabet_free(ab);
+}
+
+
+// long strings with short and long (> decoding table width) codewords
+void test_huffcode_codec_skewed(CuTest *tc)
+{
+	size_t n = 40, len = 100000;
+	alphabet *ab = int_alphabet_new(n);
+	size_t *freqs = ARR_NEW(size_t, n);
+	freqs[0] = freqs[1] = 1;
+	for (size_t i = 2; i < n; i++) {
+		freqs[i] = freqs[i - 1] + freqs[i - 2];
+	}
+	size_t limits[3] = {6, 16, HUFFCODE_MAX_CODELEN};
+	for (size_t l = 0; l < 3; l++) {
+		huffcode *hc = huffcode_new_lenlim(ab, freqs, limits[l]);
+		xstr *src = xstr_new(nbytes(n));
+		for (size_t i = 0; i < len; i++) {
+			// roughly geometric, with every char present
+			size_t c = (i < n) ? i : n - 1 - MIN(n - 1, (size_t)__builtin_ctzll(rand() | (1ULL << 40)));
+			xstr_push(src, ab_char(ab, c));
+		}
+		bitvec *code = huffcode_encode_xstr(src, hc);
+		size_t code_len = 0;
+		for (size_t i = 0; i < len; i++) {
+			code_len += huffcode_codelen(hc, ab_rank(ab, xstr_get(src, i)));
+		}
+		CuAssertSizeTEquals(tc, code_len, bitvec_len(code));
+		xstr *dec = huffcode_decode(code, hc);
+		CuAssertSizeTEquals(tc, len, xstr_len(dec));
+		CuAssertIntEquals(tc, 0, xstr_cmp(src, dec));
+		xstr_free(dec);
+		bitvec_free(code);
+		xstr_free(src);
+		huffcode_free(hc);
+	}
+	FREE(freqs);
+	alphabet_free(ab);
+}
+
+
 CuSuite *huffcode_get_test_suite()
 {
 	CuSuite *suite = CuSuiteNew();
 	SUITE_ADD_TEST(suite, test_huffcode_new);
 	SUITE_ADD_TEST(suite, test_huffcode_codec);
+	SUITE_ADD_TEST(suite, test_huffcode_canonical);
+	SUITE_ADD_TEST(suite, test_huffcode_lenlim);
+	SUITE_ADD_TEST(suite, test_huffcode_codec_skewed);
 	return suite;
 }
 
@@ -0,0 +1,229 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "CuTest.h"
+
+#include "alphabet.h"
+#include "arrays.h"
+#include "cstrutil.h"
+#include "lcp.h"
+#include "mathutil.h"
+#include "memdbg.h"
+#include "randutil.h"
+#include "sais.h"
+#include "vec.h"
+
+
+static char *lcp_random_str(alphabet *ab, size_t len, size_t period)
+{
+	char *ret = cstr_new(len);
+	for (size_t i=0; i < len; i++) {
+		ret[i] = (period && i >= period) ? ret[i - period]
+		         : (char)ab_char(ab, rand_range_size_t(0, ab_size(ab)));
+	}
+	return ret;
+}
+
+
+static size_t lcp_bf(const char *str, size_t len, size_t i, size_t j)
+{
+	size_t h = 0;
+	while (i + h < len && j + h < len && str[i + h] == str[j + h]) {
+		h++;
+	}
+	return h;
+}
+
+
+void test_lcp_construction(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = alphabet_new(4, "acgt");
+	for (size_t len = 0; len < 300; len += 13) {
+		for (size_t period = 0; period < 8; period += 3) {
+			char *str = lcp_random_str(ab, len, period);
+			size_t *sa = sais(str, len, ab);
+			size_t *kasai = lcp_kasai(str, len, sa);
+			size_t *phi = lcp_phi(str, len, sa);
+			size_t *plcp = lcp_plcp(str, len, sa);
+			CuAssertSizeTEquals(tc, 0, kasai[0]);
+			CuAssertSizeTEquals(tc, 0, phi[0]);
+			for (size_t i = 1; i <= len; i++) {
+				size_t h = lcp_bf(str, len, sa[i - 1], sa[i]);
+				CuAssertSizeTEquals(tc, h, kasai[i]);
+				CuAssertSizeTEquals(tc, h, phi[i]);
+				CuAssertSizeTEquals(tc, h, plcp[sa[i]]);
+			}
+			FREE(plcp);
+			FREE(phi);
+			FREE(kasai);
+			FREE(sa);
+			FREE(str);
+		}
+	}
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+void test_lcparray_get_rmq(CuTest *tc)
+{
+	memdbg_reset();
+	size_t maxvals[4] = {0, 200, 70000, (size_t)1 << 40};
+	for (size_t m = 0; m < 4; m++) {
+		for (size_t n = 1; n < 20000; n = (n * 3) + 1) {
+			size_t *lcp = ARR_NEW(size_t, n);
+			for (size_t i = 0; i < n; i++) {
+				// mostly small values, as in real LCP arrays
+				lcp[i] = (maxvals[m] == 0) ? 0
+				         : (rand_range_size_t(0, 4) ? rand_range_size_t(0, 100)
+				            : rand_range_size_t(0, maxvals[m]));
+			}
+			lcparray *lcpa = lcparray_new(lcp, n);
+			CuAssertSizeTEquals(tc, n, lcparray_len(lcpa));
+			for (size_t i = 0; i < n; i++) {
+				CuAssertSizeTEquals(tc, lcp[i], lcparray_get(lcpa, i));
+			}
+			for (size_t q = 0; q < 200; q++) {
+				size_t from = rand_range_size_t(0, n);
+				size_t to = rand_range_size_t(from + 1, n + 1);
+				if (q % 4 == 0) {
+					from = 0;
+					to = n;
+				}
+				size_t best = from;
+				for (size_t i = from + 1; i < to; i++) {
+					if (lcp[i] < lcp[best]) {
+						best = i;
+					}
+				}
+				CuAssertSizeTEquals(tc, best, lcparray_rmq(lcpa, from, to));
+			}
+			lcparray_free(lcpa);
+			FREE(lcp);
+		}
+	}
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+static bool is_left_diverse(const char *str, const size_t *sa,
+                            size_t lb, size_t rb)
+{
+	for (size_t k = lb; k <= rb; k++) {
+		if (sa[k] == 0 || str[sa[k] - 1] != str[sa[lb] - 1]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/*
+ * Top-down traversal of the lcp-interval tree, checking each interval
+ * against the plain LCP and counting the left-diverse intervals.
+ */
+static size_t check_intervals(CuTest *tc, lcparray *lcpa, const char *str,
+                              const size_t *sa, const size_t *lcp,
+                              const lcp_interval *iv, size_t minlen)
+{
+	size_t nrep = (iv->lcp >= minlen && iv->lcp > 0
+	               && is_left_diverse(str, sa, iv->lb, iv->rb));
+	vec *children = vec_new(sizeof(lcp_interval));
+	lcparray_child_intervals(lcpa, iv, children);
+	CuAssert(tc, "Less than two children", vec_len(children) >= 2);
+	size_t lb = iv->lb;
+	for (size_t c = 0; c < vec_len(children); c++) {
+		const lcp_interval *child = (const lcp_interval *)vec_get(children, c);
+		CuAssertSizeTEquals(tc, lb, child->lb);
+		if (c > 0) {
+			CuAssertSizeTEquals(tc, iv->lcp, lcp[child->lb]);
+		}
+		for (size_t k = child->lb + 1; k <= child->rb; k++) {
+			CuAssert(tc, "Wrong child lcp", lcp[k] >= child->lcp);
+			CuAssert(tc, "Child not deeper", lcp[k] > iv->lcp);
+		}
+		if (child->lb < child->rb) {
+			nrep += check_intervals(tc, lcpa, str, sa, lcp, child, minlen);
+		}
+		lb = child->rb + 1;
+	}
+	CuAssertSizeTEquals(tc, iv->rb + 1, lb);
+	DESTROY_FLAT(children, vec);
+	return nrep;
+}
+
+
+void test_lcparray_esa(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = alphabet_new(3, "abc");
+	for (size_t len = 1; len < 400; len += 37) {
+		for (size_t period = 0; period < 10; period += 4) {
+			char *str = lcp_random_str(ab, len, period);
+			size_t *sa = sais(str, len, ab);
+			size_t *lcp = lcp_kasai(str, len, sa);
+			lcparray *lcpa = lcparray_new_from_sa(str, len, sa);
+			for (size_t i = 0; i <= len; i++) {
+				CuAssertSizeTEquals(tc, lcp[i], lcparray_get(lcpa, i));
+			}
+			lcp_interval root = lcparray_interval(lcpa, 0, len);
+			CuAssertSizeTEquals(tc, 0, root.lcp);
+			for (size_t minlen = 1; minlen < 4; minlen += 2) {
+				size_t nrep = check_intervals(tc, lcpa, str, sa, lcp, &root, minlen);
+				vec *repeats = vec_new(sizeof(lcp_interval));
+				lcparray_maximal_repeats(lcpa, str, sa, minlen, repeats);
+				CuAssertSizeTEquals(tc, nrep, vec_len(repeats));
+				for (size_t r = 0; r < vec_len(repeats); r++) {
+					const lcp_interval *rep = (const lcp_interval *)vec_get(repeats, r);
+					lcp_interval iv = lcparray_interval(lcpa, rep->lb, rep->rb);
+					CuAssertSizeTEquals(tc, iv.lcp, rep->lcp);
+					CuAssert(tc, "Short repeat", rep->lcp >= minlen);
+					CuAssert(tc, "Not left-maximal",
+					         is_left_diverse(str, sa, rep->lb, rep->rb));
+					CuAssert(tc, "Not right-maximal",
+					         (rep->lb == 0 || lcp[rep->lb] < rep->lcp)
+					         && (rep->rb == len || lcp[rep->rb + 1] < rep->lcp));
+				}
+				DESTROY_FLAT(repeats, vec);
+			}
+			lcparray_free(lcpa);
+			FREE(lcp);
+			FREE(sa);
+			FREE(str);
+		}
+	}
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+CuSuite *lcp_get_test_suite()
+{
+	CuSuite *suite = CuSuiteNew();
+	SUITE_ADD_TEST(suite, test_lcp_construction);
+	SUITE_ADD_TEST(suite, test_lcparray_get_rmq);
+	SUITE_ADD_TEST(suite, test_lcparray_esa);
+	return suite;
+}
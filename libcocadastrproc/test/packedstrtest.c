@@ -0,0 +1,199 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CuTest.h"
+
+#include "alphabet.h"
+#include "arrays.h"
+#include "cstrutil.h"
+#include "packedstr.h"
+#include "xstr.h"
+
+
+void test_packedstr_get_set(CuTest *tc)
+{
+	for (size_t b=1; b<=4; b*=2) {
+		size_t len = 1000;
+		xchar_t *exp = ARR_NEW(xchar_t, len);
+		packedstr *ps = packedstr_new(b);
+		for (size_t i=0; i<len; i++) {
+			exp[i] = rand() % (1 << b);
+			packedstr_push(ps, exp[i]);
+		}
+		CuAssertSizeTEquals(tc, len, packedstr_len(ps));
+		for (size_t i=0; i<len; i++)
+			CuAssertIntEquals(tc, exp[i], packedstr_get(ps, i));
+		for (size_t i=0; i<len; i+=3) {
+			exp[i] = rand() % (1 << b);
+			packedstr_set(ps, i, exp[i]);
+		}
+		for (size_t i=0; i<len; i++)
+			CuAssertIntEquals(tc, exp[i], packedstr_get(ps, i));
+		CuAssertTrue(tc, packedstr_nbytes(ps) <= 2 * (len * b / 8 + 8));
+		packedstr_free(ps);
+		FREE(exp);
+	}
+	CuAssertPtrEquals(tc, NULL, packedstr_new(3));
+}
+
+
+void test_packedstr_from_str(CuTest *tc)
+{
+	char *nucl[4] = {"Aa", "Cc", "Gg", "Tt"};
+	alphabet *dna = alphabet_new_with_equivs(4, nucl);
+	char *src = "ACGTacgtNNAGGTCCATTGAC";
+	size_t len = strlen(src);
+	packedstr *ps = packedstr_new_from_str(dna, src, len);
+	CuAssertSizeTEquals(tc, 2, packedstr_bits_per_char(ps));
+	CuAssertSizeTEquals(tc, len, packedstr_len(ps));
+	char *dest = cstr_new(len);
+	packedstr_to_str(ps, dna, 0, len, dest);
+	// unknown chars become rank 0
+	CuAssertStrEquals(tc, "ACGTACGTAAAGGTCCATTGAC", dest);
+	packedstr_to_str(ps, dna, 4, 3, dest);
+	CuAssertStrEquals(tc, "ACG", dest);
+
+	xstr *xs = packedstr_to_xstr(ps, dna, 0, len);
+	packedstr *ps2 = packedstr_new_from_xstr(dna, xs);
+	CuAssertIntEquals(tc, 0, packedstr_cmp(ps, ps2));
+	xstr_free(xs);
+	packedstr_free(ps2);
+	packedstr_free(ps);
+	FREE(dest);
+
+	// 3 letters fit in 2 bits and keep the unknown rank
+	alphabet *ab3 = alphabet_new(3, "abc");
+	ps = packedstr_new_from_str(ab3, "abcx", 4);
+	CuAssertIntEquals(tc, 3, packedstr_get(ps, 3));
+	packedstr_free(ps);
+	alphabet_free(ab3);
+
+	alphabet *big = int_alphabet_new(17);
+	CuAssertPtrEquals(tc, NULL, packedstr_new_from_str(big, "", 0));
+	alphabet_free(big);
+	alphabet_free(dna);
+}
+
+
+void test_packedstr_kmer(CuTest *tc)
+{
+	for (size_t b=1; b<=4; b*=2) {
+		size_t len = 300;
+		packedstr *ps = packedstr_new(b);
+		for (size_t i=0; i<len; i++)
+			packedstr_push(ps, rand() % (1 << b));
+		for (size_t k=0; k<=64/b; k++) {
+			for (size_t pos=0; pos+k<=len; pos++) {
+				uint64_t exp = 0;
+				for (size_t i=0; i<k; i++)
+					exp = (exp << b) | packedstr_get(ps, pos+i);
+				CuAssertTrue(tc, exp == packedstr_kmer(ps, pos, k));
+			}
+		}
+		packedstr_free(ps);
+	}
+}
+
+
+static int _ncmp_bf(packedstr *a, packedstr *b, size_t n)
+{
+	size_t la = packedstr_len(a), lb = packedstr_len(b);
+	for (size_t i=0; i<n; i++) {
+		if (i==la || i==lb)
+			return (la==lb) ? 0 : (la < lb) ? -1 : +1;
+		xchar_t ca = packedstr_get(a, i), cb = packedstr_get(b, i);
+		if (ca != cb)
+			return (ca < cb) ? -1 : +1;
+	}
+	return 0;
+}
+
+
+void test_packedstr_ncmp(CuTest *tc)
+{
+	for (size_t b=1; b<=4; b*=2) {
+		for (size_t t=0; t<300; t++) {
+			size_t la = rand()%150, lb = rand()%150;
+			packedstr *x = packedstr_new(b);
+			packedstr *y = packedstr_new(b);
+			for (size_t i=0; i<la; i++)
+				packedstr_push(x, rand() % (1 << b));
+			for (size_t i=0; i<lb; i++)
+				packedstr_push(y, (i<la) ? packedstr_get(x, i) : rand() % (1 << b));
+			if (lb && rand()%2)
+				packedstr_set(y, rand()%lb, rand() % (1 << b));
+			size_t n = rand()%160;
+			CuAssertIntEquals(tc, _ncmp_bf(x, y, n), packedstr_ncmp(x, y, n));
+			CuAssertIntEquals(tc, _ncmp_bf(y, x, n), packedstr_ncmp(y, x, n));
+			packedstr_free(x);
+			packedstr_free(y);
+		}
+	}
+}
+
+
+void test_packedstr_revcomp(CuTest *tc)
+{
+	for (size_t b=1; b<=4; b*=2) {
+		for (size_t len=0; len<200; len+=7) {
+			packedstr *ps = packedstr_new(b);
+			for (size_t i=0; i<len; i++)
+				packedstr_push(ps, rand() % (1 << b));
+			packedstr *rc = packedstr_revcomp(ps);
+			CuAssertSizeTEquals(tc, len, packedstr_len(rc));
+			for (size_t i=0; i<len; i++)
+				CuAssertIntEquals(tc, (1 << b) - 1 - packedstr_get(ps, len-1-i),
+				                  packedstr_get(rc, i));
+			packedstr *rcrc = packedstr_revcomp(rc);
+			CuAssertIntEquals(tc, 0, packedstr_cmp(ps, rcrc));
+			packedstr_free(rcrc);
+			packedstr_free(rc);
+			packedstr_free(ps);
+		}
+	}
+	char *nucl[4] = {"Aa", "Cc", "Gg", "Tt"};
+	alphabet *dna = alphabet_new_with_equivs(4, nucl);
+	packedstr *ps = packedstr_new_from_str(dna, "AACGTTG", 7);
+	packedstr *rc = packedstr_revcomp(ps);
+	char dest[8];
+	packedstr_to_str(rc, dna, 0, 7, dest);
+	CuAssertStrEquals(tc, "CAACGTT", dest);
+	packedstr_free(rc);
+	packedstr_free(ps);
+	alphabet_free(dna);
+}
+
+
+CuSuite *packedstr_get_test_suite()
+{
+	CuSuite *suite = CuSuiteNew();
+	SUITE_ADD_TEST(suite, test_packedstr_get_set);
+	SUITE_ADD_TEST(suite, test_packedstr_from_str);
+	SUITE_ADD_TEST(suite, test_packedstr_kmer);
+	SUITE_ADD_TEST(suite, test_packedstr_ncmp);
+	SUITE_ADD_TEST(suite, test_packedstr_revcomp);
+	return suite;
+}
@@ -0,0 +1,241 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "CuTest.h"
+
+#include "alphabet.h"
+#include "arrays.h"
+#include "bitvec.h"
+#include "cstrutil.h"
+#include "huffcode.h"
+#include "mathutil.h"
+#include "memdbg.h"
+#include "randutil.h"
+#include "ranscode.h"
+#include "xstr.h"
+
+
+// chars of rank r with probability ~ 2^-(r+1)
+static void _skewed_str(char *dest, alphabet *ab, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		size_t r = 0;
+		while (r + 1 < ab_size(ab) && (rand() % 2)) {
+			r++;
+		}
+		dest[i] = ab_char(ab, r);
+	}
+	dest[len] = '\0';
+}
+
+
+void test_ranscode_codec(CuTest *tc)
+{
+	memdbg_reset();
+	char *letters = "abcdefghijklmnopqrstuvwxyz";
+	for (size_t order = 0; order <= 1; order++) {
+		for (size_t len = 0; len < 300; len++) {
+			alphabet *ab = alphabet_new(1 + (len % strlen(letters)), letters);
+			char *str = cstr_new(len);
+			_skewed_str(str, ab, len);
+			ranscode *rc = ranscode_new_from_str(ab, str, order);
+			bitvec *code = ranscode_encode(str, len, rc);
+			xstr *xsdec = ranscode_decode(code, rc);
+			CuAssertPtrNotNull(tc, xsdec);
+			CuAssertSizeTEquals(tc, len, xstr_len(xsdec));
+			char *dec = xstr_detach(xsdec);
+			CuAssertStrEquals(tc, str, dec);
+			FREE(dec);
+			bitvec_free(code);
+			ranscode_free(rc);
+			FREE(str);
+			alphabet_free(ab);
+		}
+	}
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+void test_ranscode_xstr(CuTest *tc)
+{
+	memdbg_reset();
+	size_t n = 1000, len = 100000;
+	alphabet *ab = int_alphabet_new(n);
+	xstr *src = xstr_new(nbytes(n));
+	for (size_t i = 0; i < len; i++) {
+		xstr_push(src, ab_char(ab, rand_range_size_t(0, n)));
+	}
+	for (size_t order = 0; order <= 1; order++) {
+		ranscode *rc = ranscode_new_from_xstr(ab, src, order);
+		bitvec *code = ranscode_encode_xstr(src, rc);
+		xstr *dec = ranscode_decode(code, rc);
+		CuAssertPtrNotNull(tc, dec);
+		CuAssertIntEquals(tc, 0, xstr_cmp(src, dec));
+		// any single flipped bit is detected
+		size_t nbits = bitvec_len(code), nundetected = 0;
+		for (size_t t = 0; t < 200; t++) {
+			size_t pos = (t == 0) ? nbits - 3 : rand_range_size_t(0, nbits);
+			bitvec_set_bit(code, pos, !bitvec_get_bit(code, pos));
+			xstr *bad = ranscode_decode(code, rc);
+			if (bad != NULL) {
+				nundetected++;
+				xstr_free(bad);
+			}
+			bitvec_set_bit(code, pos, !bitvec_get_bit(code, pos));
+		}
+		CuAssertSizeTEquals(tc, 0, nundetected);
+		xstr_free(dec);
+		bitvec_free(code);
+		ranscode_free(rc);
+	}
+	xstr_free(src);
+	alphabet_free(ab);
+
+	ab = int_alphabet_new(RANSCODE_SCALE + 1);
+	size_t *freqs = ARR_OF_0_NEW(size_t, RANSCODE_SCALE + 1);
+	CuAssertPtrEquals(tc, NULL, ranscode_new(ab, freqs, 0));
+	FREE(freqs);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+void test_ranscode_compression(CuTest *tc)
+{
+	memdbg_reset();
+	size_t len = 200000;
+	alphabet *ab = alphabet_new(4, "ACGT");
+	char *str = cstr_new(len);
+
+	// very skewed source: Huffman needs at least one bit per char
+	for (size_t i = 0; i < len; i++) {
+		str[i] = ab_char(ab, (rand() % 100) < 95 ? 0 : 1 + (rand() % 3));
+	}
+	size_t freqs[4] = {0, 0, 0, 0};
+	double entropy = 0;
+	for (size_t i = 0; i < len; i++) {
+		freqs[ab_rank(ab, str[i])]++;
+	}
+	for (size_t i = 0; i < 4; i++) {
+		double p = (double)freqs[i] / len;
+		entropy -= p ? p * log2(p) : 0;
+	}
+	ranscode *rc = ranscode_new(ab, freqs, 0);
+	bitvec *code = ranscode_encode(str, len, rc);
+	huffcode *hc = huffcode_new(ab, freqs);
+	bitvec *hcode = huffcode_encode(str, len, hc);
+	CuAssert(tc, "rANS worse than Huffman", bitvec_len(code) < bitvec_len(hcode));
+	CuAssert(tc, "rANS far from entropy",
+	         bitvec_len(code) < 1.01 * entropy * len + 1024);
+	bitvec_free(hcode);
+	huffcode_free(hc);
+	bitvec_free(code);
+	ranscode_free(rc);
+
+	// order 1 source: each char mostly repeats the previous one
+	str[0] = 'A';
+	for (size_t i = 1; i < len; i++) {
+		str[i] = (rand() % 10) ? str[i - 1] : ab_char(ab, rand() % 4);
+	}
+	ranscode *rc0 = ranscode_new_from_str(ab, str, 0);
+	ranscode *rc1 = ranscode_new_from_str(ab, str, 1);
+	bitvec *code0 = ranscode_encode(str, len, rc0);
+	bitvec *code1 = ranscode_encode(str, len, rc1);
+	CuAssert(tc, "Order 1 model should compress better",
+	         2 * bitvec_len(code1) < bitvec_len(code0));
+	xstr *dec = ranscode_decode(code1, rc1);
+	char *cdec = xstr_detach(dec);
+	CuAssertStrEquals(tc, str, cdec);
+	FREE(cdec);
+	bitvec_free(code0);
+	bitvec_free(code1);
+	ranscode_free(rc0);
+	ranscode_free(rc1);
+
+	FREE(str);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+// decodes a copy of the code with the 64-bit length field set to n
+static xstr *_decode_with_len(const bitvec *code, uint64_t n,
+                              const ranscode *rc)
+{
+	size_t size = bitvec_len(code) / BYTESIZE;
+	byte_t *bytes = ARR_NEW(byte_t, size);
+	memcpy(bytes, bitvec_as_bytes(code), size);
+	for (size_t i = 0; i < sizeof(uint64_t); i++) {
+		bytes[i] = (byte_t)(n >> (i * BYTESIZE));
+	}
+	bitvec *bad = bitvec_new_from_bitarr(bytes, size * BYTESIZE);
+	xstr *dec = ranscode_decode(bad, rc);
+	bitvec_free(bad);
+	FREE(bytes);
+	return dec;
+}
+
+
+void test_ranscode_corrupt_len(CuTest *tc)
+{
+	memdbg_reset();
+	char *letters = "acgt";
+	for (size_t nchars = 1; nchars <= strlen(letters); nchars += 3) {
+		alphabet *ab = alphabet_new(nchars, letters);
+		size_t len = 1000;
+		char *str = cstr_new(len);
+		_skewed_str(str, ab, len);
+		ranscode *rc = ranscode_new_from_str(ab, str, 0);
+		bitvec *code = ranscode_encode(str, len, rc);
+		CuAssertPtrEquals(tc, NULL, _decode_with_len(code, (uint64_t)1 << 62, rc));
+		CuAssertPtrEquals(tc, NULL, _decode_with_len(code, UINT64_MAX, rc));
+		// a single char costs no bits, so only the above are out of range
+		if (nchars > 1) {
+			CuAssertPtrEquals(tc, NULL, _decode_with_len(code, (uint64_t)1 << 40, rc));
+			CuAssertPtrEquals(tc, NULL, _decode_with_len(code, len + 1, rc));
+		}
+		xstr *dec = _decode_with_len(code, len, rc);
+		CuAssertPtrNotNull(tc, dec);
+		CuAssertSizeTEquals(tc, len, xstr_len(dec));
+		xstr_free(dec);
+		bitvec_free(code);
+		ranscode_free(rc);
+		FREE(str);
+		alphabet_free(ab);
+	}
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+CuSuite *ranscode_get_test_suite()
+{
+	CuSuite *suite = CuSuiteNew();
+	SUITE_ADD_TEST(suite, test_ranscode_codec);
+	SUITE_ADD_TEST(suite, test_ranscode_xstr);
+	SUITE_ADD_TEST(suite, test_ranscode_compression);
+	SUITE_ADD_TEST(suite, test_ranscode_corrupt_len);
+	return suite;
+}
@@ -0,0 +1,210 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "CuTest.h"
+
+#include "mathutil.h"
+#include "memdbg.h"
+#include "new.h"
+#include "randutil.h"
+#include "roaring64.h"
+
+
+#define CHUNK ((uint64_t)1 << 32)
+
+
+static int cmp_u64(const void *l, const void *r)
+{
+	uint64_t a = *(const uint64_t *)l, b = *(const uint64_t *)r;
+	return (a > b) - (a < b);
+}
+
+
+// sorted distinct positions clustered around chunk boundaries and
+// scattered over a universe of given length
+static size_t random_positions64(uint64_t *pos, size_t n, uint64_t len)
+{
+	for (size_t i = 0; i < n; i++) {
+		switch (i % 3) {
+		case 0:
+			pos[i] = rand_range_uint64_t(0, len);
+			break;
+		case 1:
+			if (len > CHUNK) {
+				uint64_t chunk = rand_range_uint64_t(1, len / CHUNK + 1) * CHUNK;
+				pos[i] = chunk - 300 + rand_range_uint64_t(0, 600);
+			}
+			else {
+				pos[i] = rand_range_uint64_t(0, len);
+			}
+			break;
+		default:
+			pos[i] = pos[i - 1] + 1;
+			break;
+		}
+		pos[i] = MIN(pos[i], len - 1);
+	}
+	qsort(pos, n, sizeof(uint64_t), cmp_u64);
+	size_t m = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (m == 0 || pos[i] != pos[m - 1]) {
+			pos[m++] = pos[i];
+		}
+	}
+	return m;
+}
+
+
+// number of positions < p
+static uint64_t ref_rank1(uint64_t *pos, size_t n, uint64_t p)
+{
+	size_t l = 0, r = n;
+	while (l < r) {
+		size_t m = (l + r) / 2;
+		if (pos[m] < p) l = m + 1;
+		else r = m;
+	}
+	return l;
+}
+
+
+static void check_rbv64(CuTest *tc, roaring64bitvec *rbv, uint64_t *pos, size_t n,
+                        uint64_t len)
+{
+	CuAssertULlongEquals(tc, len, roaring64bitvec_len(rbv));
+	CuAssertULlongEquals(tc, n, roaring64bitvec_card(rbv));
+	CuAssertULlongEquals(tc, len - n, roaring64bitvec_count(rbv, 0));
+	for (size_t i = 0; i < n; i++) {
+		CuAssertULlongEquals(tc, pos[i], roaring64bitvec_select1(rbv, i));
+		CuAssertULlongEquals(tc, i, roaring64bitvec_rank1(rbv, pos[i]));
+		CuAssert(tc, "Bit should be set", roaring64bitvec_get(rbv, pos[i]));
+		for (int d = -2; d <= 2; d += 4) {
+			uint64_t p = pos[i] + d;
+			if (p < len) {
+				CuAssertIntEquals(tc, ref_rank1(pos, n, p + 1) > ref_rank1(pos, n, p),
+				                  roaring64bitvec_get(rbv, p));
+				CuAssertULlongEquals(tc, ref_rank1(pos, n, p), roaring64bitvec_rank1(rbv, p));
+				CuAssertULlongEquals(tc, p - ref_rank1(pos, n, p),
+				                     roaring64bitvec_rank0(rbv, p));
+			}
+		}
+	}
+	CuAssertULlongEquals(tc, len, roaring64bitvec_select1(rbv, n));
+	CuAssertULlongEquals(tc, n, roaring64bitvec_rank1(rbv, len + 10));
+	// select0 checked against a scan over the sorted positions
+	for (size_t t = 0; n < len && t < 2000; t++) {
+		uint64_t rank = (t < 1000) ? rand_range_uint64_t(0, len - n)
+		                : MIN(len - n - 1, (pos[t % n] - ref_rank1(pos, n, pos[t % n])) + (t % 3));
+		size_t k = ref_rank1(pos, n, rank);
+		while (k < n && pos[k] <= rank + k) {
+			k++;
+		}
+		CuAssertULlongEquals(tc, rank + k, roaring64bitvec_select0(rbv, rank));
+	}
+	CuAssertULlongEquals(tc, len, roaring64bitvec_select0(rbv, len - n));
+	// iteration
+	roaring64bitvec_iter *it = roaring64bitvec_get_iter(rbv);
+	size_t i = 0;
+	FOREACH_IN_ITER(p, uint64_t, roaring64bitvec_iter_as_iter(it)) {
+		CuAssertULlongEquals(tc, pos[i], *p);
+		i++;
+	}
+	CuAssertSizeTEquals(tc, n, i);
+	roaring64bitvec_iter_free(it);
+}
+
+
+void test_roaring64bitvec_new_from_sorted(CuTest *tc)
+{
+	memdbg_reset();
+	uint64_t lens[3] = {1000, 5 * CHUNK + 12345, (uint64_t)1 << 62};
+	for (size_t l = 0; l < 3; l++) {
+		size_t n = 20000;
+		uint64_t *pos = malloc(n * sizeof(uint64_t));
+		n = random_positions64(pos, n, lens[l]);
+		roaring64bitvec *rbv = roaring64bitvec_new_from_sorted(pos, n, lens[l]);
+		check_rbv64(tc, rbv, pos, n, lens[l]);
+		roaring64bitvec_free(rbv);
+		free(pos);
+	}
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+void test_roaring64bitvec_set(CuTest *tc)
+{
+	memdbg_reset();
+	uint64_t len = 7 * CHUNK + 999;
+	size_t n = 30000;
+	uint64_t *pos = malloc(n * sizeof(uint64_t));
+	n = random_positions64(pos, n, len);
+	roaring64bitvec *rbv = roaring64bitvec_new(len);
+	// set in shuffled order, with extra positions later cleared
+	for (size_t i = 0; i < n; i++) {
+		size_t j = (i * 7919) % n;
+		roaring64bitvec_set(rbv, pos[j], true);
+		if (j + 1 < n && pos[j] + 1 < pos[j + 1]) {
+			roaring64bitvec_set(rbv, pos[j] + 1, true);
+			roaring64bitvec_set(rbv, pos[j] + 1, false);
+		}
+	}
+	roaring64bitvec_set(rbv, len - 1, false);
+	check_rbv64(tc, rbv, pos, n, len);
+	roaring64bitvec_run_optimize(rbv);
+	roaring64bitvec_fit(rbv);
+	check_rbv64(tc, rbv, pos, n, len);
+	roaring64bitvec_free(rbv);
+	free(pos);
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+void test_roaring64bitvec_memsize(CuTest *tc)
+{
+	memdbg_reset();
+	// one position in each of many chunks
+	uint64_t len = (uint64_t)1 << 62;
+	roaring64bitvec *rbv = roaring64bitvec_new(len);
+	size_t n = 5000;
+	for (size_t i = 0; i < n; i++) {
+		roaring64bitvec_set(rbv, ((uint64_t)i * 100003) << 32 | (i * 7717), true);
+	}
+	roaring64bitvec_fit(rbv);
+	CuAssert(tc, "Memory should grow with the number of chunks in use",
+	         roaring64bitvec_memsize(rbv) < n * 256);
+	CuAssertULlongEquals(tc, n, roaring64bitvec_card(rbv));
+	roaring64bitvec_free(rbv);
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+CuSuite *roaring64bitvec_get_test_suite()
+{
+	CuSuite *suite = CuSuiteNew();
+	SUITE_ADD_TEST(suite, test_roaring64bitvec_new_from_sorted);
+	SUITE_ADD_TEST(suite, test_roaring64bitvec_set);
+	SUITE_ADD_TEST(suite, test_roaring64bitvec_memsize);
+	return suite;
+}
@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "arrays.h"
 #include "bitarr.h"
@@ -253,6 +254,445 @@ void roaringbitvec_test_select(CuTest *tc)
 }
 
 
+// random positions in [0, len), either sparse, dense or clustered in runs
+static size_t random_positions(uint32_t *pos, size_t len, int shape)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < len; ) {
+		switch (shape) {
+		case 0:
+			i += 1 + rand_range_size_t(0, 100);
+			if (i < len) pos[n++] = i;
+			break;
+		case 1:
+			if (rand() % 4) pos[n++] = i;
+			i++;
+			break;
+		case 2: {
+			size_t runlen = rand_range_size_t(1, 300);
+			for (size_t j = 0; j < runlen && i < len; j++) pos[n++] = i++;
+			i += rand_range_size_t(1, 500);
+			break;
+		}
+		default:
+			i = len;
+			break;
+		}
+	}
+	return n;
+}
+
+
+static void check_rbv(CuTest *tc, roaringbitvec *rbv, bool *bits, size_t len)
+{
+	CuAssertSizeTEquals(tc, len, roaringbitvec_len(rbv));
+	size_t rank1 = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (roaringbitvec_get(rbv, i) != bits[i]) {
+			CuAssertIntEquals(tc, bits[i], roaringbitvec_get(rbv, i));
+		}
+		if ((i % 97) == 0) {
+			CuAssertSizeTEquals(tc, rank1, roaringbitvec_rank1(rbv, i));
+			CuAssertSizeTEquals(tc, i - rank1, roaringbitvec_rank0(rbv, i));
+		}
+		if (bits[i] && (rank1 % 89) == 0) {
+			CuAssertSizeTEquals(tc, i, roaringbitvec_select1(rbv, rank1));
+		}
+		if (!bits[i] && ((i - rank1) % 89) == 0) {
+			CuAssertSizeTEquals(tc, i, roaringbitvec_select0(rbv, i - rank1));
+		}
+		rank1 += bits[i];
+	}
+	CuAssertSizeTEquals(tc, rank1, roaringbitvec_card(rbv));
+	CuAssertSizeTEquals(tc, len, roaringbitvec_select1(rbv, rank1));
+}
+
+
+void roaringbitvec_test_new_from_sorted(CuTest *tc)
+{
+	memdbg_reset();
+	size_t lens[4] = {0, 1000, (1 << 16), (1 << 18) + 725};
+	for (size_t l = 0; l < 4; l++) {
+		size_t len = lens[l];
+		for (int shape = 0; shape < 4; shape++) {
+			uint32_t *pos = malloc((len + 1) * sizeof(uint32_t));
+			bool *bits = calloc(len + 1, sizeof(bool));
+			size_t n = random_positions(pos, len, shape);
+			for (size_t i = 0; i < n; i++) {
+				bits[pos[i]] = true;
+			}
+			roaringbitvec *rbv = roaringbitvec_new_from_sorted(pos, n, len);
+			check_rbv(tc, rbv, bits, len);
+			roaringbitvec_free(rbv);
+			free(pos);
+			free(bits);
+		}
+	}
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+void roaringbitvec_test_set_runs(CuTest *tc)
+{
+	memdbg_reset();
+	size_t len = (1 << 17) + 333;
+	uint32_t *pos = malloc(len * sizeof(uint32_t));
+	bool *bits = calloc(len, sizeof(bool));
+	size_t n = random_positions(pos, len, 2);
+	for (size_t i = 0; i < n; i++) {
+		bits[pos[i]] = true;
+	}
+	roaringbitvec *rbv = roaringbitvec_new_from_sorted(pos, n, len);
+	for (size_t k = 0; k < 40000; k++) {
+		size_t i = rand_range_size_t(0, len);
+		if (k % 2) {
+			// flip near run boundaries
+			i = pos[rand_range_size_t(0, n)] + rand_range_size_t(0, 3);
+			i = MIN(i, len - 1);
+		}
+		bool val = rand() % 2;
+		bits[i] = val;
+		roaringbitvec_set(rbv, i, val);
+	}
+	check_rbv(tc, rbv, bits, len);
+	roaringbitvec_free(rbv);
+	free(pos);
+	free(bits);
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+void roaringbitvec_test_run_optimize(CuTest *tc)
+{
+	memdbg_reset();
+	// whole containers only: a short, dense last container may
+	// legitimately be run-encoded
+	size_t len = (1 << 18);
+	for (int shape = 0; shape < 4; shape++) {
+		uint32_t *pos = malloc(len * sizeof(uint32_t));
+		bool *bits = calloc(len, sizeof(bool));
+		size_t n = random_positions(pos, len, shape);
+		roaringbitvec *rbv = roaringbitvec_new(len);
+		for (size_t i = 0; i < n; i++) {
+			bits[pos[i]] = true;
+			roaringbitvec_set(rbv, pos[i], true);
+		}
+		size_t mem = roaringbitvec_memsize(rbv);
+		bool has_runs = roaringbitvec_run_optimize(rbv);
+		CuAssertIntEquals(tc, shape == 2, has_runs);
+		roaringbitvec_fit(rbv);
+		if (shape == 2) {
+			CuAssert(tc, "Run containers should be smaller",
+			         roaringbitvec_memsize(rbv) < mem);
+		}
+		check_rbv(tc, rbv, bits, len);
+		roaringbitvec_free(rbv);
+		free(pos);
+		free(bits);
+	}
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+void roaringbitvec_test_ops(CuTest *tc)
+{
+	memdbg_reset();
+	size_t lens[3] = {(1 << 18) + 725, (1 << 17), 3000};
+	for (int sa = 0; sa < 4; sa++) {
+		for (int sb = 0; sb < 4; sb++) {
+			size_t la = lens[(sa + sb) % 3], lb = lens[(sa * sb) % 3];
+			size_t lmax = MAX(la, lb);
+			uint32_t *pa = malloc(la * sizeof(uint32_t));
+			uint32_t *pb = malloc(lb * sizeof(uint32_t));
+			bool *ba = calloc(lmax, sizeof(bool));
+			bool *bb = calloc(lmax, sizeof(bool));
+			bool *exp = calloc(lmax, sizeof(bool));
+			size_t na = random_positions(pa, la, sa);
+			size_t nb = random_positions(pb, lb, sb);
+			for (size_t i = 0; i < na; i++) ba[pa[i]] = true;
+			for (size_t i = 0; i < nb; i++) bb[pb[i]] = true;
+			roaringbitvec *a = roaringbitvec_new_from_sorted(pa, na, la);
+			roaringbitvec *b = roaringbitvec_new_from_sorted(pb, nb, lb);
+			// mix in array and bitmap containers
+			if (sa == 2) {
+				for (size_t i = 0; i < la; i += 7) {
+					ba[i] = true;
+					roaringbitvec_set(a, i, true);
+				}
+			}
+			for (int op = 0; op < 4; op++) {
+				size_t len = (op == 3) ? la : lmax;
+				size_t card = 0;
+				for (size_t i = 0; i < len; i++) {
+					switch (op) {
+					case 0: exp[i] = ba[i] && bb[i]; break;
+					case 1: exp[i] = ba[i] || bb[i]; break;
+					case 2: exp[i] = ba[i] != bb[i]; break;
+					default: exp[i] = ba[i] && !bb[i]; break;
+					}
+					card += exp[i];
+				}
+				roaringbitvec *res = NULL;
+				size_t res_card = 0;
+				switch (op) {
+				case 0:
+					res = roaringbitvec_and(a, b);
+					res_card = roaringbitvec_and_card(a, b);
+					break;
+				case 1:
+					res = roaringbitvec_or(a, b);
+					res_card = roaringbitvec_or_card(a, b);
+					break;
+				case 2:
+					res = roaringbitvec_xor(a, b);
+					res_card = roaringbitvec_xor_card(a, b);
+					break;
+				default:
+					res = roaringbitvec_andnot(a, b);
+					res_card = roaringbitvec_andnot_card(a, b);
+					break;
+				}
+				CuAssertSizeTEquals(tc, card, res_card);
+				check_rbv(tc, res, exp, len);
+				roaringbitvec_free(res);
+
+				res = roaringbitvec_new_from_sorted(pa, na, la);
+				for (size_t i = 0; sa == 2 && i < la; i += 7) {
+					roaringbitvec_set(res, i, true);
+				}
+				switch (op) {
+				case 0: roaringbitvec_and_inplace(res, b); break;
+				case 1: roaringbitvec_or_inplace(res, b); break;
+				case 2: roaringbitvec_xor_inplace(res, b); break;
+				default: roaringbitvec_andnot_inplace(res, b); break;
+				}
+				check_rbv(tc, res, exp, len);
+				roaringbitvec_free(res);
+			}
+			roaringbitvec_free(a);
+			roaringbitvec_free(b);
+			free(pa);
+			free(pb);
+			free(ba);
+			free(bb);
+			free(exp);
+		}
+	}
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+void roaringbitvec_test_iter(CuTest *tc)
+{
+	memdbg_reset();
+	size_t len = (1 << 18) + 725;
+	for (int shape = 0; shape < 4; shape++) {
+		uint32_t *pos = malloc(len * sizeof(uint32_t));
+		size_t n = random_positions(pos, len, shape);
+		roaringbitvec *rbv = roaringbitvec_new_from_sorted(pos, n, len);
+		roaringbitvec_iter *it = roaringbitvec_get_iter(rbv);
+		size_t i = 0;
+		FOREACH_IN_ITER(p, size_t, roaringbitvec_iter_as_iter(it)) {
+			CuAssertSizeTEquals(tc, pos[i], *p);
+			i++;
+		}
+		CuAssertSizeTEquals(tc, n, i);
+		FREE(it);
+		roaringbitvec_free(rbv);
+		free(pos);
+	}
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+
+void roaringbitvec_test_serialise(CuTest *tc)
+{
+	memdbg_reset();
+	size_t len = (1 << 18) + 725;
+	char path[] = "/tmp/roaringtestXXXXXX";
+	int fd = mkstemp(path);
+	CuAssert(tc, "Unable to create temp file", fd >= 0);
+	close(fd);
+	for (int shape = 0; shape < 4; shape++) {
+		for (int opt = 0; opt < 2; opt++) {
+			uint32_t *pos = malloc(len * sizeof(uint32_t));
+			bool *bits = calloc(len, sizeof(bool));
+			size_t n = random_positions(pos, len, shape);
+			for (size_t i = 0; i < n; i++) {
+				bits[pos[i]] = true;
+			}
+			// bit by bit construction yields no run containers
+			roaringbitvec *rbv = roaringbitvec_new(len);
+			for (size_t i = 0; i < n; i++) {
+				roaringbitvec_set(rbv, pos[i], true);
+			}
+			bool has_runs = opt && roaringbitvec_run_optimize(rbv);
+
+			FILE *stream = fopen(path, "wb");
+			size_t size = roaringbitvec_write(rbv, stream);
+			fclose(stream);
+			CuAssertSizeTEquals(tc, roaringbitvec_serialised_size(rbv), size);
+
+			// check the header against the format spec
+			byte_t *buf = malloc(size + 1);
+			stream = fopen(path, "rb");
+			CuAssertSizeTEquals(tc, size, fread(buf + 1, 1, size, stream));
+			fclose(stream);
+			uint32_t cookie = buf[1] | (buf[2] << 8);
+			CuAssertIntEquals(tc, has_runs ? 12347 : 12346, cookie);
+
+			roaringbitvec *mapped = roaringbitvec_open_mmap(path, len);
+			CuAssertPtrNotNull(tc, mapped);
+			check_rbv(tc, mapped, bits, len);
+
+			// misaligned buffer: containers are copied
+			roaringbitvec *copied = roaringbitvec_new_from_buffer(buf + 1, size, len);
+			CuAssertPtrNotNull(tc, copied);
+			check_rbv(tc, copied, bits, len);
+			roaringbitvec_free(copied);
+
+			// modifying a mapped bitvector copies the affected containers
+			for (size_t i = 0; i < len; i += 1001) {
+				bits[i] = !bits[i];
+				roaringbitvec_set(mapped, i, bits[i]);
+			}
+			check_rbv(tc, mapped, bits, len);
+			roaringbitvec_free(mapped);
+
+			// truncated or corrupt input is rejected
+			CuAssertPtrEquals(tc, NULL,
+			                  roaringbitvec_new_from_buffer(buf + 1, size - 1, len));
+			buf[1] ^= 0xFF;
+			CuAssertPtrEquals(tc, NULL,
+			                  roaringbitvec_new_from_buffer(buf + 1, size, len));
+
+			roaringbitvec_free(rbv);
+			free(buf);
+			free(pos);
+			free(bits);
+		}
+	}
+	remove(path);
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
+
+static size_t put_le16(byte_t *buf, size_t off, uint32_t val)
+{
+	buf[off] = val & 0xFF;
+	buf[off + 1] = (val >> 8) & 0xFF;
+	return off + 2;
+}
+
+
+// a single array container at key 0 holding the given values
+static size_t array_rbv_buf(byte_t *buf, const uint16_t *vals, size_t n)
+{
+	size_t off = put_le16(buf, 0, 12346);
+	off = put_le16(buf, off, 0);
+	off = put_le16(buf, off, 1);
+	off = put_le16(buf, off, 0);
+	off = put_le16(buf, off, 0);
+	off = put_le16(buf, off, n - 1);
+	off = put_le16(buf, off, off + 4);
+	off = put_le16(buf, off, 0);
+	for (size_t i = 0; i < n; i++) {
+		off = put_le16(buf, off, vals[i]);
+	}
+	return off;
+}
+
+
+// a single run container at key 0 with the given cardinality and runs
+static size_t run_rbv_buf(byte_t *buf, size_t card, const uint16_t *runs,
+                          size_t nruns)
+{
+	size_t off = put_le16(buf, 0, 12347);
+	off = put_le16(buf, off, 0);
+	buf[off++] = 1;
+	off = put_le16(buf, off, 0);
+	off = put_le16(buf, off, card - 1);
+	off = put_le16(buf, off, nruns);
+	for (size_t i = 0; i < 2 * nruns; i++) {
+		off = put_le16(buf, off, runs[i]);
+	}
+	return off;
+}
+
+
+void roaringbitvec_test_load_invalid(CuTest *tc)
+{
+	memdbg_reset();
+	size_t len = 1 << 17;
+	// aligned to the container words
+	uint64_t words[(2 * (1 << 16) / 64) + 8];
+	byte_t *buf = (byte_t *)words;
+	size_t size;
+	roaringbitvec *rbv;
+
+	uint16_t sorted[3] = {3, 5, 900}, unsorted[3] = {3, 900, 5},
+	                                  dup[3] = {3, 5, 5};
+	size = array_rbv_buf(buf, sorted, 3);
+	rbv = roaringbitvec_new_from_buffer(buf, size, len);
+	CuAssertPtrNotNull(tc, rbv);
+	CuAssertSizeTEquals(tc, 3, roaringbitvec_card(rbv));
+	roaringbitvec_free(rbv);
+	size = array_rbv_buf(buf, unsorted, 3);
+	CuAssertPtrEquals(tc, NULL, roaringbitvec_new_from_buffer(buf, size, len));
+	size = array_rbv_buf(buf, dup, 3);
+	CuAssertPtrEquals(tc, NULL, roaringbitvec_new_from_buffer(buf, size, len));
+	// position beyond the length
+	size = array_rbv_buf(buf, sorted, 3);
+	CuAssertPtrEquals(tc, NULL, roaringbitvec_new_from_buffer(buf, size, 900));
+
+	uint16_t runs[4] = {10, 4, 100, 0};
+	size = run_rbv_buf(buf, 6, runs, 2);
+	rbv = roaringbitvec_new_from_buffer(buf, size, len);
+	CuAssertPtrNotNull(tc, rbv);
+	CuAssertSizeTEquals(tc, 6, roaringbitvec_card(rbv));
+	roaringbitvec_free(rbv);
+	// cardinality does not match the runs
+	size = run_rbv_buf(buf, 7, runs, 2);
+	CuAssertPtrEquals(tc, NULL, roaringbitvec_new_from_buffer(buf, size, len));
+	// run past the end of the container
+	uint16_t overflow[2] = {0xFFF0, 0x20};
+	size = run_rbv_buf(buf, 0x21, overflow, 1);
+	CuAssertPtrEquals(tc, NULL, roaringbitvec_new_from_buffer(buf, size, len));
+	// overlapping and adjacent runs
+	uint16_t overlap[4] = {10, 4, 14, 0}, adjacent[4] = {10, 4, 15, 0};
+	size = run_rbv_buf(buf, 6, overlap, 2);
+	CuAssertPtrEquals(tc, NULL, roaringbitvec_new_from_buffer(buf, size, len));
+	size = run_rbv_buf(buf, 6, adjacent, 2);
+	CuAssertPtrEquals(tc, NULL, roaringbitvec_new_from_buffer(buf, size, len));
+	// no runs
+	size = run_rbv_buf(buf, 1, runs, 0);
+	CuAssertPtrEquals(tc, NULL, roaringbitvec_new_from_buffer(buf, size, len));
+
+	// bitmap whose cardinality does not match its bits
+	roaringbitvec *full = roaringbitvec_new(len);
+	for (size_t i = 0; i < 5000; i++) {
+		roaringbitvec_set(full, 2 * i, true);
+	}
+	char path[] = "/tmp/roaringtestXXXXXX";
+	int fd = mkstemp(path);
+	CuAssert(tc, "Unable to create temp file", fd >= 0);
+	FILE *stream = fdopen(fd, "w+b");
+	size = roaringbitvec_write(full, stream);
+	rewind(stream);
+	CuAssertSizeTEquals(tc, size, fread(buf, 1, size, stream));
+	fclose(stream);
+	remove(path);
+	rbv = roaringbitvec_new_from_buffer(buf, size, len);
+	CuAssertPtrNotNull(tc, rbv);
+	roaringbitvec_free(rbv);
+	buf[size - 1] ^= 0x80;
+	CuAssertPtrEquals(tc, NULL, roaringbitvec_new_from_buffer(buf, size, len));
+	roaringbitvec_free(full);
+
+	CuAssert(tc, "Memory leak.", memdbg_is_empty());
+}
+
 
 void test_roaringbitvec_speed_rank(CuTest *tc)
 {
@@ -297,6 +737,13 @@ CuSuite *roaringbitvec_get_test_suite()
 	SUITE_ADD_TEST(suite, roaringbitvec_test_rank);
 	//SUITE_ADD_TEST(suite, test_roaringbitvec_speed_rank);
 	SUITE_ADD_TEST(suite, roaringbitvec_test_select);
+	SUITE_ADD_TEST(suite, roaringbitvec_test_new_from_sorted);
+	SUITE_ADD_TEST(suite, roaringbitvec_test_set_runs);
+	SUITE_ADD_TEST(suite, roaringbitvec_test_run_optimize);
+	SUITE_ADD_TEST(suite, roaringbitvec_test_ops);
+	SUITE_ADD_TEST(suite, roaringbitvec_test_iter);
+	SUITE_ADD_TEST(suite, roaringbitvec_test_serialise);
+	SUITE_ADD_TEST(suite, roaringbitvec_test_load_invalid);
 
 	return suite;
 }
@@ -19,6 +19,7 @@
  *
  */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -127,10 +128,156 @@ void sais_test_xstr(CuTest *tc)
 }
 
 
+static void periodic_str(alphabet *ab, size_t len, size_t period, char *dest)
+{
+	for (size_t i = 0; i < len; i++) {
+		dest[i] = (i % period < period - 1) ? (char)ab_char(ab, 0)
+		          : (char)ab_char(ab, 1 + (i / period) % (ab_size(ab) - 1));
+	}
+	dest[len] = '\0';
+}
+
+
+void sais_test_packed(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = alphabet_new(4, "acgt");
+	sais_width widths[3] = {SAIS_W32, SAIS_W40, SAIS_W64};
+	size_t max_len = 600;
+	char *str = cstr_new(max_len);
+	for (size_t len = 0; len < max_len; len += 7) {
+		for (int periodic = 0; periodic < 2; periodic++) {
+			if (periodic) {
+				periodic_str(ab, len, 5, str);
+			}
+			else {
+				random_str(ab, len, str);
+			}
+			size_t *sarr = sais(str, len, ab);
+			for (size_t w = 0; w < 3; w++) {
+				for (size_t nthreads = 1; nthreads <= 3; nthreads += 2) {
+					byte_t *psa = sais_packed(str, len, ab, widths[w], nthreads);
+					for (size_t i = 0; i <= len; i++) {
+						CuAssertSizeTEquals(tc, sarr[i],
+						                    sais_packed_get(psa, widths[w], i));
+					}
+					FREE(psa);
+				}
+			}
+			FREE(sarr);
+		}
+	}
+	CuAssertIntEquals(tc, SAIS_W32, sais_min_width(1000));
+	CuAssertIntEquals(tc, SAIS_W40, sais_min_width((size_t)UINT32_MAX));
+	CuAssertIntEquals(tc, SAIS_W64, sais_min_width((size_t)1 << 41));
+	FREE(str);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+void sais_test_xstr_packed(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = int_alphabet_new(300);
+	xstr *str = xstr_new(nbytes(ab_size(ab)));
+	for (size_t len = 0; len < 3000; len += 97) {
+		random_xstr(ab, len, str);
+		size_t *sarr = sais_xstr(str, ab);
+		byte_t *psa = sais_xstr_packed(str, ab, SAIS_W40, 4);
+		for (size_t i = 0; i <= len; i++) {
+			CuAssertSizeTEquals(tc, sarr[i], sais_packed_get(psa, SAIS_W40, i));
+		}
+		FREE(psa);
+		FREE(sarr);
+	}
+	xstr_free(str);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+void sais_test_par(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = alphabet_new(4, "acgt");
+	size_t len = 50000;
+	char *str = cstr_new(len);
+	for (size_t period = 0; period < 3; period++) {
+		if (period) {
+			periodic_str(ab, len, 3 * period, str);
+		}
+		else {
+			random_str(ab, len, str);
+		}
+		size_t *sarr = sais(str, len, ab);
+		for (size_t nthreads = 2; nthreads <= 8; nthreads *= 2) {
+			size_t *psarr = sais_par(str, len, ab, nthreads);
+			size_t ndiff = 0;
+			for (size_t i = 0; i <= len; i++) {
+				ndiff += (sarr[i] != psarr[i]);
+			}
+			CuAssertSizeTEquals(tc, 0, ndiff);
+			FREE(psarr);
+		}
+		FREE(sarr);
+	}
+	FREE(str);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
+void sais_test_file(CuTest *tc)
+{
+	memdbg_reset();
+	alphabet *ab = alphabet_new(4, "acgt");
+	size_t len = 5000;
+	char *str = cstr_new(len);
+	random_str(ab, len, str);
+	size_t *sarr = sais(str, len, ab);
+	sais_width widths[3] = {SAIS_W32, SAIS_W40, SAIS_W64};
+	size_t *range = ARR_NEW(size_t, len + 1);
+	for (size_t w = 0; w < 3; w++) {
+		byte_t *psa = sais_packed(str, len, ab, widths[w], 2);
+		FILE *file = tmpfile();
+		fputs("header", file);
+		CuAssertSizeTEquals(tc, len + 1,
+		                    sais_packed_write(psa, widths[w], len + 1, file));
+		FREE(psa);
+		fseek(file, strlen("header"), SEEK_SET);
+		CuAssertSizeTEquals(tc, len + 1,
+		                    sais_file_get_range(file, widths[w], 0, len + 1, range));
+		for (size_t i = 0; i <= len; i++) {
+			CuAssertSizeTEquals(tc, sarr[i], range[i]);
+		}
+		CuAssertSizeTEquals(tc, 10,
+		                    sais_file_get_range(file, widths[w], 1000, 1010, range));
+		for (size_t i = 0; i < 10; i++) {
+			CuAssertSizeTEquals(tc, sarr[1000 + i], range[i]);
+		}
+		CuAssertSizeTEquals(tc, 1,
+		                    sais_file_get_range(file, widths[w], len, len + 7, range));
+		CuAssertSizeTEquals(tc, sarr[len], range[0]);
+		CuAssertIntEquals(tc, (int)strlen("header"), (int)ftell(file));
+		fclose(file);
+	}
+	FREE(range);
+	FREE(sarr);
+	FREE(str);
+	alphabet_free(ab);
+	CuAssert(tc, "Memory leak", memdbg_is_empty());
+}
+
+
 CuSuite *sais_get_test_suite()
 {
 	CuSuite *suite = CuSuiteNew();
 	SUITE_ADD_TEST(suite, sais_test_str);
 	SUITE_ADD_TEST(suite, sais_test_xstr);
+	SUITE_ADD_TEST(suite, sais_test_packed);
+	SUITE_ADD_TEST(suite, sais_test_xstr_packed);
+	SUITE_ADD_TEST(suite, sais_test_par);
+	SUITE_ADD_TEST(suite, sais_test_file);
 	return suite;
 }
@@ -30,6 +30,7 @@
 #include "cstrutil.h"
 #include "huffcode.h"
 #include "mathutil.h"
+#include "strreader.h"
 #include "strstream.h"
 #include "wavtree.h"
 
@@ -285,6 +286,149 @@ void test_wavtree_char(CuTest *tc)
 
 
 
+// Checks access, rank and select on wt against a scan of the
+// len chars of src, which counts the occurrences of each char so far.
+static void check_wavtree_bf(CuTest *tc, wavtree *wt, alphabet *ab,
+                             const xchar_t *src, size_t len)
+{
+	CuAssertSizeTEquals(tc, len, wavtree_len(wt));
+	size_t nchars = ab_size(ab);
+	size_t *counts = ARR_OF_0_NEW(size_t, nchars);
+	size_t step = 1 + len / 256;
+	for (size_t i = 0; i <= len; i++) {
+		if (i % step == 0 || i == len) {
+			for (size_t r = 0; r < nchars; r++)
+				CuAssertSizeTEquals(tc, counts[r],
+				                    wavtree_rank(wt, i, ab_char(ab, r)));
+		}
+		if (i == len) break;
+		size_t r = ab_rank(ab, src[i]);
+		CuAssertIntEquals(tc, src[i], wavtree_char(wt, i));
+		CuAssertSizeTEquals(tc, counts[r], wavtree_rank_pos(wt, i));
+		CuAssertSizeTEquals(tc, i, wavtree_select(wt, src[i], counts[r]));
+		counts[r]++;
+	}
+	FREE(counts);
+}
+
+
+static xchar_t *str_to_xchars(const char *str, size_t len)
+{
+	xchar_t *ret = ARR_NEW(xchar_t, len);
+	for (size_t i = 0; i < len; i++)
+		ret[i] = (unsigned char)str[i];
+	return ret;
+}
+
+
+void test_wavtree_new_par(CuTest *tc)
+{
+	wavtree_test_setup(tc);
+	for (size_t k = 0; k < nwt; k++) {
+		xchar_t *src = str_to_xchars(strings[k], slens[k]);
+		for (size_t nthreads = 0; nthreads <= 5; nthreads++) {
+			wavtree *wt = wavtree_new_par(alphabets[k], strings[k], slens[k],
+			                              k < 9 ? WT_BALANCED : WT_HUFFMAN,
+			                              nthreads);
+			check_wavtree_bf(tc, wt, alphabets[k], src, slens[k]);
+			wavtree_free(wt);
+		}
+		FREE(src);
+	}
+	wavtree_test_teardown(tc);
+
+	// long string, many small nodes sharing bytes between chunks
+	alphabet *ab = seq_ab(26);
+	size_t len = 100000;
+	char *str = random_str(ab, len);
+	xchar_t *src = str_to_xchars(str, len);
+	wtshape shp[2] = {WT_BALANCED, WT_HUFFMAN};
+	for (size_t s = 0; s < 2; s++) {
+		wavtree *wt = wavtree_new_par(ab, str, len, shp[s], 7);
+		check_wavtree_bf(tc, wt, ab, src, len);
+		wavtree_free(wt);
+	}
+	FREE(src);
+	FREE(str);
+	alphabet_free(ab);
+}
+
+
+static void check_range_ops(CuTest *tc, wavtree *wt, alphabet *ab,
+                            char *str, size_t len)
+{
+	size_t nchars = ab_size(ab);
+	size_t *counts = ARR_NEW(size_t, nchars);
+	size_t *bfcounts = ARR_NEW(size_t, nchars);
+	xchar_t *dchars = ARR_NEW(xchar_t, nchars);
+	size_t *dcounts = ARR_NEW(size_t, nchars);
+	for (size_t pos = 0; pos <= len + 1; pos++) {
+		wavtree_rank_all(wt, pos, counts);
+		for (size_t r = 0; r < nchars; r++)
+			CuAssertSizeTEquals(tc, __rank_bf(str, MIN(pos, len), ab_char(ab, r)),
+			                    counts[r]);
+	}
+	size_t step = MAX(1, len / 7);
+	for (size_t lo = 0; lo <= len; lo += step) {
+		for (size_t hi = lo; hi <= len; hi += step) {
+			memset(bfcounts, 0, nchars * sizeof(size_t));
+			for (size_t i = lo; i < hi; i++)
+				bfcounts[ab_rank(ab, str[i])]++;
+			for (size_t a = 0; a < nchars; a += 3) {
+				for (size_t b = a; b < nchars; b += 2) {
+					size_t bf = 0;
+					for (size_t r = a; r <= b; r++)
+						bf += bfcounts[r];
+					CuAssertSizeTEquals(tc, bf,
+					                    wavtree_range_count(wt, lo, hi, ab_char(ab, a), ab_char(ab, b)));
+				}
+			}
+			size_t k = 0;
+			for (size_t r = 0; r < nchars; r++) {
+				for (size_t j = 0; j < bfcounts[r]; j++, k++)
+					CuAssertIntEquals(tc, ab_char(ab, r),
+					                  wavtree_range_quantile(wt, lo, hi, k));
+			}
+			CuAssertIntEquals(tc, XEOF, wavtree_range_quantile(wt, lo, hi, k));
+			size_t ndist = wavtree_range_distinct(wt, lo, hi, dchars, dcounts);
+			size_t d = 0;
+			for (size_t r = 0; r < nchars; r++) {
+				if (bfcounts[r] == 0) continue;
+				CuAssertTrue(tc, d < ndist);
+				CuAssertIntEquals(tc, ab_char(ab, r), dchars[d]);
+				CuAssertSizeTEquals(tc, bfcounts[r], dcounts[d]);
+				d++;
+			}
+			CuAssertSizeTEquals(tc, d, ndist);
+		}
+	}
+	FREE(counts);
+	FREE(bfcounts);
+	FREE(dchars);
+	FREE(dcounts);
+}
+
+
+void test_wavtree_range_ops(CuTest *tc)
+{
+	wavtree_test_setup(tc);
+	for (size_t k = 0; k < nwt; k++) {
+		check_range_ops(tc, wts[k], alphabets[k], strings[k], slens[k]);
+	}
+	wavtree_test_teardown(tc);
+
+	// online trees rank the chars by order of first occurrence
+	char *str = "abracadabra";
+	strreader *rdr = strreader_new(str, strlen(str));
+	wavtree *wt = wavtree_new_online(strreader_as_strread(rdr));
+	alphabet *ab = alphabet_new(5, "abrcd");
+	check_range_ops(tc, wt, ab, str, strlen(str));
+	alphabet_free(ab);
+	wavtree_free(wt);
+	strreader_free(rdr);
+}
+
+
 static xstr **xstrs;
 
 static alphabet *xseq_ab(size_t len)
@@ -518,6 +662,26 @@ void test_xwavtree_succ(CuTest *tc)
 
 
 
+void test_xwavtree_new_par(CuTest *tc)
+{
+	xwavtree_test_setup(tc);
+	for (size_t k = 0; k < nwt; k++) {
+		size_t len = xstr_len(xstrs[k]);
+		xchar_t *src = ARR_NEW(xchar_t, len);
+		xstr_get_range(xstrs[k], 0, len, src);
+		for (size_t nthreads = 1; nthreads <= 4; nthreads++) {
+			wavtree *wt = wavtree_new_from_xstr_par(alphabets[k], xstrs[k],
+			                                        k < 9 ? WT_BALANCED : WT_HUFFMAN,
+			                                        nthreads);
+			check_wavtree_bf(tc, wt, alphabets[k], src, len);
+			wavtree_free(wt);
+		}
+		FREE(src);
+	}
+	xwavtree_test_teardown(tc);
+}
+
+
 CuSuite *wavtree_get_test_suite()
 {
 	CuSuite *suite = CuSuiteNew();
@@ -527,12 +691,15 @@ CuSuite *wavtree_get_test_suite()
 	SUITE_ADD_TEST(suite, test_wavtree_pred);
 	SUITE_ADD_TEST(suite, test_wavtree_succ);
 	SUITE_ADD_TEST(suite, test_wavtree_char);
+	SUITE_ADD_TEST(suite, test_wavtree_new_par);
+	SUITE_ADD_TEST(suite, test_wavtree_range_ops);
 	SUITE_ADD_TEST(suite, test_xwavtree_rank);
 	SUITE_ADD_TEST(suite, test_xwavtree_rank_pos);
 	SUITE_ADD_TEST(suite, test_xwavtree_select);
 	SUITE_ADD_TEST(suite, test_xwavtree_char);
 	SUITE_ADD_TEST(suite, test_xwavtree_succ);
 	SUITE_ADD_TEST(suite, test_xwavtree_pred);
+	SUITE_ADD_TEST(suite, test_xwavtree_new_par);
 
 	return suite;
 }
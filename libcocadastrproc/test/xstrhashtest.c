@@ -0,0 +1,192 @@
+/*
+ * COCADA - COCADA Collection of Algorithms and DAta Structures
+ *
+ * Copyright (C) 2016  Paulo G S Fonseca
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CuTest.h"
+
+#include "alphabet.h"
+#include "arrays.h"
+#include "new.h"
+#include "order.h"
+#include "xstr.h"
+#include "xstrhash.h"
+
+
+static alphabet *_dna()
+{
+	char *nucl[4] = {"Aa", "Cc", "Gg", "Tt"};
+	return alphabet_new_with_equivs(4, nucl);
+}
+
+
+static void _random_dna(char *dest, size_t len, bool with_n)
+{
+	for (size_t i=0; i<len; i++)
+		dest[i] = (with_n && rand()%20==0) ? 'N' : "ACGTacgt"[rand()%8];
+}
+
+
+void test_xstrhash_lex(CuTest *tc)
+{
+	alphabet *ab = _dna();
+	xstrhash *h = xstrhash_new(ab);
+	size_t len = 200, k = 20;
+	char *str = malloc(len);
+	_random_dna(str, len, false);
+	xstr *xs = xstr_new_from_arr_cpy(str, len, 1);
+	uint64_t hash = xstrhash_lex_sub(h, xs, 0, k);
+	for (size_t i=1; i+k<=len; i++) {
+		hash = xstrhash_roll_lex_sub(h, xs, i-1, i-1+k, hash, xstr_get(xs, i-1+k));
+		CuAssertTrue(tc, hash == xstrhash_lex_sub(h, xs, i, i+k));
+	}
+	xstr *win = xstr_new(1);
+	xstr_ncpy(win, 0, xs, 0, k);
+	hash = xstrhash_lex(h, win);
+	hash = xstrhash_roll_lex(h, win, hash, xstr_get(xs, k));
+	CuAssertTrue(tc, hash == xstrhash_lex_sub(h, xs, 1, k+1));
+	xstr_free(win);
+	xstr_free(xs);
+	free(str);
+	DESTROY_FLAT(h, xstrhash);
+}
+
+
+void test_rollhash_many(CuTest *tc)
+{
+	alphabet *ab = _dna();
+	size_t len = 3000;
+	char *str = malloc(len);
+	uint64_t *hs = ARR_NEW(uint64_t, len);
+	uint64_t *xhs = ARR_NEW(uint64_t, len);
+	size_t ks[6] = {1, 5, 31, 64, 100, 1500};
+	for (rollhash_type t=ROLLHASH_KARP_RABIN; t<=ROLLHASH_NTHASH; t++) {
+		for (size_t ki=0; ki<6; ki++) {
+			size_t k = ks[ki];
+			_random_dna(str, len, true);
+			xstr *xs = xstr_new_from_arr_cpy(str, len, 1);
+			rollhash *rh = rollhash_new(t, ab, k, 17);
+			CuAssertSizeTEquals(tc, len-k+1, rollhash_many_str(rh, str, len, hs));
+			CuAssertSizeTEquals(tc, len-k+1, rollhash_many(rh, xs, xhs));
+			rollhash_state st;
+			uint64_t h = rollhash_init(rh, &st, xs, 0);
+			for (size_t i=0; i+k<=len; i++) {
+				CuAssertTrue(tc, hs[i] == xhs[i]);
+				rollhash_state st0;
+				CuAssertTrue(tc, hs[i] == rollhash_init(rh, &st0, xs, i));
+				CuAssertTrue(tc, hs[i] == h);
+				if (i+k < len)
+					h = rollhash_roll(rh, &st, str[i], str[i+k]);
+			}
+			CuAssertSizeTEquals(tc, 0, rollhash_many_str(rh, str, k-1, hs));
+			rollhash_free(rh);
+			xstr_free(xs);
+		}
+	}
+	FREE(hs);
+	FREE(xhs);
+	free(str);
+	alphabet_free(ab);
+}
+
+
+static char _comp(char c)
+{
+	switch (c) {
+	case 'A': case 'a': return 'T';
+	case 'C': case 'c': return 'G';
+	case 'G': case 'g': return 'C';
+	case 'T': case 't': return 'A';
+	default: return 'N';
+	}
+}
+
+
+void test_rollhash_nthash_canonical(CuTest *tc)
+{
+	alphabet *ab = _dna();
+	size_t len = 500, k = 33;
+	char *str = malloc(len), *rc = malloc(len);
+	_random_dna(str, len, true);
+	for (size_t i=0; i<len; i++)
+		rc[len-1-i] = _comp(str[i]);
+	uint64_t *hs = ARR_NEW(uint64_t, len);
+	uint64_t *rhs = ARR_NEW(uint64_t, len);
+	for (uint64_t seed=0; seed<2; seed++) {
+		rollhash *rh = rollhash_new(ROLLHASH_NTHASH, ab, k, seed);
+		size_t n = rollhash_many_str(rh, str, len, hs);
+		rollhash_many_str(rh, rc, len, rhs);
+		for (size_t i=0; i<n; i++) {
+			CuAssertTrue(tc, hs[i] == rhs[n-1-i]);
+			CuAssertTrue(tc, rollhash_extra(rh, hs[i], 0) == hs[i]);
+			CuAssertTrue(tc, rollhash_extra(rh, hs[i], 1) != hs[i]);
+		}
+		rollhash_free(rh);
+	}
+	alphabet *ab3 = alphabet_new(3, "abc");
+	CuAssertPtrEquals(tc, NULL, rollhash_new(ROLLHASH_NTHASH, ab3, k, 0));
+	CuAssertPtrEquals(tc, NULL, rollhash_new(ROLLHASH_BUZHASH, ab3, 0, 0));
+	alphabet_free(ab3);
+	FREE(hs);
+	FREE(rhs);
+	free(str);
+	free(rc);
+	alphabet_free(ab);
+}
+
+
+void test_rollhash_collisions(CuTest *tc)
+{
+	// 40-mers overflow the lexicographic hash but should not collide
+	// with the rolling hashes
+	alphabet *ab = _dna();
+	size_t len = 20000, k = 40;
+	char *str = malloc(len);
+	_random_dna(str, len, false);
+	uint64_t *hs = ARR_NEW(uint64_t, len);
+	for (rollhash_type t=ROLLHASH_KARP_RABIN; t<=ROLLHASH_NTHASH; t++) {
+		rollhash *rh = rollhash_new(t, ab, k, 5);
+		size_t n = rollhash_many_str(rh, str, len, hs);
+		qsort(hs, n, sizeof(uint64_t), cmp_uint64_t);
+		size_t ncoll = 0;
+		for (size_t i=1; i<n; i++)
+			ncoll += (hs[i] == hs[i-1]);
+		CuAssertSizeTEquals(tc, 0, ncoll);
+		rollhash_free(rh);
+	}
+	FREE(hs);
+	free(str);
+	alphabet_free(ab);
+}
+
+
+CuSuite *xstrhash_get_test_suite()
+{
+	CuSuite *suite = CuSuiteNew();
+	SUITE_ADD_TEST(suite, test_xstrhash_lex);
+	SUITE_ADD_TEST(suite, test_rollhash_many);
+	SUITE_ADD_TEST(suite, test_rollhash_nthash_canonical);
+	SUITE_ADD_TEST(suite, test_rollhash_collisions);
+	return suite;
+}
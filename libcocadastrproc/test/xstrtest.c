@@ -50,6 +50,97 @@ void test_xstr_get_set(CuTest *tc)
 }
 
 
+void test_xstr_range(CuTest *tc)
+{
+	xchar_t buf[100];
+	for (size_t sz=1; sz<=XCHAR_BYTES; sz++) {
+		xchar_t mask = (sz < sizeof(xchar_t)) ? ((xchar_t)1 << (8*sz)) - 1
+		               : (xchar_t)~0;
+		xstr *xs = xstr_new(sz);
+		for (size_t i=0; i<100; i++)
+			buf[i] = (xchar_t)rand() & mask;
+		xstr_set_range(xs, 0, 60, buf);
+		// overwrite the tail and extend past the end
+		xstr_set_range(xs, 50, 50, buf+50);
+		CuAssertSizeTEquals(tc, 100, xstr_len(xs));
+		for (size_t i=0; i<100; i++)
+			CuAssertTrue(tc, buf[i] == xstr_get(xs, i));
+		xchar_t got[100];
+		xstr_get_range(xs, 7, 80, got);
+		for (size_t i=0; i<80; i++)
+			CuAssertTrue(tc, buf[7+i] == got[i]);
+
+		xstr *cp = xstr_new(sz);
+		xstr_push_n(cp, 1, 10);
+		xstr_ncpy(cp, 5, xs, 20, 30);
+		CuAssertSizeTEquals(tc, 35, xstr_len(cp));
+		for (size_t i=0; i<35; i++)
+			CuAssertTrue(tc, ((i<5) ? 1 : buf[15+i]) == xstr_get(cp, i));
+		xstr_free(cp);
+		xstr_free(xs);
+	}
+}
+
+
+static int _ncmp_bf(const xstr *a, const xstr *b, size_t n)
+{
+	for (size_t i=0; i<n; i++) {
+		if (i==xstr_len(a) || i==xstr_len(b))
+			return (xstr_len(a)==xstr_len(b)) ? 0
+			       : (xstr_len(a) < xstr_len(b)) ? -1 : +1;
+		if (xstr_get(a, i) != xstr_get(b, i))
+			return (xstr_get(a, i) < xstr_get(b, i)) ? -1 : +1;
+	}
+	return 0;
+}
+
+
+void test_xstr_ncmp(CuTest *tc)
+{
+	for (size_t sz=1; sz<=XCHAR_BYTES; sz++) {
+		for (size_t t=0; t<200; t++) {
+			size_t la = rand()%40, lb = rand()%40;
+			xstr *a = xstr_new(sz);
+			xstr *b = xstr_new(sz);
+			for (size_t i=0; i<la; i++)
+				xstr_push(a, rand()%3 ? 0x0102 : (xchar_t)rand()%0x10000);
+			xstr_ncpy(b, 0, a, 0, MIN(la, lb));
+			for (size_t i=la; i<lb; i++)
+				xstr_push(b, (xchar_t)rand()%0x10000);
+			// a single differing char, possibly in any byte
+			if (lb && rand()%2)
+				xstr_set(b, rand()%lb, (xchar_t)rand()%0x10000);
+			size_t n = rand()%45;
+			CuAssertIntEquals(tc, _ncmp_bf(a, b, n), xstr_ncmp(a, b, n));
+			CuAssertIntEquals(tc, _ncmp_bf(b, a, n), xstr_ncmp(b, a, n));
+			xstr_free(a);
+			xstr_free(b);
+		}
+	}
+}
+
+
+void test_xstr_views(CuTest *tc)
+{
+	xstr *xs = xstr_new(2);
+	for (size_t i=0; i<300; i++)
+		xstr_push(xs, i*7);
+	uint16_t *v = xstr_as_uint16_t(xs);
+	for (size_t i=0; i<300; i++) {
+		CuAssertTrue(tc, (uint16_t)(i*7) == v[i]);
+		v[i] = (uint16_t)i;
+	}
+	for (size_t i=0; i<300; i++)
+		CuAssertTrue(tc, i == xstr_get(xs, i));
+	xstr_free(xs);
+
+	xs = xstr_new(1);
+	xstr_push_n(xs, 'a', 10);
+	CuAssertIntEquals(tc, 'a', xstr_as_uint8_t(xs)[9]);
+	xstr_free(xs);
+}
+
+
 void print_int16(FILE *stream, xchar_t c)
 {
 	fprintf(stream, "{%d}", c);
@@ -86,6 +177,9 @@ CuSuite *xstr_get_test_suite()
 {
 	CuSuite *suite = CuSuiteNew();
 	SUITE_ADD_TEST(suite, test_xstr_get_set);
+	SUITE_ADD_TEST(suite, test_xstr_range);
+	SUITE_ADD_TEST(suite, test_xstr_ncmp);
+	SUITE_ADD_TEST(suite, test_xstr_views);
 	SUITE_ADD_TEST(suite, test_xstr_format);
 	return suite;
 }
\ No newline at end of file